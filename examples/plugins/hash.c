@@ -0,0 +1,59 @@
+/*
+ * A native extension: FNV-1a hashing and integer clamping.
+ *
+ *   clang -std=c11 -shared -fPIC -I include -o examples/plugins/hash.so examples/plugins/hash.c
+ *   ./osfl examples/plugins/hash.osfl
+ */
+#include "osfl_plugin.h"
+
+static int64_t fnv1a(const char* text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return (int64_t)(hash & 0x7fffffffffffffffULL);
+}
+
+static Value hash_fnv1a(int arg_count, Value* args) {
+    Value result = { .type = VAL_INT };
+    result.as.int_val = arg_count == 1 && args[0].type == VAL_STRING ? fnv1a(args[0].as.str_val) : 0;
+    return result;
+}
+
+/* map_native("fnv1a", names) hashes a whole list in one call. */
+static void hash_fnv1a_batch(size_t count, Value* args, Value* results) {
+    for (size_t i = 0; i < count; i++) {
+        results[i].type = VAL_INT;
+        results[i].as.int_val = args[i].type == VAL_STRING ? fnv1a(args[i].as.str_val) : 0;
+    }
+}
+
+static int64_t clamp_i64(const int64_t* args) {
+    return args[0] < args[1] ? args[1] : (args[0] > args[2] ? args[2] : args[0]);
+}
+
+static Value hash_clamp(int arg_count, Value* args) {
+    Value result = { .type = VAL_INT };
+    int64_t ints[3];
+    for (int i = 0; i < 3; i++) {
+        ints[i] = i < arg_count && args[i].type == VAL_INT ? args[i].as.int_val : 0;
+    }
+    result.as.int_val = clamp_i64(ints);
+    return result;
+}
+
+static const NativeDescriptor natives[] = {
+    { "fnv1a", hash_fnv1a, 1, 1, { NATIVE_TYPE_STRING }, NATIVE_TYPE_INT,
+      NATIVE_PURE | NATIVE_NO_ALLOC, NULL, NULL, hash_fnv1a_batch },
+    { "clamp", hash_clamp, 3, 3, { NATIVE_TYPE_INT, NATIVE_TYPE_INT, NATIVE_TYPE_INT }, NATIVE_TYPE_INT,
+      NATIVE_PURE | NATIVE_NO_ALLOC, clamp_i64, NULL, NULL },
+};
+
+static const OSFLPlugin plugin = {
+    OSFL_PLUGIN_ABI_VERSION, "hash", natives, sizeof(natives) / sizeof(natives[0])
+};
+
+OSFL_PLUGIN_EXPORT const OSFLPlugin* osfl_plugin_init(void) {
+    return &plugin;
+}
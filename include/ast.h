@@ -31,8 +31,11 @@ typedef enum {
     AST_NODE_RETURN_STMT,
     AST_NODE_WHILE_STMT,
     AST_NODE_FOR_STMT,
+    AST_NODE_SWITCH_STMT,
     AST_NODE_IF_STMT,        // More detailed "if" statement
     AST_NODE_EXPR_STMT,      // Expression used as a statement
+    AST_NODE_RETRY_STMT,     // "retry" inside a catch or on_error handler
+    AST_NODE_IMPORT,         // import "path/name.osfl";
 
     /* Expression node types */
     AST_EXPR,                // A generic expr if still needed
@@ -87,11 +90,29 @@ typedef struct {
     size_t arg_count;
 } AstCallData;
 
+/*
+ * What an identifier refers to, filled in by the semantic pass.
+ */
+typedef enum {
+    IDENT_UNRESOLVED,   /* not declared: a native, bound at run time */
+    IDENT_LOCAL,        /* frame slot 'slot' of the function 'depth' levels out */
+    IDENT_GLOBAL,       /* slot 'slot' of the top-level frame */
+    IDENT_FUNCTION,     /* function number 'slot' */
+    IDENT_MODULE,       /* import number 'slot'; only valid as 'name.member' */
+    IDENT_CLASS,        /* class number 'slot'; only valid as a constructor call */
+    IDENT_UPVALUE       /* upvalue 'slot' of the closure being run */
+} AstIdentBinding;
+
 /*
  * For an identifier expression: a name
  */
 typedef struct {
-    char* name;
+    const char* name;     /* interned text, owned by the intern table */
+    SymbolId symbol;
+    AstIdentBinding binding;
+    int depth;
+    int slot;
+    bool boxed;           /* the variable is captured and reassigned, so it lives in a box */
 } AstIdentifierData;
 
 /*
@@ -108,13 +129,31 @@ typedef struct {
 typedef struct {
     struct AstNode* object;
     char* member_name;
+    SymbolId member_symbol;
+    int field_slot;       /* frame slot of the field when the object is scalar-replaced
+                             (see AstVarDeclData.field_slot), else -1 */
 } AstMemberData;
 
 /*
- * For interpolation segments: stores the expr from "${ expr }"
+ * import "dir/name.osfl"; binds 'name' (the file name without its
+ * extension) to the module. 'index' is numbered by the semantic pass.
+ * Importing a shared library loads it as a plugin instead: nothing is
+ * bound, its natives become callable by name, and 'plugin' is set.
  */
 typedef struct {
-    struct AstNode* expr;
+    char* path;
+    SymbolId alias;
+    int index;
+    bool plugin;
+} AstImportData;
+
+/*
+ * An interpolated string "a ${x} b": its string literal segments and
+ * "${ expr }" expressions, in source order.
+ */
+typedef struct {
+    struct AstNode** parts;
+    size_t part_count;
 } AstInterpolationData;
 
 /*
@@ -131,18 +170,38 @@ typedef struct {
  */
 typedef struct {
     char* var_name;
+    SymbolId var_symbol;
     bool is_const;
     struct AstNode* initializer;
+    int slot;             /* frame slot, assigned by the semantic pass */
+    bool boxed;           /* see AstIdentifierData.boxed */
+    int field_slot;       /* the object it is initialized with never escapes: the first
+                             of the frame slots holding its fields instead, else -1 */
 } AstVarDeclData;
 
 /*
- * Function declaration
+ * Function declaration, or a function expression func (params) { ... }
+ * (which has no name).
+ *
+ * A function declared inside another function, and every function
+ * expression, is a closure: it is made into a value where it is defined,
+ * copying the variables of enclosing functions it uses into its upvalues.
+ * A declared one is stored in a slot of the enclosing function.
  */
 typedef struct {
     char* func_name;
+    SymbolId func_symbol;
     char** param_names;
+    SymbolId* param_symbols;
     size_t param_count;
     struct AstNode* body; /* usually a block node */
+    size_t frame_size;    /* parameters + locals, assigned by the semantic pass */
+    int func_index;       /* function number, assigned by the semantic pass; -1 for closures */
+    int closure_slot;     /* enclosing frame slot holding a declared closure, or -1 */
+    bool boxed;           /* closure_slot holds a box (see AstIdentifierData.boxed) */
+    bool* param_boxed;    /* per parameter: kept in a box */
+    int* captures;        /* per upvalue: enclosing frame slot, or -(i+1) for enclosing upvalue i */
+    size_t capture_count;
 } AstFuncDeclData;
 
 /*
@@ -150,8 +209,12 @@ typedef struct {
  */
 typedef struct {
     char* class_name;
+    SymbolId class_symbol;
+    SymbolId parent_symbol; /* class Name : Parent { ... }, or SYMBOL_ID_NONE */
     struct AstNode** members;
     size_t member_count;
+    int class_index;        /* class number, assigned by the semantic pass */
+    int parent_index;       /* the parent's class number, or -1 */
 } AstClassDeclData;
 
 /*
@@ -188,6 +251,24 @@ typedef struct {
     struct AstNode* body;
 } AstForStmtData;
 
+/*
+ * One arm of a switch: case <labels>: <body>. A default arm has no labels.
+ */
+typedef struct {
+    struct AstNode** labels;   /* integer or string literals */
+    size_t label_count;
+    struct AstNode* body;      /* block node */
+} AstSwitchCase;
+
+/*
+ * Switch statement; arms do not fall through into each other
+ */
+typedef struct {
+    struct AstNode* subject;
+    AstSwitchCase* cases;
+    size_t case_count;
+} AstSwitchStmtData;
+
 /*
  * Return statement
  */
@@ -197,10 +278,14 @@ typedef struct {
 
 /*
  * On_error or try/catch
+ *
+ * For try/catch, handler_body is the guarded statement and catch_body the
+ * handler (NULL without a catch clause). For on_error, handler_body is the
+ * handler; it guards the statements that follow it in the same block.
  */
 typedef struct {
     struct AstNode* handler_body;
-    /* or store 'tryBlock', 'catchBlock', etc. */
+    struct AstNode* catch_body;
 } AstErrorHandlerData;
 
 /*
@@ -253,6 +338,9 @@ typedef struct AstNode {
         /* For statement */
         AstForStmtData       for_stmt;
 
+        /* Switch statement */
+        AstSwitchStmtData    switch_stmt;
+
         /* Return statement */
         AstReturnStmtData    ret_stmt;
 
@@ -261,6 +349,9 @@ typedef struct AstNode {
 
         /* A block of statements */
         AstBlockData         block;
+
+        /* Import declaration */
+        AstImportData        import_decl;
     } as;
 
     /* Linked-list pointer for chaining siblings */
@@ -280,6 +371,9 @@ AstNode* ast_new_frame(const SourceLocation* loc,
 /* Example destructor to free the entire tree */
 void ast_destroy(AstNode* node);
 
+/* If 'node' is an integer literal, possibly negated, store its value and return true */
+bool ast_integer_value(const AstNode* node, int64_t* out);
+
 #ifdef __cplusplus
 }
 #endif
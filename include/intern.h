@@ -0,0 +1,44 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Integer id of an interned identifier
+ *
+ * The lexer interns every identifier it scans, so later passes compare
+ * names by id instead of by string. Ids start at 1; 0 means "no symbol".
+ */
+typedef uint32_t SymbolId;
+
+#define SYMBOL_ID_NONE 0u
+
+/**
+ * Intern the first 'length' characters of 'text'
+ * @return the id shared by all equal names, or SYMBOL_ID_NONE on failure
+ */
+SymbolId intern_name(const char* text, size_t length);
+
+/**
+ * Intern a NUL-terminated name
+ */
+SymbolId intern_cstr(const char* text);
+
+/**
+ * Look up a name without adding it
+ * @return its id, or SYMBOL_ID_NONE if the name was never interned
+ */
+SymbolId intern_find(const char* text);
+
+/**
+ * @return the interned text for 'id', valid until intern_reset(), or NULL
+ */
+const char* intern_text(SymbolId id);
+
+/**
+ * Free every interned name; all ids and texts become invalid
+ */
+void intern_reset(void);
+
+#endif /* INTERN_H */
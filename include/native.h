@@ -0,0 +1,90 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdint.h>
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Native functions are described to the compiler and the VM by a
+ * NativeDescriptor: besides the entry point it gives the arity, type hints
+ * for the arguments and the result, and what the function is known not to
+ * do. The semantic pass checks calls against the arity, the compiler folds
+ * calls of pure natives with constant arguments, and the VM calls a fast
+ * path, when there is one, without building an argument array. map_native
+ * applies a native to a whole list through its batch entry point.
+ */
+
+/* A type hint; NATIVE_TYPE_NUMBER accepts an int or a float. */
+typedef enum {
+    NATIVE_TYPE_ANY,
+    NATIVE_TYPE_INT,
+    NATIVE_TYPE_FLOAT,
+    NATIVE_TYPE_NUMBER,
+    NATIVE_TYPE_BOOL,
+    NATIVE_TYPE_STRING,
+    NATIVE_TYPE_LIST,
+    NATIVE_TYPE_FILE
+} NativeType;
+
+#define NATIVE_PURE      0x1   /* the result depends only on the arguments, and nothing else happens */
+#define NATIVE_NO_ALLOC  0x2   /* returns a scalar and allocates nothing the VM has to own */
+#define NATIVE_EXTERNAL  0x4   /* reads or changes the world outside the VM: files, the clock, output */
+
+#define NATIVE_VARIADIC  (-1)  /* max_args: no upper limit */
+#define NATIVE_MAX_HINTS 4     /* arguments with a type hint; the fast paths take at most this many */
+
+typedef struct NativeDescriptor {
+    const char* name;
+    Value (*func)(int arg_count, Value* args);
+    int min_args;
+    int max_args;                              /* NATIVE_VARIADIC for no limit */
+    NativeType arg_types[NATIVE_MAX_HINTS];    /* hints for the first arguments */
+    NativeType return_type;
+    unsigned flags;                            /* NATIVE_PURE, NATIVE_NO_ALLOC, NATIVE_EXTERNAL */
+    /*
+     * Optional entry points taking unboxed arguments, for natives with a
+     * fixed arity (min_args == max_args). fast_i64 is used when every
+     * argument is an int and yields an int; fast_f64 when every argument is
+     * a number and yields a float. Either must agree with 'func'.
+     */
+    int64_t (*fast_i64)(const int64_t* args);
+    double (*fast_f64)(const double* args);
+    /*
+     * Optional batch entry point for natives taking one argument: calls the
+     * native on each of args[0..count) and writes the results, in order, to
+     * results[0..count). 'args' is the element array of a list, so the
+     * native sees the elements in place. Used by map_native.
+     */
+    void (*batch)(size_t count, Value* args, Value* results);
+} NativeDescriptor;
+
+/* True if 'native' accepts 'argc' arguments. */
+#define NATIVE_ACCEPTS(native, argc) \
+    ((argc) >= (native)->min_args && \
+     ((native)->max_args == NATIVE_VARIADIC || (argc) <= (native)->max_args))
+
+/*
+ * True if map_native may apply 'native' to a list: it takes one argument,
+ * has a batch entry point or is pure, and is not external. A replayed run
+ * takes external results from the log only at call sites of the native
+ * itself, so map_native must never reach one.
+ */
+#define NATIVE_MAPPABLE(native) \
+    (NATIVE_ACCEPTS(native, 1) && ((native)->batch || ((native)->flags & NATIVE_PURE)) && \
+     !((native)->flags & NATIVE_EXTERNAL))
+
+/* True if a fast path of 'native' can take 'argc' arguments. */
+#define NATIVE_HAS_FAST_PATH(native, argc) \
+    (((native)->fast_i64 || (native)->fast_f64) && \
+     (native)->min_args == (native)->max_args && (argc) == (native)->min_args && \
+     (argc) <= NATIVE_MAX_HINTS)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NATIVE_H */
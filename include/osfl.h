@@ -24,6 +24,8 @@ extern "C" {
 #define OSFL_MAX_ERROR_LENGTH  128
 #define OSFL_DEFAULT_TAB_WIDTH 4
 #define OSFL_MAX_IDENTIFIER_LENGTH 64
+#define OSFL_MAX_PLUGINS       16
+#define OSFL_MAX_BREAKPOINTS   16
 
 /* ----------------------------------------------------------
     Status Codes and Error Handling
@@ -60,6 +62,20 @@ typedef struct {
     const char* output_file;    /* Output file (if any) */
     bool debug_mode;            /* Enable debug output */
     bool optimize;              /* Enable optimizations */
+    const char* profile_generate; /* Write an execution profile here after the run (or NULL) */
+    const char* profile_use;    /* Feed this profile from an earlier run to the optimizer (or NULL) */
+    const char* plugins[OSFL_MAX_PLUGINS]; /* Native extension libraries to load at startup */
+    size_t plugin_count;
+    const char* snapshot_save;  /* Save the state after top-level initialization here (or NULL) */
+    const char* snapshot_load;  /* Run main() of this snapshot instead of a source file (or NULL) */
+    bool serve_fork;            /* Fork a worker running main() for each job instead of running once */
+    const char* serve_socket;   /* Read jobs from connections to this Unix socket, not stdin (or NULL) */
+    long long fuel;             /* Stop a script after this many backward jumps and calls (0: no limit) */
+    size_t breakpoints[OSFL_MAX_BREAKPOINTS]; /* Print the VM state whenever one of these PCs is reached */
+    size_t breakpoint_count;
+    const char* record_natives; /* Log the results of external natives (files, clock, output) here (or NULL) */
+    const char* replay_natives; /* Take those results from this log instead, with no side effects (or NULL) */
+    const char* trace_file;     /* Write a Chrome trace of the phases, calls and natives here at cleanup (or NULL) */
 } OSFLConfig;
 
 /* ----------------------------------------------------------
@@ -110,6 +126,13 @@ OSFLStatus osfl_run_file(const char* filename);
  */
 OSFLStatus osfl_run_string(const char* source, size_t length);
 
+/**
+ * Restore a snapshot saved with snapshot_save and run its main()
+ * @param path Snapshot file
+ * @return Status code
+ */
+OSFLStatus osfl_run_snapshot(const char* path);
+
 /**
  * Set configuration options
  * @param config New configuration
@@ -0,0 +1,56 @@
+#ifndef OSFL_PLUGIN_H
+#define OSFL_PLUGIN_H
+
+#include <stddef.h>
+#include "native.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Native extension modules.
+ *
+ * A plugin is a shared library (.so, .dylib or .dll) that exports one
+ * function, named by OSFL_PLUGIN_ENTRY, returning a table of native
+ * descriptors. It is loaded at startup (--plugin <file>) or by a script:
+ *
+ *     import "ext/hash.so";
+ *
+ * Its natives are then called by bare name, like the built-in ones, and go
+ * into the same registry of the VM, so a call costs exactly what a call of
+ * a built-in native does. The semantic pass and the compiler see their
+ * descriptors too (arity checks, folding of pure natives).
+ *
+ * Strings and lists a native returns are owned by the VM afterwards and
+ * released with free(), so the plugin must allocate them with the same C
+ * runtime as the interpreter.
+ *
+ *     static const NativeDescriptor natives[] = { ... };
+ *     static const OSFLPlugin plugin = { OSFL_PLUGIN_ABI_VERSION, "hash", natives, 2 };
+ *     OSFL_PLUGIN_EXPORT const OSFLPlugin* osfl_plugin_init(void) { return &plugin; }
+ */
+
+#define OSFL_PLUGIN_ABI_VERSION 3
+#define OSFL_PLUGIN_ENTRY "osfl_plugin_init"
+
+typedef struct {
+    int abi_version;                  /* OSFL_PLUGIN_ABI_VERSION the plugin was built against */
+    const char* name;
+    const NativeDescriptor* natives;  /* must stay valid while the plugin is loaded */
+    size_t native_count;
+} OSFLPlugin;
+
+typedef const OSFLPlugin* (*OSFLPluginInit)(void);
+
+#ifdef _WIN32
+#define OSFL_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define OSFL_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OSFL_PLUGIN_H */
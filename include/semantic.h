@@ -25,6 +25,50 @@ typedef struct {
     char* custom_name; /* if SEMANTIC_TYPE_CUSTOM, e.g. "MyClass" */
 } TypeInfo;
 
+/**
+ * @brief A variable of a function, and what closures do with it.
+ * A variable that is captured and also reassigned (or captured before it is
+ * initialized) lives in a box shared with the closures; any other captured
+ * variable is copied into them by value.
+ */
+typedef struct {
+    bool initialized;
+    bool captured;
+    bool reassigned;
+    /* The class of the object it was initialized with while that object has
+       not escaped, so its fields can live in frame slots; else NULL. */
+    const AstNode* record;
+    int* field_slot;  /* its declaration's AstVarDeclData.field_slot */
+} SemanticVariable;
+
+/**
+ * @brief An AST flag set at the end of the analysis to whether 'variable' needs a box.
+ */
+typedef struct {
+    bool* flag;
+    int variable;
+} SemanticBoxFlag;
+
+/**
+ * @brief An AST field slot set at the end of the analysis to field 'offset' of
+ * the object in 'variable', if that object was scalar-replaced.
+ */
+typedef struct {
+    int* slot;
+    int variable;
+    int offset;
+} SemanticFieldUse;
+
+/**
+ * @brief A function being analyzed, and the variable each of its upvalues holds.
+ */
+typedef struct {
+    AstFuncDeclData* func;
+    int* captured;
+} SemanticFunction;
+
+#define SEMANTIC_MAX_NESTING 64
+
 /**
  * @brief Holds data for semantic analysis (symbol table, etc.)
  */
@@ -32,6 +76,34 @@ typedef struct {
     Scope* current_scope;
     /* You can add error tracking, warnings, etc. */
     int error_count;
+    /* Next free frame slot in the function being analyzed (or at top level). */
+    int next_slot;
+    /* Function nesting level being analyzed; 0 is top level. */
+    int function_level;
+    /* Functions numbered so far. */
+    int function_count;
+    /* Catch/on_error handlers enclosing the current statement in this function. */
+    int handler_depth;
+    /* Imports numbered so far. */
+    int import_count;
+    /* Plugin imports that could not be loaded; not counted as semantic errors. */
+    int import_error_count;
+    /* Classes numbered so far, and their declarations by number. */
+    int class_count;
+    const AstNode** classes;
+    size_t class_capacity;
+    /* Variables of functions (not of the top level), numbered as they are declared. */
+    SemanticVariable* variables;
+    size_t variable_count;
+    size_t variable_capacity;
+    SemanticBoxFlag* box_flags;
+    size_t box_flag_count;
+    size_t box_flag_capacity;
+    SemanticFieldUse* field_uses;
+    size_t field_use_count;
+    size_t field_use_capacity;
+    /* The functions being analyzed, indexed by the nesting level of their bodies. */
+    SemanticFunction functions[SEMANTIC_MAX_NESTING + 1];
 } SemanticContext;
 
 /**
@@ -46,6 +118,9 @@ void semantic_cleanup(SemanticContext* ctx);
 
 /**
  * @brief Perform semantic analysis on the AST
+ * Also resolves names: declarations get frame slots, functions get numbers,
+ * and every identifier is annotated with what it refers to (see AstIdentBinding),
+ * so later stages never look names up again.
  * @param root The root AST node (e.g. AST_NODE_PROGRAM)
  * @param ctx The semantic context
  */
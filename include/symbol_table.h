@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "intern.h"
 
 /**
  * @brief Kinds of symbols in the language
@@ -11,16 +12,21 @@ typedef enum {
     SYMBOL_VAR,
     SYMBOL_CONST,
     SYMBOL_FUNC,
-    SYMBOL_CLASS
+    SYMBOL_CLASS,
+    SYMBOL_MODULE   // an imported module; slot is its import number
 } SymbolKind;
 
 /**
  * @brief Symbol information structure
  */
 typedef struct Symbol {
-    char* name;
+    const char* name;  // interned text of 'id'
+    SymbolId id;
     SymbolKind kind;
     int reg;    // <-- New: the register number assigned to this symbol
+    int slot;   // frame slot of a local variable (function number for functions), or -1
+    int level;  // function nesting level of the declaration; 0 is top level
+    int variable;  // a function's variable: its number in the semantic pass's variable table, else -1
     /* optionally store type info, or pointer to AST node, etc. */
 } Symbol;
 
@@ -50,10 +56,23 @@ void scope_destroy(Scope* scope);
  */
 bool scope_add_symbol(Scope* scope, const char* name, SymbolKind kind, int reg);
 
+/**
+ * Add the symbol 'id', stored in slot 'slot' and declared at function
+ * nesting level 'level', to the current scope
+ * @return true if success, false if symbol already exists
+ */
+bool scope_add_local(Scope* scope, SymbolId id, SymbolKind kind, int slot, int level);
+
 /**
  * Lookup a symbol in the current scope or any parent
  * @return pointer to Symbol, or NULL if not found
  */
 Symbol* scope_lookup(Scope* scope, const char* name);
 
+/**
+ * Lookup an interned symbol id in the current scope or any parent
+ * @return pointer to Symbol, or NULL if not found
+ */
+Symbol* scope_lookup_id(Scope* scope, SymbolId id);
+
 #endif /* SYMBOL_TABLE_H */
@@ -24,9 +24,26 @@ typedef enum {
     VAL_OBJ
 } ValueType;
 
+/*
+ * A Value is a reference: strings, lists and objects are shared by every
+ * Value pointing at them. Their reference counts live with the payload and
+ * are maintained by the VM (see vm_retain / vm_release).
+ */
+struct Value;
+
+/*
+ * The header of a list. Every Value of the list points at the same header,
+ * so a native that grows the storage (reallocating 'data') is seen by all
+ * of them; the header itself never moves.
+ */
+typedef struct ValueList {
+    struct Value* data;
+    size_t length;
+    size_t capacity;
+} ValueList;
+
 typedef struct Value {
     ValueType type;
-    int refcount;
     union {
         int64_t int_val;
         double float_val;
@@ -36,11 +53,7 @@ typedef struct Value {
         struct {
             void* native_file;
         } file_val;
-        struct {
-            struct Value* data;
-            size_t length;
-            size_t capacity;
-        } list_val;
+        ValueList* list_val;
     } as;
 } Value;
 
@@ -10,29 +10,85 @@ extern "C" {
 typedef enum {
     OP_NOP,
     OP_LOAD_CONST,          // load integer constant
-    OP_LOAD_CONST_FLOAT,    // load float constant
+    OP_LOAD_CONST_FLOAT,    // load float constant: the double's bits, low half in operand2, high half in operand3
     OP_LOAD_CONST_STR,      // load string constant
-    OP_MOVE,
+    OP_LOAD_BOOL,           // reg = bool operand2 (VAL_BOOL)
+    OP_MOVE,                // copy: dest and src share the value
+    OP_MOVE_OWN,            // move: dest takes the value, src is left null (src's last use)
+    OP_LOAD_LOCAL,          // reg = frame slot
+    OP_STORE_LOCAL,         // frame slot = reg; operand3 != 0 moves the value out of reg
+    OP_MOVE_LOCAL,          // fused load+store: frame slot = frame slot (copy)
+    OP_STORE_LOCAL_CONST,   // fused load+store: frame slot = integer constant
+    OP_LOAD_GLOBAL,         // reg = top-level frame slot
+    OP_STORE_GLOBAL,        // top-level frame slot = reg; operand3 != 0 moves the value out of reg
     OP_ADD,
     OP_SUB,
     OP_MUL,
     OP_DIV,
-    OP_EQ,                  // new: compare equality; result is int: 1 if equal, 0 otherwise
+    OP_MOD,
+    OP_BIT_AND,
+    OP_BIT_OR,
+    OP_BIT_XOR,
+    OP_BIT_NOT,             // reg = ~reg (ints)
+    OP_NOT,                 // reg = !reg; result is VAL_BOOL
+    OP_EQ,                  // compare; result is VAL_BOOL
     OP_NEQ,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_CONCAT_N,            // reg operand1 = string of regs operand2 .. operand2+operand3-1 joined
     OP_JUMP,
     OP_JUMP_IF_ZERO,
-    OP_CALL,                // regular (bytecode) function call
+    OP_JUMP_IF_NONZERO,     // inverted form of OP_JUMP_IF_ZERO, used for bottom-tested loops
+    OP_JUMP_IF_EQ,          // fused compare-and-branch: jump to operand1 if (operand2 == operand3) != operand4
+    OP_JUMP_IF_NE,
+    OP_JUMP_IF_LT,
+    OP_JUMP_IF_LE,
+    OP_JUMP_IF_GT,
+    OP_JUMP_IF_GE,
+    OP_TABLESWITCH,         // jump via dense table operand3 on int reg operand2; operand1 = default
+    OP_LOOKUPSWITCH,        // binary search of sorted table operand3 for reg operand2; operand1 = default
+    OP_CALL,                // regular (bytecode) function call; operand2 = callee frame slots
     OP_CALL_NATIVE,         // native function call (extended instruction)
-    OP_RET,
+    OP_RET,                 // return reg operand1 (-1: null) to the caller
     OP_HALT,
     OP_NEWOBJ,
-    OP_SETPROP,
+    OP_SETPROP,             // obj[key] = value; operand4 != 0 moves value out of its register
     OP_GETPROP,
+    OP_NEWCLASS,            // reg operand1 = new object of class operand2, its fields preallocated
+    OP_GETFIELD,            // reg operand1 = field (name: constant operand3) of object reg operand2
+    OP_SETFIELD,            // field (name: constant operand2) of object reg operand1 = reg operand3
+    OP_INVOKE,              // call method (name: constant operand1) of the object in reg operand4; operand2 = argument count
+    OP_CLOSURE,             // reg operand1 = closure of function operand2 (ClosureInfo), its upvalues captured
+    OP_CALL_INDIRECT,       // call the closure in reg operand1; operand2 = argument count
+    OP_LOAD_UPVALUE,        // reg operand1 = upvalue operand2 of the running closure (read through its box if operand3)
+    OP_STORE_UPVALUE,       // boxed upvalue operand1 of the running closure = reg operand2
+    OP_BOX,                 // frame slot operand1 = a new box holding the slot's value (null if operand2)
+    OP_LOAD_BOXED,          // reg operand1 = contents of the box in frame slot operand2
+    OP_STORE_BOXED,         // contents of the box in frame slot operand1 = reg operand2
     OP_CORO_INIT,
     OP_CORO_YIELD,
-    OP_CORO_RESUME
+    OP_CORO_RESUME,
+    OP_BREAKPOINT           // never compiled: a debugger patches it over an instruction (see debugger.h)
 } VMOpcode;
 
+/*
+    OP_CALL_NATIVE packs its argument count and a move mask into operand3:
+    bit i of the mask means argument i's register is not read again, so the
+    value is handed to the native instead of being borrowed.
+*/
+#define NATIVE_ARGC_MASK  0xff
+#define NATIVE_MOVE_SHIFT 8
+
+/*
+    OP_CALL, OP_INVOKE and OP_CALL_INDIRECT take their arguments (for
+    OP_INVOKE, the object first) from registers operand4 onwards, which the
+    callee sees as registers 0, 1, ... The caller's registers below operand4
+    are kept across the call. The returned value goes to register operand3,
+    or is dropped if operand3 is -1.
+*/
+
 typedef struct {
 		VMOpcode opcode;
 		int operand1;
@@ -70,7 +70,8 @@ AstNode* ast_make_unary(const SourceLocation* loc, OSFLTokenType op, AstNode* ex
 
 AstNode* ast_make_identifier(const SourceLocation* loc, const char* name) {
     AstNode* node = ast_alloc_node(AST_EXPR_IDENTIFIER, loc);
-    node->as.ident.name = ast_strdup(name);
+    node->as.ident.symbol = intern_cstr(name);
+    node->as.ident.name = intern_text(node->as.ident.symbol);
     return node;
 }
 
@@ -84,17 +85,20 @@ AstNode* ast_make_call(const SourceLocation* loc, AstNode* callee, size_t arg_co
     return node;
 }
 
-AstNode* ast_make_interpolation(const SourceLocation* loc, AstNode* expr) {
+AstNode* ast_make_interpolation(const SourceLocation* loc, AstNode** parts, size_t part_count) {
     AstNode* node = ast_alloc_node(AST_EXPR_INTERPOLATION, loc);
-    node->as.interpolation.expr = expr;
+    node->as.interpolation.parts = parts;
+    node->as.interpolation.part_count = part_count;
     return node;
 }
 
 AstNode* ast_make_var_decl(const SourceLocation* loc, const char* var_name, bool is_const, AstNode* init) {
     AstNode* node = ast_alloc_node(AST_NODE_VAR_DECL, loc);
     node->as.var_decl.var_name = ast_strdup(var_name);
+    node->as.var_decl.var_symbol = intern_cstr(var_name);
     node->as.var_decl.initializer = init;
     node->as.var_decl.is_const = is_const;
+    node->as.var_decl.slot = -1;
     return node;
 }
 
@@ -102,15 +106,21 @@ AstNode* ast_make_func_decl(const SourceLocation* loc, const char* func_name,
                             char** params, size_t param_count, AstNode* body) {
     AstNode* node = ast_alloc_node(AST_NODE_FUNC_DECL, loc);
     node->as.func_decl.func_name = ast_strdup(func_name);
+    node->as.func_decl.func_symbol = intern_cstr(func_name);
     node->as.func_decl.param_names = NULL;
+    node->as.func_decl.param_symbols = NULL;
     node->as.func_decl.param_count = param_count;
     if (param_count > 0) {
         node->as.func_decl.param_names = (char**)calloc(param_count, sizeof(char*));
+        node->as.func_decl.param_symbols = (SymbolId*)calloc(param_count, sizeof(SymbolId));
         for (size_t i = 0; i < param_count; i++) {
             node->as.func_decl.param_names[i] = ast_strdup(params[i]);
+            node->as.func_decl.param_symbols[i] = intern_cstr(params[i]);
         }
     }
     node->as.func_decl.body = body;
+    node->as.func_decl.func_index = -1;
+    node->as.func_decl.closure_slot = -1;
     return node;
 }
 
@@ -136,7 +146,6 @@ static void ast_destroy_recursive(AstNode* node) {
             }
             break;
         case AST_EXPR_IDENTIFIER:
-            free(node->as.ident.name);
             break;
         case AST_EXPR_CALL:
             if (node->as.call.args) {
@@ -163,7 +172,10 @@ static void ast_destroy_recursive(AstNode* node) {
             ast_destroy_recursive(node->as.member_expr.object);
             break;
         case AST_EXPR_INTERPOLATION:
-            ast_destroy_recursive(node->as.interpolation.expr);
+            for (size_t i = 0; i < node->as.interpolation.part_count; i++) {
+                ast_destroy_recursive(node->as.interpolation.parts[i]);
+            }
+            free(node->as.interpolation.parts);
             break;
 
         case AST_NODE_VAR_DECL:
@@ -177,7 +189,10 @@ static void ast_destroy_recursive(AstNode* node) {
                     free(node->as.func_decl.param_names[i]);
                 }
                 free(node->as.func_decl.param_names);
+                free(node->as.func_decl.param_symbols);
             }
+            free(node->as.func_decl.param_boxed);
+            free(node->as.func_decl.captures);
             ast_destroy_recursive(node->as.func_decl.body);
             break;
         case AST_NODE_CLASS_DECL:
@@ -204,9 +219,29 @@ static void ast_destroy_recursive(AstNode* node) {
             ast_destroy_recursive(node->as.for_stmt.increment);
             ast_destroy_recursive(node->as.for_stmt.body);
             break;
+        case AST_NODE_SWITCH_STMT:
+            ast_destroy_recursive(node->as.switch_stmt.subject);
+            for (size_t i = 0; i < node->as.switch_stmt.case_count; i++) {
+                AstSwitchCase* arm = &node->as.switch_stmt.cases[i];
+                for (size_t j = 0; j < arm->label_count; j++) {
+                    ast_destroy_recursive(arm->labels[j]);
+                }
+                free(arm->labels);
+                ast_destroy_recursive(arm->body);
+            }
+            free(node->as.switch_stmt.cases);
+            break;
         case AST_NODE_RETURN_STMT:
             ast_destroy_recursive(node->as.ret_stmt.expr);
             break;
+        case AST_NODE_IMPORT:
+            free(node->as.import_decl.path);
+            break;
+        case AST_NODE_TRY_CATCH:
+        case AST_NODE_ERROR_HANDLER:
+            ast_destroy_recursive(node->as.error_handler.handler_body);
+            ast_destroy_recursive(node->as.error_handler.catch_body);
+            break;
         case AST_NODE_BLOCK:
             if (node->as.block.statements) {
                 for (size_t i = 0; i < node->as.block.statement_count; i++) {
@@ -227,3 +262,17 @@ static void ast_destroy_recursive(AstNode* node) {
 void ast_destroy(AstNode* node) {
     ast_destroy_recursive(node);
 }
+
+bool ast_integer_value(const AstNode* node, int64_t* out) {
+    if (!node) return false;
+    if (node->type == AST_EXPR_LITERAL && node->as.literal.literal_type == TOKEN_INTEGER) {
+        *out = node->as.literal.i64_val;
+        return true;
+    }
+    if (node->type == AST_EXPR_UNARY && node->as.unary.op == TOKEN_MINUS &&
+        ast_integer_value(node->as.unary.expr, out)) {
+        *out = -*out;
+        return true;
+    }
+    return false;
+}
@@ -19,6 +19,17 @@ Bytecode* bytecode_create(void) {
 		bc->constant_pool.count = 0;
 		bc->constant_pool.capacity = INITIAL_CONSTANT_POOL_CAPACITY;
 		bc->constant_pool.strings = (char**)malloc(bc->constant_pool.capacity * sizeof(char*));
+		bc->origins = NULL;
+		bc->top_level_slots = 0;
+		bc->switch_tables = NULL;
+		bc->switch_table_count = 0;
+		bc->handlers = NULL;
+		bc->handler_count = 0;
+		bc->classes = NULL;
+		bc->class_count = 0;
+		bc->closures = NULL;
+		bc->closure_count = 0;
+		bc->main_address = -1;
 		return bc;
 }
 
@@ -33,6 +44,21 @@ void bytecode_destroy(Bytecode* bc) {
 				free(bc->constant_pool.strings[i]);
 		}
 		free(bc->constant_pool.strings);
+		free(bc->origins);
+		for (size_t i = 0; i < bc->switch_table_count; i++) {
+				free(bc->switch_tables[i].entries);
+		}
+		free(bc->switch_tables);
+		free(bc->handlers);
+		for (size_t i = 0; i < bc->class_count; i++) {
+				free(bc->classes[i].fields);
+				free(bc->classes[i].methods);
+		}
+		free(bc->classes);
+		for (size_t i = 0; i < bc->closure_count; i++) {
+				free(bc->closures[i].captures);
+		}
+		free(bc->closures);
 		free(bc);
 }
 
@@ -93,3 +119,133 @@ int bytecode_add_constant_str(Bytecode* bc, const char* str) {
 		cp->strings[cp->count] = strdup(str);
 		return (int)(cp->count++);
 }
+
+int bytecode_add_switch_table(Bytecode* bc, int64_t low, const SwitchEntry* entries, size_t count) {
+		if (!bc) return -1;
+		SwitchTable* tables = (SwitchTable*)realloc(bc->switch_tables,
+				(bc->switch_table_count + 1) * sizeof(SwitchTable));
+		if (!tables) return -1;
+		bc->switch_tables = tables;
+		SwitchEntry* copy = (SwitchEntry*)malloc((count > 0 ? count : 1) * sizeof(SwitchEntry));
+		if (!copy) return -1;
+		if (count > 0) memcpy(copy, entries, count * sizeof(SwitchEntry));
+		SwitchTable* table = &bc->switch_tables[bc->switch_table_count];
+		table->low = low;
+		table->entries = copy;
+		table->count = count;
+		return (int)(bc->switch_table_count++);
+}
+
+int bytecode_add_handler(Bytecode* bc, int start, int end, int handler) {
+		if (!bc) return -1;
+		HandlerEntry* handlers = (HandlerEntry*)realloc(bc->handlers,
+				(bc->handler_count + 1) * sizeof(HandlerEntry));
+		if (!handlers) return -1;
+		bc->handlers = handlers;
+		HandlerEntry* entry = &bc->handlers[bc->handler_count];
+		entry->start = start;
+		entry->end = end;
+		entry->handler = handler;
+		return (int)(bc->handler_count++);
+}
+
+int bytecode_add_class(Bytecode* bc, int name, const int* fields, size_t field_count,
+		const ClassMethod* methods, size_t method_count) {
+		if (!bc) return -1;
+		ClassInfo* classes = (ClassInfo*)realloc(bc->classes, (bc->class_count + 1) * sizeof(ClassInfo));
+		if (!classes) return -1;
+		bc->classes = classes;
+		int* field_copy = (int*)malloc((field_count > 0 ? field_count : 1) * sizeof(int));
+		ClassMethod* method_copy = (ClassMethod*)malloc((method_count > 0 ? method_count : 1) * sizeof(ClassMethod));
+		if (!field_copy || !method_copy) {
+				free(field_copy);
+				free(method_copy);
+				return -1;
+		}
+		if (field_count > 0) memcpy(field_copy, fields, field_count * sizeof(int));
+		if (method_count > 0) memcpy(method_copy, methods, method_count * sizeof(ClassMethod));
+		ClassInfo* cls = &bc->classes[bc->class_count];
+		cls->name = name;
+		cls->fields = field_copy;
+		cls->field_count = field_count;
+		cls->methods = method_copy;
+		cls->method_count = method_count;
+		return (int)(bc->class_count++);
+}
+
+int bytecode_add_closure(Bytecode* bc, int address, int frame_size, const int* captures, size_t capture_count) {
+		if (!bc) return -1;
+		ClosureInfo* closures = (ClosureInfo*)realloc(bc->closures, (bc->closure_count + 1) * sizeof(ClosureInfo));
+		if (!closures) return -1;
+		bc->closures = closures;
+		int* copy = (int*)malloc((capture_count > 0 ? capture_count : 1) * sizeof(int));
+		if (!copy) return -1;
+		if (capture_count > 0) memcpy(copy, captures, capture_count * sizeof(int));
+		ClosureInfo* info = &bc->closures[bc->closure_count];
+		info->address = address;
+		info->frame_size = frame_size;
+		info->captures = copy;
+		info->capture_count = capture_count;
+		return (int)(bc->closure_count++);
+}
+
+/**
+	 * FNV-1a over the string's bytes.
+	 */
+uint32_t bytecode_hash_string(const char* str) {
+		uint32_t hash = 2166136261u;
+		for (const char* c = str; c && *c; c++) {
+				hash ^= (unsigned char)*c;
+				hash *= 16777619u;
+		}
+		return hash;
+}
+
+size_t bytecode_origin(const Bytecode* bc, size_t pc) {
+		if (!bc || !bc->origins || pc >= bc->instruction_count) return pc;
+		return (size_t)bc->origins[pc];
+}
+
+/**
+	 * FNV-1a over opcodes, operands and constant strings.
+	 */
+uint64_t bytecode_fingerprint(const Bytecode* bc) {
+		uint64_t hash = 14695981039346656037ULL;
+		if (!bc) return hash;
+		for (size_t i = 0; i < bc->instruction_count; i++) {
+				const Instruction* inst = &bc->instructions[i];
+				int fields[5] = { (int)inst->opcode, inst->operand1, inst->operand2, inst->operand3, inst->operand4 };
+				const unsigned char* bytes = (const unsigned char*)fields;
+				for (size_t b = 0; b < sizeof(fields); b++) {
+						hash ^= bytes[b];
+						hash *= 1099511628211ULL;
+				}
+		}
+		for (size_t t = 0; t < bc->switch_table_count; t++) {
+				const SwitchTable* table = &bc->switch_tables[t];
+				for (size_t i = 0; i < table->count; i++) {
+						int fields[3] = { (int)table->entries[i].key, table->entries[i].target, table->entries[i].str_index };
+						const unsigned char* bytes = (const unsigned char*)fields;
+						for (size_t b = 0; b < sizeof(fields); b++) {
+								hash ^= bytes[b];
+								hash *= 1099511628211ULL;
+						}
+				}
+		}
+		for (size_t h = 0; h < bc->handler_count; h++) {
+				const unsigned char* bytes = (const unsigned char*)&bc->handlers[h];
+				for (size_t b = 0; b < sizeof(HandlerEntry); b++) {
+						hash ^= bytes[b];
+						hash *= 1099511628211ULL;
+				}
+		}
+		for (size_t i = 0; i < bc->constant_pool.count; i++) {
+				for (const char* c = bc->constant_pool.strings[i]; *c; c++) {
+						hash ^= (unsigned char)*c;
+						hash *= 1099511628211ULL;
+				}
+				hash ^= 0xff;
+				hash *= 1099511628211ULL;
+		}
+		return hash;
+}
@@ -1,6 +1,7 @@
 #ifndef BYTECODE_H
 #define BYTECODE_H
 
+#include <stdint.h>
 #include "../../include/vm_common.h"
 
 #ifdef __cplusplus
@@ -14,6 +15,59 @@ typedef struct {
 		size_t capacity;
 } ConstantPool;
 
+// One case of a switch table.
+typedef struct {
+		int64_t key;     // case value, or bytecode_hash_string() of a string case
+		int target;      // PC of the case body; -1 for a gap in an OP_TABLESWITCH range
+		int str_index;   // constant pool index of a string case, or -1
+} SwitchEntry;
+
+// Jump table of an OP_TABLESWITCH (entries[i] is for value low + i) or an
+// OP_LOOKUPSWITCH (entries sorted by key). The default target is operand1.
+typedef struct {
+		int64_t low;
+		SwitchEntry* entries;
+		size_t count;
+} SwitchTable;
+
+// A guarded PC range [start, end): a runtime error raised by an instruction in
+// the range, or by a call made from it, resumes at 'handler'. Entries are kept
+// innermost first, so the first entry covering a PC is the one that applies.
+typedef struct {
+		int start;
+		int end;
+		int handler;
+} HandlerEntry;
+
+// An entry of a class's method table. A method is called with the object in
+// register 0 and its arguments in the registers after it.
+typedef struct {
+		int name;        // constant pool index of the method name
+		int address;
+		int frame_size;
+} ClassMethod;
+
+// The shape and method table of a class. An object of the class holds one
+// value per field, in this order; inherited fields come first. A subclass
+// starts from a copy of its parent's method table and overrides entries in
+// place, so a method keeps its index down the hierarchy.
+typedef struct {
+		int name;        // constant pool index of the class name
+		int* fields;     // constant pool index of each field name
+		size_t field_count;
+		ClassMethod* methods;
+		size_t method_count;
+} ClassInfo;
+
+// A function OP_CLOSURE makes into a value: its code, and where each of its
+// upvalues is copied from when the closure is made.
+typedef struct {
+		int address;
+		int frame_size;
+		int* captures;   // per upvalue: frame slot (>= 0), or -(i+1) for upvalue i of the running closure
+		size_t capture_count;
+} ClosureInfo;
+
 // The Bytecode structure now includes an instructions array with a capacity
 // and a constant pool.
 typedef struct {
@@ -21,6 +75,25 @@ typedef struct {
 		size_t instruction_count;
 		size_t instruction_capacity;
 		ConstantPool constant_pool;
+		// Unoptimized PC of each instruction, filled in by the optimizer when it
+		// moves code around; NULL means instructions are still in source order.
+		int* origins;
+		// Frame slots used by code outside any function (see OP_LOAD_LOCAL).
+		size_t top_level_slots;
+		// Jump tables referenced by switch instructions (operand3).
+		SwitchTable* switch_tables;
+		size_t switch_table_count;
+		// Exception handler table, consulted only when an error is raised.
+		HandlerEntry* handlers;
+		size_t handler_count;
+		// Classes, indexed by the class number of OP_NEWCLASS.
+		ClassInfo* classes;
+		size_t class_count;
+		// Functions made into closures, indexed by operand2 of OP_CLOSURE.
+		ClosureInfo* closures;
+		size_t closure_count;
+		// Address of main(), which the top-level code calls last; -1 if there is none.
+		int main_address;
 } Bytecode;
 
 Bytecode* bytecode_create(void);
@@ -31,6 +104,28 @@ void bytecode_add_instruction_ex(Bytecode* bc, VMOpcode opcode, int op1, int op2
 // Interns a string into the constant pool and returns its index.
 int bytecode_add_constant_str(Bytecode* bc, const char* str);
 
+// Copies a switch table into the bytecode and returns its index, or -1.
+int bytecode_add_switch_table(Bytecode* bc, int64_t low, const SwitchEntry* entries, size_t count);
+
+// Appends an exception handler entry and returns its index, or -1.
+int bytecode_add_handler(Bytecode* bc, int start, int end, int handler);
+
+// Copies a class's field and method tables into the bytecode and returns its index, or -1.
+int bytecode_add_class(Bytecode* bc, int name, const int* fields, size_t field_count,
+		const ClassMethod* methods, size_t method_count);
+
+// Copies a closure's capture list into the bytecode and returns its index, or -1.
+int bytecode_add_closure(Bytecode* bc, int address, int frame_size, const int* captures, size_t capture_count);
+
+// Hash used to dispatch string switches; the compiler and the VM must agree on it.
+uint32_t bytecode_hash_string(const char* str);
+
+// Returns the unoptimized PC of the instruction at 'pc'.
+size_t bytecode_origin(const Bytecode* bc, size_t pc);
+
+// Hash of the instruction stream and constant pool, used to match profiles to programs.
+uint64_t bytecode_fingerprint(const Bytecode* bc);
+
 #ifdef __cplusplus
 }
 #endif
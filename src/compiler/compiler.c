@@ -3,69 +3,478 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include "../include/ast.h"
 #include "../include/vm_common.h"
-#include "../include/symbol_table.h"
 #include "bytecode.h"
+#include "../runtime/runtime.h"
 
 /* Forward declarations of local helper functions: */
 static void compile_node(AstNode* node, Bytecode* bc);
 static int compile_expression(AstNode* expr, Bytecode* bc);
-static void add_function_entry(const char* name, int address);
-static int lookup_function_address(const char* name);
-static Scope* current_scope = NULL;
+static int compile_assignment(AstNode* expr, Bytecode* bc);
+static int compile_logical(AstNode* expr, Bytecode* bc);
+static int compile_interpolation(AstNode* expr, Bytecode* bc);
+static void compile_switch(AstNode* node, Bytecode* bc);
+static void compile_statements(AstNode** stmts, size_t count, Bytecode* bc);
+static void compile_guarded(AstNode** stmts, size_t count, AstNode* handler, Bytecode* bc);
+static void add_function_entry(int index, SymbolId symbol, int address, size_t frame_size);
+static int compile_function(AstNode* func, const AstNode* ctor, Bytecode* bc);
+static void compile_class(AstNode* node, Bytecode* bc);
+static int compile_member_assignment(AstNode* expr, Bytecode* bc);
+static int compile_call_args(AstNode* expr, int receiver, Bytecode* bc);
+
+/* Imports and name.func() calls of the unit being compiled, resolved by module_link(). */
+static LinkTable link_table;
+
+/* Set while compiling a function body; top-level locals live in the VM's top-level frame. */
+static bool in_function = false;
+
+/* Set while compiling a constructor, which returns the new object. */
+static bool in_constructor = false;
+
+/* Classes compiled so far, indexed by the class numbers the semantic pass assigned. */
+#define MAX_CLASSES 64
+static const AstNode* class_table[MAX_CLASSES];
 
 /* A naive global for register allocation. */
 static int next_register = 0;
 
+/* The VM's register file. */
+#define MAX_REGISTERS 16
+
+/* Errors found while compiling; any of them fails the compilation. */
+static int compile_errors = 0;
+static bool registers_exhausted = false;  /* reported once */
+
+static void compile_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "Compile error: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    compile_errors++;
+}
+
+/**
+ * Allocate 'count' consecutive registers and return the first. Running out
+ * is an error; the registers returned are then not valid.
+ */
+static int alloc_registers(int count) {
+    int first = next_register;
+    next_register += count;
+    if (next_register > MAX_REGISTERS && !registers_exhausted) {
+        registers_exhausted = true;
+        compile_error("expression too complex: it needs more than %d registers", MAX_REGISTERS);
+    }
+    return first;
+}
+
+static int alloc_register(void) {
+    return alloc_registers(1);
+}
+
 /*
-    A simple function table so that function declarations record their starting address.
+    The function table, indexed by the function numbers the semantic pass
+    assigned, so that calls find their callee without comparing names.
 */
 typedef struct {
-    char* name;
+    SymbolId symbol;
     int address;
+    size_t frame_size;  /* frame slots for parameters and locals */
+    int closure;        /* its ClosureInfo once it is used as a value, or -1 */
 } FunctionEntry;
 
 #define MAX_FUNCTIONS 64
 static FunctionEntry function_table[MAX_FUNCTIONS];
 static int function_count = 0;
 
-static void add_function_entry(const char* name, int address) {
-    if (function_count < MAX_FUNCTIONS) {
-        function_table[function_count].name = strdup(name);
-        function_table[function_count].address = address;
-        function_count++;
+static void add_function_entry(int index, SymbolId symbol, int address, size_t frame_size) {
+    if (index >= 0 && index < MAX_FUNCTIONS) {
+        function_table[index].symbol = symbol;
+        function_table[index].address = address;
+        function_table[index].frame_size = frame_size;
+        function_table[index].closure = -1;
+        if (index >= function_count) function_count = index + 1;
     } else {
         fprintf(stderr, "Function table overflow\n");
         exit(1);
     }
 }
 
-#define MAX_VARIABLES 64
+/* Only used to find entry points; calls use the resolved function number. */
+static const FunctionEntry* find_function(const char* name) {
+    SymbolId symbol = intern_find(name);
+    if (symbol == SYMBOL_ID_NONE) return NULL;
+    for (int i = 0; i < function_count; i++) {
+        if (function_table[i].symbol == symbol) {
+            return &function_table[i];
+        }
+    }
+    return NULL;
+}
+
+static bool is_assignment(const AstNode* expr) {
+    if (!expr || expr->type != AST_EXPR_BINARY) return false;
+    switch (expr->as.binary.op) {
+        case TOKEN_ASSIGN:
+        case TOKEN_PLUS_ASSIGN:
+        case TOKEN_MINUS_ASSIGN:
+        case TOKEN_STAR_ASSIGN:
+        case TOKEN_SLASH_ASSIGN:
+        case TOKEN_MOD_ASSIGN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* The slot of a variable (or scalar-replaced field) in the running frame named by 'expr', or -1. */
+static int local_slot_of(const AstNode* expr) {
+    if (expr && expr->type == AST_EXPR_MEMBER) return expr->as.member_expr.field_slot;
+    if (!expr || expr->type != AST_EXPR_IDENTIFIER) return -1;
+    const AstIdentifierData* id = &expr->as.ident;
+    return (id->binding == IDENT_LOCAL && id->depth == 0 && !id->boxed) ? id->slot : -1;
+}
 
-// A simple mapping from variable name to register number.
-// (For production code, you’d use a proper scoped symbol table.)
-static char* variable_names[MAX_VARIABLES];
-static int variable_count = 0;
+/* A bytecode call just compiled for its effect alone drops its result. */
+static void drop_call_result(const AstNode* expr, Bytecode* bc) {
+    if (expr->type != AST_EXPR_CALL || bc->instruction_count == 0) return;
+    Instruction* last = &bc->instructions[bc->instruction_count - 1];
+    if (last->opcode == OP_CALL || last->opcode == OP_INVOKE || last->opcode == OP_CALL_INDIRECT) {
+        last->operand3 = -1;
+    }
+}
 
-// Lookup a variable name in the current mapping.
-// Returns its register index if found; otherwise returns -1.
-static int lookup_variable_register(const char* name) {
-    for (int i = 0; i < variable_count; i++) {
-        if (strcmp(variable_names[i], name) == 0) {
-            return i;
+/**
+ * Store the value of 'value' into frame slot 'slot' when the result is not
+ * needed in a register. Constants and other locals are stored directly,
+ * without a round trip through a register.
+ */
+static void compile_store_local(AstNode* value, int slot, Bytecode* bc) {
+    int src_slot = local_slot_of(value);
+    if (value->type == AST_EXPR_LITERAL && value->as.literal.literal_type == TOKEN_INTEGER) {
+        bytecode_add_instruction(bc, OP_STORE_LOCAL_CONST, slot, (int)value->as.literal.i64_val, 0);
+    } else if (src_slot >= 0) {
+        if (src_slot != slot) {
+            bytecode_add_instruction(bc, OP_MOVE_LOCAL, slot, src_slot, 0);
+        }
+    } else {
+        int r = compile_expression(value, bc);
+        if (r >= 0) {
+            bytecode_add_instruction(bc, OP_STORE_LOCAL, slot, r, 0);
         }
     }
-    return -1;
 }
 
-static int lookup_function_address(const char* name) {
-    for (int i = 0; i < function_count; i++) {
-        if (strcmp(function_table[i].name, name) == 0) {
-            return function_table[i].address;
+/**
+ * Emit the store of register 'r' into the variable 'id' names.
+ * Returns false if the identifier is not something that can be stored to.
+ */
+static bool emit_store_variable(const AstIdentifierData* id, int r, Bytecode* bc) {
+    if (id->binding == IDENT_LOCAL && id->depth == 0) {
+        bytecode_add_instruction(bc, id->boxed ? OP_STORE_BOXED : OP_STORE_LOCAL, id->slot, r, 0);
+        return true;
+    }
+    if (id->binding == IDENT_UPVALUE) {
+        bytecode_add_instruction(bc, OP_STORE_UPVALUE, id->slot, r, 0);
+        return true;
+    }
+    if (id->binding == IDENT_GLOBAL) {
+        bytecode_add_instruction(bc, OP_STORE_GLOBAL, id->slot, r, 0);
+        return true;
+    }
+    compile_error("cannot assign to '%s': it is not a variable of this function or the top level",
+                  id->name);
+    return false;
+}
+
+/*
+    Forward branches whose target is not known yet. Each entry is the index of
+    a jump instruction whose operand1 is filled in by jump_list_patch().
+*/
+typedef struct {
+    size_t* sites;
+    size_t count;
+    size_t capacity;
+} JumpList;
+
+static void jump_list_add(JumpList* list, size_t site) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 4;
+        size_t* sites = (size_t*)realloc(list->sites, capacity * sizeof(size_t));
+        if (!sites) {
+            fprintf(stderr, "Out of memory for jump list\n");
+            exit(1);
         }
+        list->sites = sites;
+        list->capacity = capacity;
     }
-    return -1;
+    list->sites[list->count++] = site;
+}
+
+/* Point every jump in 'list' at 'target' and empty the list. */
+static void jump_list_patch(Bytecode* bc, JumpList* list, size_t target) {
+    for (size_t i = 0; i < list->count; i++) {
+        bc->instructions[list->sites[i]].operand1 = (int)target;
+    }
+    free(list->sites);
+    list->sites = NULL;
+    list->count = list->capacity = 0;
+}
+
+/* The comparison opcode for a relational token, or OP_NOP. */
+static VMOpcode comparison_opcode(OSFLTokenType op) {
+    switch (op) {
+        case TOKEN_EQ:  return OP_EQ;
+        case TOKEN_NEQ: return OP_NEQ;
+        case TOKEN_LT:  return OP_LT;
+        case TOKEN_LTE: return OP_LE;
+        case TOKEN_GT:  return OP_GT;
+        case TOKEN_GTE: return OP_GE;
+        default:        return OP_NOP;
+    }
+}
+
+static bool is_logical(const AstNode* expr, OSFLTokenType op) {
+    return expr && expr->type == AST_EXPR_BINARY && expr->as.binary.op == op;
+}
+
+/**
+ * Emit code that jumps when 'cond' evaluates to 'when' and falls through
+ * otherwise. The jumps are added to 'exits' for the caller to patch.
+ * && and || short-circuit, ! flips the sense, and comparisons use the fused
+ * compare-and-branch opcodes (operand4 set to jump when they are false).
+ */
+static void compile_branch(AstNode* cond, bool when, JumpList* exits, Bytecode* bc) {
+    if (cond->type == AST_EXPR_UNARY && cond->as.unary.op == TOKEN_NOT) {
+        compile_branch(cond->as.unary.expr, !when, exits, bc);
+        return;
+    }
+    bool is_and = is_logical(cond, TOKEN_AND);
+    if (is_and || is_logical(cond, TOKEN_OR)) {
+        // "a && b" is false as soon as a is false; "a || b" true as soon as a is true.
+        if (when == !is_and) {
+            compile_branch(cond->as.binary.left, when, exits, bc);
+            compile_branch(cond->as.binary.right, when, exits, bc);
+        } else {
+            JumpList skip = {0};
+            compile_branch(cond->as.binary.left, !when, &skip, bc);
+            compile_branch(cond->as.binary.right, when, exits, bc);
+            jump_list_patch(bc, &skip, bc->instruction_count);
+        }
+        return;
+    }
+    VMOpcode cmp = (cond->type == AST_EXPR_BINARY) ? comparison_opcode(cond->as.binary.op) : OP_NOP;
+    if (cmp != OP_NOP) {
+        int left_reg = compile_expression(cond->as.binary.left, bc);
+        int right_reg = compile_expression(cond->as.binary.right, bc);
+        jump_list_add(exits, bc->instruction_count);
+        bytecode_add_instruction_ex(bc, (VMOpcode)(OP_JUMP_IF_EQ + (cmp - OP_EQ)), 0,
+                                    left_reg, right_reg, !when);
+        return;
+    }
+    int r = compile_expression(cond, bc);
+    jump_list_add(exits, bc->instruction_count);
+    bytecode_add_instruction(bc, when ? OP_JUMP_IF_NONZERO : OP_JUMP_IF_ZERO, 0, r, 0);
+}
+
+/**
+ * Compile && or || used as a value: the result is a VAL_BOOL, and the right
+ * operand is only evaluated when it decides the result.
+ */
+static int compile_logical(AstNode* expr, Bytecode* bc) {
+    int dest_reg = alloc_register();
+    JumpList false_exits = {0};
+    bytecode_add_instruction(bc, OP_LOAD_BOOL, dest_reg, 0, 0);
+    compile_branch(expr, false, &false_exits, bc);
+    bytecode_add_instruction(bc, OP_LOAD_BOOL, dest_reg, 1, 0);
+    jump_list_patch(bc, &false_exits, bc->instruction_count);
+    next_register = dest_reg + 1;
+    return dest_reg;
+}
+
+/* Integer cases use a dense jump table when it is at most this sparse. */
+#define SWITCH_MIN_TABLE_CASES 3
+#define SWITCH_MAX_TABLE_SPAN 1024
+
+static int compare_switch_entries(const void* a, const void* b) {
+    int64_t x = ((const SwitchEntry*)a)->key;
+    int64_t y = ((const SwitchEntry*)b)->key;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Compile a switch into one multi-way branch. Dense integer cases become an
+ * OP_TABLESWITCH indexed by value; sparse integer cases and string cases an
+ * OP_LOOKUPSWITCH, binary-searched by value or by string hash.
+ */
+static void compile_switch(AstNode* node, Bytecode* bc) {
+    const AstSwitchStmtData* sw = &node->as.switch_stmt;
+    int subject_reg = compile_expression(sw->subject, bc);
+    size_t dispatch = bc->instruction_count;
+    bytecode_add_instruction(bc, OP_LOOKUPSWITCH, 0, subject_reg, -1);
+
+    size_t label_count = 0;
+    for (size_t i = 0; i < sw->case_count; i++) {
+        label_count += sw->cases[i].label_count;
+    }
+    SwitchEntry* entries = (SwitchEntry*)calloc(label_count > 0 ? label_count : 1, sizeof(SwitchEntry));
+    if (!entries) {
+        fprintf(stderr, "Out of memory for switch table\n");
+        exit(1);
+    }
+
+    // Arms are laid out in source order, each jumping to the end when done.
+    JumpList done = {0};
+    size_t n = 0;
+    int default_target = -1;
+    bool strings = false;
+    for (size_t i = 0; i < sw->case_count; i++) {
+        const AstSwitchCase* arm = &sw->cases[i];
+        int body_start = (int)bc->instruction_count;
+        if (arm->label_count == 0) default_target = body_start;
+        for (size_t j = 0; j < arm->label_count; j++) {
+            const AstNode* label = arm->labels[j];
+            SwitchEntry* e = &entries[n++];
+            e->target = body_start;
+            e->str_index = -1;
+            if (!ast_integer_value(label, &e->key)) {
+                e->str_index = bytecode_add_constant_str(bc, label->as.literal.str_val);
+                e->key = (int64_t)bytecode_hash_string(label->as.literal.str_val);
+                strings = true;
+            }
+        }
+        compile_node(arm->body, bc);
+        if (i + 1 < sw->case_count) {
+            jump_list_add(&done, bc->instruction_count);
+            bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
+        }
+    }
+    size_t end = bc->instruction_count;
+    jump_list_patch(bc, &done, end);
+
+    Instruction* inst = &bc->instructions[dispatch];
+    inst->operand1 = default_target >= 0 ? default_target : (int)end;
+    qsort(entries, n, sizeof(SwitchEntry), compare_switch_entries);
+    // Labels can be any two int64s, so their distance is taken unsigned and
+    // checked before one is added to it.
+    uint64_t distance = n > 0 ? (uint64_t)entries[n - 1].key - (uint64_t)entries[0].key : 0;
+    if (!strings && n >= SWITCH_MIN_TABLE_CASES && distance < SWITCH_MAX_TABLE_SPAN &&
+        distance < (uint64_t)n * 2) {
+        size_t span = (size_t)distance + 1;
+        // Gaps in the range get target -1 and go to the default.
+        SwitchEntry* table = (SwitchEntry*)malloc(span * sizeof(SwitchEntry));
+        if (!table) {
+            fprintf(stderr, "Out of memory for switch table\n");
+            exit(1);
+        }
+        for (size_t k = 0; k < span; k++) {
+            table[k].key = entries[0].key + (int64_t)k;
+            table[k].target = -1;
+            table[k].str_index = -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            table[entries[i].key - entries[0].key].target = entries[i].target;
+        }
+        inst->opcode = OP_TABLESWITCH;
+        inst->operand3 = bytecode_add_switch_table(bc, entries[0].key, table, span);
+        free(table);
+    } else {
+        inst->operand3 = bytecode_add_switch_table(bc, 0, entries, n);
+    }
+    free(entries);
+}
+
+/*
+    An open try or on_error guard. Function bodies are compiled inline but run
+    in a frame of their own, so a guard's range skips over any function
+    declared inside it: each contiguous piece becomes one handler table entry
+    once the handler's address is known.
+*/
+typedef struct {
+    size_t piece_start;  /* start of the piece being emitted */
+    size_t* pieces;      /* finished pieces, as start/end pairs */
+    size_t piece_count;
+} Guard;
+
+#define MAX_GUARD_DEPTH 64
+static Guard guards[MAX_GUARD_DEPTH];
+static int guard_count = 0;
+static int guard_base = 0;       /* guards below this belong to an enclosing function */
+static int retry_target = -1;    /* start of the range a retry re-enters, or -1 */
+
+static void guard_end_piece(Guard* g, size_t end) {
+    if (end <= g->piece_start) return;
+    size_t* pieces = (size_t*)realloc(g->pieces, (g->piece_count + 1) * 2 * sizeof(size_t));
+    if (!pieces) {
+        fprintf(stderr, "Out of memory for handler ranges\n");
+        exit(1);
+    }
+    g->pieces = pieces;
+    g->pieces[g->piece_count * 2] = g->piece_start;
+    g->pieces[g->piece_count * 2 + 1] = end;
+    g->piece_count++;
+}
+
+/**
+ * Compile 'stmts' guarded by 'handler'. The guarded code runs with no extra
+ * instructions; a jump steps over the handler, which is only entered through
+ * the handler table. Without a handler, errors in the range are ignored.
+ */
+static void compile_guarded(AstNode** stmts, size_t count, AstNode* handler, Bytecode* bc) {
+    if (guard_count >= MAX_GUARD_DEPTH) {
+        fprintf(stderr, "Too many nested error handlers\n");
+        exit(1);
+    }
+    size_t start = bc->instruction_count;
+    Guard* g = &guards[guard_count++];
+    g->piece_start = start;
+    g->pieces = NULL;
+    g->piece_count = 0;
+
+    compile_statements(stmts, count, bc);
+
+    guard_count--;
+    guard_end_piece(g, bc->instruction_count);
+    size_t skip_jump = (size_t)-1;
+    if (handler) {
+        skip_jump = bc->instruction_count;
+        bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
+    }
+    // Inner guards finish first, so the table lists them before outer ones.
+    for (size_t i = 0; i < g->piece_count; i++) {
+        bytecode_add_handler(bc, (int)g->pieces[i * 2], (int)g->pieces[i * 2 + 1],
+                             (int)bc->instruction_count);
+    }
+    free(g->pieces);
+
+    if (handler) {
+        int saved_retry = retry_target;
+        retry_target = (int)start;
+        compile_node(handler, bc);
+        retry_target = saved_retry;
+        bc->instructions[skip_jump].operand1 = (int)bc->instruction_count;
+    }
+}
+
+/**
+ * Compile a statement list. An on_error statement guards the statements
+ * after it in the same list.
+ */
+static void compile_statements(AstNode** stmts, size_t count, Bytecode* bc) {
+    // Variables live in frame slots, so no temporary outlives its statement.
+    int base_register = next_register;
+    for (size_t i = 0; i < count; i++) {
+        next_register = base_register;
+        if (stmts[i]->type == AST_NODE_ERROR_HANDLER) {
+            compile_guarded(stmts + i + 1, count - i - 1, stmts[i]->as.error_handler.handler_body, bc);
+            break;
+        }
+        compile_node(stmts[i], bc);
+    }
+    next_register = base_register;
 }
 
 void dump_bytecode(const Bytecode* bc) {
@@ -81,26 +490,326 @@ void dump_bytecode(const Bytecode* bc) {
     }
 }
 
+static void compiler_reset(void) {
+    next_register = 0;
+    compile_errors = 0;
+    registers_exhausted = false;
+    function_count = 0; // reset the function table
+    in_function = false;
+    in_constructor = false;
+    memset(class_table, 0, sizeof(class_table));
+    guard_count = guard_base = 0;
+    retry_target = -1;
+    link_table_free(&link_table);
+}
+
 /**
  * Entry point: compile the AST into Bytecode, then return it.
  */
 Bytecode* compiler_compile_ast(AstNode* root) {
     Bytecode* bc = bytecode_create();
-    next_register = 0;
-    function_count = 0; // reset the function table
-
-    // Prepopulate function table with native functions.
-    // Here we add "print" with a special address (-1) to indicate native.
-    add_function_entry("print", -1);
-    // Add other native functions as needed.
+    compiler_reset();
+    // Names the semantic pass could not resolve (such as "print") are natives.
 
     compile_node(root, bc);
+    if (compile_errors > 0) {
+        bytecode_destroy(bc);
+        return NULL;
+    }
 
     bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);
+
+    // Linking compiles imported modules, which reuses this compiler's state.
+    LinkTable links = link_table;
+    memset(&link_table, 0, sizeof(link_table));
+    bool linked = module_link(bc, &links);
+    link_table_free(&links);
+    if (!linked) {
+        bytecode_destroy(bc);
+        return NULL;
+    }
     dump_bytecode(bc);
     return bc;
 }
 
+Bytecode* compiler_compile_module(AstNode* root, LinkTable* links,
+                                  ModuleExport** exports, size_t* export_count) {
+    Bytecode* bc = bytecode_create();
+    compiler_reset();
+
+    compile_node(root, bc);
+    if (compile_errors > 0) {
+        bytecode_destroy(bc);
+        return NULL;
+    }
+
+    // The initializer returns to the code after the import site.
+    bytecode_add_instruction(bc, OP_JUMP, -1, 0, 0);
+
+    *exports = (ModuleExport*)calloc(function_count > 0 ? (size_t)function_count : 1, sizeof(ModuleExport));
+    if (!*exports) {
+        fprintf(stderr, "Out of memory for module exports\n");
+        exit(1);
+    }
+    for (int i = 0; i < function_count; i++) {
+        ModuleExport* e = &(*exports)[i];
+        e->symbol = function_table[i].symbol;
+        e->address = function_table[i].address;
+        // The body ends where the jump stepping over it lands.
+        e->end = bc->instructions[e->address - 1].operand1;
+        e->frame_size = function_table[i].frame_size;
+    }
+    *export_count = (size_t)function_count;
+    *links = link_table;
+    memset(&link_table, 0, sizeof(link_table));
+    return bc;
+}
+
+/**
+ * Store the initial value of every field of class 'cls' that has one, the
+ * inherited fields first, into the object in frame slot 0.
+ */
+static void emit_field_initializers(const AstNode* cls, Bytecode* bc) {
+    const AstClassDeclData* data = &cls->as.class_decl;
+    if (data->parent_index >= 0 && data->parent_index < MAX_CLASSES && class_table[data->parent_index]) {
+        emit_field_initializers(class_table[data->parent_index], bc);
+    }
+    for (size_t i = 0; i < data->member_count; i++) {
+        const AstNode* member = data->members[i];
+        if (member->type != AST_NODE_VAR_DECL || !member->as.var_decl.initializer) continue;
+        int saved_register = next_register;
+        int value = compile_expression(member->as.var_decl.initializer, bc);
+        int object = alloc_register();
+        bytecode_add_instruction(bc, OP_LOAD_LOCAL, object, 0, 0);
+        bytecode_add_instruction(bc, OP_SETFIELD, object,
+                                 bytecode_add_constant_str(bc, member->as.var_decl.var_name), value);
+        next_register = saved_register;
+    }
+}
+
+/* Where the field 'name' is in an object of class 'class_index', as OP_GETFIELD finds it; -1 if absent. */
+static int field_offset(const Bytecode* bc, int class_index, const char* name) {
+    const ClassInfo* info = &bc->classes[class_index];
+    for (size_t i = 0; i < info->field_count; i++) {
+        if (strcmp(bc->constant_pool.strings[info->fields[i]], name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+/**
+ * Like emit_field_initializers, for an object of class 'class_index' whose
+ * fields are the frame slots from 'field_slot' on.
+ */
+static void store_field_initializers(const AstNode* cls, int class_index, int field_slot, Bytecode* bc) {
+    const AstClassDeclData* data = &cls->as.class_decl;
+    if (data->parent_index >= 0 && data->parent_index < MAX_CLASSES && class_table[data->parent_index]) {
+        store_field_initializers(class_table[data->parent_index], class_index, field_slot, bc);
+    }
+    for (size_t i = 0; i < data->member_count; i++) {
+        const AstNode* member = data->members[i];
+        if (member->type != AST_NODE_VAR_DECL || !member->as.var_decl.initializer) continue;
+        int offset = field_offset(bc, class_index, member->as.var_decl.var_name);
+        compile_store_local(member->as.var_decl.initializer, field_slot + offset, bc);
+    }
+}
+
+/**
+ * Compile 'var name = Class(args)' for an object that never escapes (see
+ * AstVarDeclData.field_slot). Nothing is allocated: the values its field
+ * initializers and constructor would give the fields are stored into their
+ * frame slots. The semantic pass checked that the constructor only stores
+ * parameters into fields.
+ */
+static void compile_record(AstNode* node, Bytecode* bc) {
+    AstNode* call = node->as.var_decl.initializer;
+    int class_index = call->as.call.callee->as.ident.slot;
+    const AstNode* cls = class_table[class_index];
+    int field_slot = node->as.var_decl.field_slot;
+    int mark = next_register;
+    int args = compile_call_args(call, -1, bc);
+    store_field_initializers(cls, class_index, field_slot, bc);
+    const AstClassDeclData* data = &cls->as.class_decl;
+    const AstNode* ctor = NULL;
+    for (size_t i = 0; i < data->member_count; i++) {
+        const AstNode* member = data->members[i];
+        if (member->type == AST_NODE_FUNC_DECL && strcmp(member->as.func_decl.func_name, "init") == 0) {
+            ctor = member;
+        }
+    }
+    const AstNode* body = ctor ? ctor->as.func_decl.body : NULL;
+    for (size_t i = 0; body && i < body->as.block.statement_count; i++) {
+        // this.field = parameter; the parameters after 'this' are the arguments.
+        const AstNode* store = body->as.block.statements[i]->as.unary.expr;
+        int offset = field_offset(bc, class_index, store->as.binary.left->as.member_expr.member_name);
+        bytecode_add_instruction(bc, OP_STORE_LOCAL, field_slot + offset,
+                                 args + store->as.binary.right->as.ident.slot - 1, 0);
+    }
+    next_register = mark;
+}
+
+/**
+ * Compile the function 'func' (a nested function or a function expression)
+ * and load a closure of it, holding its captured variables, into a fresh
+ * register. Returns the register.
+ */
+static int compile_closure(AstNode* func, Bytecode* bc) {
+    const AstFuncDeclData* data = &func->as.func_decl;
+    int address = compile_function(func, NULL, bc);
+    int r = alloc_register();
+    bytecode_add_instruction(bc, OP_CLOSURE, r,
+                             bytecode_add_closure(bc, address, (int)data->frame_size,
+                                                  data->captures, data->capture_count), 0);
+    return r;
+}
+
+/**
+ * Compile a function body in line, stepped over by the code around it, and
+ * return its address. 'ctor' is the class when the function is a
+ * constructor: it first runs the field initializers, and returns the
+ * object. 'func' is NULL for the constructor of a
+ * class that declares none, which takes only 'this'.
+ */
+static int compile_function(AstNode* func, const AstNode* ctor, Bytecode* bc) {
+    // Top-level code runs straight through, so step over the body.
+    size_t skip_jump = bc->instruction_count;
+    bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
+    int func_address = (int)bc->instruction_count;
+    size_t param_count = 1;
+    if (func) {
+        printf("DEBUG: Compiling function node: %s\n", func->as.func_decl.func_name);
+        if (func->as.func_decl.func_index >= 0) {
+            add_function_entry(func->as.func_decl.func_index, func->as.func_decl.func_symbol,
+                               func_address, func->as.func_decl.frame_size);
+        }
+        printf("DEBUG: Function '%s' has %zu parameter(s) and a frame of %zu slot(s).\n",
+               func->as.func_decl.func_name, func->as.func_decl.param_count,
+               func->as.func_decl.frame_size);
+        param_count = func->as.func_decl.param_count;
+    }
+    // Arguments arrive in registers 0..n-1; the prologue moves parameter i
+    // into frame slot i, leaving the whole register file for temporaries.
+    for (int i = 0; i < (int)param_count; i++) {
+        bytecode_add_instruction(bc, OP_STORE_LOCAL, i, i, 1);
+    }
+    // A parameter that a closure captures and that is reassigned lives in a box.
+    for (int i = 0; func && i < (int)param_count; i++) {
+        if (func->as.func_decl.param_boxed && func->as.func_decl.param_boxed[i]) {
+            bytecode_add_instruction(bc, OP_BOX, i, 0, 0);
+        }
+    }
+    int saved_register = next_register;
+    bool saved_in_function = in_function;
+    bool saved_in_constructor = in_constructor;
+    int saved_guard_base = guard_base;
+    int saved_retry = retry_target;
+    next_register = 0;
+    in_function = true;
+    in_constructor = ctor != NULL;
+    // Guards of the enclosing code do not cover the body.
+    for (int g = guard_count; g-- > guard_base;) {
+        guard_end_piece(&guards[g], (size_t)func_address);
+    }
+    guard_base = guard_count;
+    retry_target = -1;
+
+    if (ctor) {
+        emit_field_initializers(ctor, bc);
+    }
+    if (func) {
+        compile_node(func->as.func_decl.body, bc);
+    }
+    if (ctor) {
+        bytecode_add_instruction(bc, OP_LOAD_LOCAL, 0, 0, 0);
+    }
+    bytecode_add_instruction(bc, OP_RET, ctor ? 0 : -1, 0, 0);
+    bc->instructions[skip_jump].operand1 = (int)bc->instruction_count;
+
+    next_register = saved_register;
+    in_function = saved_in_function;
+    in_constructor = saved_in_constructor;
+    guard_base = saved_guard_base;
+    retry_target = saved_retry;
+    for (int g = guard_base; g < guard_count; g++) {
+        guards[g].piece_start = bc->instruction_count;
+    }
+    return func_address;
+}
+
+/* Put 'method' into the table, replacing an inherited method of the same name. */
+static void set_method(ClassMethod* methods, size_t* count, const Bytecode* bc, ClassMethod method) {
+    const char* name = bc->constant_pool.strings[method.name];
+    for (size_t i = 0; i < *count; i++) {
+        if (strcmp(bc->constant_pool.strings[methods[i].name], name) == 0) {
+            methods[i] = method;
+            return;
+        }
+    }
+    methods[(*count)++] = method;
+}
+
+/**
+ * Compile a class: its methods as functions taking 'this' in slot 0, and its
+ * field layout and method table, which start from the parent's. Every class
+ * gets its own constructor "init" (constructors are not inherited); one is
+ * made up when the class declares none.
+ */
+static void compile_class(AstNode* node, Bytecode* bc) {
+    const AstClassDeclData* data = &node->as.class_decl;
+    if (data->class_index < 0 || data->class_index >= MAX_CLASSES) {
+        fprintf(stderr, "Class table overflow\n");
+        exit(1);
+    }
+    class_table[data->class_index] = node;
+    const ClassInfo* parent = (data->parent_index >= 0 && (size_t)data->parent_index < bc->class_count)
+                              ? &bc->classes[data->parent_index] : NULL;
+    size_t inherited_fields = parent ? parent->field_count : 0;
+    size_t inherited_methods = parent ? parent->method_count : 0;
+    int* fields = (int*)malloc((inherited_fields + data->member_count + 1) * sizeof(int));
+    ClassMethod* methods = (ClassMethod*)malloc((inherited_methods + data->member_count + 1) * sizeof(ClassMethod));
+    if (!fields || !methods) {
+        fprintf(stderr, "Failed to allocate memory for class '%s'.\n", data->class_name);
+        exit(1);
+    }
+    size_t field_count = inherited_fields;
+    size_t method_count = inherited_methods;
+    if (parent) {
+        memcpy(fields, parent->fields, inherited_fields * sizeof(int));
+        memcpy(methods, parent->methods, inherited_methods * sizeof(ClassMethod));
+    }
+
+    bool has_constructor = false;
+    for (size_t i = 0; i < data->member_count; i++) {
+        AstNode* member = data->members[i];
+        if (member->type == AST_NODE_VAR_DECL) {
+            fields[field_count++] = bytecode_add_constant_str(bc, member->as.var_decl.var_name);
+        } else if (member->type == AST_NODE_FUNC_DECL) {
+            bool is_constructor = strcmp(member->as.func_decl.func_name, "init") == 0;
+            ClassMethod method;
+            method.address = compile_function(member, is_constructor ? node : NULL, bc);
+            method.frame_size = (int)member->as.func_decl.frame_size;
+            method.name = bytecode_add_constant_str(bc, member->as.func_decl.func_name);
+            set_method(methods, &method_count, bc, method);
+            has_constructor |= is_constructor;
+        }
+    }
+    if (!has_constructor) {
+        ClassMethod method;
+        method.address = compile_function(NULL, node, bc);
+        method.frame_size = 1;
+        method.name = bytecode_add_constant_str(bc, "init");
+        set_method(methods, &method_count, bc, method);
+    }
+
+    int index = bytecode_add_class(bc, bytecode_add_constant_str(bc, data->class_name),
+                                   fields, field_count, methods, method_count);
+    if (index != data->class_index) {
+        compile_error("class '%s' was numbered %d but compiled as class %d",
+                      data->class_name, data->class_index, index);
+    }
+    free(fields);
+    free(methods);
+}
+
 /**
  * Recursively compile AST nodes.
  */
@@ -114,14 +823,14 @@ static void compile_node(AstNode* node, Bytecode* bc) {
             if (strcmp(node->as.frame_decl.frame_name, "Main") == 0) {
                 printf("DEBUG: Found Main frame\n");
                 // First compile the frame contents normally.
-                for (size_t i = 0; i < node->as.frame_decl.body_count; i++) {
-                    compile_node(node->as.frame_decl.body_statements[i], bc);
-                }
+                compile_statements(node->as.frame_decl.body_statements,
+                                   node->as.frame_decl.body_count, bc);
                 // After compiling the frame, look up the main function and call it.
-                int main_addr = lookup_function_address("main");
-                if (main_addr >= 0) {
-                    printf("DEBUG: Adding call to main() at address %d\n", main_addr);
-                    bytecode_add_instruction(bc, OP_CALL, main_addr, 0, 0);
+                const FunctionEntry* main_fn = find_function("main");
+                if (main_fn) {
+                    printf("DEBUG: Adding call to main() at address %d\n", main_fn->address);
+                    bc->main_address = main_fn->address;
+                    bytecode_add_instruction_ex(bc, OP_CALL, main_fn->address, (int)main_fn->frame_size, -1, 0);
                     // Add HALT after main returns.
                     bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);
                 } else {
@@ -129,106 +838,139 @@ static void compile_node(AstNode* node, Bytecode* bc) {
                 }
             } else {
                 // Regular frame compilation.
-                for (size_t i = 0; i < node->as.frame_decl.body_count; i++) {
-                    compile_node(node->as.frame_decl.body_statements[i], bc);
-                }
+                compile_statements(node->as.frame_decl.body_statements,
+                                   node->as.frame_decl.body_count, bc);
             }
         } break;
-        case AST_NODE_BLOCK: {
-            for (size_t i = 0; i < node->as.block.statement_count; i++) {
-                compile_node(node->as.block.statements[i], bc);
+        case AST_NODE_BLOCK:
+            compile_statements(node->as.block.statements, node->as.block.statement_count, bc);
+            break;
+        case AST_NODE_VAR_DECL:
+        case AST_NODE_CONST_DECL: {
+            int slot = node->as.var_decl.slot;
+            if (slot < 0) {
+                compile_error("variable '%s' has no frame slot; was the semantic pass run?",
+                              node->as.var_decl.var_name);
+                break;
             }
-        } break;
-        case AST_NODE_VAR_DECL: {
-            if (node->as.var_decl.initializer) {
-                int r = compile_expression(node->as.var_decl.initializer, bc);
-                (void)r;
+            if (node->as.var_decl.field_slot >= 0) {
+                compile_record(node, bc);
+            } else if (node->as.var_decl.initializer) {
+                compile_store_local(node->as.var_decl.initializer, slot, bc);
+            }
+            if (node->as.var_decl.boxed) {
+                // Each declaration gets a box of its own, so closures made in a loop
+                // capture a fresh variable per iteration.
+                bytecode_add_instruction(bc, OP_BOX, slot, node->as.var_decl.initializer ? 0 : 1, 0);
+            }
+            if (!in_function && (size_t)slot >= bc->top_level_slots) {
+                bc->top_level_slots = (size_t)slot + 1;
             }
         } break;
         case AST_NODE_EXPR_STMT: {
-            compile_expression(node->as.unary.expr, bc);
+            AstNode* expr = node->as.unary.expr;
+            int slot = (is_assignment(expr) && expr->as.binary.op == TOKEN_ASSIGN)
+                       ? local_slot_of(expr->as.binary.left) : -1;
+            if (slot >= 0) {
+                // The assigned value is discarded, so store it without keeping a register.
+                compile_store_local(expr->as.binary.right, slot, bc);
+            } else {
+                compile_expression(expr, bc);
+                drop_call_result(expr, bc);
+            }
         } break;
         case AST_NODE_IF: {
-            int cond_reg = compile_expression(node->as.if_stmt.condition, bc);
-            size_t jump_index = bc->instruction_count;
-            bytecode_add_instruction(bc, OP_JUMP_IF_ZERO, 0, cond_reg, 0);
+            JumpList else_exits = {0};
+            compile_branch(node->as.if_stmt.condition, false, &else_exits, bc);
             compile_node(node->as.if_stmt.then_branch, bc);
             size_t else_jump_index = (size_t)(-1);
             if (node->as.if_stmt.else_branch) {
                 else_jump_index = bc->instruction_count;
                 bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
             }
-            bc->instructions[jump_index].operand1 = (int)bc->instruction_count;
+            jump_list_patch(bc, &else_exits, bc->instruction_count);
             if (node->as.if_stmt.else_branch) {
                 compile_node(node->as.if_stmt.else_branch, bc);
                 bc->instructions[else_jump_index].operand1 = (int)bc->instruction_count;
             }
         } break;
         case AST_NODE_WHILE_STMT: {
-            size_t loop_start = bc->instruction_count;
-            int cond_reg = compile_expression(node->as.while_stmt.condition, bc);
-            size_t jump_index = bc->instruction_count;
-            bytecode_add_instruction(bc, OP_JUMP_IF_ZERO, 0, cond_reg, 0);
+            // Loops are emitted bottom-tested: one taken branch per iteration
+            // instead of a conditional exit plus a backward jump.
+            size_t entry_jump = bc->instruction_count;
+            bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
+            size_t body_start = bc->instruction_count;
             compile_node(node->as.while_stmt.body, bc);
-            bytecode_add_instruction(bc, OP_JUMP, (int)loop_start, 0, 0);
-            bc->instructions[jump_index].operand1 = (int)bc->instruction_count;
+            bc->instructions[entry_jump].operand1 = (int)bc->instruction_count;
+            JumpList repeat = {0};
+            compile_branch(node->as.while_stmt.condition, true, &repeat, bc);
+            jump_list_patch(bc, &repeat, body_start);
         } break;
         case AST_NODE_FOR_STMT: {
             compile_node(node->as.for_stmt.init, bc);
-            size_t loop_start = bc->instruction_count;
-            int cond_reg = compile_expression(node->as.for_stmt.condition, bc);
-            size_t jump_index = bc->instruction_count;
-            bytecode_add_instruction(bc, OP_JUMP_IF_ZERO, 0, cond_reg, 0);
+            size_t entry_jump = bc->instruction_count;
+            bytecode_add_instruction(bc, OP_JUMP, 0, 0, 0);
+            size_t body_start = bc->instruction_count;
             compile_node(node->as.for_stmt.body, bc);
             compile_node(node->as.for_stmt.increment, bc);
-            bytecode_add_instruction(bc, OP_JUMP, (int)loop_start, 0, 0);
-            bc->instructions[jump_index].operand1 = (int)bc->instruction_count;
+            bc->instructions[entry_jump].operand1 = (int)bc->instruction_count;
+            if (node->as.for_stmt.condition) {
+                JumpList repeat = {0};
+                compile_branch(node->as.for_stmt.condition, true, &repeat, bc);
+                jump_list_patch(bc, &repeat, body_start);
+            } else {
+                bytecode_add_instruction(bc, OP_JUMP, (int)body_start, 0, 0);
+            }
         } break;
+        case AST_NODE_SWITCH_STMT:
+            compile_switch(node, bc);
+            break;
+        case AST_NODE_TRY_CATCH:
+            compile_guarded(&node->as.error_handler.handler_body, 1,
+                            node->as.error_handler.catch_body, bc);
+            break;
+        case AST_NODE_RETRY_STMT:
+            if (retry_target >= 0) {
+                bytecode_add_instruction(bc, OP_JUMP, retry_target, 0, 0);
+            }
+            break;
         case AST_NODE_RETURN_STMT: {
             int ret_reg = compile_expression(node->as.ret_stmt.expr, bc);
-            (void)ret_reg;
-            bytecode_add_instruction(bc, OP_RET, 0, 0, 0);
+            if (in_constructor) {
+                // A constructor always hands back the new object.
+                ret_reg = alloc_register();
+                bytecode_add_instruction(bc, OP_LOAD_LOCAL, ret_reg, 0, 0);
+            }
+            bytecode_add_instruction(bc, OP_RET, ret_reg, 0, 0);
         } break;
         case AST_NODE_FUNC_DECL: {
-            printf("DEBUG: Compiling function node: %s\n", node->as.func_decl.func_name);
-            int func_address = (int)bc->instruction_count;
-            add_function_entry(node->as.func_decl.func_name, func_address);
-            
-            // Save the old scope.
-            Scope* old_scope = current_scope;
-            // Create a new scope for this function.
-            current_scope = scope_create(old_scope);
-            if (!current_scope) {
-                fprintf(stderr, "Failed to create function scope for '%s'.\n", node->as.func_decl.func_name);
-                exit(1);
+            int slot = node->as.func_decl.closure_slot;
+            if (slot < 0) {
+                compile_function(node, NULL, bc);
+                break;
             }
-            printf("DEBUG: Setting up symbol table for function '%s' with %d parameter(s).\n",
-                   node->as.func_decl.func_name, node->as.func_decl.param_count);
-            // For each parameter, add it to the scope with register i.
-            for (int i = 0; i < (int)node->as.func_decl.param_count; i++) {
-                if (!scope_add_symbol(current_scope, node->as.func_decl.param_names[i], SYMBOL_VAR, i)) {
-                    fprintf(stderr, "Failed to add parameter '%s' to symbol table.\n", node->as.func_decl.param_names[i]);
-                } else {
-                    printf("DEBUG: Mapped parameter '%s' to register %d.\n", node->as.func_decl.param_names[i], i);
-                }
+            // A nested function is a closure in a slot of the enclosing function.
+            // When it captures itself, the box must exist before the closure does.
+            if (node->as.func_decl.boxed) {
+                bytecode_add_instruction(bc, OP_BOX, slot, 1, 0);
             }
-            // Reserve registers for parameters.
             int saved_register = next_register;
-            next_register = node->as.func_decl.param_count;
-            
-            compile_node(node->as.func_decl.body, bc);
-            bytecode_add_instruction(bc, OP_RET, 0, 0, 0);
-            
-            // Clean up the function scope.
-            scope_destroy(current_scope);
-            current_scope = old_scope;
+            int r = compile_closure(node, bc);
+            bytecode_add_instruction(bc, node->as.func_decl.boxed ? OP_STORE_BOXED : OP_STORE_LOCAL, slot, r, 0);
             next_register = saved_register;
         } break;
-        case AST_NODE_CLASS_DECL: {
-            for (size_t i = 0; i < node->as.class_decl.member_count; i++) {
-                compile_node(node->as.class_decl.members[i], bc);
-            }
+        case AST_NODE_IMPORT: {
+            // A plugin was loaded by the semantic pass; its natives are called by name.
+            if (node->as.import_decl.plugin) break;
+            // Becomes a jump into the module's initializer if the module is linked.
+            link_table_add_import(&link_table, node->as.import_decl.index,
+                                  module_resolve_path(node->loc.file, node->as.import_decl.path),
+                                  (int)bc->instruction_count);
+            bytecode_add_instruction(bc, OP_NOP, 0, 0, 0);
         } break;
+        case AST_NODE_CLASS_DECL:
+            compile_class(node, bc);
+            break;
         default: {
             // For other node types, do nothing.
         } break;
@@ -239,6 +981,127 @@ static void compile_node(AstNode* node, Bytecode* bc) {
     }
 }
 
+/* Load the float 'value' into register 'r'; the instruction carries its bits. */
+static void emit_load_float(Bytecode* bc, int r, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bytecode_add_instruction(bc, OP_LOAD_CONST_FLOAT, r, (int)(uint32_t)bits, (int)(uint32_t)(bits >> 32));
+}
+
+/**
+ * Evaluate 'expr' at compile time if it is a number: a numeric literal, a
+ * negated one, or a call of a pure native with a fast path whose arguments
+ * are themselves constant. The result is what the VM would compute.
+ */
+static bool constant_number(const AstNode* expr, Value* out) {
+    if (!expr) return false;
+    if (expr->type == AST_EXPR_LITERAL) {
+        if (expr->as.literal.literal_type == TOKEN_INTEGER) {
+            out->type = VAL_INT;
+            out->as.int_val = expr->as.literal.i64_val;
+            return true;
+        }
+        if (expr->as.literal.literal_type == TOKEN_FLOAT) {
+            out->type = VAL_FLOAT;
+            out->as.float_val = expr->as.literal.f64_val;
+            return true;
+        }
+        return false;
+    }
+    if (expr->type == AST_EXPR_UNARY && expr->as.unary.op == TOKEN_MINUS) {
+        if (!constant_number(expr->as.unary.expr, out)) return false;
+        if (out->type == VAL_INT) {
+            out->as.int_val = -out->as.int_val;
+        } else {
+            out->as.float_val = -out->as.float_val;
+        }
+        return true;
+    }
+    if (expr->type != AST_EXPR_CALL || expr->as.call.callee->type != AST_EXPR_IDENTIFIER ||
+        expr->as.call.callee->as.ident.binding != IDENT_UNRESOLVED) {
+        return false;
+    }
+    const NativeDescriptor* native = osfl_find_native(expr->as.call.callee->as.ident.name);
+    int arg_count = (int)expr->as.call.arg_count;
+    if (!native || !(native->flags & NATIVE_PURE) || !NATIVE_HAS_FAST_PATH(native, arg_count)) {
+        return false;
+    }
+    Value args[NATIVE_MAX_HINTS];
+    bool all_int = true;
+    for (int i = 0; i < arg_count; i++) {
+        if (!constant_number(expr->as.call.args[i], &args[i])) return false;
+        if (args[i].type != VAL_INT) all_int = false;
+    }
+    if (all_int && native->fast_i64) {
+        int64_t ints[NATIVE_MAX_HINTS];
+        for (int i = 0; i < arg_count; i++) ints[i] = args[i].as.int_val;
+        out->type = VAL_INT;
+        out->as.int_val = native->fast_i64(ints);
+    } else if (!native->fast_f64) {
+        return false;
+    } else {
+        double floats[NATIVE_MAX_HINTS];
+        for (int i = 0; i < arg_count; i++) {
+            floats[i] = args[i].type == VAL_INT ? (double)args[i].as.int_val : args[i].as.float_val;
+        }
+        out->type = VAL_FLOAT;
+        out->as.float_val = native->fast_f64(floats);
+    }
+    return true;
+}
+
+/* True for 'name.member' where 'name' is an imported module. */
+static bool is_module_member(const AstNode* expr) {
+    return expr->type == AST_EXPR_MEMBER &&
+           expr->as.member_expr.object->type == AST_EXPR_IDENTIFIER &&
+           expr->as.member_expr.object->as.ident.binding == IDENT_MODULE;
+}
+
+/**
+ * Compile the arguments of a call, after the receiver 'receiver' when it is
+ * not -1, and return the first of the consecutive registers holding them.
+ * They usually land there as they are compiled; otherwise they are moved
+ * into a fresh block.
+ */
+static int compile_call_args(AstNode* expr, int receiver, Bytecode* bc) {
+    int first = receiver >= 0 ? 1 : 0;
+    int count = first + (int)expr->as.call.arg_count;
+    int* arg_regs = (int*)malloc((count + 1) * sizeof(int));
+    if (!arg_regs) {
+        fprintf(stderr, "Failed to allocate memory for function call arguments.\n");
+        exit(1);
+    }
+    arg_regs[0] = receiver;
+    // Compile each argument; store its register.
+    for (int i = first; i < count; i++) {
+        arg_regs[i] = compile_expression(expr->as.call.args[i - first], bc);
+    }
+    int base = count > 0 ? arg_regs[0] : next_register;
+    bool in_place = true;
+    for (int i = 0; i < count; i++) {
+        if (arg_regs[i] != base + i) in_place = false;
+    }
+    if (!in_place) {
+        base = alloc_registers(count);
+        for (int i = 0; i < count; i++) {
+            bytecode_add_instruction(bc, OP_MOVE, base + i, arg_regs[i], 0);
+        }
+    }
+    free(arg_regs);
+    return base;
+}
+
+/**
+ * Emit a bytecode call whose arguments start at register 'base' (see
+ * vm_common.h). The result replaces the first argument, and the registers
+ * above it are free again.
+ */
+static int emit_call(Bytecode* bc, VMOpcode opcode, int operand1, int operand2, int base) {
+    bytecode_add_instruction_ex(bc, opcode, operand1, operand2, base, base);
+    next_register = base;
+    return alloc_register();
+}
+
 /**
  * Compile an expression node into bytecode and return the register index holding its result.
  */
@@ -249,32 +1112,32 @@ static int compile_expression(AstNode* expr, Bytecode* bc) {
         case AST_EXPR_LITERAL: {
             switch (expr->as.literal.literal_type) {
                 case TOKEN_INTEGER: {
-                    int r = next_register++;
+                    int r = alloc_register();
                     long long val = expr->as.literal.i64_val;
                     bytecode_add_instruction(bc, OP_LOAD_CONST, r, (int)val, 0);
                     return r;
                 }
                 case TOKEN_FLOAT: {
-                    int r = next_register++;
-                    double f = expr->as.literal.f64_val;
-                    bytecode_add_instruction(bc, OP_LOAD_CONST_FLOAT, r, 0, 0);
+                    int r = alloc_register();
+                    emit_load_float(bc, r, expr->as.literal.f64_val);
                     return r;
                 }
                 case TOKEN_STRING:
                 case TOKEN_DOCSTRING:
                 case TOKEN_REGEX: {
-                    int r = next_register++;
-                    bytecode_add_instruction(bc, OP_LOAD_CONST_STR, r, (int)(intptr_t)expr->as.literal.str_val, 0);
+                    int r = alloc_register();
+                    int cp_index = bytecode_add_constant_str(bc, expr->as.literal.str_val);
+                    bytecode_add_instruction(bc, OP_LOAD_CONST_STR, r, cp_index, 0);
                     return r;
                 }
                 case TOKEN_BOOL_TRUE: {
-                    int r = next_register++;
-                    bytecode_add_instruction(bc, OP_LOAD_CONST, r, 1, 0);
+                    int r = alloc_register();
+                    bytecode_add_instruction(bc, OP_LOAD_BOOL, r, 1, 0);
                     return r;
                 }
                 case TOKEN_BOOL_FALSE: {
-                    int r = next_register++;
-                    bytecode_add_instruction(bc, OP_LOAD_CONST, r, 0, 0);
+                    int r = alloc_register();
+                    bytecode_add_instruction(bc, OP_LOAD_BOOL, r, 0, 0);
                     return r;
                 }
                 default:
@@ -282,9 +1145,18 @@ static int compile_expression(AstNode* expr, Bytecode* bc) {
             }
         } break;
         case AST_EXPR_BINARY: {
+            if (is_assignment(expr)) {
+                return compile_assignment(expr, bc);
+            }
+            if (expr->as.binary.op == TOKEN_AND || expr->as.binary.op == TOKEN_OR) {
+                return compile_logical(expr, bc);
+            }
+            // The operands' registers are free once the result is computed.
+            int mark = next_register;
             int left_reg = compile_expression(expr->as.binary.left, bc);
             int right_reg = compile_expression(expr->as.binary.right, bc);
-            int dest_reg = next_register++;
+            next_register = mark;
+            int dest_reg = alloc_register();
             switch (expr->as.binary.op) {
                 case TOKEN_PLUS:
                     bytecode_add_instruction(bc, OP_ADD, dest_reg, left_reg, right_reg);
@@ -298,16 +1170,27 @@ static int compile_expression(AstNode* expr, Bytecode* bc) {
                 case TOKEN_SLASH:
                     bytecode_add_instruction(bc, OP_DIV, dest_reg, left_reg, right_reg);
                     return dest_reg;
-                case TOKEN_EQ: {
-                    // New case: equality comparison
-                    bytecode_add_instruction(bc, OP_EQ, dest_reg, left_reg, right_reg);
+                case TOKEN_PERCENT:
+                    bytecode_add_instruction(bc, OP_MOD, dest_reg, left_reg, right_reg);
                     return dest_reg;
-                }
-                case TOKEN_NEQ: {
-                    // New case: inequality comparison
-                    bytecode_add_instruction(bc, OP_NEQ, dest_reg, left_reg, right_reg);
+                case TOKEN_BIT_AND:
+                    bytecode_add_instruction(bc, OP_BIT_AND, dest_reg, left_reg, right_reg);
+                    return dest_reg;
+                case TOKEN_BIT_OR:
+                    bytecode_add_instruction(bc, OP_BIT_OR, dest_reg, left_reg, right_reg);
+                    return dest_reg;
+                case TOKEN_BIT_XOR:
+                    bytecode_add_instruction(bc, OP_BIT_XOR, dest_reg, left_reg, right_reg);
+                    return dest_reg;
+                case TOKEN_EQ:
+                case TOKEN_NEQ:
+                case TOKEN_LT:
+                case TOKEN_LTE:
+                case TOKEN_GT:
+                case TOKEN_GTE:
+                    bytecode_add_instruction(bc, comparison_opcode(expr->as.binary.op),
+                                             dest_reg, left_reg, right_reg);
                     return dest_reg;
-                }
                 default:
                     break;
             }
@@ -315,7 +1198,7 @@ static int compile_expression(AstNode* expr, Bytecode* bc) {
         } break;
         case AST_EXPR_UNARY: {
             int operand_reg = compile_expression(expr->as.unary.expr, bc);
-            int dest_reg = next_register++;
+            int dest_reg = alloc_register();
             switch (expr->as.unary.op) {
                 case TOKEN_MINUS:
                     bytecode_add_instruction(bc, OP_LOAD_CONST, dest_reg, 0, 0);
@@ -323,79 +1206,256 @@ static int compile_expression(AstNode* expr, Bytecode* bc) {
                     return dest_reg;
                 case TOKEN_PLUS:
                     return operand_reg;
+                case TOKEN_NOT:
+                    bytecode_add_instruction(bc, OP_NOT, dest_reg, operand_reg, 0);
+                    return dest_reg;
+                case TOKEN_BIT_NOT:
+                    bytecode_add_instruction(bc, OP_BIT_NOT, dest_reg, operand_reg, 0);
+                    return dest_reg;
                 default:
                     return operand_reg;
             }
         } break;
         case AST_EXPR_IDENTIFIER: {
-            const char* id = expr->as.ident.name;
-            Symbol* sym = NULL;
-            if (current_scope != NULL) {
-                sym = scope_lookup(current_scope, id);
-            }
-            if (sym != NULL) {
-                // Found the symbol in the current scope; return its register.
-                return sym->reg;
-            }
-            // Otherwise, fall back on function lookup.
-            int func_addr = lookup_function_address(id);
-            if (func_addr < 0) {
-                fprintf(stderr, "[DEBUG] Identifier '%s' not found in function table or symbol table; returning dummy register.\n", id);
-                return next_register++; // dummy; ideally, you would signal an error.
+            // Variables are read from their frame slot into a fresh register.
+            const AstIdentifierData* id = &expr->as.ident;
+            int r = alloc_register();
+            switch (id->binding) {
+                case IDENT_LOCAL:
+                    if (id->depth == 0) {
+                        bytecode_add_instruction(bc, id->boxed ? OP_LOAD_BOXED : OP_LOAD_LOCAL, r, id->slot, 0);
+                    } else {
+                        compile_error("'%s' belongs to an enclosing function and is not captured", id->name);
+                    }
+                    break;
+                case IDENT_GLOBAL:
+                    bytecode_add_instruction(bc, OP_LOAD_GLOBAL, r, id->slot, 0);
+                    break;
+                case IDENT_UPVALUE:
+                    bytecode_add_instruction(bc, OP_LOAD_UPVALUE, r, id->slot, id->boxed ? 1 : 0);
+                    break;
+                case IDENT_FUNCTION: {
+                    // A function used as a value is a closure that captures nothing.
+                    FunctionEntry* fn = &function_table[id->slot];
+                    if (fn->closure < 0) {
+                        fn->closure = bytecode_add_closure(bc, fn->address, (int)fn->frame_size, NULL, 0);
+                    }
+                    bytecode_add_instruction(bc, OP_CLOSURE, r, fn->closure, 0);
+                } break;
+                default:
+                    compile_error("identifier '%s' is unresolved; was the semantic pass run?", id->name);
+                    break;
             }
-            return func_addr;
+            return r;
         } break;
         case AST_EXPR_CALL: {
             if (expr->as.call.callee->type == AST_EXPR_IDENTIFIER) {
-                const char* func_name = expr->as.call.callee->as.ident.name;
-                int func_addr = lookup_function_address(func_name);
-                if (func_addr < 0) {
-                    // Native call branch (unchanged)
-                    fprintf(stderr, "[DEBUG] Identifier '%s' not found in function table; treating as native.\n", func_name);
-                    for (size_t i = 0; i < expr->as.call.arg_count; i++) {
-                        compile_expression(expr->as.call.args[i], bc);
+                const AstIdentifierData* callee = &expr->as.call.callee->as.ident;
+                const char* func_name = callee->name;
+                if (callee->binding == IDENT_CLASS) {
+                    // Name(...): a new object with a slot per field, set up by the class's constructor.
+                    int object = alloc_register();
+                    bytecode_add_instruction(bc, OP_NEWCLASS, object, callee->slot, 0);
+                    int base = compile_call_args(expr, object, bc);
+                    return emit_call(bc, OP_INVOKE, bytecode_add_constant_str(bc, "init"),
+                                     (int)expr->as.call.arg_count + 1, base);
+                } else if (callee->binding == IDENT_UNRESOLVED) {
+                    // A pure native of constant arguments is computed now.
+                    Value folded;
+                    if (constant_number(expr, &folded) &&
+                        (folded.type == VAL_FLOAT || (folded.as.int_val >= INT32_MIN && folded.as.int_val <= INT32_MAX))) {
+                        int r = alloc_register();
+                        if (folded.type == VAL_INT) {
+                            bytecode_add_instruction(bc, OP_LOAD_CONST, r, (int)folded.as.int_val, 0);
+                        } else {
+                            emit_load_float(bc, r, folded.as.float_val);
+                        }
+                        return r;
                     }
-                    int base_reg = next_register - expr->as.call.arg_count;
-                    int dest_reg = next_register++;
+                    // Native call branch
+                    int base_reg = compile_call_args(expr, -1, bc);
+                    int dest_reg = alloc_register();
                     int native_index = bytecode_add_constant_str(bc, func_name);
                     fprintf(stderr, "[DEBUG] Interned native function '%s' at constant pool index %d.\n", func_name, native_index);
                     bytecode_add_instruction_ex(bc, OP_CALL_NATIVE, dest_reg, native_index, (int)expr->as.call.arg_count, base_reg);
                     return dest_reg;
-                } else {
+                } else if (callee->binding == IDENT_FUNCTION) {
                     // Regular function call.
-                    int arg_count = (int)expr->as.call.arg_count;
-                    int* arg_regs = (int*)malloc(arg_count * sizeof(int));
-                    if (!arg_regs) {
-                        fprintf(stderr, "Failed to allocate memory for function call arguments.\n");
-                        exit(1);
-                    }
-                    // Compile each argument; store its register.
-                    for (int i = 0; i < arg_count; i++) {
-                        arg_regs[i] = compile_expression(expr->as.call.args[i], bc);
-                    }
-                    // Now, move each argument into the callee's expected registers (0, 1, 2, …).
-                    for (int i = 0; i < arg_count; i++) {
-                        bytecode_add_instruction(bc, OP_MOVE, i, arg_regs[i], 0);
-                    }
-                    free(arg_regs);
-                    // Emit the call instruction.
-                    bytecode_add_instruction(bc, OP_CALL, func_addr, 0, 0);
-                    int ret_reg = next_register++;
-                    return ret_reg;
+                    int base = compile_call_args(expr, -1, bc);
+                    const FunctionEntry* fn = &function_table[callee->slot];
+                    return emit_call(bc, OP_CALL, fn->address, (int)fn->frame_size, base);
                 }
-            } else {
+            }
+            if (is_module_member(expr->as.call.callee)) {
+                // name.func(...): the target and frame size are filled in by the linker.
+                const AstMemberData* member = &expr->as.call.callee->as.member_expr;
+                int base = compile_call_args(expr, -1, bc);
+                link_table_add_call(&link_table, (int)bc->instruction_count,
+                                    member->object->as.ident.slot, member->member_symbol);
+                return emit_call(bc, OP_CALL, -1, 0, base);
+            } else if (expr->as.call.callee->type == AST_EXPR_MEMBER) {
+                // obj.method(...): dispatched on the class of the object passed first.
+                const AstMemberData* member = &expr->as.call.callee->as.member_expr;
+                int receiver = compile_expression(member->object, bc);
+                if (receiver < 0) return -1;
+                int base = compile_call_args(expr, receiver, bc);
+                return emit_call(bc, OP_INVOKE, bytecode_add_constant_str(bc, member->member_name),
+                                 (int)expr->as.call.arg_count + 1, base);
+            }
+            // Anything else evaluates to a closure, called through its register.
+            int function = compile_expression(expr->as.call.callee, bc);
+            if (function < 0) {
                 fprintf(stderr, "Unsupported callee type in function call.\n");
                 return -1;
             }
+            int base = compile_call_args(expr, -1, bc);
+            return emit_call(bc, OP_CALL_INDIRECT, function, (int)expr->as.call.arg_count, base);
         } break;
-        case AST_EXPR_INTERPOLATION: {
-            int inner_reg = compile_expression(expr->as.interpolation.expr, bc);
-            bytecode_add_instruction(bc, OP_CALL, lookup_function_address("str"), 0, 0);
-            int ret_reg = next_register++;
-            return ret_reg;
+        case AST_NODE_FUNC_DECL:
+            // A function expression.
+            return compile_closure(expr, bc);
+        case AST_EXPR_MEMBER: {
+            if (expr->as.member_expr.field_slot >= 0) {
+                int r = alloc_register();
+                bytecode_add_instruction(bc, OP_LOAD_LOCAL, r, expr->as.member_expr.field_slot, 0);
+                return r;
+            }
+            int mark = next_register;
+            int object = compile_expression(expr->as.member_expr.object, bc);
+            if (object < 0) return -1;
+            next_register = mark;
+            int r = alloc_register();
+            bytecode_add_instruction(bc, OP_GETFIELD, r, object,
+                                     bytecode_add_constant_str(bc, expr->as.member_expr.member_name));
+            return r;
         } break;
+        case AST_EXPR_INTERPOLATION:
+            return compile_interpolation(expr, bc);
         default:
             break;
     }
     return -1;
 }
+
+/* Parts one OP_CONCAT_N joins; longer interpolations are folded in batches. */
+#define CONCAT_MAX_PARTS 8
+
+static bool is_empty_string_literal(const AstNode* node) {
+    return node->type == AST_EXPR_LITERAL &&
+           node->as.literal.literal_type == TOKEN_STRING &&
+           node->as.literal.str_val && node->as.literal.str_val[0] == '\0';
+}
+
+/**
+ * Compile "a${x}b" into consecutive registers joined by OP_CONCAT_N, so the
+ * result string is allocated once instead of once per part.
+ */
+static int compile_interpolation(AstNode* expr, Bytecode* bc) {
+    const AstInterpolationData* data = &expr->as.interpolation;
+    int base = next_register;
+    int count = 0;
+    for (size_t i = 0; i < data->part_count; i++) {
+        AstNode* part = data->parts[i];
+        if (is_empty_string_literal(part)) continue;
+        if (count == CONCAT_MAX_PARTS) {
+            bytecode_add_instruction(bc, OP_CONCAT_N, base, base, count);
+            count = 1;
+        }
+        next_register = base + count;
+        int r = compile_expression(part, bc);
+        if (r < 0) return -1;
+        if (r != base + count) {
+            bytecode_add_instruction(bc, OP_MOVE, base + count, r, 0);
+        }
+        count++;
+    }
+    bytecode_add_instruction(bc, OP_CONCAT_N, base, base, count);
+    next_register = base + 1;
+    return base;
+}
+
+/**
+ * The value 'target op= value' assigns: the right-hand side, or for a
+ * compound operator its combination with the target's value in 'current_reg'.
+ */
+static int compile_assigned_value(AstNode* expr, int current_reg, Bytecode* bc) {
+    if (expr->as.binary.op == TOKEN_ASSIGN) {
+        return compile_expression(expr->as.binary.right, bc);
+    }
+    VMOpcode op;
+    switch (expr->as.binary.op) {
+        case TOKEN_PLUS_ASSIGN:  op = OP_ADD; break;
+        case TOKEN_MINUS_ASSIGN: op = OP_SUB; break;
+        case TOKEN_STAR_ASSIGN:  op = OP_MUL; break;
+        case TOKEN_SLASH_ASSIGN: op = OP_DIV; break;
+        case TOKEN_MOD_ASSIGN:   op = OP_MOD; break;
+        default:
+            fprintf(stderr, "Unsupported compound assignment operator.\n");
+            return -1;
+    }
+    int rhs_reg = compile_expression(expr->as.binary.right, bc);
+    int value_reg = alloc_register();
+    bytecode_add_instruction(bc, op, value_reg, current_reg, rhs_reg);
+    return value_reg;
+}
+
+/**
+ * Compile 'target op= value' and return the register holding the assigned value.
+ */
+static int compile_assignment(AstNode* expr, Bytecode* bc) {
+    AstNode* target = expr->as.binary.left;
+    if (target->type == AST_EXPR_MEMBER) {
+        return compile_member_assignment(expr, bc);
+    }
+    if (target->type != AST_EXPR_IDENTIFIER) {
+        fprintf(stderr, "Unsupported assignment target.\n");
+        return -1;
+    }
+    const AstIdentifierData* id = &target->as.ident;
+    if (id->binding != IDENT_GLOBAL && id->binding != IDENT_UPVALUE &&
+        !(id->binding == IDENT_LOCAL && id->depth == 0)) {
+        compile_error("assignment to '%s', which is not a variable in reach", id->name);
+        return -1;
+    }
+
+    int current_reg = -1;
+    if (expr->as.binary.op != TOKEN_ASSIGN) {
+        current_reg = compile_expression(target, bc);
+    }
+    int value_reg = compile_assigned_value(expr, current_reg, bc);
+    if (value_reg < 0) return -1;
+
+    emit_store_variable(id, value_reg, bc);
+    return value_reg;
+}
+
+/**
+ * Compile 'obj.field op= value': the value is stored into the object's field,
+ * or into its frame slot if the object was scalar-replaced.
+ */
+static int compile_member_assignment(AstNode* expr, Bytecode* bc) {
+    const AstMemberData* member = &expr->as.binary.left->as.member_expr;
+    if (member->field_slot >= 0) {
+        int current_reg = -1;
+        if (expr->as.binary.op != TOKEN_ASSIGN) {
+            current_reg = alloc_register();
+            bytecode_add_instruction(bc, OP_LOAD_LOCAL, current_reg, member->field_slot, 0);
+        }
+        int value_reg = compile_assigned_value(expr, current_reg, bc);
+        if (value_reg < 0) return -1;
+        bytecode_add_instruction(bc, OP_STORE_LOCAL, member->field_slot, value_reg, 0);
+        return value_reg;
+    }
+    int object = compile_expression(member->object, bc);
+    if (object < 0) return -1;
+    int name = bytecode_add_constant_str(bc, member->member_name);
+    int current_reg = -1;
+    if (expr->as.binary.op != TOKEN_ASSIGN) {
+        current_reg = alloc_register();
+        bytecode_add_instruction(bc, OP_GETFIELD, current_reg, object, name);
+    }
+    int value_reg = compile_assigned_value(expr, current_reg, bc);
+    if (value_reg < 0) return -1;
+    bytecode_add_instruction(bc, OP_SETFIELD, object, name, value_reg);
+    return value_reg;
+}
@@ -3,6 +3,7 @@
 
 #include "../../include/ast.h"   /* Adjust the path as needed */
 #include "bytecode.h"
+#include "module.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,10 +13,27 @@ extern "C" {
  * @brief Compile the given AST node (e.g. a root program node) into Bytecode.
  *
  * @param root The root of the AST (like a program or block)
- * @return Bytecode* A newly allocated Bytecode struct with instructions
+ * @return Bytecode* A newly allocated Bytecode struct with instructions,
+ *         or NULL if the program has compile errors
  */
 Bytecode* compiler_compile_ast(AstNode* root);
 
+/**
+ * @brief Compile an imported file into an unlinked module segment.
+ *
+ * The code ends in an OP_JUMP back to the import site (target -1 until
+ * linked) instead of OP_HALT, and calls into other modules are left in
+ * 'links' for module_link().
+ *
+ * @param root The module's AST, after semantic analysis
+ * @param links Receives the module's own imports and module calls
+ * @param exports Receives the module's functions (malloc'd)
+ * @param export_count Receives the number of exports
+ * @return Bytecode* The module's code, or NULL on failure
+ */
+Bytecode* compiler_compile_module(AstNode* root, LinkTable* links,
+                                  ModuleExport** exports, size_t* export_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,518 @@
+#include "module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "compiler.h"
+#include "../lexer/lexer.h"
+#include "../parser/parser.h"
+#include "../../include/semantic.h"
+
+/* ------------------------------------------------------------------
+ * Link tables
+ * ------------------------------------------------------------------ */
+void link_table_add_import(LinkTable* links, int index, char* path, int site) {
+    if (index < 0) {
+        free(path);
+        return;
+    }
+    if ((size_t)index >= links->import_count) {
+        ModuleImport* imports = (ModuleImport*)realloc(links->imports, ((size_t)index + 1) * sizeof(ModuleImport));
+        if (!imports) {
+            fprintf(stderr, "Out of memory for module imports\n");
+            exit(1);
+        }
+        for (size_t i = links->import_count; i <= (size_t)index; i++) {
+            imports[i].path = NULL;
+            imports[i].site = -1;
+        }
+        links->imports = imports;
+        links->import_count = (size_t)index + 1;
+    }
+    free(links->imports[index].path);
+    links->imports[index].path = path;
+    links->imports[index].site = site;
+}
+
+void link_table_add_call(LinkTable* links, int site, int import_index, SymbolId symbol) {
+    ModuleCall* calls = (ModuleCall*)realloc(links->calls, (links->call_count + 1) * sizeof(ModuleCall));
+    if (!calls) {
+        fprintf(stderr, "Out of memory for module calls\n");
+        exit(1);
+    }
+    calls[links->call_count].site = site;
+    calls[links->call_count].import_index = import_index;
+    calls[links->call_count].symbol = symbol;
+    links->calls = calls;
+    links->call_count++;
+}
+
+void link_table_free(LinkTable* links) {
+    for (size_t i = 0; i < links->import_count; i++) {
+        free(links->imports[i].path);
+    }
+    free(links->imports);
+    free(links->calls);
+    links->imports = NULL;
+    links->calls = NULL;
+    links->import_count = links->call_count = 0;
+}
+
+/* ------------------------------------------------------------------
+ * The module cache
+ * ------------------------------------------------------------------ */
+static Module* module_cache = NULL;
+
+static void module_release_code(Module* module) {
+    bytecode_destroy(module->code);
+    free(module->exports);
+    link_table_free(&module->links);
+    module->code = NULL;
+    module->exports = NULL;
+    module->export_count = 0;
+}
+
+void module_cache_clear(void) {
+    while (module_cache) {
+        Module* next = module_cache->next;
+        module_release_code(module_cache);
+        free(module_cache->path);
+        free(module_cache);
+        module_cache = next;
+    }
+}
+
+static uint64_t hash_source(const char* source, size_t length) {
+    uint64_t hash = 14695981039346656037ull;  /* FNV-1a */
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)source[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static char* read_source(const char* path, size_t* length) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* source = size >= 0 ? (char*)malloc((size_t)size + 1) : NULL;
+    if (!source) {
+        fclose(fp);
+        return NULL;
+    }
+    *length = fread(source, 1, (size_t)size, fp);
+    source[*length] = '\0';
+    fclose(fp);
+    return source;
+}
+
+/* Run the front end over 'source' and compile it into 'module'. */
+static bool module_compile(Module* module, const char* source, size_t length) {
+    LexerConfig lex_cfg = lexer_default_config();
+    lex_cfg.file_name = module->path;  /* outlives the tokens and the AST */
+    Lexer* lexer = lexer_create(source, length, lex_cfg);
+    if (!lexer) return false;
+
+    size_t token_count = 0;
+    size_t tokens_capacity = 1024;
+    Token* tokens = (Token*)malloc(tokens_capacity * sizeof(Token));
+    while (tokens) {
+        if (token_count == tokens_capacity) {
+            tokens_capacity *= 2;
+            Token* grown = (Token*)realloc(tokens, tokens_capacity * sizeof(Token));
+            if (!grown) {
+                free(tokens);
+                tokens = NULL;
+                break;
+            }
+            tokens = grown;
+        }
+        Token t = lexer_next_token(lexer);
+        tokens[token_count++] = t;
+        if (t.type == TOKEN_EOF || t.type == TOKEN_ERROR) break;
+    }
+    LexerError lex_error = lexer_get_error(lexer);
+    lexer_destroy(lexer);
+    if (!tokens || lex_error.type != LEXER_ERROR_NONE) {
+        if (tokens) {
+            fprintf(stderr, "Module '%s': %s\n", module->path, lex_error.message);
+        }
+        free(tokens);
+        return false;
+    }
+
+    Parser* parser = parser_create(tokens, token_count);
+    AstNode* root = parser ? parser_parse(parser) : NULL;
+    parser_destroy(parser);
+    free(tokens);
+
+    SemanticContext sem_ctx;
+    semantic_init(&sem_ctx);
+    semantic_analyze(root, &sem_ctx);
+    int errors = sem_ctx.error_count + sem_ctx.import_error_count;
+    semantic_cleanup(&sem_ctx);
+    if (errors > 0) {
+        ast_destroy(root);
+        return false;
+    }
+
+    module->code = compiler_compile_module(root, &module->links, &module->exports, &module->export_count);
+    ast_destroy(root);
+    return module->code != NULL;
+}
+
+Module* module_load(const char* path) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) {
+        fprintf(stderr, "Cannot open module '%s'\n", path ? path : "(null)");
+        return NULL;
+    }
+    Module* module = module_cache;
+    while (module && strcmp(module->path, path) != 0) {
+        module = module->next;
+    }
+    if (module && module->code && module->mtime == st.st_mtime && module->size == (size_t)st.st_size) {
+        return module;
+    }
+
+    size_t length = 0;
+    char* source = read_source(path, &length);
+    if (!source) {
+        fprintf(stderr, "Cannot read module '%s'\n", path);
+        return NULL;
+    }
+    uint64_t hash = hash_source(source, length);
+    if (module && module->code && module->source_hash == hash) {
+        // Touched but not changed.
+        module->mtime = st.st_mtime;
+        module->size = length;
+        free(source);
+        return module;
+    }
+
+    if (!module) {
+        module = (Module*)calloc(1, sizeof(Module));
+        char* copy = module ? (char*)malloc(strlen(path) + 1) : NULL;
+        if (!copy) {
+            fprintf(stderr, "Out of memory for module '%s'\n", path);
+            free(module);
+            free(source);
+            return NULL;
+        }
+        strcpy(copy, path);
+        module->path = copy;
+        module->next = module_cache;
+        module_cache = module;
+    } else {
+        module_release_code(module);
+    }
+    module->mtime = st.st_mtime;
+    module->size = length;
+    module->source_hash = hash;
+    bool ok = module_compile(module, source, length);
+    free(source);
+    if (!ok) {
+        fprintf(stderr, "Failed to compile module '%s'\n", path);
+        module_release_code(module);
+        return NULL;
+    }
+    return module;
+}
+
+char* module_resolve_path(const char* importer, const char* path) {
+    size_t dir_length = 0;
+    bool absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+    if (importer && !absolute) {
+        for (const char* c = importer; *c; c++) {
+            if (*c == '/' || *c == '\\') dir_length = (size_t)(c - importer) + 1;
+        }
+    }
+    size_t path_length = strlen(path);
+    char* resolved = (char*)malloc(dir_length + path_length + 1);
+    if (!resolved) {
+        fprintf(stderr, "Out of memory resolving module path\n");
+        exit(1);
+    }
+    memcpy(resolved, importer, dir_length);
+    memcpy(resolved + dir_length, path, path_length + 1);
+    return resolved;
+}
+
+/* ------------------------------------------------------------------
+ * Linking
+ * ------------------------------------------------------------------ */
+
+/* A module copied into the program being linked. */
+typedef struct {
+    Module* module;
+    int code_base;
+    size_t code_length;
+    bool initialized;   /* an import site runs its initializer */
+} LinkedModule;
+
+typedef struct {
+    Bytecode* program;
+    LinkedModule* linked;
+    size_t linked_count;
+} Linker;
+
+/* Code outside every function body is the initializer, run in the top-level frame. */
+static bool* initializer_mask(const Module* module) {
+    size_t count = module->code->instruction_count;
+    bool* init = (bool*)malloc(count > 0 ? count : 1);
+    if (!init) {
+        fprintf(stderr, "Out of memory linking module '%s'\n", module->path);
+        exit(1);
+    }
+    memset(init, 1, count);
+    for (size_t i = 0; i < module->export_count; i++) {
+        for (int pc = module->exports[i].address; pc < module->exports[i].end; pc++) {
+            init[pc] = false;
+        }
+    }
+    // Methods, including made-up constructors, which are not exported.
+    const Bytecode* code = module->code;
+    for (size_t c = 0; c < code->class_count; c++) {
+        for (size_t m = 0; m < code->classes[c].method_count; m++) {
+            int address = code->classes[c].methods[m].address;
+            for (int pc = address; pc < code->instructions[address - 1].operand1; pc++) {
+                init[pc] = false;
+            }
+        }
+    }
+    // Closures: nested functions and function expressions.
+    for (size_t c = 0; c < code->closure_count; c++) {
+        int address = code->closures[c].address;
+        for (int pc = address; pc < code->instructions[address - 1].operand1; pc++) {
+            init[pc] = false;
+        }
+    }
+    return init;
+}
+
+/**
+ * Append a copy of 'module' to the program, moving its code, switch tables,
+ * classes, closures and handlers to 'code_base', its strings into the program's
+ * constant pool and its top-level slots after the program's own.
+ */
+static void relocate_module(Bytecode* program, const Module* module, int code_base) {
+    const Bytecode* code = module->code;
+    int global_base = (int)program->top_level_slots;
+    int table_base = (int)program->switch_table_count;
+    int class_base = (int)program->class_count;
+    int closure_base = (int)program->closure_count;
+
+    int* strings = (int*)malloc((code->constant_pool.count > 0 ? code->constant_pool.count : 1) * sizeof(int));
+    if (!strings) {
+        fprintf(stderr, "Out of memory linking module '%s'\n", module->path);
+        exit(1);
+    }
+    for (size_t i = 0; i < code->constant_pool.count; i++) {
+        strings[i] = bytecode_add_constant_str(program, code->constant_pool.strings[i]);
+    }
+
+    for (size_t t = 0; t < code->switch_table_count; t++) {
+        const SwitchTable* table = &code->switch_tables[t];
+        SwitchEntry* entries = (SwitchEntry*)malloc((table->count > 0 ? table->count : 1) * sizeof(SwitchEntry));
+        if (!entries) {
+            fprintf(stderr, "Out of memory linking module '%s'\n", module->path);
+            exit(1);
+        }
+        for (size_t i = 0; i < table->count; i++) {
+            entries[i] = table->entries[i];
+            if (entries[i].target >= 0) entries[i].target += code_base;
+            if (entries[i].str_index >= 0) entries[i].str_index = strings[entries[i].str_index];
+        }
+        bytecode_add_switch_table(program, table->low, entries, table->count);
+        free(entries);
+    }
+
+    for (size_t c = 0; c < code->class_count; c++) {
+        const ClassInfo* cls = &code->classes[c];
+        int* fields = (int*)malloc((cls->field_count > 0 ? cls->field_count : 1) * sizeof(int));
+        ClassMethod* methods = (ClassMethod*)malloc((cls->method_count > 0 ? cls->method_count : 1) * sizeof(ClassMethod));
+        if (!fields || !methods) {
+            fprintf(stderr, "Out of memory linking module '%s'\n", module->path);
+            exit(1);
+        }
+        for (size_t i = 0; i < cls->field_count; i++) {
+            fields[i] = strings[cls->fields[i]];
+        }
+        for (size_t i = 0; i < cls->method_count; i++) {
+            methods[i] = cls->methods[i];
+            methods[i].name = strings[methods[i].name];
+            methods[i].address += code_base;
+        }
+        bytecode_add_class(program, strings[cls->name], fields, cls->field_count, methods, cls->method_count);
+        free(fields);
+        free(methods);
+    }
+
+    for (size_t c = 0; c < code->closure_count; c++) {
+        const ClosureInfo* info = &code->closures[c];
+        bytecode_add_closure(program, info->address + code_base, info->frame_size,
+                             info->captures, info->capture_count);
+    }
+
+    bool* init = initializer_mask(module);
+    for (size_t pc = 0; pc < code->instruction_count; pc++) {
+        Instruction inst = code->instructions[pc];
+        switch (inst.opcode) {
+            case OP_JUMP:
+            case OP_JUMP_IF_ZERO:
+            case OP_JUMP_IF_NONZERO:
+            case OP_JUMP_IF_EQ:
+            case OP_JUMP_IF_NE:
+            case OP_JUMP_IF_LT:
+            case OP_JUMP_IF_LE:
+            case OP_JUMP_IF_GT:
+            case OP_JUMP_IF_GE:
+            case OP_CALL:
+                // -1 marks a target filled in by the linker.
+                if (inst.operand1 >= 0) inst.operand1 += code_base;
+                break;
+            case OP_TABLESWITCH:
+            case OP_LOOKUPSWITCH:
+                inst.operand1 += code_base;
+                inst.operand3 += table_base;
+                break;
+            case OP_LOAD_CONST_STR:
+            case OP_CALL_NATIVE:
+            case OP_SETFIELD:
+                inst.operand2 = strings[inst.operand2];
+                break;
+            case OP_GETFIELD:
+                inst.operand3 = strings[inst.operand3];
+                break;
+            case OP_INVOKE:
+                inst.operand1 = strings[inst.operand1];
+                break;
+            case OP_NEWCLASS:
+                inst.operand2 += class_base;
+                break;
+            case OP_CLOSURE:
+                inst.operand2 += closure_base;
+                break;
+            case OP_LOAD_GLOBAL:
+                inst.operand2 += global_base;
+                break;
+            case OP_STORE_GLOBAL:
+                inst.operand1 += global_base;
+                break;
+            case OP_LOAD_LOCAL:
+                if (init[pc]) inst.operand2 += global_base;
+                break;
+            case OP_STORE_LOCAL:
+            case OP_STORE_LOCAL_CONST:
+                if (init[pc]) inst.operand1 += global_base;
+                break;
+            case OP_MOVE_LOCAL:
+                if (init[pc]) {
+                    inst.operand1 += global_base;
+                    inst.operand2 += global_base;
+                }
+                break;
+            default:
+                break;
+        }
+        bytecode_add_instruction_ex(program, inst.opcode, inst.operand1, inst.operand2,
+                                    inst.operand3, inst.operand4);
+    }
+    free(init);
+    free(strings);
+
+    for (size_t i = 0; i < code->handler_count; i++) {
+        const HandlerEntry* h = &code->handlers[i];
+        bytecode_add_handler(program, h->start + code_base, h->end + code_base, h->handler + code_base);
+    }
+    program->top_level_slots += code->top_level_slots;
+}
+
+static bool link_unit(Linker* linker, const LinkTable* links, int code_base);
+
+/* The copy of the module at 'path' in the program, linking it on first use. */
+static LinkedModule* link_module(Linker* linker, const char* path) {
+    for (size_t i = 0; i < linker->linked_count; i++) {
+        if (strcmp(linker->linked[i].module->path, path) == 0) {
+            return &linker->linked[i];
+        }
+    }
+    Module* module = module_load(path);
+    if (!module) return NULL;
+
+    LinkedModule* linked = (LinkedModule*)realloc(linker->linked, (linker->linked_count + 1) * sizeof(LinkedModule));
+    if (!linked) {
+        fprintf(stderr, "Out of memory linking module '%s'\n", path);
+        exit(1);
+    }
+    linker->linked = linked;
+    size_t index = linker->linked_count++;
+    linked[index].module = module;
+    linked[index].code_base = (int)linker->program->instruction_count;
+    linked[index].code_length = module->code->instruction_count;
+    linked[index].initialized = false;
+    relocate_module(linker->program, module, linked[index].code_base);
+    return &linker->linked[index];
+}
+
+/**
+ * Resolve the calls of one unit (the program, or a module at 'code_base').
+ * A module's initializer runs from the first import site that links it, and
+ * the modules it calls into are linked before returning, so initializers run
+ * in dependency order.
+ */
+static bool link_unit(Linker* linker, const LinkTable* links, int code_base) {
+    for (size_t c = 0; c < links->call_count; c++) {
+        const ModuleCall* call = &links->calls[c];
+        const ModuleImport* import = (size_t)call->import_index < links->import_count
+                                   ? &links->imports[call->import_index] : NULL;
+        if (!import || !import->path) {
+            fprintf(stderr, "Link error: call to '%s' through an import that was not compiled\n",
+                    intern_text(call->symbol));
+            return false;
+        }
+        LinkedModule* target = link_module(linker, import->path);
+        if (!target) return false;
+        size_t target_index = (size_t)(target - linker->linked);
+
+        if (!target->initialized) {
+            target->initialized = true;
+            Instruction* site = &linker->program->instructions[code_base + import->site];
+            site->opcode = OP_JUMP;
+            site->operand1 = target->code_base;
+            Instruction* back = &linker->program->instructions[target->code_base + target->code_length - 1];
+            back->operand1 = code_base + import->site + 1;
+            int target_base = target->code_base;
+            if (!link_unit(linker, &target->module->links, target_base)) return false;
+            target = &linker->linked[target_index];  /* linking may have moved the array */
+        }
+
+        const Module* module = target->module;
+        const ModuleExport* exported = NULL;
+        for (size_t e = 0; e < module->export_count; e++) {
+            if (module->exports[e].symbol == call->symbol) {
+                exported = &module->exports[e];
+                break;
+            }
+        }
+        if (!exported) {
+            fprintf(stderr, "Link error: module '%s' has no function '%s'\n",
+                    module->path, intern_text(call->symbol));
+            return false;
+        }
+        Instruction* inst = &linker->program->instructions[code_base + call->site];
+        inst->operand1 = target->code_base + exported->address;
+        inst->operand2 = (int)exported->frame_size;
+    }
+    return true;
+}
+
+bool module_link(Bytecode* program, const LinkTable* links) {
+    if (!links || links->call_count == 0) return true;
+    Linker linker = { program, NULL, 0 };
+    bool ok = link_unit(&linker, links, 0);
+    free(linker.linked);
+    return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../../include/intern.h"
+#include "bytecode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Modules: import "dir/name.osfl"; makes the functions of another file
+ * callable as name.func(...).
+ *
+ * Each imported file is compiled once per process into a Bytecode segment of
+ * its own and kept in a cache keyed by path, revalidated by modification time
+ * and size (and by content hash when those changed). The VM runs a single
+ * instruction stream, so linking copies a cached segment into the importing
+ * program, relocating its jumps, calls, constants and top-level slots, and
+ * resolves calls by symbol against the module's exported functions.
+ *
+ * Loading is lazy: a module is only read and compiled when the program (or a
+ * module it links) actually calls into it.
+ */
+
+/* An import statement: 'site' is the OP_NOP that runs the module's initializer. */
+typedef struct {
+    char* path;     /* resolved path, or NULL for an unused import number */
+    int site;
+} ModuleImport;
+
+/* A call name.func(...): 'site' is an OP_CALL whose target is filled in at link time. */
+typedef struct {
+    int site;
+    int import_index;
+    SymbolId symbol;
+} ModuleCall;
+
+/* What a compiled unit needs from other modules, indexed by import number. */
+typedef struct {
+    ModuleImport* imports;
+    size_t import_count;
+    ModuleCall* calls;
+    size_t call_count;
+} LinkTable;
+
+void link_table_add_import(LinkTable* links, int index, char* path, int site);
+void link_table_add_call(LinkTable* links, int site, int import_index, SymbolId symbol);
+void link_table_free(LinkTable* links);
+
+/* A function a module defines: code [address, end) in the module's segment. */
+typedef struct {
+    SymbolId symbol;
+    int address;
+    int end;
+    size_t frame_size;
+} ModuleExport;
+
+typedef struct Module {
+    char* path;
+    time_t mtime;
+    size_t size;
+    uint64_t source_hash;
+    /*
+     * Unoptimized code: the module's top-level statements (its initializer,
+     * with function bodies stepped over) followed by an OP_JUMP back to the
+     * import site, whose target is set when it is linked.
+     */
+    Bytecode* code;
+    ModuleExport* exports;
+    size_t export_count;
+    LinkTable links;
+    struct Module* next;
+} Module;
+
+/**
+ * Return the compiled module for the file at 'path', compiling it only if it
+ * is not cached or the file changed since. The module stays owned by the
+ * cache until module_cache_clear(). Returns NULL if it cannot be compiled.
+ */
+Module* module_load(const char* path);
+
+/**
+ * Resolve an import path relative to the directory of the importing file.
+ * Returns a malloc'd string.
+ */
+char* module_resolve_path(const char* importer, const char* path);
+
+/**
+ * Append every module 'program' calls into (and the modules those call into)
+ * to 'program' and patch the calls and import sites in 'links'.
+ * Returns false, after reporting why, if a module or function is missing.
+ */
+bool module_link(Bytecode* program, const LinkTable* links);
+
+void module_cache_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MODULE_H */
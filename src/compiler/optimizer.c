@@ -0,0 +1,947 @@
+#include "optimizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/vm_common.h"
+
+/* Upper bound on jump-chain length followed while threading (guards against cycles). */
+#define MAX_THREAD_STEPS 32
+
+/* Each level of loop nesting is assumed to execute this many times more often. */
+#define LOOP_WEIGHT_FACTOR 8.0
+#define MAX_LOOP_DEPTH 8
+
+/* Profile-guided inlining: calls executed at least this often, into straight-line
+   bodies of at most this many instructions (excluding the OP_RET). */
+#define INLINE_MIN_CALLS 64
+#define INLINE_MAX_BODY 8
+
+/* The VM's register file. */
+#define NUM_REGISTERS 16
+
+/* The bit of register 'r' in a register set; none for an invalid index. */
+#define REG_BIT(r) (((r) >= 0 && (r) < NUM_REGISTERS) ? (1u << (r)) : 0u)
+
+/*
+    A basic block inside the flat instruction array: [start, end).
+*/
+typedef struct {
+    size_t start;
+    size_t end;
+    int fallthrough;    /* block entered when control falls off the end, or -1 */
+    int taken;          /* block targeted by the terminating branch, or -1 */
+    int loop_depth;
+    double weight;
+    double taken_weight;    /* estimated traversals of the taken edge */
+    double fall_weight;     /* estimated traversals of the fallthrough edge */
+    bool reachable;
+    bool placed;
+} BasicBlock;
+
+/* Branches that test one register (operand2). */
+static bool is_register_test(VMOpcode op) {
+    return op == OP_JUMP_IF_ZERO || op == OP_JUMP_IF_NONZERO;
+}
+
+/* Fused compare-and-branch: jumps if operand2 <cmp> operand3 holds. */
+static bool is_compare_branch(VMOpcode op) {
+    return op >= OP_JUMP_IF_EQ && op <= OP_JUMP_IF_GE;
+}
+
+static bool is_conditional_branch(VMOpcode op) {
+    return is_register_test(op) || is_compare_branch(op);
+}
+
+static bool is_branch(VMOpcode op) {
+    return op == OP_JUMP || is_conditional_branch(op);
+}
+
+/* Multi-way branches: operand1 is the default target, the rest are in a switch table. */
+static bool is_switch(VMOpcode op) {
+    return op == OP_TABLESWITCH || op == OP_LOOKUPSWITCH;
+}
+
+static SwitchTable* switch_table_of(const Bytecode* bc, const Instruction* inst) {
+    if (!is_switch(inst->opcode) || inst->operand3 < 0 ||
+        (size_t)inst->operand3 >= bc->switch_table_count) {
+        return NULL;
+    }
+    return &bc->switch_tables[inst->operand3];
+}
+
+/* Set 'marks' for every in-range case target of the switch 'inst'. */
+static void mark_switch_targets(const Bytecode* bc, const Instruction* inst, bool* marks) {
+    const SwitchTable* table = switch_table_of(bc, inst);
+    if (!table) return;
+    for (size_t e = 0; e < table->count; e++) {
+        int target = table->entries[e].target;
+        if (target >= 0 && (size_t)target < bc->instruction_count) marks[target] = true;
+    }
+}
+
+/* Set 'marks' for every handler entry point; they are reached only when an error is raised. */
+static void mark_handler_targets(const Bytecode* bc, bool* marks) {
+    for (size_t h = 0; h < bc->handler_count; h++) {
+        int target = bc->handlers[h].handler;
+        if (target >= 0 && (size_t)target < bc->instruction_count) marks[target] = true;
+    }
+}
+
+/*
+ * Set 'marks' for every method and closure entry point; they are reached
+ * only through OP_INVOKE and OP_CALL_INDIRECT.
+ */
+static void mark_method_targets(const Bytecode* bc, bool* marks) {
+    for (size_t c = 0; c < bc->class_count; c++) {
+        for (size_t m = 0; m < bc->classes[c].method_count; m++) {
+            int target = bc->classes[c].methods[m].address;
+            if (target >= 0 && (size_t)target < bc->instruction_count) marks[target] = true;
+        }
+    }
+    for (size_t c = 0; c < bc->closure_count; c++) {
+        int target = bc->closures[c].address;
+        if (target >= 0 && (size_t)target < bc->instruction_count) marks[target] = true;
+    }
+}
+
+static bool is_terminator(VMOpcode op) {
+    return op == OP_RET || op == OP_HALT;
+}
+
+static bool falls_through(VMOpcode op) {
+    return op != OP_JUMP && !is_switch(op) && !is_terminator(op);
+}
+
+/*
+    Make conditional branch 'inst' jump exactly when it used to fall through.
+    Compare-and-branch forms carry their sense in operand4, since an ordered
+    comparison has no opposite comparison once NaN is involved.
+*/
+static void invert_condition(Instruction* inst) {
+    if (is_compare_branch(inst->opcode)) {
+        inst->operand4 = !inst->operand4;
+    } else {
+        inst->opcode = (inst->opcode == OP_JUMP_IF_ZERO) ? OP_JUMP_IF_NONZERO : OP_JUMP_IF_ZERO;
+    }
+}
+
+/**
+ * Follow a chain of unconditional jumps starting at 'target' and return its end.
+ */
+static size_t final_target(const Bytecode* bc, size_t target) {
+    for (int steps = 0; steps < MAX_THREAD_STEPS; steps++) {
+        if (target >= bc->instruction_count) break;
+        const Instruction* next = &bc->instructions[target];
+        if (next->opcode != OP_JUMP || (size_t)next->operand1 == target) break;
+        target = (size_t)next->operand1;
+    }
+    return target;
+}
+
+/**
+ * Execution count recorded for the instruction at 'pc', or 0 without a profile.
+ */
+static double profile_count(const Bytecode* bc, const Profile* profile, size_t pc) {
+    const ProfileEntry* entry = profile_entry(profile, bytecode_origin(bc, pc));
+    return entry ? (double)entry->exec_count : 0.0;
+}
+
+/**
+ * Length of the callee body if the OP_CALL at 'pc' is worth inlining, else 0.
+ * Only hot calls into short straight-line bodies ending in OP_RET qualify.
+ * The body may read and write globals but not its own frame: parameters and
+ * locals would need slots in the caller's frame, whose size is fixed by every
+ * call site, closure and method that enters the caller. So a function with a
+ * parameter or a local, which starts by storing it, is never inlined.
+ * Neither is a call that keeps registers of the caller, which the body would
+ * overwrite, nor one whose result is used when the body returns nothing.
+ */
+static size_t inline_body_length(const Bytecode* bc, const Profile* profile, size_t pc) {
+    const Instruction* call = &bc->instructions[pc];
+    if (!profile || call->opcode != OP_CALL || call->operand4 != 0) return 0;
+    if (profile_count(bc, profile, pc) < INLINE_MIN_CALLS) return 0;
+    size_t start = (size_t)call->operand1;
+    for (size_t i = start; i < bc->instruction_count && i <= start + INLINE_MAX_BODY; i++) {
+        switch (bc->instructions[i].opcode) {
+            case OP_RET:
+                if (bc->instructions[i].operand1 < 0 && call->operand3 >= 0) return 0;
+                return i - start + 1;
+            case OP_NOP:
+            case OP_LOAD_CONST:
+            case OP_LOAD_CONST_FLOAT:
+            case OP_LOAD_CONST_STR:
+            case OP_LOAD_BOOL:
+            case OP_LOAD_GLOBAL:
+            case OP_STORE_GLOBAL:
+            case OP_MOVE:
+            case OP_MOVE_OWN:
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+            case OP_BIT_AND:
+            case OP_BIT_OR:
+            case OP_BIT_XOR:
+            case OP_BIT_NOT:
+            case OP_NOT:
+            case OP_EQ:
+            case OP_NEQ:
+            case OP_LT:
+            case OP_LE:
+            case OP_GT:
+            case OP_GE:
+            case OP_CONCAT_N:
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 0;
+}
+
+void optimizer_thread_jumps(Bytecode* bc) {
+    if (!bc) return;
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        Instruction* inst = &bc->instructions[i];
+        SwitchTable* table = switch_table_of(bc, inst);
+        if (table) {
+            inst->operand1 = (int)final_target(bc, (size_t)inst->operand1);
+            for (size_t e = 0; e < table->count; e++) {
+                if (table->entries[e].target >= 0) {
+                    table->entries[e].target = (int)final_target(bc, (size_t)table->entries[e].target);
+                }
+            }
+            continue;
+        }
+        if (!is_branch(inst->opcode)) continue;
+
+        size_t target = final_target(bc, (size_t)inst->operand1);
+
+        // A conditional branch landing on a test of the same register already
+        // knows the outcome of that test.
+        if (is_register_test(inst->opcode)) {
+            for (int steps = 0; steps < MAX_THREAD_STEPS && target < bc->instruction_count; steps++) {
+                const Instruction* next = &bc->instructions[target];
+                if (!is_register_test(next->opcode) || next->operand2 != inst->operand2) break;
+                size_t resolved = (next->opcode == inst->opcode) ? (size_t)next->operand1 : target + 1;
+                if (resolved == target) break;
+                target = final_target(bc, resolved);
+            }
+        }
+        inst->operand1 = (int)target;
+
+        // Jumping to a return/halt is the same as returning/halting here.
+        if (inst->opcode == OP_JUMP && target < bc->instruction_count &&
+            is_terminator(bc->instructions[target].opcode)) {
+            *inst = bc->instructions[target];
+        }
+    }
+}
+
+/**
+ * Peephole: "JZ r, L1; JUMP L2; L1:" becomes "JNZ r, L2; L1:".
+ * The skipped jump is turned into a NOP and dropped by the layout pass.
+ */
+static void invert_branches_over_jumps(Bytecode* bc) {
+    size_t count = bc->instruction_count;
+    if (count < 2) return;
+
+    bool* is_target = (bool*)calloc(count + 1, sizeof(bool));
+    if (!is_target) return;
+    for (size_t i = 0; i < count; i++) {
+        const Instruction* inst = &bc->instructions[i];
+        if ((is_branch(inst->opcode) || is_switch(inst->opcode) || inst->opcode == OP_CALL) &&
+            inst->operand1 >= 0 && (size_t)inst->operand1 <= count) {
+            is_target[inst->operand1] = true;
+        }
+        mark_switch_targets(bc, inst, is_target);
+    }
+    mark_handler_targets(bc, is_target);
+    mark_method_targets(bc, is_target);
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        Instruction* cond = &bc->instructions[i];
+        Instruction* jump = &bc->instructions[i + 1];
+        if (!is_conditional_branch(cond->opcode) || jump->opcode != OP_JUMP) continue;
+        if ((size_t)cond->operand1 != i + 2 || is_target[i + 1]) continue;
+        invert_condition(cond);
+        cond->operand1 = jump->operand1;
+        jump->opcode = OP_NOP;
+    }
+    free(is_target);
+}
+
+/**
+ * Split the instruction stream into basic blocks and fill in successor edges.
+ * 'block_of' receives the block index for each leader PC.
+ */
+static BasicBlock* build_blocks(const Bytecode* bc, int* block_of, size_t* out_count) {
+    size_t count = bc->instruction_count;
+    bool* leader = (bool*)calloc(count + 1, sizeof(bool));
+    if (!leader) return NULL;
+    leader[0] = true;
+    for (size_t i = 0; i < count; i++) {
+        const Instruction* inst = &bc->instructions[i];
+        if (is_branch(inst->opcode) || is_switch(inst->opcode) || inst->opcode == OP_CALL) {
+            if (inst->operand1 >= 0 && (size_t)inst->operand1 < count) {
+                leader[inst->operand1] = true;
+            }
+        }
+        mark_switch_targets(bc, inst, leader);
+        if (is_branch(inst->opcode) || is_switch(inst->opcode) || is_terminator(inst->opcode)) {
+            leader[i + 1] = true;
+        }
+    }
+    mark_handler_targets(bc, leader);
+    mark_method_targets(bc, leader);
+
+    size_t block_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (leader[i]) block_count++;
+    }
+    BasicBlock* blocks = (BasicBlock*)calloc(block_count, sizeof(BasicBlock));
+    if (!blocks) {
+        free(leader);
+        return NULL;
+    }
+
+    size_t b = 0;
+    for (size_t i = 0; i < count; i++) {
+        block_of[i] = -1;
+        if (leader[i]) {
+            if (b > 0) blocks[b - 1].end = i;
+            blocks[b].start = i;
+            block_of[i] = (int)b;
+            b++;
+        }
+    }
+    blocks[block_count - 1].end = count;
+    free(leader);
+
+    for (size_t i = 0; i < block_count; i++) {
+        const Instruction* last = &bc->instructions[blocks[i].end - 1];
+        blocks[i].fallthrough = -1;
+        blocks[i].taken = -1;
+        if (falls_through(last->opcode) && blocks[i].end < count) {
+            blocks[i].fallthrough = block_of[blocks[i].end];
+        }
+        if (is_branch(last->opcode) && last->operand1 >= 0 && (size_t)last->operand1 < count) {
+            blocks[i].taken = block_of[last->operand1];
+        }
+    }
+    *out_count = block_count;
+    return blocks;
+}
+
+/**
+ * Mark blocks reachable from the entry point, from any method of a class,
+ * closure or error handler, from the cases of any reachable switch, or from
+ * any reachable OP_CALL that is not going to be inlined.
+ */
+static void mark_reachable(const Bytecode* bc, const Profile* profile, BasicBlock* blocks,
+                           size_t block_count, const int* block_of) {
+    int* worklist = (int*)malloc(block_count * sizeof(int));
+    if (!worklist) return;
+    size_t top = 0;
+    blocks[0].reachable = true;
+    worklist[top++] = 0;
+    for (size_t c = 0; c < bc->class_count; c++) {
+        for (size_t m = 0; m < bc->classes[c].method_count; m++) {
+            int method = block_of[bc->classes[c].methods[m].address];
+            if (method >= 0 && !blocks[method].reachable) {
+                blocks[method].reachable = true;
+                worklist[top++] = method;
+            }
+        }
+    }
+    for (size_t c = 0; c < bc->closure_count; c++) {
+        int closure = block_of[bc->closures[c].address];
+        if (closure >= 0 && !blocks[closure].reachable) {
+            blocks[closure].reachable = true;
+            worklist[top++] = closure;
+        }
+    }
+    for (size_t h = 0; h < bc->handler_count; h++) {
+        int handler = block_of[bc->handlers[h].handler];
+        if (handler >= 0 && !blocks[handler].reachable) {
+            blocks[handler].reachable = true;
+            worklist[top++] = handler;
+        }
+    }
+    while (top > 0) {
+        BasicBlock* blk = &blocks[worklist[--top]];
+        int succ[2] = { blk->fallthrough, blk->taken };
+        for (int s = 0; s < 2; s++) {
+            if (succ[s] >= 0 && !blocks[succ[s]].reachable) {
+                blocks[succ[s]].reachable = true;
+                worklist[top++] = succ[s];
+            }
+        }
+        const Instruction* last = &bc->instructions[blk->end - 1];
+        const SwitchTable* table = switch_table_of(bc, last);
+        for (size_t e = 0; table && e <= table->count; e++) {
+            int target = e < table->count ? table->entries[e].target : last->operand1;
+            int succ_block = target >= 0 ? block_of[target] : -1;
+            if (succ_block >= 0 && !blocks[succ_block].reachable) {
+                blocks[succ_block].reachable = true;
+                worklist[top++] = succ_block;
+            }
+        }
+        for (size_t i = blk->start; i < blk->end; i++) {
+            const Instruction* inst = &bc->instructions[i];
+            if (inst->opcode != OP_CALL) continue;
+            if (inst->operand1 < 0 || (size_t)inst->operand1 >= bc->instruction_count) continue;
+            if (inline_body_length(bc, profile, i) > 0) continue;  /* body is copied in place */
+            int callee = block_of[inst->operand1];
+            if (callee >= 0 && !blocks[callee].reachable) {
+                blocks[callee].reachable = true;
+                worklist[top++] = callee;
+            }
+        }
+    }
+    free(worklist);
+}
+
+/**
+ * Static frequency estimate: every back edge h <- b marks the blocks between
+ * the header and the latch as one loop level deeper.
+ */
+static void estimate_weights(BasicBlock* blocks, size_t block_count) {
+    for (size_t b = 0; b < block_count; b++) {
+        if (!blocks[b].reachable) continue;
+        int succ[2] = { blocks[b].fallthrough, blocks[b].taken };
+        for (int s = 0; s < 2; s++) {
+            if (succ[s] < 0 || (size_t)succ[s] > b) continue;
+            for (size_t k = (size_t)succ[s]; k <= b; k++) {
+                blocks[k].loop_depth++;
+            }
+        }
+    }
+    for (size_t b = 0; b < block_count; b++) {
+        double w = 1.0;
+        int depth = blocks[b].loop_depth < MAX_LOOP_DEPTH ? blocks[b].loop_depth : MAX_LOOP_DEPTH;
+        for (int d = 0; d < depth; d++) w *= LOOP_WEIGHT_FACTOR;
+        blocks[b].weight = w;
+    }
+    for (size_t b = 0; b < block_count; b++) {
+        blocks[b].taken_weight = blocks[b].taken >= 0 ? blocks[blocks[b].taken].weight : 0.0;
+        blocks[b].fall_weight = blocks[b].fallthrough >= 0 ? blocks[blocks[b].fallthrough].weight : 0.0;
+    }
+}
+
+/**
+ * Replace the static edge estimates with the counts recorded in 'profile'.
+ * Code the profile never saw executing keeps weight 0 and sinks to the end.
+ */
+static void apply_profile_weights(const Bytecode* bc, const Profile* profile,
+                                  BasicBlock* blocks, size_t block_count) {
+    for (size_t b = 0; b < block_count; b++) {
+        size_t last = blocks[b].end - 1;
+        const ProfileEntry* entry = profile_entry(profile, bytecode_origin(bc, last));
+        double exec = entry ? (double)entry->exec_count : 0.0;
+        double taken = entry ? (double)entry->taken_count : 0.0;
+        blocks[b].weight = profile_count(bc, profile, blocks[b].start);
+        if (is_conditional_branch(bc->instructions[last].opcode)) {
+            blocks[b].taken_weight = taken;
+            blocks[b].fall_weight = exec - taken;
+        } else {
+            blocks[b].taken_weight = blocks[b].taken >= 0 ? exec : 0.0;
+            blocks[b].fall_weight = blocks[b].fallthrough >= 0 ? exec : 0.0;
+        }
+    }
+}
+
+/**
+ * Pick the successor that should follow 'cur' in the final layout, or -1.
+ * Ties go to the original fallthrough so that unprofiled code keeps its shape,
+ * and unconditional jumps into a deeper loop are left alone to keep loops bottom-tested.
+ */
+static int pick_successor(const Bytecode* bc, const BasicBlock* blocks, int cur) {
+    const BasicBlock* blk = &blocks[cur];
+    VMOpcode last = bc->instructions[blk->end - 1].opcode;
+    int best = -1;
+    if (blk->fallthrough >= 0 && !blocks[blk->fallthrough].placed) {
+        best = blk->fallthrough;
+    }
+    if (blk->taken >= 0 && !blocks[blk->taken].placed) {
+        const BasicBlock* t = &blocks[blk->taken];
+        bool loop_entry = (last == OP_JUMP && t->loop_depth > blk->loop_depth);
+        if (!loop_entry && (best < 0 || blk->taken_weight > blk->fall_weight)) {
+            best = blk->taken;
+        }
+    }
+    return best;
+}
+
+/**
+ * The layout pass only handles code whose branches, switch cases and handlers
+ * all land inside the program, and whose last instruction does not fall
+ * through into a conditional exit.
+ */
+static bool layout_supported(const Bytecode* bc) {
+    size_t count = bc->instruction_count;
+    for (size_t h = 0; h < bc->handler_count; h++) {
+        const HandlerEntry* entry = &bc->handlers[h];
+        if (entry->start < 0 || entry->start > entry->end || (size_t)entry->end > count ||
+            entry->handler < 0 || (size_t)entry->handler >= count) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Instruction* inst = &bc->instructions[i];
+        if ((is_branch(inst->opcode) || is_switch(inst->opcode) || inst->opcode == OP_CALL) &&
+            (inst->operand1 < 0 || (size_t)inst->operand1 >= count)) {
+            return false;
+        }
+        if (is_switch(inst->opcode)) {
+            const SwitchTable* table = switch_table_of(bc, inst);
+            if (!table) return false;
+            for (size_t e = 0; e < table->count; e++) {
+                if (table->entries[e].target >= (int)count) return false;
+            }
+        }
+    }
+    for (size_t c = 0; c < bc->class_count; c++) {
+        for (size_t m = 0; m < bc->classes[c].method_count; m++) {
+            int address = bc->classes[c].methods[m].address;
+            if (address < 0 || (size_t)address >= count) return false;
+        }
+    }
+    for (size_t c = 0; c < bc->closure_count; c++) {
+        int address = bc->closures[c].address;
+        if (address < 0 || (size_t)address >= count) return false;
+    }
+    return !is_conditional_branch(bc->instructions[count - 1].opcode);
+}
+
+/**
+ * Rebuild the handler table for the new layout. 'source' holds the old PC of
+ * each of the 'count' new instructions. A guarded range becomes one entry per
+ * run of new instructions whose old PC it covered, and the entries of each
+ * range keep the range's place in the table, so the innermost still comes first.
+ */
+static void remap_handlers(Bytecode* bc, const int* source, size_t count,
+                           const int* block_of, const size_t* new_start) {
+    HandlerEntry* old = bc->handlers;
+    size_t old_count = bc->handler_count;
+    bc->handlers = NULL;
+    bc->handler_count = 0;
+    for (size_t h = 0; h < old_count; h++) {
+        int handler = (int)new_start[block_of[old[h].handler]];
+        size_t i = 0;
+        while (i < count) {
+            if (source[i] < old[h].start || source[i] >= old[h].end) {
+                i++;
+                continue;
+            }
+            size_t run = i;
+            while (i < count && source[i] >= old[h].start && source[i] < old[h].end) i++;
+            bytecode_add_handler(bc, (int)run, (int)i, handler);
+        }
+    }
+    free(old);
+}
+
+void optimizer_layout_blocks(Bytecode* bc, const Profile* profile) {
+    if (!bc || bc->instruction_count == 0) return;
+    if (!layout_supported(bc)) return;
+    size_t count = bc->instruction_count;
+
+    int* block_of = (int*)malloc((count + 1) * sizeof(int));
+    if (!block_of) return;
+    size_t block_count = 0;
+    BasicBlock* blocks = build_blocks(bc, block_of, &block_count);
+    if (!blocks) {
+        free(block_of);
+        return;
+    }
+    mark_reachable(bc, profile, blocks, block_count, block_of);
+    estimate_weights(blocks, block_count);
+    if (profile) {
+        apply_profile_weights(bc, profile, blocks, block_count);
+    }
+
+    /* Greedy chaining: follow the hottest successor, then restart at the first unplaced block. */
+    int* order = (int*)malloc(block_count * sizeof(int));
+    size_t* new_start = (size_t*)malloc(block_count * sizeof(size_t));
+    if (!order || !new_start) {
+        free(order);
+        free(new_start);
+        free(blocks);
+        free(block_of);
+        return;
+    }
+    size_t placed = 0;
+    size_t scan = 0;
+    int cur = 0;
+    while (cur >= 0) {
+        blocks[cur].placed = true;
+        order[placed++] = cur;
+        cur = pick_successor(bc, blocks, cur);
+        if (cur < 0) {
+            while (scan < block_count && (blocks[scan].placed || !blocks[scan].reachable)) scan++;
+            cur = (scan < block_count) ? (int)scan : -1;
+        }
+    }
+
+    /* Emit blocks in their new order, fixing up each block's exit. Targets are
+       recorded as block indices first and resolved once every block has a position. */
+    size_t capacity = count * 2 + 1 + (profile ? count * INLINE_MAX_BODY : 0);
+    Instruction* out = (Instruction*)malloc(capacity * sizeof(Instruction));
+    int* out_block_target = (int*)malloc(capacity * sizeof(int));
+    int* out_origin = (int*)malloc(capacity * sizeof(int));
+    int* out_source = (int*)malloc(capacity * sizeof(int));  /* PC each instruction came from */
+    if (!out || !out_block_target || !out_origin || !out_source) {
+        free(out);
+        free(out_block_target);
+        free(out_origin);
+        free(out_source);
+        free(order);
+        free(new_start);
+        free(blocks);
+        free(block_of);
+        return;
+    }
+    size_t n = 0;
+    for (size_t k = 0; k < placed; k++) {
+        const BasicBlock* blk = &blocks[order[k]];
+        int next = (k + 1 < placed) ? order[k + 1] : -1;
+        new_start[order[k]] = n;
+
+        for (size_t i = blk->start; i < blk->end; i++) {
+            Instruction inst = bc->instructions[i];
+            bool is_last = (i + 1 == blk->end);
+            if (inst.opcode == OP_NOP) continue;
+            out_block_target[n] = -1;
+            out_origin[n] = (int)bytecode_origin(bc, i);
+            out_source[n] = (int)i;
+            if (inst.opcode == OP_CALL && inst.operand1 >= 0 && (size_t)inst.operand1 < count) {
+                size_t body = inline_body_length(bc, profile, i);
+                if (body > 0) {
+                    /* Copy the callee in place of the call, its OP_RET turned into a move
+                       of the result. Errors it raises are caught where the call's would
+                       be, so it takes the call's PC. */
+                    for (size_t j = 0; j < body; j++) {
+                        size_t src = (size_t)inst.operand1 + j;
+                        Instruction copy = bc->instructions[src];
+                        if (copy.opcode == OP_RET) {
+                            if (inst.operand3 < 0 || copy.operand1 == inst.operand3) continue;
+                            copy = (Instruction){ OP_MOVE, inst.operand3, copy.operand1, 0, 0 };
+                        }
+                        if (copy.opcode == OP_NOP) continue;
+                        out_block_target[n] = -1;
+                        out_origin[n] = (int)bytecode_origin(bc, src);
+                        out_source[n] = (int)i;
+                        out[n++] = copy;
+                    }
+                    continue;
+                }
+                out_block_target[n] = block_of[inst.operand1];
+            }
+            if (is_switch(inst.opcode)) {
+                out_block_target[n] = block_of[inst.operand1];  /* the default; cases are remapped below */
+            }
+            if (is_last && is_branch(inst.opcode)) {
+                if (inst.opcode == OP_JUMP) {
+                    if (blk->taken == next) continue;
+                    out_block_target[n] = blk->taken;
+                } else if (blk->taken == blk->fallthrough) {
+                    continue;  /* branch and fallthrough agree: the test is dead */
+                } else if (blk->fallthrough == next) {
+                    out_block_target[n] = blk->taken;
+                } else if (blk->taken == next) {
+                    invert_condition(&inst);
+                    out_block_target[n] = blk->fallthrough;
+                } else {
+                    out_block_target[n] = blk->taken;
+                    out[n++] = inst;
+                    inst.opcode = OP_JUMP;
+                    inst.operand2 = inst.operand3 = inst.operand4 = 0;
+                    out_block_target[n] = blk->fallthrough;
+                    out_origin[n] = out_origin[n - 1];
+                    out_source[n] = (int)i;
+                }
+            }
+            out[n++] = inst;
+        }
+
+        const Instruction* last = &bc->instructions[blk->end - 1];
+        bool needs_exit = falls_through(last->opcode) &&
+                          !(is_conditional_branch(last->opcode) && blk->taken != blk->fallthrough);
+        if (needs_exit && blk->fallthrough != next) {
+            Instruction exit_inst = { OP_HALT, 0, 0, 0, 0 };
+            out_block_target[n] = -1;
+            out_origin[n] = (int)bytecode_origin(bc, blk->end - 1);
+            out_source[n] = (int)(blk->end - 1);
+            if (blk->fallthrough >= 0) {
+                exit_inst.opcode = OP_JUMP;
+                out_block_target[n] = blk->fallthrough;
+            } else if (next < 0) {
+                continue;  /* already falling off the end of the program */
+            }
+            out[n++] = exit_inst;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (out_block_target[i] >= 0) {
+            out[i].operand1 = (int)new_start[out_block_target[i]];
+        }
+    }
+    for (size_t c = 0; c < bc->class_count; c++) {
+        for (size_t m = 0; m < bc->classes[c].method_count; m++) {
+            ClassMethod* method = &bc->classes[c].methods[m];
+            method->address = (int)new_start[block_of[method->address]];
+        }
+    }
+    for (size_t c = 0; c < bc->closure_count; c++) {
+        bc->closures[c].address = (int)new_start[block_of[bc->closures[c].address]];
+    }
+    if (bc->main_address >= 0) {
+        bc->main_address = (int)new_start[block_of[bc->main_address]];
+    }
+    /* Case targets are leaders; those of a switch that was dropped as unreachable go to the default. */
+    for (size_t t = 0; t < bc->switch_table_count; t++) {
+        SwitchTable* table = &bc->switch_tables[t];
+        for (size_t e = 0; e < table->count; e++) {
+            int target = table->entries[e].target;
+            int block = target >= 0 ? block_of[target] : -1;
+            table->entries[e].target = (block >= 0 && blocks[block].placed) ? (int)new_start[block] : -1;
+        }
+    }
+    remap_handlers(bc, out_source, n, block_of, new_start);
+
+    free(bc->instructions);
+    bc->instructions = out;
+    bc->instruction_count = n;
+    bc->instruction_capacity = capacity;
+    free(bc->origins);
+    bc->origins = out_origin;
+
+    free(out_source);
+    free(out_block_target);
+    free(order);
+    free(new_start);
+    free(blocks);
+    free(block_of);
+}
+
+/**
+ * Registers read and written by 'inst', as bitmasks. Returns false for
+ * instructions whose register effects are not known locally (calls, returns,
+ * coroutine switches), which must be treated as reading every register.
+ */
+static bool register_effects(const Instruction* inst, unsigned* defs, unsigned* uses) {
+    *defs = 0;
+    *uses = 0;
+    switch (inst->opcode) {
+        case OP_NOP:
+        case OP_JUMP:
+        case OP_MOVE_LOCAL:
+        case OP_STORE_LOCAL_CONST:
+            return true;
+        case OP_LOAD_CONST:
+        case OP_LOAD_CONST_FLOAT:
+        case OP_LOAD_CONST_STR:
+        case OP_LOAD_BOOL:
+        case OP_NEWOBJ:
+        case OP_NEWCLASS:
+        case OP_LOAD_LOCAL:
+        case OP_LOAD_GLOBAL:
+        case OP_CLOSURE:
+        case OP_LOAD_UPVALUE:
+        case OP_LOAD_BOXED:
+            *defs = REG_BIT(inst->operand1);
+            return true;
+        case OP_BOX:
+            return true;
+        case OP_STORE_UPVALUE:
+        case OP_STORE_BOXED:
+            *uses = REG_BIT(inst->operand2);
+            return true;
+        case OP_STORE_LOCAL:
+        case OP_STORE_GLOBAL:
+            *uses = REG_BIT(inst->operand2);
+            if (inst->operand3) *defs = REG_BIT(inst->operand2);  /* value moved into the slot */
+            return true;
+        case OP_MOVE:
+        case OP_NOT:
+        case OP_BIT_NOT:
+        case OP_GETFIELD:
+            *defs = REG_BIT(inst->operand1);
+            *uses = REG_BIT(inst->operand2);
+            return true;
+        case OP_MOVE_OWN:
+            *defs = REG_BIT(inst->operand1) | REG_BIT(inst->operand2);
+            *uses = REG_BIT(inst->operand2);
+            return true;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+        case OP_GETPROP:
+            *defs = REG_BIT(inst->operand1);
+            *uses = REG_BIT(inst->operand2) | REG_BIT(inst->operand3);
+            return true;
+        case OP_CONCAT_N:
+            *defs = REG_BIT(inst->operand1);
+            for (int i = 0; i < inst->operand3; i++) {
+                *uses |= REG_BIT(inst->operand2 + i);
+            }
+            return true;
+        case OP_SETPROP:
+            *uses = REG_BIT(inst->operand1) | REG_BIT(inst->operand2) | REG_BIT(inst->operand3);
+            if (inst->operand4) *defs = REG_BIT(inst->operand3);  /* value moved into the object */
+            return true;
+        case OP_SETFIELD:
+            *uses = REG_BIT(inst->operand1) | REG_BIT(inst->operand3);
+            return true;
+        case OP_JUMP_IF_ZERO:
+        case OP_JUMP_IF_NONZERO:
+        case OP_TABLESWITCH:
+        case OP_LOOKUPSWITCH:
+            *uses = REG_BIT(inst->operand2);
+            return true;
+        case OP_JUMP_IF_EQ:
+        case OP_JUMP_IF_NE:
+        case OP_JUMP_IF_LT:
+        case OP_JUMP_IF_LE:
+        case OP_JUMP_IF_GT:
+        case OP_JUMP_IF_GE:
+            *uses = REG_BIT(inst->operand2) | REG_BIT(inst->operand3);
+            return true;
+        case OP_CALL_NATIVE: {
+            int argc = inst->operand3 & NATIVE_ARGC_MASK;
+            unsigned moved = (unsigned)inst->operand3 >> NATIVE_MOVE_SHIFT;
+            *defs = REG_BIT(inst->operand1);
+            for (int i = 0; i < argc; i++) {
+                *uses |= REG_BIT(inst->operand4 + i);
+                if (moved & REG_BIT(i)) *defs |= REG_BIT(inst->operand4 + i);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * Backward liveness over the instruction graph: live[i] receives the registers
+ * that may still be read after instruction i executes. Instructions with
+ * unknown register effects (calls, returns, halts) read everything, since the
+ * register file is shared with callers, callees and the host.
+ */
+static unsigned* compute_live_out(const Bytecode* bc) {
+    size_t count = bc->instruction_count;
+    unsigned all = (1u << NUM_REGISTERS) - 1;
+    unsigned* live_in = (unsigned*)calloc(count + 1, sizeof(unsigned));
+    unsigned* live_out = (unsigned*)calloc(count + 1, sizeof(unsigned));
+    if (!live_in || !live_out) {
+        free(live_in);
+        free(live_out);
+        return NULL;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t k = count; k-- > 0;) {
+            const Instruction* inst = &bc->instructions[k];
+            unsigned out = 0;
+            if (falls_through(inst->opcode) && k + 1 < count) out |= live_in[k + 1];
+            if (is_branch(inst->opcode) || is_switch(inst->opcode)) {
+                if (inst->operand1 >= 0 && (size_t)inst->operand1 < count) out |= live_in[inst->operand1];
+                else out = all;
+            }
+            const SwitchTable* table = switch_table_of(bc, inst);
+            for (size_t e = 0; table && e < table->count; e++) {
+                int target = table->entries[e].target;
+                if (target >= 0 && (size_t)target < count) out |= live_in[target];
+            }
+            // An error raised here may continue at a handler.
+            for (size_t h = 0; h < bc->handler_count; h++) {
+                const HandlerEntry* entry = &bc->handlers[h];
+                if ((size_t)entry->start <= k && k < (size_t)entry->end &&
+                    entry->handler >= 0 && (size_t)entry->handler < count) {
+                    out |= live_in[entry->handler];
+                }
+            }
+            unsigned defs, uses, in;
+            if (register_effects(inst, &defs, &uses)) {
+                in = uses | (out & ~defs);
+            } else {
+                in = all;
+            }
+            if (in != live_in[k] || out != live_out[k]) {
+                live_in[k] = in;
+                live_out[k] = out;
+                changed = true;
+            }
+        }
+    }
+    free(live_in);
+    return live_out;
+}
+
+void optimizer_mark_last_uses(Bytecode* bc) {
+    if (!bc || bc->instruction_count == 0) return;
+    unsigned* live_out = compute_live_out(bc);
+    if (!live_out) return;
+
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        Instruction* inst = &bc->instructions[i];
+        unsigned defs, uses;
+        if (!register_effects(inst, &defs, &uses)) continue;
+        /* The value a register held before 'inst' is dead afterwards if no
+           later read can see it: either nothing reads it or 'inst' overwrites it. */
+        unsigned dead = ~live_out[i] | defs;
+
+        if (inst->opcode == OP_MOVE && inst->operand1 != inst->operand2 &&
+            (dead & REG_BIT(inst->operand2))) {
+            inst->opcode = OP_MOVE_OWN;
+        } else if (inst->opcode == OP_SETPROP && !inst->operand4 &&
+                   inst->operand3 != inst->operand1 && inst->operand3 != inst->operand2 &&
+                   (dead & REG_BIT(inst->operand3))) {
+            inst->operand4 = 1;  /* the object takes the register's reference */
+        } else if ((inst->opcode == OP_STORE_LOCAL || inst->opcode == OP_STORE_GLOBAL) &&
+                   !inst->operand3 &&
+                   (dead & REG_BIT(inst->operand2))) {
+            inst->operand3 = 1;  /* the frame slot takes the register's reference */
+        } else if (inst->opcode == OP_CALL_NATIVE) {
+            int argc = inst->operand3 & NATIVE_ARGC_MASK;
+            unsigned moved = (unsigned)inst->operand3 >> NATIVE_MOVE_SHIFT;
+            for (int a = 0; a < argc; a++) {
+                int r = inst->operand4 + a;
+                if (r < 0 || r >= NUM_REGISTERS || !(dead & (1u << r))) continue;
+                /* the same register passed twice must stay readable for both */
+                bool repeated = false;
+                for (int b = 0; b < argc; b++) {
+                    if (b != a && inst->operand4 + b == r) repeated = true;
+                }
+                if (!repeated && !(moved & (1u << a))) moved |= 1u << a;
+            }
+            inst->operand3 = argc | (int)(moved << NATIVE_MOVE_SHIFT);
+        }
+    }
+    free(live_out);
+}
+
+void optimizer_optimize(Bytecode* bc, const Profile* profile) {
+    if (!bc) return;
+    optimizer_thread_jumps(bc);
+    invert_branches_over_jumps(bc);
+    optimizer_layout_blocks(bc, profile);
+    optimizer_thread_jumps(bc);
+    optimizer_mark_last_uses(bc);
+}
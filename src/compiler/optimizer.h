@@ -0,0 +1,55 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "bytecode.h"
+#include "../vm/profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Thread jumps to their final destination.
+ *
+ * Rewrites every branch whose target is an unconditional OP_JUMP so that it
+ * points straight at the end of the chain, and replaces jumps to OP_RET /
+ * OP_HALT with the terminator itself.
+ */
+void optimizer_thread_jumps(Bytecode* bc);
+
+/**
+ * @brief Reorder basic blocks so that the hottest successor is the fallthrough.
+ *
+ * Block frequencies come from 'profile' when one is given (edge counts recorded
+ * by a previous run) and are otherwise estimated statically from loop nesting
+ * depth. With a profile, hot calls to short straight-line functions that use
+ * no parameters or locals (globals are fine) are inlined.
+ * Conditions are inverted where that makes the hot path contiguous,
+ * redundant jumps are dropped and unreachable blocks are discarded.
+ * bc->origins is updated so that each instruction maps back to its source PC.
+ */
+void optimizer_layout_blocks(Bytecode* bc, const Profile* profile);
+
+/**
+ * @brief Turn copies at a register's last use into ownership transfers.
+ *
+ * Liveness is computed over the whole program. An OP_MOVE whose source is
+ * never read again becomes OP_MOVE_OWN, an OP_SETPROP whose value register
+ * dies gets its move flag (operand4), and OP_CALL_NATIVE arguments that die
+ * at the call get their bit set in the move mask. Each of these hands the
+ * register's reference over instead of retaining a new one and releasing
+ * the old one later.
+ */
+void optimizer_mark_last_uses(Bytecode* bc);
+
+/**
+ * @brief Run all bytecode-level optimizations in order.
+ * @param profile Optional execution profile of the unoptimized program, or NULL.
+ */
+void optimizer_optimize(Bytecode* bc, const Profile* profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OPTIMIZER_H */
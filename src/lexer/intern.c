@@ -0,0 +1,134 @@
+#include "../../include/intern.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+    Names live in 'names', indexed by id. 'buckets' is an open-addressed
+    hash of ids (0 = empty) kept at most half full.
+*/
+static char** names = NULL;
+static uint32_t* name_hashes = NULL;
+static size_t name_count = 0;     /* ids in use, including the unused id 0 */
+static size_t name_capacity = 0;
+
+static SymbolId* buckets = NULL;
+static size_t bucket_count = 0;
+
+static uint32_t hash_name(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;  /* FNV-1a */
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t find_bucket(const char* text, size_t length, uint32_t hash) {
+    size_t mask = bucket_count - 1;
+    size_t i = hash & mask;
+    while (buckets[i] != SYMBOL_ID_NONE) {
+        SymbolId id = buckets[i];
+        if (name_hashes[id] == hash && strncmp(names[id], text, length) == 0 &&
+            names[id][length] == '\0') {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_buckets(void) {
+    size_t new_count = bucket_count ? bucket_count * 2 : 64;
+    SymbolId* new_buckets = (SymbolId*)calloc(new_count, sizeof(SymbolId));
+    if (!new_buckets) return 0;
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+    for (size_t id = 1; id < name_count; id++) {
+        size_t i = name_hashes[id] & (bucket_count - 1);
+        while (buckets[i] != SYMBOL_ID_NONE) {
+            i = (i + 1) & (bucket_count - 1);
+        }
+        buckets[i] = (SymbolId)id;
+    }
+    return 1;
+}
+
+static int grow_names(void) {
+    size_t new_capacity = name_capacity ? name_capacity * 2 : 64;
+    char** new_names = (char**)realloc(names, new_capacity * sizeof(char*));
+    if (!new_names) return 0;
+    names = new_names;
+    uint32_t* new_hashes = (uint32_t*)realloc(name_hashes, new_capacity * sizeof(uint32_t));
+    if (!new_hashes) return 0;
+    name_hashes = new_hashes;
+    name_capacity = new_capacity;
+    if (name_count == 0) {
+        names[0] = NULL;
+        name_hashes[0] = 0;
+        name_count = 1;
+    }
+    return 1;
+}
+
+SymbolId intern_name(const char* text, size_t length) {
+    if (!text) return SYMBOL_ID_NONE;
+    if (name_count + 1 > name_capacity && !grow_names()) {
+        fprintf(stderr, "Failed to grow the identifier table.\n");
+        return SYMBOL_ID_NONE;
+    }
+    if ((name_count + 1) * 2 > bucket_count && !grow_buckets()) {
+        fprintf(stderr, "Failed to grow the identifier table.\n");
+        return SYMBOL_ID_NONE;
+    }
+
+    uint32_t hash = hash_name(text, length);
+    size_t i = find_bucket(text, length, hash);
+    if (buckets[i] != SYMBOL_ID_NONE) {
+        return buckets[i];
+    }
+
+    char* copy = (char*)malloc(length + 1);
+    if (!copy) {
+        fprintf(stderr, "Failed to allocate interned identifier.\n");
+        return SYMBOL_ID_NONE;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    SymbolId id = (SymbolId)name_count++;
+    names[id] = copy;
+    name_hashes[id] = hash;
+    buckets[i] = id;
+    return id;
+}
+
+SymbolId intern_cstr(const char* text) {
+    return text ? intern_name(text, strlen(text)) : SYMBOL_ID_NONE;
+}
+
+SymbolId intern_find(const char* text) {
+    if (!text || bucket_count == 0) return SYMBOL_ID_NONE;
+    size_t length = strlen(text);
+    return buckets[find_bucket(text, length, hash_name(text, length))];
+}
+
+const char* intern_text(SymbolId id) {
+    return (id != SYMBOL_ID_NONE && id < name_count) ? names[id] : NULL;
+}
+
+void intern_reset(void) {
+    for (size_t id = 1; id < name_count; id++) {
+        free(names[id]);
+    }
+    free(names);
+    free(name_hashes);
+    free(buckets);
+    names = NULL;
+    name_hashes = NULL;
+    buckets = NULL;
+    name_count = 0;
+    name_capacity = 0;
+    bucket_count = 0;
+}
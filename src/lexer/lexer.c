@@ -52,6 +52,21 @@ static void set_error(Lexer* lexer, LexerErrorType type, const char* fmt, ...);
 /* ----------------------------------------------------------
 Lexer Structure Definition
 ---------------------------------------------------------- */
+#define LEXER_MAX_INTERP_DEPTH 16
+
+/*
+    String interpolation: "a ${x} b" is scanned as STRING "a ",
+    INTERPOLATION_START, the tokens of x, INTERPOLATION_END, STRING " b".
+    Every "${" is preceded and every "}" that closes one is followed by a
+    (possibly empty) string segment.
+*/
+typedef struct {
+    size_t braces[LEXER_MAX_INTERP_DEPTH];  /* '{' nesting inside each open "${" */
+    size_t depth;
+    int    pending_start;  /* the segment just returned stopped at a "${" */
+    int    resume_string;  /* the "}" just returned closed an interpolation */
+} InterpState;
+
 struct Lexer {
     /* Source code management */
     const char* source;
@@ -73,6 +88,11 @@ struct Lexer {
 
     /* Internal buffers for building strings, docstrings, etc. */
     char        string_buffer[LEXER_MAX_STRING_LENGTH];
+
+    InterpState interp;
+
+    /* Type of the last token returned; decides whether '/' starts a regex */
+    OSFLTokenType last_type;
 };
 
 /* ----------------------------------------------------------
@@ -85,8 +105,10 @@ static Token lexer_next_token_internal(Lexer* lexer);
 static Token scan_identifier(Lexer* lexer, Token token);
 static Token scan_number(Lexer* lexer, Token token);
 static Token scan_string(Lexer* lexer, Token token);
+static Token scan_string_segment(Lexer* lexer, Token token);
 static Token scan_docstring(Lexer* lexer, Token token);
 static Token scan_regex_literal(Lexer* lexer, Token token);
+static int   regex_allowed(Lexer* lexer);
 static Token scan_operator_or_regex(Lexer* lexer);
 static Token scan_token_dispatch(Lexer* lexer, Token token);
 
@@ -159,6 +181,8 @@ static const KeywordEntry KEYWORDS[] = {
     {"while",     TOKEN_WHILE},
     {"for",       TOKEN_FOR},
     {"switch",    TOKEN_SWITCH},
+    {"case",      TOKEN_CASE},
+    {"default",   TOKEN_DEFAULT},
     {"class",     TOKEN_CLASS},
     {"import",    TOKEN_IMPORT},
 
@@ -203,6 +227,8 @@ Lexer* lexer_create(const char* source, size_t length, LexerConfig config)
 
     lexer->config = config;
     memset(lexer->string_buffer, 0, LEXER_MAX_STRING_LENGTH);
+    memset(&lexer->interp, 0, sizeof(lexer->interp));
+    lexer->last_type = TOKEN_EOF;
 
     return lexer;
 }
@@ -236,6 +262,8 @@ void lexer_reset(Lexer* lexer, const char* new_source)
     lexer->peek = (lexer->length > 1) ? lexer->source[1] : '\0';
     memset(lexer->string_buffer, 0, LEXER_MAX_STRING_LENGTH);
     memset(lexer->error_buffer, 0, LEXER_MAX_ERROR_LENGTH);
+    memset(&lexer->interp, 0, sizeof(lexer->interp));
+    lexer->last_type = TOKEN_EOF;
 
     lexer->error.type = LEXER_ERROR_NONE;
     lexer->error.message[0] = '\0';
@@ -313,8 +341,8 @@ SourceLocation lexer_current_location(Lexer* lexer)
 Token lexer_next_token(Lexer* lexer) {
     fprintf(stderr, "DEBUG: Getting next token at position %zu\n", lexer->position);
     
-    // Skip whitespace manually using character functions
-    while (!is_at_end(lexer) && isspace(lexer_peek_char(lexer))) {
+    // Skip whitespace manually using character functions (not inside a string)
+    while (!lexer->interp.resume_string && !is_at_end(lexer) && isspace(lexer_peek_char(lexer))) {
         char c = lexer_peek_char(lexer);
         if (c == '\n' && lexer->config.track_line_endings) {
             Token t;
@@ -327,6 +355,7 @@ Token lexer_next_token(Lexer* lexer) {
             };
             strcpy_s(t.text, sizeof(t.text), "\\n");
             lexer_advance_char(lexer);
+            lexer->last_type = TOKEN_NEWLINE;
             fprintf(stderr, "DEBUG: Found newline token\n");
             return t;
         }
@@ -337,6 +366,7 @@ Token lexer_next_token(Lexer* lexer) {
     
     // Proceed with the standard token creation
     Token result = lexer_next_token_internal(lexer);
+    lexer->last_type = result.type;
     fprintf(stderr, "DEBUG: Created token type=%d, text='%s'\n", 
             result.type, result.text ? result.text : "NULL");
     return result;
@@ -350,6 +380,8 @@ Token lexer_peek_token(Lexer* lexer)
     char saved_current = lexer->current;
     char saved_peek = lexer->peek;
 
+    InterpState saved_interp = lexer->interp;
+
     LexerError saved_error = lexer->error;
     char saved_error_buffer[LEXER_MAX_ERROR_LENGTH];
     memcpy(saved_error_buffer, lexer->error_buffer, LEXER_MAX_ERROR_LENGTH);
@@ -362,6 +394,7 @@ Token lexer_peek_token(Lexer* lexer)
     lexer->column = saved_column;
     lexer->current = saved_current;
     lexer->peek = saved_peek;
+    lexer->interp = saved_interp;
 
     lexer->error = saved_error;
     memcpy(lexer->error_buffer, saved_error_buffer, LEXER_MAX_ERROR_LENGTH);
@@ -377,6 +410,28 @@ static Token lexer_next_token_internal(Lexer* lexer)
     Token token;
     memset(&token, 0, sizeof(Token));
 
+    if (lexer->interp.pending_start || lexer->interp.resume_string) {
+        token.location = lexer_current_location(lexer);
+    }
+    if (lexer->interp.pending_start) {
+        lexer->interp.pending_start = 0;
+        if (lexer->interp.depth >= LEXER_MAX_INTERP_DEPTH) {
+            set_error(lexer, LEXER_ERROR_INVALID_STRING, "String interpolation nested too deeply");
+            token.type = TOKEN_ERROR;
+            return token;
+        }
+        lexer->interp.braces[lexer->interp.depth++] = 0;
+        advance(lexer);  /* '$' */
+        advance(lexer);  /* '{' */
+        token.type = TOKEN_INTERPOLATION_START;
+        strcpy_s(token.text, sizeof(token.text), "${");
+        return token;
+    }
+    if (lexer->interp.resume_string) {
+        lexer->interp.resume_string = 0;
+        return scan_string_segment(lexer, token);
+    }
+
     skip_whitespace(lexer);
     skip_comments(lexer);
 
@@ -426,8 +481,8 @@ static Token scan_token_dispatch(Lexer* lexer, Token token)
         return scan_string(lexer, token);
     }
 
-    /* Check for potential regex: '/' that isn't '//' or '/*' */
-    if (c == '/' && lexer->peek != '/' && lexer->peek != '*') {
+    /* Check for potential regex: '/' that isn't '//' or '/*', in operand position */
+    if (c == '/' && lexer->peek != '/' && lexer->peek != '*' && regex_allowed(lexer)) {
         return scan_regex_literal(lexer, token);
     }
 
@@ -498,31 +553,22 @@ Scan: String with Interpolation => TOKEN_STRING
 ---------------------------------------------------------- */
 static Token scan_string(Lexer* lexer, Token token)
 {
-    token.type = TOKEN_STRING;
     advance(lexer);
+    return scan_string_segment(lexer, token);
+}
+
+/* Scan string text up to the closing '"' or the next "${". */
+static Token scan_string_segment(Lexer* lexer, Token token)
+{
+    token.type = TOKEN_STRING;
 
     size_t length = 0;
     memset(lexer->string_buffer, 0, LEXER_MAX_STRING_LENGTH);
 
     while (!is_at_end(lexer) && lexer->current != '"') {
         if (lexer->current == '$' && lexer->peek == '{') {
-            if (length > 0) {
-                strncpy_s(token.text, sizeof(token.text),
-                          lexer->string_buffer, sizeof(token.text) - 1);
-                token.value.string_value.data = _strdup(lexer->string_buffer);
-                token.value.string_value.length = length;
-                return token;
-            }
-            Token interp;
-            memset(&interp, 0, sizeof(interp));
-            interp.type = TOKEN_INTERPOLATION_START;
-            interp.location.line = lexer->line;
-            interp.location.column = lexer->column;
-            interp.location.file = lexer->config.file_name;
-            strcpy_s(interp.text, sizeof(interp.text), "${");
-            advance(lexer);
-            advance(lexer);
-            return interp;
+            lexer->interp.pending_start = 1;
+            break;
         }
 
         if (lexer->current == '\\') {
@@ -550,15 +596,17 @@ static Token scan_string(Lexer* lexer, Token token)
         advance(lexer);
     }
 
-    if (is_at_end(lexer)) {
+    if (lexer->interp.pending_start) {
+        /* the "${" is scanned as the next token */
+    } else if (is_at_end(lexer)) {
         set_error(lexer, LEXER_ERROR_UNTERMINATED_STRING,
                   "Unterminated string literal before EOF");
         token.type = TOKEN_ERROR;
         return token;
+    } else {
+        advance(lexer);  /* closing '"' */
     }
 
-    advance(lexer);
-
     strncpy_s(token.text, sizeof(token.text),
               lexer->string_buffer, sizeof(token.text) - 1);
     token.value.string_value.data = _strdup(lexer->string_buffer);
@@ -567,6 +615,39 @@ static Token scan_string(Lexer* lexer, Token token)
     return token;
 }
 
+/* ----------------------------------------------------------
+A '/' starts a regex literal only where an operand is expected (so
+"a / b" stays a division) and only if the literal is closed by an
+unescaped '/' on the same line.
+---------------------------------------------------------- */
+static int regex_allowed(Lexer* lexer)
+{
+    switch (lexer->last_type) {
+        case TOKEN_IDENTIFIER:
+        case TOKEN_INTEGER:
+        case TOKEN_FLOAT:
+        case TOKEN_STRING:
+        case TOKEN_DOCSTRING:
+        case TOKEN_REGEX:
+        case TOKEN_BOOL_TRUE:
+        case TOKEN_BOOL_FALSE:
+        case TOKEN_NULL:
+        case TOKEN_RPAREN:
+        case TOKEN_RBRACKET:
+            return FALSE;
+        default:
+            break;
+    }
+    for (size_t i = lexer->position + 1; i < lexer->length && lexer->source[i] != '\n'; i++) {
+        if (lexer->source[i] == '\\') {
+            i++;
+        } else if (lexer->source[i] == '/') {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 /* ----------------------------------------------------------
 Scan: Regex Literal => TOKEN_REGEX
 ---------------------------------------------------------- */
@@ -769,6 +850,10 @@ static Token scan_identifier(Lexer* lexer, Token token)
         token.value.bool_value = false;
     }
 
+    if (token.type == TOKEN_IDENTIFIER) {
+        token.symbol = intern_name(buffer, length);
+    }
+
     return token;
 }
 
@@ -827,8 +912,20 @@ static Token scan_operator_or_regex(Lexer* lexer)
         case '>': token.type = TOKEN_GT;            strcpy_s(token.text, sizeof(token.text), ">");  break;
         case '(': token.type = TOKEN_LPAREN;        strcpy_s(token.text, sizeof(token.text), "(");  break;
         case ')': token.type = TOKEN_RPAREN;        strcpy_s(token.text, sizeof(token.text), ")");  break;
-        case '{': token.type = TOKEN_LBRACE;        strcpy_s(token.text, sizeof(token.text), "{");  break;
-        case '}': token.type = TOKEN_RBRACE;        strcpy_s(token.text, sizeof(token.text), "}");  break;
+        case '{':
+            if (lexer->interp.depth > 0) lexer->interp.braces[lexer->interp.depth - 1]++;
+            token.type = TOKEN_LBRACE;        strcpy_s(token.text, sizeof(token.text), "{");  break;
+        case '}':
+            if (lexer->interp.depth > 0 && lexer->interp.braces[lexer->interp.depth - 1] == 0) {
+                /* Closes a "${"; the string continues after it. */
+                lexer->interp.depth--;
+                lexer->interp.resume_string = 1;
+                token.type = TOKEN_INTERPOLATION_END;
+                strcpy_s(token.text, sizeof(token.text), "}");
+                break;
+            }
+            if (lexer->interp.depth > 0) lexer->interp.braces[lexer->interp.depth - 1]--;
+            token.type = TOKEN_RBRACE;        strcpy_s(token.text, sizeof(token.text), "}");  break;
         case ';': token.type = TOKEN_SEMICOLON;     strcpy_s(token.text, sizeof(token.text), ";");  break;
         case ':': token.type = TOKEN_COLON;         strcpy_s(token.text, sizeof(token.text), ":");  break;
         case ',': token.type = TOKEN_COMMA;         strcpy_s(token.text, sizeof(token.text), ",");  break;
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "../../include/source_location.h"
+#include "../../include/intern.h"
 
 /**
  * @brief Represents all possible token types in the OSFL language
@@ -34,6 +35,8 @@ typedef enum {
     TOKEN_FOR,                // for
     TOKEN_ELIF,               // elif (Python-style else-if)
     TOKEN_SWITCH,             // switch
+    TOKEN_CASE,               // case
+    TOKEN_DEFAULT,            // default
     TOKEN_CLASS,              // class
     TOKEN_IMPORT,             // import
 
@@ -143,6 +146,7 @@ typedef struct {
     TokenValue value;
     SourceLocation location;
     char text[64];  // Fixed-size buffer for token text
+    SymbolId symbol; // Interned id of an identifier's text; SYMBOL_ID_NONE otherwise
 } Token;
 
 /**
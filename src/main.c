@@ -14,6 +14,18 @@ static void print_usage(const char* program_name) {
     fprintf(stderr, "  -o <file>           Specify output file\n");
     fprintf(stderr, "  -d, --debug         Enable debug output\n");
     fprintf(stderr, "  --no-optimize       Disable optimizations\n");
+    fprintf(stderr, "  --profile-generate <file>  Record an execution profile to <file>\n");
+    fprintf(stderr, "  --profile-use <file>       Optimize using a profile recorded earlier\n");
+    fprintf(stderr, "  --plugin <file>            Load a native extension library (repeatable)\n");
+    fprintf(stderr, "  --snapshot-save <file>     Save the state after top-level initialization\n");
+    fprintf(stderr, "  --snapshot-load <file>     Run main() of a saved snapshot (no input file needed)\n");
+    fprintf(stderr, "  --serve-fork               Initialize once, then fork a worker running main() per stdin line\n");
+    fprintf(stderr, "  --serve-socket <path>      Like --serve-fork, taking one job per connection to a Unix socket\n");
+    fprintf(stderr, "  --fuel <n>                 Stop the script after n backward jumps and calls\n");
+    fprintf(stderr, "  --break <pc>               Print registers and frames at this instruction (repeatable)\n");
+    fprintf(stderr, "  --record <file>            Log what the clock, files and output natives return\n");
+    fprintf(stderr, "  --replay <file>            Rerun a recorded run from its log, without side effects\n");
+    fprintf(stderr, "  --trace <file>             Write a timeline of the run (Chrome trace-event JSON, for Perfetto)\n");
 }
 
 static OSFLStatus parse_args(int argc, char* argv[], OSFLConfig* config) {
@@ -39,6 +51,50 @@ static OSFLStatus parse_args(int argc, char* argv[], OSFLConfig* config) {
             config->debug_mode = true;
         } else if (strcmp(argv[i], "--no-optimize") == 0) {
             config->optimize = false;
+        } else if (strcmp(argv[i], "--profile-generate") == 0 && i + 1 < argc) {
+            config->profile_generate = argv[++i];
+        } else if (strcmp(argv[i], "--profile-use") == 0 && i + 1 < argc) {
+            config->profile_use = argv[++i];
+        } else if (strcmp(argv[i], "--snapshot-save") == 0 && i + 1 < argc) {
+            config->snapshot_save = argv[++i];
+        } else if (strcmp(argv[i], "--snapshot-load") == 0 && i + 1 < argc) {
+            config->snapshot_load = argv[++i];
+        } else if (strcmp(argv[i], "--serve-fork") == 0) {
+            config->serve_fork = true;
+        } else if (strcmp(argv[i], "--serve-socket") == 0 && i + 1 < argc) {
+            config->serve_fork = true;
+            config->serve_socket = argv[++i];
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            char* end = NULL;
+            config->fuel = strtoll(argv[++i], &end, 10);
+            if (!end || *end != '\0' || config->fuel < 0) {
+                fprintf(stderr, "Invalid fuel: %s\n", argv[i]);
+                return OSFL_ERROR_INVALID_INPUT;
+            }
+        } else if (strcmp(argv[i], "--break") == 0 && i + 1 < argc) {
+            char* end = NULL;
+            long long pc = strtoll(argv[++i], &end, 10);
+            if (!end || *end != '\0' || pc < 0) {
+                fprintf(stderr, "Invalid breakpoint: %s\n", argv[i]);
+                return OSFL_ERROR_INVALID_INPUT;
+            }
+            if (config->breakpoint_count == OSFL_MAX_BREAKPOINTS) {
+                fprintf(stderr, "At most %d breakpoints can be set\n", OSFL_MAX_BREAKPOINTS);
+                return OSFL_ERROR_INVALID_INPUT;
+            }
+            config->breakpoints[config->breakpoint_count++] = (size_t)pc;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            config->record_natives = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            config->replay_natives = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config->trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--plugin") == 0 && i + 1 < argc) {
+            if (config->plugin_count == OSFL_MAX_PLUGINS) {
+                fprintf(stderr, "At most %d plugins can be loaded\n", OSFL_MAX_PLUGINS);
+                return OSFL_ERROR_INVALID_INPUT;
+            }
+            config->plugins[config->plugin_count++] = argv[++i];
         } else if (argv[i][0] == '-') {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             return OSFL_ERROR_INVALID_INPUT;
@@ -51,7 +107,13 @@ static OSFLStatus parse_args(int argc, char* argv[], OSFLConfig* config) {
         }
     }
 
-    if (!config->input_file) {
+    if ((config->record_natives || config->replay_natives) &&
+        (config->serve_fork || config->snapshot_load || (config->record_natives && config->replay_natives))) {
+        fprintf(stderr, "--record and --replay take a single run of a source file\n");
+        return OSFL_ERROR_INVALID_INPUT;
+    }
+
+    if (!config->input_file && !config->snapshot_load) {
         fprintf(stderr, "No input file specified\n");
         return OSFL_ERROR_INVALID_INPUT;
     }
@@ -94,7 +156,8 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    status = osfl_run_file(config.input_file);
+    status = config.snapshot_load ? osfl_run_snapshot(config.snapshot_load)
+                                  : osfl_run_file(config.input_file);
     if (status != OSFL_SUCCESS) {
         handle_error();
         osfl_cleanup();
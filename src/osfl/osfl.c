@@ -12,11 +12,22 @@
 #include "../../include/ast.h"
 #include "../../include/semantic.h"
 #include "../../include/symbol_table.h"
+#include "../../include/intern.h"
 #include "../compiler/compiler.h"
 #include "../compiler/bytecode.h"
+#include "../compiler/optimizer.h"
+#include "../compiler/module.h"
 #include "../vm/vm.h"
+#include "../vm/profile.h"
+#include "../vm/snapshot.h"
+#include "../vm/debugger.h"
+#include "../vm/replay.h"
+#include "../vm/tracer.h"
 #include "../vm/frame.h"    /* For frame_create/destroy if needed */
 #include "../runtime/runtime.h" /* If you have a runtime layer */
+#include "../runtime/regex.h"
+#include "../runtime/plugin.h"
+#include "serve.h"
 #include <excpt.h>
 
 /* ------------------------------------------------------------------
@@ -73,6 +84,18 @@ OSFLStatus osfl_init(const OSFLConfig* config) {
     fprintf(stderr, "  input_file: %s\n", g_osfl_current_config.input_file ? g_osfl_current_config.input_file : "NULL");
     fprintf(stderr, "  debug_mode: %s\n", g_osfl_current_config.debug_mode ? "true" : "false");
 
+    for (size_t i = 0; i < g_osfl_current_config.plugin_count; i++) {
+        char error[OSFL_MAX_ERROR_LENGTH];
+        if (!plugin_load(g_osfl_current_config.plugins[i], error, sizeof(error))) {
+            set_osfl_error(OSFL_ERROR_FILE_IO, error, __FILE__, __LINE__, 0);
+            return OSFL_ERROR_FILE_IO;
+        }
+    }
+
+    if (g_osfl_current_config.trace_file) {
+        tracer_start(tracer_default_config());
+    }
+
     fprintf(stderr, "DEBUG: osfl_init completed successfully\n");
     return OSFL_SUCCESS;
 }
@@ -81,8 +104,16 @@ OSFLStatus osfl_init(const OSFLConfig* config) {
  * Clean up OSFL
  */
 void osfl_cleanup(void) {
-    /* If you had any global allocations, free them here. 
-       For now, we do nothing. */
+    /* Compiled modules are shared by every script run in the session. */
+    module_cache_clear();
+    /* Identifier names are interned for the whole session. */
+    intern_reset();
+    /* Natives of plugins may still be referenced until here. */
+    plugin_unload_all();
+    if (tracer_enabled()) {
+        tracer_write(g_osfl_current_config.trace_file);
+        tracer_stop();
+    }
 }
 
 /**
@@ -110,6 +141,131 @@ void osfl_clear_error(void) {
     g_osfl_last_error.column = 0;
 }
 
+/* ------------------------------------------------------------------
+    Profile-guided optimization
+------------------------------------------------------------------ */
+
+/**
+ * Optimize freshly compiled bytecode, using the configured profile_use file
+ * when it matches this program. Returns an empty profile to record into when
+ * profile_generate is set, otherwise NULL.
+ */
+static Profile* osfl_prepare_bytecode(Bytecode* bc) {
+    uint64_t fingerprint = bytecode_fingerprint(bc);
+    size_t source_count = bc->instruction_count;
+
+    if (g_osfl_current_config.optimize) {
+        uint64_t start = tracer_now();
+        Profile* feedback = NULL;
+        if (g_osfl_current_config.profile_use) {
+            feedback = profile_read(g_osfl_current_config.profile_use);
+            if (feedback && (feedback->fingerprint != fingerprint || feedback->count != source_count)) {
+                fprintf(stderr, "Profile '%s' was recorded for a different program; ignoring it.\n",
+                        g_osfl_current_config.profile_use);
+                profile_destroy(feedback);
+                feedback = NULL;
+            }
+        }
+        optimizer_optimize(bc, feedback);
+        profile_destroy(feedback);
+        tracer_span("pipeline", "optimize", start);
+    }
+
+    if (!g_osfl_current_config.profile_generate) return NULL;
+    return profile_create(fingerprint, source_count);
+}
+
+/**
+ * Write and free the profile recorded during a run.
+ */
+static void osfl_finish_profile(Profile* profile) {
+    if (!profile) return;
+    profile_write(profile, g_osfl_current_config.profile_generate);
+    profile_destroy(profile);
+}
+
+/**
+ * Register the built-in natives, then those of the loaded plugins, and set
+ * the configured fuel limit. A plugin native with the name of a built-in
+ * one takes over its registry entry.
+ */
+static void osfl_prepare_vm(VM* vm) {
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    size_t plugin_natives = plugin_native_count();
+    for (size_t i = 0; i < plugin_natives; i++) {
+        vm_register_native_desc(vm, plugin_native(i));
+    }
+    vm_set_fuel(vm, g_osfl_current_config.fuel, NULL, NULL);
+}
+
+/**
+ * Run with the configured breakpoints, printing the state at each one.
+ */
+static void osfl_run_debugged(VM* vm) {
+    Debugger* dbg = debugger_attach(vm);
+    if (!dbg) {
+        vm_run(vm);
+        return;
+    }
+    for (size_t i = 0; i < g_osfl_current_config.breakpoint_count; i++) {
+        if (!debugger_set_breakpoint(dbg, g_osfl_current_config.breakpoints[i])) {
+            fprintf(stderr, "No instruction at PC %zu for a breakpoint\n", g_osfl_current_config.breakpoints[i]);
+        }
+    }
+    while (debugger_continue(dbg) == DEBUG_STOP_BREAKPOINT) {
+        fprintf(stderr, "Breakpoint at PC %zu:\n", vm->pc);
+        debugger_print_state(dbg, stderr);
+    }
+    debugger_detach(dbg);
+}
+
+/**
+ * How a run of 'vm' ended: a runtime error if it ran out of fuel or stopped
+ * on an error no handler caught, which is recorded as the last error.
+ */
+static OSFLStatus osfl_run_status(const VM* vm) {
+    if (vm->out_of_fuel) {
+        set_osfl_error(OSFL_ERROR_RUNTIME, "Script ran out of fuel", __FILE__, __LINE__, 0);
+        return OSFL_ERROR_RUNTIME;
+    }
+    if (vm->faulted) {
+        char error[OSFL_MAX_ERROR_LENGTH];
+        size_t length = strcspn(vm->error_message, "\n");
+        if (length >= sizeof(error)) length = sizeof(error) - 1;
+        memcpy(error, vm->error_message, length);
+        error[length] = '\0';
+        set_osfl_error(OSFL_ERROR_RUNTIME, error, __FILE__, __LINE__, 0);
+        return OSFL_ERROR_RUNTIME;
+    }
+    return OSFL_SUCCESS;
+}
+
+/**
+ * Run main() on 'vm', paused before it, once per job when the serve mode is
+ * configured, otherwise continue the run.
+ */
+static OSFLStatus osfl_run_main(VM* vm) {
+    if (!g_osfl_current_config.serve_fork) {
+        if (g_osfl_current_config.breakpoint_count > 0) {
+            osfl_run_debugged(vm);
+        } else {
+            vm_run(vm);
+        }
+        return osfl_run_status(vm);
+    }
+    char error[OSFL_MAX_ERROR_LENGTH];
+    bool served = g_osfl_current_config.serve_socket
+        ? serve_socket(vm, g_osfl_current_config.serve_socket, error, sizeof(error))
+        : serve_jobs(vm, stdin, error, sizeof(error));
+    if (!served) {
+        set_osfl_error(OSFL_ERROR_RUNTIME, error, __FILE__, __LINE__, 0);
+        return OSFL_ERROR_RUNTIME;
+    }
+    return OSFL_SUCCESS;
+}
+
 /**
  * The main "run a file" pipeline:
  *  1) read file
@@ -134,6 +290,9 @@ OSFLStatus osfl_run_file(const char* filename) {
     AstNode* root = NULL;
     Bytecode* bc = NULL;
     VM* vm = NULL;
+    Profile* profile = NULL;
+    Replay* replay = NULL;
+    uint64_t fingerprint = 0;
     OSFLStatus status = OSFL_SUCCESS;
 
     __try {
@@ -161,12 +320,12 @@ OSFLStatus osfl_run_file(const char* filename) {
         fclose(fp);
 
         /* 2) Lex => tokens */
+        uint64_t phase = tracer_now();
         LexerConfig lex_cfg = lexer_default_config();
         lex_cfg.include_comments = g_osfl_current_config.include_comments;
         lex_cfg.file_name = filename;
         lexer = lexer_create(source, read_size, lex_cfg);
         if (!lexer) {
-            free(source);
             set_osfl_error(OSFL_ERROR_LEXER, "Failed to create lexer", __FILE__, __LINE__, 0);
             status = OSFL_ERROR_LEXER;
             goto cleanup;
@@ -200,96 +359,101 @@ OSFLStatus osfl_run_file(const char* filename) {
             }
         }
 
+        tracer_span("pipeline", "lex", phase);
+
         LexerError lexError = lexer_get_error(lexer);
         if (lexError.type != LEXER_ERROR_NONE) {
             OSFLStatus sc = OSFL_ERROR_LEXER;
             set_osfl_error(sc, lexError.message, lexError.location.file, lexError.location.line, lexError.location.column);
-            lexer_destroy(lexer);
-            free(source);
             status = sc;
             goto cleanup;
         }
 
         /* 3) Parse => AST */
+        phase = tracer_now();
         parser = parser_create(tokens, token_count);
         root = parser_parse(parser);
         parser_destroy(parser);
+        parser = NULL;
+        tracer_span("pipeline", "parse", phase);
 
         /* 4) Semantic analysis */
+        phase = tracer_now();
         SemanticContext sem_ctx;
         semantic_init(&sem_ctx);
         semantic_analyze(root, &sem_ctx);
+        tracer_span("pipeline", "semantic", phase);
+        if (sem_ctx.import_error_count > 0) {
+            set_osfl_error(OSFL_ERROR_FILE_IO, "A plugin could not be loaded", __FILE__, __LINE__, 0);
+            semantic_cleanup(&sem_ctx);
+            status = OSFL_ERROR_FILE_IO;
+            goto cleanup;
+        }
         if (sem_ctx.error_count > 0) {
             set_osfl_error(OSFL_ERROR_SYNTAX, "Semantic errors occurred", __FILE__, __LINE__, 0);
             semantic_cleanup(&sem_ctx);
-            ast_destroy(root);
-            lexer_destroy(lexer);
-            free(source);
             status = OSFL_ERROR_SYNTAX;
             goto cleanup;
         }
         semantic_cleanup(&sem_ctx);
 
         /* 5) Compile => bytecode */
+        phase = tracer_now();
         bc = compiler_compile_ast(root);
+        tracer_span("pipeline", "compile", phase);
         if (!bc) {
             set_osfl_error(OSFL_ERROR_COMPILER, "Failed to compile AST", __FILE__, __LINE__, 0);
-            ast_destroy(root);
-            lexer_destroy(lexer);
-            free(source);
             status = OSFL_ERROR_COMPILER;
             goto cleanup;
         }
+        fingerprint = bytecode_fingerprint(bc);
+        profile = osfl_prepare_bytecode(bc);
 
         /* 6) Create VM */
         vm = vm_create(bc);
         if (!vm) {
             set_osfl_error(OSFL_ERROR_VM, "Failed to create VM", __FILE__, __LINE__, 0);
-            bytecode_destroy(bc);
-            ast_destroy(root);
-            lexer_destroy(lexer);
-            free(source);
+            profile_destroy(profile);
             status = OSFL_ERROR_VM;
             goto cleanup;
         }
 
-        /* Register native functions */
-        vm_register_native(vm, "print", osfl_print);
-        vm_register_native(vm, "split", osfl_split);
-        vm_register_native(vm, "join", osfl_join);
-        vm_register_native(vm, "substring", osfl_substring);
-        vm_register_native(vm, "replace", osfl_replace);
-        vm_register_native(vm, "to_upper", osfl_to_upper);
-        vm_register_native(vm, "to_lower", osfl_to_lower);
-        vm_register_native(vm, "len", osfl_len);
-        vm_register_native(vm, "append", osfl_append);
-        vm_register_native(vm, "pop", osfl_pop);
-        vm_register_native(vm, "insert", osfl_insert);
-        vm_register_native(vm, "remove", osfl_remove);
-        vm_register_native(vm, "sqrt", osfl_sqrt);
-        vm_register_native(vm, "pow", osfl_pow);
-        vm_register_native(vm, "sin", osfl_sin);
-        vm_register_native(vm, "cos", osfl_cos);
-        vm_register_native(vm, "tan", osfl_tan);
-        vm_register_native(vm, "log", osfl_log);
-        vm_register_native(vm, "abs", osfl_abs);
-        vm_register_native(vm, "int", osfl_int);
-        vm_register_native(vm, "float", osfl_float);
-        vm_register_native(vm, "str", osfl_str);
-        vm_register_native(vm, "bool", osfl_bool);
-        vm_register_native(vm, "open", osfl_open);
-        vm_register_native(vm, "read", osfl_read);
-        vm_register_native(vm, "write", osfl_write);
-        vm_register_native(vm, "close", osfl_close);
-        vm_register_native(vm, "exit", osfl_exit);
-        vm_register_native(vm, "time", osfl_time);
-        vm_register_native(vm, "type", osfl_type);
-        vm_register_native(vm, "range", osfl_range);
-        vm_register_native(vm, "enumerate", osfl_enumerate);
+        /* Register native functions, set the fuel limit */
+        osfl_prepare_vm(vm);
+
+        if (g_osfl_current_config.record_natives || g_osfl_current_config.replay_natives) {
+            replay = g_osfl_current_config.replay_natives
+                ? replay_open(g_osfl_current_config.replay_natives, fingerprint)
+                : replay_record(g_osfl_current_config.record_natives, fingerprint);
+            if (!replay) {
+                set_osfl_error(OSFL_ERROR_FILE_IO, "Could not open the native call log", __FILE__, __LINE__, 0);
+                profile_destroy(profile);
+                status = OSFL_ERROR_FILE_IO;
+                goto cleanup;
+            }
+            vm->replay = replay;
+        }
 
-        vm_run(vm);
+        vm->profile = profile;
+        if (g_osfl_current_config.snapshot_save || g_osfl_current_config.serve_fork) {
+            /* Run the top-level code only; what it built is saved or served. */
+            vm->pause_before_main = true;
+            vm_run(vm);
+        }
+        if (g_osfl_current_config.snapshot_save && vm_paused_at_main(vm) &&
+            !vm_snapshot(vm, g_osfl_current_config.snapshot_save)) {
+            fprintf(stderr, "Continuing without a snapshot.\n");
+        }
+        phase = tracer_now();
+        status = osfl_run_main(vm);
+        tracer_span("pipeline", "run", phase);
+        osfl_finish_profile(profile);
+        profile = NULL;
 
     cleanup:
+        /* Error paths jump here with whatever was built so far; it is freed only here. */
+        regex_cache_clear();
+        replay_close(replay);
         if (vm) vm_destroy(vm);
         if (bc) bytecode_destroy(bc);
         if (root) ast_destroy(root);
@@ -300,6 +464,9 @@ OSFLStatus osfl_run_file(const char* filename) {
         return status;
     }
     __except(EXCEPTION_EXECUTE_HANDLER) {
+        regex_cache_clear();
+        profile_destroy(profile);
+        replay_close(replay);
         if (vm) vm_destroy(vm);
         if (bc) bytecode_destroy(bc);
         if (root) ast_destroy(root);
@@ -359,6 +526,13 @@ OSFLStatus osfl_run_string(const char* source, size_t length) {
     SemanticContext sem_ctx;
     semantic_init(&sem_ctx);
     semantic_analyze(root, &sem_ctx);
+    if (sem_ctx.import_error_count > 0) {
+        set_osfl_error(OSFL_ERROR_FILE_IO, "A plugin could not be loaded", __FILE__, __LINE__, 0);
+        semantic_cleanup(&sem_ctx);
+        ast_destroy(root);
+        lexer_destroy(lexer);
+        return OSFL_ERROR_FILE_IO;
+    }
     if (sem_ctx.error_count > 0) {
         set_osfl_error(OSFL_ERROR_SYNTAX, "Semantic errors in run_string", __FILE__, __LINE__, 0);
         semantic_cleanup(&sem_ctx);
@@ -376,15 +550,21 @@ OSFLStatus osfl_run_string(const char* source, size_t length) {
         lexer_destroy(lexer);
         return OSFL_ERROR_COMPILER;
     }
+    Profile* profile = osfl_prepare_bytecode(bc);
     VM* vm = vm_create(bc);
     if (!vm) {
         set_osfl_error(OSFL_ERROR_VM, "Failed to create VM in run_string", __FILE__, __LINE__, 0);
+        profile_destroy(profile);
         bytecode_destroy(bc);
         ast_destroy(root);
         lexer_destroy(lexer);
         return OSFL_ERROR_VM;
     }
+    osfl_prepare_vm(vm);
+    vm->profile = profile;
     vm_run(vm);
+    osfl_finish_profile(profile);
+    OSFLStatus status = osfl_run_status(vm);
 
     /* cleanup */
     vm_destroy(vm);
@@ -392,7 +572,29 @@ OSFLStatus osfl_run_string(const char* source, size_t length) {
     ast_destroy(root);
     lexer_destroy(lexer);
 
-    return OSFL_SUCCESS;
+    return status;
+}
+
+/**
+ * Run main() of a snapshot. Nothing is compiled and the top-level code does
+ * not run again; only the natives are registered anew.
+ */
+OSFLStatus osfl_run_snapshot(const char* path) {
+    osfl_clear_error();
+    VM* vm = vm_restore(path);
+    if (!vm) {
+        char errbuf[OSFL_MAX_ERROR_LENGTH];
+        snprintf(errbuf, sizeof(errbuf), "Could not restore snapshot '%s'", path ? path : "");
+        set_osfl_error(OSFL_ERROR_FILE_IO, errbuf, __FILE__, __LINE__, 0);
+        return OSFL_ERROR_FILE_IO;
+    }
+    Bytecode* bc = vm->bytecode;
+    osfl_prepare_vm(vm);
+    OSFLStatus status = osfl_run_main(vm);
+    regex_cache_clear();
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    return status;
 }
 
 /**
@@ -425,5 +627,20 @@ OSFLConfig osfl_default_config(void) {
     c.output_file = NULL;
     c.debug_mode = false;
     c.optimize = true;
+    c.profile_generate = NULL;
+    c.profile_use = NULL;
+    c.plugin_count = 0;
+    c.snapshot_save = NULL;
+    c.snapshot_load = NULL;
+    c.serve_fork = false;
+    c.serve_socket = NULL;
+    c.fuel = 0;
+    c.breakpoint_count = 0;
+    c.record_natives = NULL;
+    c.replay_natives = NULL;
+    c.trace_file = NULL;
+    for (size_t i = 0; i < OSFL_MAX_PLUGINS; i++) {
+        c.plugins[i] = NULL;
+    }
     return c;
 }
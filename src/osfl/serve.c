@@ -0,0 +1,212 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "serve.h"
+#include "../runtime/runtime.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/* Workers running at once when jobs come from a stream; more wait for one to finish. */
+#define SERVE_MAX_WORKERS 64
+
+static void serve_error(char* error, size_t error_size, const char* format, ...) {
+    if (!error || error_size == 0) return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, error_size, format, args);
+    va_end(args);
+}
+
+#ifdef _WIN32
+
+bool serve_jobs(VM* vm, FILE* jobs, char* error, size_t error_size) {
+    (void)vm; (void)jobs;
+    serve_error(error, error_size, "Serving jobs needs fork(), which Windows does not have");
+    return false;
+}
+
+bool serve_socket(VM* vm, const char* path, char* error, size_t error_size) {
+    (void)vm; (void)path;
+    serve_error(error, error_size, "Serving jobs needs fork(), which Windows does not have");
+    return false;
+}
+
+#else
+
+/*
+ * Read a line without its newline into *line (grown as needed). With a
+ * stream, 'fd' is ignored; otherwise the line is read from 'fd' a byte at a
+ * time so nothing after it is consumed. False at the end of input.
+ */
+static bool serve_read_line(FILE* stream, int fd, char** line, size_t* capacity) {
+    size_t length = 0;
+    for (;;) {
+        int c;
+        if (stream) {
+            c = fgetc(stream);
+        } else {
+            unsigned char byte;
+            ssize_t n;
+            do {
+                n = read(fd, &byte, 1);
+            } while (n < 0 && errno == EINTR);
+            c = n == 1 ? byte : EOF;
+        }
+        if (c == EOF && length == 0) return false;
+        if (c == EOF || c == '\n') break;
+        if (length + 1 >= *capacity) {
+            size_t grown = *capacity ? *capacity * 2 : 128;
+            char* buffer = (char*)realloc(*line, grown);
+            if (!buffer) return false;
+            *line = buffer;
+            *capacity = grown;
+        }
+        (*line)[length++] = (char)c;
+    }
+    if (!*line) {
+        *line = (char*)malloc(1);
+        if (!*line) return false;
+        *capacity = 1;
+    }
+    if (length > 0 && (*line)[length - 1] == '\r') length--;
+    (*line)[length] = '\0';
+    return true;
+}
+
+/* In the worker: run main() for 'job' and exit. Never returns. */
+static void serve_run_worker(VM* vm, const char* job) {
+    osfl_set_job(job);
+    /* Each job gets the whole fuel budget, whatever the initialization used. */
+    if (vm->fuel_quantum > 0) vm->fuel = vm->fuel_quantum;
+    vm_run(vm);
+    if (vm->out_of_fuel) fprintf(stderr, "Job '%s' ran out of fuel\n", job);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(vm->faulted || vm->out_of_fuel ? 1 : 0);
+}
+
+/* Fork a worker. The buffered output of the server must not be copied into it. */
+static pid_t serve_fork_worker(void) {
+    fflush(stdout);
+    fflush(stderr);
+    return fork();
+}
+
+/* Collect finished workers; with 'block', wait for at least one. Returns how many. */
+static size_t serve_reap(bool block) {
+    size_t reaped = 0;
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, block && reaped == 0 ? 0 : WNOHANG)) > 0 ||
+           (pid < 0 && errno == EINTR)) {
+        if (pid > 0) reaped++;
+    }
+    return reaped;
+}
+
+bool serve_jobs(VM* vm, FILE* jobs, char* error, size_t error_size) {
+    if (!vm_paused_at_main(vm)) {
+        serve_error(error, error_size, "The script has no main() to run for each job");
+        return false;
+    }
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t running = 0;
+    size_t started = 0;
+    bool ok = true;
+    while (serve_read_line(jobs, -1, &line, &capacity)) {
+        if (line[0] == '\0') continue;
+        if (running == SERVE_MAX_WORKERS) {
+            running -= serve_reap(true);
+        }
+        pid_t pid = serve_fork_worker();
+        if (pid == 0) {
+            serve_run_worker(vm, line);
+        }
+        if (pid < 0) {
+            serve_error(error, error_size, "Cannot start a worker: %s", strerror(errno));
+            ok = started > 0;
+            break;
+        }
+        running++;
+        started++;
+        running -= serve_reap(false);
+    }
+    free(line);
+    while (running > 0) {
+        size_t reaped = serve_reap(true);
+        if (reaped == 0) break;
+        running -= reaped;
+    }
+    return ok;
+}
+
+bool serve_socket(VM* vm, const char* path, char* error, size_t error_size) {
+    if (!vm_paused_at_main(vm)) {
+        serve_error(error, error_size, "The script has no main() to run for each job");
+        return false;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(address.sun_path)) {
+        serve_error(error, error_size, "Socket path is too long");
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        serve_error(error, error_size, "Cannot create socket: %s", strerror(errno));
+        return false;
+    }
+    /* A socket file left by an earlier server would make bind() fail. */
+    unlink(path);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        serve_error(error, error_size, "Cannot listen on '%s': %s", path, strerror(errno));
+        close(listener);
+        return false;
+    }
+    fprintf(stderr, "Serving jobs on %s\n", path);
+
+    for (;;) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            serve_error(error, error_size, "Cannot accept a job: %s", strerror(errno));
+            break;
+        }
+        pid_t pid = serve_fork_worker();
+        if (pid == 0) {
+            /* The job is read here rather than in the server, so a slow client holds up only its worker. */
+            close(listener);
+            char* job = NULL;
+            size_t capacity = 0;
+            if (!serve_read_line(NULL, connection, &job, &capacity)) _exit(1);
+            dup2(connection, STDOUT_FILENO);
+            close(connection);
+            serve_run_worker(vm, job);
+        }
+        close(connection);
+        if (pid < 0) {
+            fprintf(stderr, "Cannot start a worker: %s\n", strerror(errno));
+        }
+        serve_reap(false);
+    }
+    close(listener);
+    unlink(path);
+    return false;
+}
+
+#endif
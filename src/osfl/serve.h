@@ -0,0 +1,43 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../vm/vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The serve mode (osfl --serve-fork): a script is compiled and its
+ * top-level code run once, then every job forks a worker from that VM,
+ * paused before main() (see vm_paused_at_main). The worker shares the
+ * bytecode and the heap built so far with the server copy-on-write, runs
+ * main() with job() returning the job's text, and exits, so starting a job
+ * costs a fork rather than a compile and an initialization.
+ *
+ * A job is one line of text. Only available where fork() is (not on
+ * Windows).
+ */
+
+/**
+ * Run a worker for each line read from 'jobs' until it ends, then wait for
+ * the workers still running. Workers write to the server's stdout.
+ * Returns false, with the reason in 'error', if no worker could be started.
+ */
+bool serve_jobs(VM* vm, FILE* jobs, char* error, size_t error_size);
+
+/**
+ * Listen on the Unix socket 'path' and run a worker for each connection:
+ * the first line the client sends is the job, and what the worker prints
+ * goes back to the client. Does not return unless the socket fails.
+ */
+bool serve_socket(VM* vm, const char* path, char* error, size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVE_H */
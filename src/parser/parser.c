@@ -10,6 +10,7 @@ static Token parser_peek(Parser* parser);
 static Token parser_advance(Parser* parser);
 static int   parser_match(Parser* parser, OSFLTokenType type);
 static void  parser_consume(Parser* parser, OSFLTokenType type, const char* error_message);
+static SymbolId token_symbol(const Token* tok);
 
 /* ------------------------------------------------------------------
  * FORWARD DECLARATIONS OF PARSE FUNCTIONS
@@ -22,6 +23,7 @@ static AstNode* parse_block(Parser* parser);
 static AstNode* parse_frame(Parser* parser);
 static AstNode* parse_var_decl(Parser* parser);
 static AstNode* parse_func_decl(Parser* parser);
+static AstNode* parse_function_rest(Parser* parser, const Token* funcTok, const char* name, SymbolId symbol);
 static AstNode* parse_class_decl(Parser* parser);
 static AstNode* parse_import_decl(Parser* parser);
 
@@ -31,6 +33,7 @@ static AstNode* parse_for_stmt(Parser* parser);
 static AstNode* parse_switch_stmt(Parser* parser);
 static AstNode* parse_try_catch_stmt(Parser* parser);
 static AstNode* parse_on_error_stmt(Parser* parser);
+static AstNode* parse_retry_stmt(Parser* parser);
 
 /* New: Return statement parser */
 static AstNode* parse_return_stmt(Parser* parser);
@@ -52,6 +55,7 @@ static AstNode* parse_factor(Parser* parser);
 static AstNode* parse_power(Parser* parser);
 static AstNode* parse_unary(Parser* parser);
 static AstNode* parse_primary(Parser* parser);
+static AstNode* parse_interpolation(Parser* parser, const Token* first);
 
 /* 
  * Utility for building dynamic arrays of AstNode*
@@ -111,6 +115,11 @@ static void skip_whitespace(Parser* parser) {
 /* ------------------------------------------------------------------
  * TOKEN HELPERS
  * ------------------------------------------------------------------ */
+/* The lexer interns identifiers; anything else used as a name is interned here. */
+static SymbolId token_symbol(const Token* tok) {
+    return tok->symbol != SYMBOL_ID_NONE ? tok->symbol : intern_cstr(tok->text);
+}
+
 static Token parser_peek(Parser* parser) {
     /* Skip any whitespace tokens */
     skip_whitespace(parser);
@@ -134,6 +143,16 @@ static Token parser_advance(Parser* parser) {
     return eof;
 }
 
+/* The token after the next one, without consuming either. */
+static Token parser_peek_next(Parser* parser) {
+    parser_peek(parser);
+    size_t saved = parser->current;
+    parser_advance(parser);
+    Token t = parser_peek(parser);
+    parser->current = saved;
+    return t;
+}
+
 static int parser_match(Parser* parser, OSFLTokenType type) {
     if (parser_peek(parser).type == type) {
         parser_advance(parser);
@@ -232,8 +251,13 @@ static AstNode* parse_statement(Parser* parser) {
         case TOKEN_SWITCH:   return parse_switch_stmt(parser);
         case TOKEN_TRY:      return parse_try_catch_stmt(parser);
         case TOKEN_ON_ERROR: return parse_on_error_stmt(parser);
+        case TOKEN_RETRY:    return parse_retry_stmt(parser);
         case TOKEN_RETURN:   return parse_return_stmt(parser);  // Return statement
         case TOKEN_LBRACE:   return parse_block(parser);
+        case TOKEN_FUNC:
+            // A nested function declaration; 'func (' starts a function expression.
+            if (parser_peek_next(parser).type == TOKEN_IDENTIFIER) return parse_func_decl(parser);
+            return parse_expression_stmt(parser);
         default:
             return parse_expression_stmt(parser);
     }
@@ -332,7 +356,10 @@ static AstNode* parse_var_decl(Parser* parser) {
     varNode->loc = declTok.location;
     varNode->as.var_decl.is_const = is_const;
     varNode->as.var_decl.var_name = strdup(nameTok.text);
+    varNode->as.var_decl.var_symbol = token_symbol(&nameTok);
     varNode->as.var_decl.initializer = init_expr;
+    varNode->as.var_decl.slot = -1;
+    varNode->as.var_decl.field_slot = -1;
     return varNode;
 }
 
@@ -340,10 +367,15 @@ static AstNode* parse_var_decl(Parser* parser) {
 static AstNode* parse_func_decl(Parser* parser) {
     Token funcTok = parser_advance(parser);
     Token nameTok = parser_advance(parser);
+    return parse_function_rest(parser, &funcTok, nameTok.text, token_symbol(&nameTok));
+}
 
+/* (params) { body } after 'func' and the name, if any. */
+static AstNode* parse_function_rest(Parser* parser, const Token* funcTok, const char* name, SymbolId symbol) {
     parser_consume(parser, TOKEN_LPAREN, "Expected '(' after function name.");
 
     char** params = NULL;
+    SymbolId* param_symbols = NULL;
     size_t param_count = 0;
     while (parser_peek(parser).type != TOKEN_RPAREN &&
            parser_peek(parser).type != TOKEN_EOF) 
@@ -351,6 +383,8 @@ static AstNode* parse_func_decl(Parser* parser) {
         Token p = parser_advance(parser);
         params = (char**)realloc(params, sizeof(char*) * (param_count + 1));
         params[param_count] = strdup(p.text);
+        param_symbols = (SymbolId*)realloc(param_symbols, sizeof(SymbolId) * (param_count + 1));
+        param_symbols[param_count] = token_symbol(&p);
         param_count++;
         if (!parser_match(parser, TOKEN_COMMA)) {
             break;
@@ -375,22 +409,45 @@ static AstNode* parse_func_decl(Parser* parser) {
     parser_consume(parser, TOKEN_RBRACE, "Expected '}' after function body.");
 
     /* Build a block node for the body */
-    AstNode* bodyBlock = make_block_node(&funcTok.location, body_stmts, body_count);
+    AstNode* bodyBlock = make_block_node(&funcTok->location, body_stmts, body_count);
 
     AstNode* funcNode = (AstNode*)calloc(1, sizeof(AstNode));
     funcNode->type = AST_NODE_FUNC_DECL;
-    funcNode->loc = funcTok.location;
-    funcNode->as.func_decl.func_name = strdup(nameTok.text);
+    funcNode->loc = funcTok->location;
+    funcNode->as.func_decl.func_name = strdup(name);
+    funcNode->as.func_decl.func_symbol = symbol;
     funcNode->as.func_decl.param_count = param_count;
     funcNode->as.func_decl.param_names = params;
+    funcNode->as.func_decl.param_symbols = param_symbols;
     funcNode->as.func_decl.body = bodyBlock;
+    funcNode->as.func_decl.func_index = -1;
+    funcNode->as.func_decl.closure_slot = -1;
     return funcNode;
 }
 
-/* class <name> { ... } => AST_NODE_CLASS_DECL */
+/* Methods receive the object they are called on as a leading parameter 'this'. */
+static void add_this_param(AstNode* func) {
+    AstFuncDeclData* fn = &func->as.func_decl;
+    size_t count = fn->param_count + 1;
+    fn->param_names = (char**)realloc(fn->param_names, sizeof(char*) * count);
+    fn->param_symbols = (SymbolId*)realloc(fn->param_symbols, sizeof(SymbolId) * count);
+    memmove(fn->param_names + 1, fn->param_names, sizeof(char*) * fn->param_count);
+    memmove(fn->param_symbols + 1, fn->param_symbols, sizeof(SymbolId) * fn->param_count);
+    fn->param_names[0] = strdup("this");
+    fn->param_symbols[0] = intern_cstr("this");
+    fn->param_count = count;
+}
+
+/* class <name> (: <parent>) { ... } => AST_NODE_CLASS_DECL */
 static AstNode* parse_class_decl(Parser* parser) {
     Token classTok = parser_advance(parser);
     Token nameTok = parser_advance(parser);
+    SymbolId parent = SYMBOL_ID_NONE;
+    if (parser_match(parser, TOKEN_COLON)) {
+        Token parentTok = parser_peek(parser);
+        parser_consume(parser, TOKEN_IDENTIFIER, "Expected a parent class name after ':'.");
+        parent = token_symbol(&parentTok);
+    }
 
     parser_consume(parser, TOKEN_LBRACE, "Expected '{' after class name.");
 
@@ -404,6 +461,9 @@ static AstNode* parse_class_decl(Parser* parser) {
             parser_advance(parser);
             continue;
         }
+        if (m->type == AST_NODE_FUNC_DECL) {
+            add_this_param(m);
+        }
         append_node(&members, &member_count, m);
     }
     parser_consume(parser, TOKEN_RBRACE, "Expected '}' after class body.");
@@ -412,23 +472,37 @@ static AstNode* parse_class_decl(Parser* parser) {
     classNode->type = AST_NODE_CLASS_DECL;
     classNode->loc = classTok.location;
     classNode->as.class_decl.class_name = strdup(nameTok.text);
+    classNode->as.class_decl.class_symbol = token_symbol(&nameTok);
+    classNode->as.class_decl.parent_symbol = parent;
     classNode->as.class_decl.members = members;
     classNode->as.class_decl.member_count = member_count;
+    classNode->as.class_decl.class_index = -1;
+    classNode->as.class_decl.parent_index = -1;
     return classNode;
 }
 
-/* import "module"; => AST_EXPR_LITERAL or a custom node */
+/* import "dir/name.osfl"; => AST_NODE_IMPORT binding 'name' */
 static AstNode* parse_import_decl(Parser* parser) {
     Token importTok = parser_advance(parser);
-    Token modTok = parser_advance(parser);
+    Token modTok = parser_peek(parser);
+    parser_consume(parser, TOKEN_STRING, "Expected a module path string after 'import'.");
     parser_match(parser, TOKEN_SEMICOLON);
 
-    /* Treat as a literal node with literal_type=TOKEN_IMPORT */
+    // The module is referred to by its file name without directory or extension.
+    const char* base = modTok.text;
+    for (const char* c = modTok.text; *c; c++) {
+        if (*c == '/' || *c == '\\') base = c + 1;
+    }
+    const char* dot = strrchr(base, '.');
+    size_t base_len = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+
     AstNode* node = (AstNode*)calloc(1, sizeof(AstNode));
-    node->type = AST_EXPR_LITERAL;
+    node->type = AST_NODE_IMPORT;
     node->loc = importTok.location;
-    node->as.literal.literal_type = TOKEN_IMPORT;
-    node->as.literal.str_val = strdup(modTok.text);
+    node->as.import_decl.path = strdup(modTok.text);
+    node->as.import_decl.alias = intern_name(base, base_len);
+    node->as.import_decl.index = -1;
+    node->as.import_decl.plugin = false;
     return node;
 }
 
@@ -493,7 +567,10 @@ static AstNode* parse_for_stmt(Parser* parser) {
     return node;
 }
 
-/* switch (<expr>) { ... } => stored as an AST_EXPR_BINARY node with op=TOKEN_SWITCH */
+/*
+ * switch (<expr>) { case <lit>, <lit>: <stmts> ... default: <stmts> } => AST_NODE_SWITCH_STMT
+ * An arm runs until the next case/default label; there is no fallthrough.
+ */
 static AstNode* parse_switch_stmt(Parser* parser) {
     Token swTok = parser_advance(parser);
     parser_consume(parser, TOKEN_LPAREN, "Expected '(' after 'switch'.");
@@ -501,22 +578,56 @@ static AstNode* parse_switch_stmt(Parser* parser) {
     parser_consume(parser, TOKEN_RPAREN, "Expected ')' after switch expression.");
 
     parser_consume(parser, TOKEN_LBRACE, "Expected '{' after switch(...).");
-    AstNode** cases = NULL;
+    AstSwitchCase* cases = NULL;
     size_t case_count = 0;
     while (parser_peek(parser).type != TOKEN_RBRACE &&
            parser_peek(parser).type != TOKEN_EOF)
     {
-        AstNode* c = parse_statement(parser);
-        if (!c) {
-            parser_advance(parser);
+        Token armTok = parser_advance(parser);
+        AstNode** labels = NULL;
+        size_t label_count = 0;
+        if (armTok.type == TOKEN_CASE) {
+            do {
+                AstNode* label = parse_expression(parser);
+                if (!label) break;
+                append_node(&labels, &label_count, label);
+            } while (parser_match(parser, TOKEN_COMMA));
+        } else if (armTok.type != TOKEN_DEFAULT) {
+            fprintf(stderr, "Parse error at %s:%d: Expected 'case' or 'default' in switch, got '%s'.\n",
+                    armTok.location.file, (int)armTok.location.line, armTok.text);
             continue;
         }
-        append_node(&cases, &case_count, c);
+        parser_consume(parser, TOKEN_COLON, "Expected ':' after case label.");
+
+        AstNode** body_stmts = NULL;
+        size_t body_count = 0;
+        while (parser_peek(parser).type != TOKEN_CASE &&
+               parser_peek(parser).type != TOKEN_DEFAULT &&
+               parser_peek(parser).type != TOKEN_RBRACE &&
+               parser_peek(parser).type != TOKEN_EOF)
+        {
+            AstNode* st = parse_statement(parser);
+            if (!st) {
+                parser_advance(parser);
+                continue;
+            }
+            append_node(&body_stmts, &body_count, st);
+        }
+
+        cases = (AstSwitchCase*)realloc(cases, sizeof(AstSwitchCase) * (case_count + 1));
+        cases[case_count].labels = labels;
+        cases[case_count].label_count = label_count;
+        cases[case_count].body = make_block_node(&armTok.location, body_stmts, body_count);
+        case_count++;
     }
     parser_consume(parser, TOKEN_RBRACE, "Expected '}' after switch.");
 
-    AstNode* caseBlock = make_block_node(&swTok.location, cases, case_count);
-    AstNode* switchNode = make_expr_binary(TOKEN_SWITCH, expr, caseBlock, &swTok.location);
+    AstNode* switchNode = (AstNode*)calloc(1, sizeof(AstNode));
+    switchNode->type = AST_NODE_SWITCH_STMT;
+    switchNode->loc = swTok.location;
+    switchNode->as.switch_stmt.subject = expr;
+    switchNode->as.switch_stmt.cases = cases;
+    switchNode->as.switch_stmt.case_count = case_count;
     return switchNode;
 }
 
@@ -528,15 +639,24 @@ static AstNode* parse_try_catch_stmt(Parser* parser) {
     AstNode* node = (AstNode*)calloc(1, sizeof(AstNode));
     node->type = AST_NODE_TRY_CATCH;
     node->loc = tryTok.location;
-    node->as.error_handler.handler_body = tryBlock; 
+    node->as.error_handler.handler_body = tryBlock;
 
     if (parser_match(parser, TOKEN_CATCH)) {
-        AstNode* catchBlock = parse_statement(parser);
-        node->next_sibling = catchBlock;
+        node->as.error_handler.catch_body = parse_statement(parser);
     }
     return node;
 }
 
+/* retry; => AST_NODE_RETRY_STMT */
+static AstNode* parse_retry_stmt(Parser* parser) {
+    Token retryTok = parser_advance(parser); // 'retry'
+    parser_match(parser, TOKEN_SEMICOLON);
+    AstNode* node = (AstNode*)calloc(1, sizeof(AstNode));
+    node->type = AST_NODE_RETRY_STMT;
+    node->loc = retryTok.location;
+    return node;
+}
+
 /* on_error { ... } => AST_NODE_ERROR_HANDLER */
 static AstNode* parse_on_error_stmt(Parser* parser) {
     Token errTok = parser_advance(parser);
@@ -783,6 +903,7 @@ static AstNode* parse_call(Parser* parser, AstNode* callee) {
     // Allocate and fill in the call node.
     AstNode* call_node = (AstNode*)calloc(1, sizeof(AstNode));
     call_node->type = AST_EXPR_CALL;
+    call_node->loc = callee->loc;
     call_node->as.call.callee = callee;
     call_node->as.call.args = args;
     call_node->as.call.arg_count = arg_count;
@@ -806,45 +927,60 @@ static AstNode* parse_primary(Parser* parser) {
         case TOKEN_REGEX: {
             parser_advance(parser);
             AstNode* regNode = (AstNode*)calloc(1, sizeof(AstNode));
-            regNode->type = AST_NODE_REGEX;
+            regNode->type = AST_EXPR_LITERAL;
             regNode->loc = t.location;
             regNode->as.literal.literal_type = TOKEN_REGEX;
             regNode->as.literal.str_val = strdup(t.text);
             return regNode;
         }
-        case TOKEN_INTERPOLATION_START: {
-            Token startTok = parser_advance(parser);
-            AstNode* innerExpr = parse_expression(parser);
-            parser_consume(parser, TOKEN_INTERPOLATION_END, "Expected '}' after interpolation expression.");
-            AstNode* interp = (AstNode*)calloc(1, sizeof(AstNode));
-            interp->type = AST_EXPR_INTERPOLATION;
-            interp->loc = startTok.location;
-            interp->as.interpolation.expr = innerExpr;
-            return interp;
-        }
         case TOKEN_LPAREN: {
             parser_advance(parser);
             AstNode* e = parse_expression(parser);
             parser_consume(parser, TOKEN_RPAREN, "Expected ')' after parenthesized expr.");
             return e;
         }
+        case TOKEN_STRING: {
+            Token litTok = parser_advance(parser);
+            if (parser_peek(parser).type == TOKEN_INTERPOLATION_START) {
+                return parse_interpolation(parser, &litTok);
+            }
+            return make_expr_literal(&litTok);
+        }
         case TOKEN_INTEGER:
         case TOKEN_FLOAT:
-        case TOKEN_STRING:
         case TOKEN_BOOL_TRUE:
         case TOKEN_BOOL_FALSE:
         {
             Token litTok = parser_advance(parser);
             return make_expr_literal(&litTok);
         }
+        case TOKEN_FUNC: {
+            // func (params) { body }: an anonymous function, made into a closure where it appears.
+            Token funcTok = parser_advance(parser);
+            return parse_function_rest(parser, &funcTok, "<func>", SYMBOL_ID_NONE);
+        }
         case TOKEN_IDENTIFIER: {
             Token idTok = parser_advance(parser);
             AstNode* node = make_expr_identifier(&idTok);
-            // Check if the next token is a '(' indicating a function call.
-            while (parser_peek(parser).type == TOKEN_LPAREN) {
-                // Consume '(' and build a call node.
-                parser_advance(parser); // consume '('
-                node = parse_call(parser, node);
+            // Calls and member accesses chain: f(x), lib.f(x), a.b.c
+            for (;;) {
+                if (parser_match(parser, TOKEN_LPAREN)) {
+                    node = parse_call(parser, node);
+                } else if (parser_peek(parser).type == TOKEN_DOT) {
+                    Token dotTok = parser_advance(parser);
+                    Token memberTok = parser_peek(parser);
+                    parser_consume(parser, TOKEN_IDENTIFIER, "Expected a member name after '.'.");
+                    AstNode* member = (AstNode*)calloc(1, sizeof(AstNode));
+                    member->type = AST_EXPR_MEMBER;
+                    member->loc = dotTok.location;
+                    member->as.member_expr.object = node;
+                    member->as.member_expr.member_name = strdup(memberTok.text);
+                    member->as.member_expr.member_symbol = token_symbol(&memberTok);
+                    member->as.member_expr.field_slot = -1;
+                    node = member;
+                } else {
+                    break;
+                }
             }
             return node;
         }
@@ -856,6 +992,29 @@ static AstNode* parse_primary(Parser* parser) {
     }
 }
 
+/* "a ${x} b" => AST_EXPR_INTERPOLATION with parts "a ", x, " b" */
+static AstNode* parse_interpolation(Parser* parser, const Token* first) {
+    AstNode** parts = NULL;
+    size_t part_count = 0;
+    append_node(&parts, &part_count, make_expr_literal(first));
+    while (parser_match(parser, TOKEN_INTERPOLATION_START)) {
+        append_node(&parts, &part_count, parse_expression(parser));
+        parser_consume(parser, TOKEN_INTERPOLATION_END, "Expected '}' after interpolation expression.");
+        // The lexer follows every interpolation with the next string segment.
+        if (parser_peek(parser).type == TOKEN_STRING) {
+            Token segment = parser_advance(parser);
+            append_node(&parts, &part_count, make_expr_literal(&segment));
+        }
+    }
+
+    AstNode* node = (AstNode*)calloc(1, sizeof(AstNode));
+    node->type = AST_EXPR_INTERPOLATION;
+    node->loc = first->location;
+    node->as.interpolation.parts = parts;
+    node->as.interpolation.part_count = part_count;
+    return node;
+}
+
 /* ------------------------------------------------------------------
  * Constructors for expressions
  * ------------------------------------------------------------------ */
@@ -891,7 +1050,8 @@ static AstNode* make_expr_identifier(const Token* tok) {
     AstNode* node = (AstNode*)calloc(1, sizeof(AstNode));
     node->type = AST_EXPR_IDENTIFIER;
     node->loc = tok->location;
-    node->as.ident.name = strdup(tok->text);
+    node->as.ident.symbol = token_symbol(tok);
+    node->as.ident.name = intern_text(node->as.ident.symbol);
     return node;
 }
 
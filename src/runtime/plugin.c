@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "plugin.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+typedef struct {
+    char* path;                 /* as given to plugin_load */
+    void* handle;
+    const OSFLPlugin* plugin;
+} LoadedPlugin;
+
+static LoadedPlugin* g_plugins = NULL;
+static size_t g_plugin_count = 0;
+static size_t g_plugin_capacity = 0;
+
+static void plugin_error(char* error, size_t error_size, const char* format, ...) {
+    if (!error || error_size == 0) return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, error_size, format, args);
+    va_end(args);
+}
+
+#ifdef _WIN32
+static void* plugin_open(const char* path) { return (void*)LoadLibraryA(path); }
+static void* plugin_symbol(void* handle, const char* name) { return (void*)GetProcAddress((HMODULE)handle, name); }
+static void plugin_close(void* handle) { FreeLibrary((HMODULE)handle); }
+static const char* plugin_last_error(void) { return "LoadLibrary failed"; }
+#else
+static void* plugin_open(const char* path) { return dlopen(path, RTLD_NOW | RTLD_LOCAL); }
+static void* plugin_symbol(void* handle, const char* name) { return dlsym(handle, name); }
+static void plugin_close(void* handle) { dlclose(handle); }
+static const char* plugin_last_error(void) { return dlerror(); }
+#endif
+
+bool plugin_is_library(const char* path) {
+    static const char* suffixes[] = { ".so", ".dylib", ".dll" };
+    size_t length = path ? strlen(path) : 0;
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        size_t suffix_length = strlen(suffixes[i]);
+        if (length > suffix_length && strcmp(path + length - suffix_length, suffixes[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool plugin_load(const char* path, char* error, size_t error_size) {
+    if (!path) {
+        plugin_error(error, error_size, "No plugin path given");
+        return false;
+    }
+    for (size_t i = 0; i < g_plugin_count; i++) {
+        if (strcmp(g_plugins[i].path, path) == 0) return true;
+    }
+
+    void* handle = plugin_open(path);
+    if (!handle) {
+        const char* reason = plugin_last_error();
+        plugin_error(error, error_size, "Cannot load plugin '%s': %s", path, reason ? reason : "unknown error");
+        return false;
+    }
+    OSFLPluginInit init = (OSFLPluginInit)plugin_symbol(handle, OSFL_PLUGIN_ENTRY);
+    const OSFLPlugin* plugin = init ? init() : NULL;
+    if (!plugin) {
+        plugin_error(error, error_size, "Plugin '%s' does not export %s", path, OSFL_PLUGIN_ENTRY);
+        plugin_close(handle);
+        return false;
+    }
+    if (plugin->abi_version != OSFL_PLUGIN_ABI_VERSION) {
+        plugin_error(error, error_size, "Plugin '%s' was built for another version of the plugin ABI", path);
+        plugin_close(handle);
+        return false;
+    }
+    for (size_t i = 0; i < plugin->native_count; i++) {
+        if (!plugin->natives[i].name || !plugin->natives[i].func) {
+            plugin_error(error, error_size, "Plugin '%s' has a native without a name or function", path);
+            plugin_close(handle);
+            return false;
+        }
+    }
+
+    if (g_plugin_count == g_plugin_capacity) {
+        size_t capacity = g_plugin_capacity ? g_plugin_capacity * 2 : 4;
+        LoadedPlugin* plugins = (LoadedPlugin*)realloc(g_plugins, capacity * sizeof(LoadedPlugin));
+        if (!plugins) {
+            plugin_error(error, error_size, "Out of memory loading plugin '%s'", path);
+            plugin_close(handle);
+            return false;
+        }
+        g_plugins = plugins;
+        g_plugin_capacity = capacity;
+    }
+    char* copy = strdup(path);
+    if (!copy) {
+        plugin_error(error, error_size, "Out of memory loading plugin '%s'", path);
+        plugin_close(handle);
+        return false;
+    }
+    g_plugins[g_plugin_count].path = copy;
+    g_plugins[g_plugin_count].handle = handle;
+    g_plugins[g_plugin_count].plugin = plugin;
+    g_plugin_count++;
+    return true;
+}
+
+bool plugin_import(const char* importer, const char* path, char* error, size_t error_size) {
+    size_t dir_length = 0;
+    bool absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+    if (importer && !absolute) {
+        for (const char* c = importer; *c; c++) {
+            if (*c == '/' || *c == '\\') dir_length = (size_t)(c - importer) + 1;
+        }
+    }
+    /* A bare name would send the loader searching the library path. */
+    const char* dir = dir_length > 0 ? importer : (absolute ? "" : "./");
+    if (dir_length == 0) dir_length = strlen(dir);
+    size_t path_length = strlen(path);
+    char* resolved = (char*)malloc(dir_length + path_length + 1);
+    if (!resolved) {
+        plugin_error(error, error_size, "Out of memory loading plugin '%s'", path);
+        return false;
+    }
+    memcpy(resolved, dir, dir_length);
+    memcpy(resolved + dir_length, path, path_length + 1);
+    bool ok = plugin_load(resolved, error, error_size);
+    free(resolved);
+    return ok;
+}
+
+size_t plugin_native_count(void) {
+    size_t count = 0;
+    for (size_t i = 0; i < g_plugin_count; i++) {
+        count += g_plugins[i].plugin->native_count;
+    }
+    return count;
+}
+
+const NativeDescriptor* plugin_native(size_t index) {
+    for (size_t i = 0; i < g_plugin_count; i++) {
+        const OSFLPlugin* plugin = g_plugins[i].plugin;
+        if (index < plugin->native_count) return &plugin->natives[index];
+        index -= plugin->native_count;
+    }
+    return NULL;
+}
+
+const NativeDescriptor* plugin_find_native(const char* name) {
+    for (size_t i = g_plugin_count; name && i-- > 0;) {
+        const OSFLPlugin* plugin = g_plugins[i].plugin;
+        for (size_t j = 0; j < plugin->native_count; j++) {
+            if (strcmp(plugin->natives[j].name, name) == 0) {
+                return &plugin->natives[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+void plugin_unload_all(void) {
+    for (size_t i = g_plugin_count; i-- > 0;) {
+        plugin_close(g_plugins[i].handle);
+        free(g_plugins[i].path);
+    }
+    free(g_plugins);
+    g_plugins = NULL;
+    g_plugin_count = g_plugin_capacity = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "../../include/osfl_plugin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The plugins loaded in this process (see osfl_plugin.h). A plugin is loaded
+ * once per path and stays loaded until plugin_unload_all().
+ */
+
+/* True if 'path' names a shared library rather than a script module. */
+bool plugin_is_library(const char* path);
+
+/**
+ * Load the plugin at 'path'. Loading the same path again does nothing.
+ * On failure returns false and writes the reason to 'error' (if given).
+ */
+bool plugin_load(const char* path, char* error, size_t error_size);
+
+/**
+ * Load the plugin 'path' names in an import of the file 'importer', which
+ * is resolved relative to the importer's directory.
+ */
+bool plugin_import(const char* importer, const char* path, char* error, size_t error_size);
+
+/* The natives of every loaded plugin, in load order. */
+size_t plugin_native_count(void);
+const NativeDescriptor* plugin_native(size_t index);
+
+/* The native 'name' of a loaded plugin, or NULL. A later plugin wins. */
+const NativeDescriptor* plugin_find_native(const char* name);
+
+void plugin_unload_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLUGIN_H */
@@ -0,0 +1,758 @@
+#include "regex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define REGEX_MAX_PROGRAM 8192
+#define REGEX_MAX_REPEAT 1000
+
+typedef enum {
+    RX_CHAR,    /* ch */
+    RX_ANY,     /* any byte but '\n' */
+    RX_CLASS,   /* byte in classes[x] */
+    RX_BOL,
+    RX_EOL,
+    RX_SPLIT,   /* continue at x, and at y with lower priority */
+    RX_JMP,     /* continue at x */
+    RX_MATCH
+} RxOp;
+
+typedef struct {
+    uint8_t op;
+    uint8_t ch;
+    int x;
+    int y;
+} RxInst;
+
+typedef struct {
+    uint8_t bits[32];
+} RxClass;
+
+struct Regex {
+    RxInst* code;
+    size_t count;
+    RxClass* classes;
+    size_t class_count;
+    unsigned char* prefix;  /* literal every match starts with */
+    size_t prefix_length;
+    bool anchored;          /* the program starts with ^ */
+};
+
+/* ---------------------------------------------------------------------
+ * Parsing: the pattern becomes a tree of RxNodes, which is then compiled.
+ * A tree makes counted repetition simple, since a sub-pattern can be
+ * emitted as many times as needed.
+ * --------------------------------------------------------------------- */
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_CHAR,
+    NODE_ANY,
+    NODE_CLASS,
+    NODE_BOL,
+    NODE_EOL,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_REPEAT
+} RxNodeKind;
+
+typedef struct {
+    RxNodeKind kind;
+    int left;       /* CAT, ALT, REPEAT */
+    int right;      /* CAT, ALT */
+    int min;        /* REPEAT */
+    int max;        /* REPEAT; -1 = unbounded */
+    bool greedy;    /* REPEAT */
+    uint8_t ch;     /* CHAR */
+    int cls;        /* CLASS */
+} RxNode;
+
+typedef struct {
+    const char* p;
+    const char* error;
+
+    RxNode* nodes;
+    size_t node_count;
+    size_t node_capacity;
+
+    RxClass* classes;
+    size_t class_count;
+    size_t class_capacity;
+
+    RxInst* code;
+    size_t count;
+    size_t capacity;
+} RxCompiler;
+
+static int parse_alt(RxCompiler* c);
+
+static bool grow(void** items, size_t* capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) return true;
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    while (new_capacity < needed) new_capacity *= 2;
+    void* grown = realloc(*items, new_capacity * item_size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static int new_node(RxCompiler* c, RxNodeKind kind) {
+    if (!grow((void**)&c->nodes, &c->node_capacity, c->node_count + 1, sizeof(RxNode))) {
+        c->error = "out of memory";
+        return -1;
+    }
+    RxNode* node = &c->nodes[c->node_count];
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    node->left = node->right = -1;
+    return (int)c->node_count++;
+}
+
+static int new_pair(RxCompiler* c, RxNodeKind kind, int left, int right) {
+    int n = new_node(c, kind);
+    if (n >= 0) {
+        c->nodes[n].left = left;
+        c->nodes[n].right = right;
+    }
+    return n;
+}
+
+static int new_class(RxCompiler* c) {
+    if (!grow((void**)&c->classes, &c->class_capacity, c->class_count + 1, sizeof(RxClass))) {
+        c->error = "out of memory";
+        return -1;
+    }
+    memset(&c->classes[c->class_count], 0, sizeof(RxClass));
+    return (int)c->class_count++;
+}
+
+static void class_set(RxClass* cls, unsigned char ch) {
+    cls->bits[ch >> 3] |= (uint8_t)(1u << (ch & 7));
+}
+
+static bool class_has(const RxClass* cls, unsigned char ch) {
+    return (cls->bits[ch >> 3] >> (ch & 7)) & 1u;
+}
+
+/* Add the set named by escape 'e' (\d, \w, \s or their negations); false if 'e' names none. */
+static bool class_add_escape(RxClass* cls, char e) {
+    RxClass set;
+    memset(&set, 0, sizeof(set));
+    switch (e) {
+        case 'd': case 'D':
+            for (int ch = '0'; ch <= '9'; ch++) class_set(&set, (unsigned char)ch);
+            break;
+        case 'w': case 'W':
+            for (int ch = '0'; ch <= '9'; ch++) class_set(&set, (unsigned char)ch);
+            for (int ch = 'a'; ch <= 'z'; ch++) class_set(&set, (unsigned char)ch);
+            for (int ch = 'A'; ch <= 'Z'; ch++) class_set(&set, (unsigned char)ch);
+            class_set(&set, '_');
+            break;
+        case 's': case 'S':
+            for (const char* ws = " \t\n\r\f\v"; *ws; ws++) class_set(&set, (unsigned char)*ws);
+            break;
+        default:
+            return false;
+    }
+    bool negate = e == 'D' || e == 'W' || e == 'S';
+    for (int i = 0; i < 32; i++) {
+        cls->bits[i] |= negate ? (uint8_t)~set.bits[i] : set.bits[i];
+    }
+    return true;
+}
+
+static unsigned char escaped_char(char e) {
+    switch (e) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        default:  return (unsigned char)e;
+    }
+}
+
+static int parse_class(RxCompiler* c) {
+    c->p++;  /* '[' */
+    bool negate = false;
+    if (*c->p == '^') {
+        negate = true;
+        c->p++;
+    }
+    int cls = new_class(c);
+    if (cls < 0) return -1;
+    bool first = true;
+    while (*c->p && (*c->p != ']' || first)) {
+        first = false;
+        unsigned char lo;
+        if (*c->p == '\\') {
+            c->p++;
+            if (!*c->p) break;
+            if (class_add_escape(&c->classes[cls], *c->p)) {
+                c->p++;
+                continue;
+            }
+            lo = escaped_char(*c->p++);
+        } else {
+            lo = (unsigned char)*c->p++;
+        }
+        unsigned char hi = lo;
+        if (c->p[0] == '-' && c->p[1] && c->p[1] != ']') {
+            c->p++;
+            if (*c->p == '\\') {
+                c->p++;
+                if (!*c->p) break;
+            }
+            hi = escaped_char(*c->p++);
+            if (hi < lo) {
+                c->error = "invalid range in character class";
+                return -1;
+            }
+        }
+        for (unsigned ch = lo; ch <= hi; ch++) {
+            class_set(&c->classes[cls], (unsigned char)ch);
+        }
+    }
+    if (*c->p != ']') {
+        c->error = "missing ']'";
+        return -1;
+    }
+    c->p++;
+    if (negate) {
+        for (int i = 0; i < 32; i++) {
+            c->classes[cls].bits[i] = (uint8_t)~c->classes[cls].bits[i];
+        }
+    }
+    int n = new_node(c, NODE_CLASS);
+    if (n >= 0) c->nodes[n].cls = cls;
+    return n;
+}
+
+static int parse_atom(RxCompiler* c) {
+    char ch = *c->p;
+    switch (ch) {
+        case '(': {
+            c->p++;
+            if (c->p[0] == '?' && c->p[1] == ':') c->p += 2;  /* groups never capture */
+            int n = parse_alt(c);
+            if (n < 0) return -1;
+            if (*c->p != ')') {
+                c->error = "missing ')'";
+                return -1;
+            }
+            c->p++;
+            return n;
+        }
+        case '[':
+            return parse_class(c);
+        case '.':
+            c->p++;
+            return new_node(c, NODE_ANY);
+        case '^':
+            c->p++;
+            return new_node(c, NODE_BOL);
+        case '$':
+            c->p++;
+            return new_node(c, NODE_EOL);
+        case '*': case '+': case '?': case '{':
+            c->error = "nothing to repeat";
+            return -1;
+        case '\\': {
+            c->p++;
+            if (!*c->p) {
+                c->error = "trailing backslash";
+                return -1;
+            }
+            char e = *c->p++;
+            RxClass set;
+            memset(&set, 0, sizeof(set));
+            if (class_add_escape(&set, e)) {
+                int cls = new_class(c);
+                if (cls < 0) return -1;
+                c->classes[cls] = set;
+                int n = new_node(c, NODE_CLASS);
+                if (n >= 0) c->nodes[n].cls = cls;
+                return n;
+            }
+            int n = new_node(c, NODE_CHAR);
+            if (n >= 0) c->nodes[n].ch = escaped_char(e);
+            return n;
+        }
+        default: {
+            c->p++;
+            int n = new_node(c, NODE_CHAR);
+            if (n >= 0) c->nodes[n].ch = (uint8_t)ch;
+            return n;
+        }
+    }
+}
+
+static bool parse_count(RxCompiler* c, int* value) {
+    if (*c->p < '0' || *c->p > '9') return false;
+    int v = 0;
+    while (*c->p >= '0' && *c->p <= '9') {
+        v = v * 10 + (*c->p++ - '0');
+        if (v > REGEX_MAX_REPEAT) {
+            c->error = "repetition count too large";
+            return false;
+        }
+    }
+    *value = v;
+    return true;
+}
+
+static int parse_repeat(RxCompiler* c) {
+    int n = parse_atom(c);
+    while (n >= 0) {
+        int min, max;
+        switch (*c->p) {
+            case '*': min = 0; max = -1; c->p++; break;
+            case '+': min = 1; max = -1; c->p++; break;
+            case '?': min = 0; max = 1; c->p++; break;
+            case '{':
+                c->p++;
+                if (!parse_count(c, &min)) {
+                    if (!c->error) c->error = "invalid repetition";
+                    return -1;
+                }
+                max = min;
+                if (*c->p == ',') {
+                    c->p++;
+                    max = -1;
+                    if (*c->p != '}' && !parse_count(c, &max)) {
+                        if (!c->error) c->error = "invalid repetition";
+                        return -1;
+                    }
+                }
+                if (*c->p != '}' || (max >= 0 && max < min)) {
+                    c->error = "invalid repetition";
+                    return -1;
+                }
+                c->p++;
+                break;
+            default:
+                return n;
+        }
+        bool greedy = true;
+        if (*c->p == '?') {
+            greedy = false;
+            c->p++;
+        }
+        int r = new_pair(c, NODE_REPEAT, n, -1);
+        if (r < 0) return -1;
+        c->nodes[r].min = min;
+        c->nodes[r].max = max;
+        c->nodes[r].greedy = greedy;
+        n = r;
+    }
+    return n;
+}
+
+static int parse_concat(RxCompiler* c) {
+    int n = -1;
+    while (*c->p && *c->p != '|' && *c->p != ')') {
+        int r = parse_repeat(c);
+        if (r < 0) return -1;
+        n = n < 0 ? r : new_pair(c, NODE_CAT, n, r);
+        if (n < 0) return -1;
+    }
+    return n < 0 ? new_node(c, NODE_EMPTY) : n;
+}
+
+static int parse_alt(RxCompiler* c) {
+    int n = parse_concat(c);
+    while (n >= 0 && *c->p == '|') {
+        c->p++;
+        int r = parse_concat(c);
+        if (r < 0) return -1;
+        n = new_pair(c, NODE_ALT, n, r);
+    }
+    return n;
+}
+
+/* ---------------------------------------------------------------------
+ * Code generation
+ * --------------------------------------------------------------------- */
+
+static int emit(RxCompiler* c, RxOp op, int x, int y, uint8_t ch) {
+    if (c->count >= REGEX_MAX_PROGRAM) {
+        c->error = "pattern too large";
+        return -1;
+    }
+    if (!grow((void**)&c->code, &c->capacity, c->count + 1, sizeof(RxInst))) {
+        c->error = "out of memory";
+        return -1;
+    }
+    RxInst* inst = &c->code[c->count];
+    inst->op = (uint8_t)op;
+    inst->ch = ch;
+    inst->x = x;
+    inst->y = y;
+    return (int)c->count++;
+}
+
+static void set_split(RxCompiler* c, int at, int next, int out, bool greedy) {
+    c->code[at].x = greedy ? next : out;
+    c->code[at].y = greedy ? out : next;
+}
+
+static bool compile_node(RxCompiler* c, int n) {
+    const RxNode node = c->nodes[n];
+    switch (node.kind) {
+        case NODE_EMPTY:
+            return true;
+        case NODE_CHAR:
+            return emit(c, RX_CHAR, 0, 0, node.ch) >= 0;
+        case NODE_ANY:
+            return emit(c, RX_ANY, 0, 0, 0) >= 0;
+        case NODE_CLASS:
+            return emit(c, RX_CLASS, node.cls, 0, 0) >= 0;
+        case NODE_BOL:
+            return emit(c, RX_BOL, 0, 0, 0) >= 0;
+        case NODE_EOL:
+            return emit(c, RX_EOL, 0, 0, 0) >= 0;
+        case NODE_CAT:
+            return compile_node(c, node.left) && compile_node(c, node.right);
+        case NODE_ALT: {
+            int split = emit(c, RX_SPLIT, 0, 0, 0);
+            if (split < 0 || !compile_node(c, node.left)) return false;
+            int jump = emit(c, RX_JMP, 0, 0, 0);
+            if (jump < 0) return false;
+            set_split(c, split, split + 1, (int)c->count, true);
+            if (!compile_node(c, node.right)) return false;
+            c->code[jump].x = (int)c->count;
+            return true;
+        }
+        case NODE_REPEAT: {
+            for (int i = 0; i < node.min; i++) {
+                if (!compile_node(c, node.left)) return false;
+            }
+            if (node.max < 0) {
+                int loop = emit(c, RX_SPLIT, 0, 0, 0);
+                if (loop < 0 || !compile_node(c, node.left) ||
+                    emit(c, RX_JMP, loop, 0, 0) < 0) {
+                    return false;
+                }
+                set_split(c, loop, loop + 1, (int)c->count, node.greedy);
+                return true;
+            }
+            /* x{0,k} as nested optionals; the pending splits are chained through y. */
+            int pending = -1;
+            for (int i = node.min; i < node.max; i++) {
+                int split = emit(c, RX_SPLIT, 0, pending, 0);
+                if (split < 0 || !compile_node(c, node.left)) return false;
+                pending = split;
+            }
+            int out = (int)c->count;
+            while (pending >= 0) {
+                int next = c->code[pending].y;
+                set_split(c, pending, pending + 1, out, node.greedy);
+                pending = next;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+Regex* regex_compile(const char* pattern, char* error, size_t error_size) {
+    RxCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.p = pattern ? pattern : "";
+
+    int root = parse_alt(&c);
+    if (root >= 0 && *c.p == ')') {
+        c.error = "unmatched ')'";
+    }
+    if (!c.error && compile_node(&c, root)) {
+        emit(&c, RX_MATCH, 0, 0, 0);
+    }
+    free(c.nodes);
+
+    Regex* re = NULL;
+    if (!c.error) {
+        re = (Regex*)calloc(1, sizeof(Regex));
+        if (!re) c.error = "out of memory";
+    }
+    if (c.error) {
+        if (error && error_size > 0) snprintf(error, error_size, "%s", c.error);
+        free(c.code);
+        free(c.classes);
+        return NULL;
+    }
+
+    re->code = c.code;
+    re->count = c.count;
+    re->classes = c.classes;
+    re->class_count = c.class_count;
+    re->anchored = c.code[0].op == RX_BOL;
+
+    size_t prefix_length = 0;
+    while (re->code[prefix_length].op == RX_CHAR) prefix_length++;
+    if (prefix_length > 0) {
+        re->prefix = (unsigned char*)malloc(prefix_length);
+        if (re->prefix) {
+            for (size_t i = 0; i < prefix_length; i++) re->prefix[i] = re->code[i].ch;
+            re->prefix_length = prefix_length;
+        }
+    }
+    return re;
+}
+
+void regex_free(Regex* re) {
+    if (!re) return;
+    free(re->code);
+    free(re->classes);
+    free(re->prefix);
+    free(re);
+}
+
+/* ---------------------------------------------------------------------
+ * Matching: a Pike VM. Each thread is a program counter plus the position
+ * its match attempt started at; the thread lists are kept in priority
+ * order and de-duplicated by program counter, so a step costs at most
+ * O(program size) and a search O(program size * text length).
+ * --------------------------------------------------------------------- */
+
+typedef struct {
+    int pc;
+    size_t start;
+} RxThread;
+
+typedef struct {
+    RxThread* threads;
+    size_t count;
+} RxList;
+
+typedef struct {
+    const Regex* re;
+    size_t length;
+    size_t* marks;       /* generation that last visited each pc */
+    size_t generation;
+    int* stack;          /* pending pcs while following jumps and splits */
+} RxRun;
+
+/* Add 'pc' and everything reachable from it without consuming input. */
+static void add_thread(RxRun* run, RxList* list, int pc, size_t start, size_t sp) {
+    size_t top = 0;
+    run->stack[top++] = pc;
+    while (top > 0) {
+        pc = run->stack[--top];
+        if (run->marks[pc] == run->generation) continue;
+        run->marks[pc] = run->generation;
+        const RxInst* inst = &run->re->code[pc];
+        switch (inst->op) {
+            case RX_JMP:
+                run->stack[top++] = inst->x;
+                break;
+            case RX_SPLIT:
+                run->stack[top++] = inst->y;  /* popped after everything x leads to */
+                run->stack[top++] = inst->x;
+                break;
+            case RX_BOL:
+                if (sp == 0) run->stack[top++] = pc + 1;
+                break;
+            case RX_EOL:
+                if (sp == run->length) run->stack[top++] = pc + 1;
+                break;
+            default:
+                list->threads[list->count].pc = pc;
+                list->threads[list->count].start = start;
+                list->count++;
+                break;
+        }
+    }
+}
+
+/*
+    First position at or after 'sp' where the literal prefix occurs, or
+    length + 1 if there is none. memchr finds the candidates (libc
+    implementations scan with vector instructions).
+*/
+static size_t skip_to_prefix(const Regex* re, const unsigned char* text, size_t length, size_t sp) {
+    while (sp + re->prefix_length <= length) {
+        const unsigned char* hit = (const unsigned char*)memchr(
+            text + sp, re->prefix[0], length - sp - re->prefix_length + 1);
+        if (!hit) break;
+        sp = (size_t)(hit - text);
+        if (memcmp(hit, re->prefix, re->prefix_length) == 0) return sp;
+        sp++;
+    }
+    return length + 1;
+}
+
+static bool run_program(const Regex* re, const char* source, size_t length, size_t from,
+                        bool whole, size_t* match_start, size_t* match_end) {
+    if (!re || !source || from > length) return false;
+    const unsigned char* text = (const unsigned char*)source;
+    size_t n = re->count;
+
+    RxThread* threads = (RxThread*)malloc(2 * n * sizeof(RxThread));
+    size_t* marks = (size_t*)calloc(n, sizeof(size_t));
+    int* stack = (int*)malloc((2 * n + 1) * sizeof(int));
+    if (!threads || !marks || !stack) {
+        free(threads);
+        free(marks);
+        free(stack);
+        return false;
+    }
+
+    RxRun run = { re, length, marks, 1, stack };
+    RxList clist = { threads, 0 };
+    RxList nlist = { threads + n, 0 };
+    bool matched = false;
+    bool unanchored = !whole && !re->anchored;
+
+    size_t sp = from;
+    for (;;) {
+        /* Start a new attempt here, behind every attempt already running. */
+        if (!matched && (sp == from || unanchored)) {
+            if (clist.count == 0 && unanchored && re->prefix_length > 0) {
+                sp = skip_to_prefix(re, text, length, sp);
+                if (sp > length) break;
+                run.generation++;
+            }
+            add_thread(&run, &clist, 0, sp, sp);
+        }
+        if (clist.count == 0) break;
+
+        run.generation++;
+        nlist.count = 0;
+        for (size_t i = 0; i < clist.count; i++) {
+            const RxThread* t = &clist.threads[i];
+            const RxInst* inst = &re->code[t->pc];
+            bool step = false;
+            switch (inst->op) {
+                case RX_CHAR:
+                    step = sp < length && text[sp] == inst->ch;
+                    break;
+                case RX_ANY:
+                    step = sp < length && text[sp] != '\n';
+                    break;
+                case RX_CLASS:
+                    step = sp < length && class_has(&re->classes[inst->x], text[sp]);
+                    break;
+                case RX_MATCH:
+                    if (whole && sp != length) break;
+                    matched = true;
+                    *match_start = t->start;
+                    *match_end = sp;
+                    i = clist.count;  /* lower-priority threads lose to this match */
+                    break;
+                default:
+                    break;
+            }
+            if (step) add_thread(&run, &nlist, t->pc + 1, t->start, sp + 1);
+        }
+
+        RxList swap = clist;
+        clist = nlist;
+        nlist = swap;
+        if (sp >= length) break;
+        sp++;
+    }
+
+    free(threads);
+    free(marks);
+    free(stack);
+    return matched;
+}
+
+bool regex_search(const Regex* re, const char* text, size_t length, size_t from,
+                  size_t* match_start, size_t* match_end) {
+    return run_program(re, text, length, from, false, match_start, match_end);
+}
+
+bool regex_match(const Regex* re, const char* text, size_t length) {
+    size_t start, end;
+    return run_program(re, text, length, 0, true, &start, &end);
+}
+
+/* ---------------------------------------------------------------------
+ * Compile-once cache, keyed by pattern text. Open addressing, kept at
+ * most half full.
+ * --------------------------------------------------------------------- */
+
+typedef struct {
+    char* pattern;
+    uint32_t hash;
+    Regex* re;
+} CacheEntry;
+
+static CacheEntry* cache = NULL;
+static size_t cache_capacity = 0;
+static size_t cache_count = 0;
+
+static uint32_t hash_pattern(const char* text) {
+    uint32_t hash = 2166136261u;  /* FNV-1a */
+    for (; *text; text++) {
+        hash ^= (unsigned char)*text;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t cache_slot(CacheEntry* entries, size_t capacity, const char* pattern, uint32_t hash) {
+    size_t mask = capacity - 1;
+    size_t i = hash & mask;
+    while (entries[i].pattern &&
+           (entries[i].hash != hash || strcmp(entries[i].pattern, pattern) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool grow_cache(void) {
+    size_t new_capacity = cache_capacity ? cache_capacity * 2 : 32;
+    CacheEntry* entries = (CacheEntry*)calloc(new_capacity, sizeof(CacheEntry));
+    if (!entries) return false;
+    for (size_t i = 0; i < cache_capacity; i++) {
+        if (cache[i].pattern) {
+            entries[cache_slot(entries, new_capacity, cache[i].pattern, cache[i].hash)] = cache[i];
+        }
+    }
+    free(cache);
+    cache = entries;
+    cache_capacity = new_capacity;
+    return true;
+}
+
+const Regex* regex_cached(const char* pattern, char* error, size_t error_size) {
+    if (!pattern) pattern = "";
+    uint32_t hash = hash_pattern(pattern);
+    if (cache_capacity > 0) {
+        CacheEntry* hit = &cache[cache_slot(cache, cache_capacity, pattern, hash)];
+        if (hit->pattern) return hit->re;
+    }
+
+    Regex* re = regex_compile(pattern, error, error_size);
+    if (!re) return NULL;
+    size_t length = strlen(pattern);
+    char* copy = (char*)malloc(length + 1);
+    if (!copy || ((cache_count + 1) * 2 > cache_capacity && !grow_cache())) {
+        if (error && error_size > 0) snprintf(error, error_size, "out of memory");
+        free(copy);
+        regex_free(re);
+        return NULL;
+    }
+    memcpy(copy, pattern, length + 1);
+    CacheEntry* slot = &cache[cache_slot(cache, cache_capacity, pattern, hash)];
+    slot->pattern = copy;
+    slot->hash = hash;
+    slot->re = re;
+    cache_count++;
+    return re;
+}
+
+void regex_cache_clear(void) {
+    for (size_t i = 0; i < cache_capacity; i++) {
+        if (cache[i].pattern) {
+            free(cache[i].pattern);
+            regex_free(cache[i].re);
+        }
+    }
+    free(cache);
+    cache = NULL;
+    cache_capacity = 0;
+    cache_count = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Regular expressions for regex literals (/.../) and the regex natives.
+ *
+ * Patterns compile to a small instruction program that is run as a
+ * Thompson NFA (Pike VM): every live state advances in lock step over the
+ * input, so matching is linear in the text length for any pattern and
+ * nothing backtracks. Leftmost match, greedy quantifiers prefer longer.
+ *
+ * Supported: literals, '.', [...] and [^...] classes with ranges, the
+ * escapes \d \w \s \D \W \S \n \t \r, groups (...), alternation '|',
+ * quantifiers * + ? {n} {n,} {n,m} (a trailing '?' makes them lazy), and
+ * the anchors ^ and $ (start and end of the text).
+ */
+typedef struct Regex Regex;
+
+/**
+ * Compile 'pattern'. On failure returns NULL and writes the reason to
+ * 'error' (if given).
+ */
+Regex* regex_compile(const char* pattern, char* error, size_t error_size);
+void regex_free(Regex* re);
+
+/**
+ * Compile 'pattern' once and reuse the program on every later call with the
+ * same text. The result stays owned by the cache until regex_cache_clear().
+ */
+const Regex* regex_cached(const char* pattern, char* error, size_t error_size);
+void regex_cache_clear(void);
+
+/**
+ * Find the leftmost match starting at or after 'from'.
+ * On success stores the match as [*match_start, *match_end).
+ */
+bool regex_search(const Regex* re, const char* text, size_t length, size_t from,
+                  size_t* match_start, size_t* match_end);
+
+/**
+ * True if the whole text matches.
+ */
+bool regex_match(const Regex* re, const char* text, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGEX_H */
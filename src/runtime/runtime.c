@@ -1,4 +1,6 @@
 #include "runtime.h"
+#include "regex.h"
+#include "plugin.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,15 +19,13 @@ static OSFL_Value make_string(const char* s) {
 }
 
 /* -----------------------------
- * Internal Helper: create an empty list
+ * Internal Helper: create an empty list (null if out of memory)
  * ----------------------------- */
 static OSFL_Value make_list(void) {
     OSFL_Value v;
     v.type = VAL_LIST;
-    v.as.list_val.data = NULL;
-    v.as.list_val.length = 0;
-    v.as.list_val.capacity = 0;
-    return v;
+    v.as.list_val = (ValueList*)calloc(1, sizeof(ValueList));
+    return v.as.list_val ? v : VALUE_NULL;
 }
 
 /* -----------------------------
@@ -33,14 +33,14 @@ static OSFL_Value make_list(void) {
  * ----------------------------- */
 static void list_push(OSFL_Value* list_value, OSFL_Value item) {
     if (list_value->type != VAL_LIST) return; /* or assert */
-    size_t len = list_value->as.list_val.length;
-    size_t cap = list_value->as.list_val.capacity;
+    size_t len = list_value->as.list_val->length;
+    size_t cap = list_value->as.list_val->capacity;
     if (len >= cap) {
         size_t new_cap = (cap == 0) ? 8 : cap * 2;
-        list_value->as.list_val.data = realloc(list_value->as.list_val.data, new_cap * sizeof(OSFL_Value));
-        list_value->as.list_val.capacity = new_cap;
+        list_value->as.list_val->data = realloc(list_value->as.list_val->data, new_cap * sizeof(OSFL_Value));
+        list_value->as.list_val->capacity = new_cap;
     }
-    list_value->as.list_val.data[list_value->as.list_val.length++] = item;
+    list_value->as.list_val->data[list_value->as.list_val->length++] = item;
 }
 
 /* -----------------------------
@@ -133,8 +133,8 @@ OSFL_Value osfl_join(int arg_count, OSFL_Value* args) {
     char* buffer = malloc(buf_size);
     buffer[0] = '\0';
 
-    for (size_t i = 0; i < listval.as.list_val.length; i++) {
-        char* piece = value_to_string(&listval.as.list_val.data[i]);
+    for (size_t i = 0; i < listval.as.list_val->length; i++) {
+        char* piece = value_to_string(&listval.as.list_val->data[i]);
         size_t need = strlen(buffer)
                     + strlen(piece)
                     + (i > 0 ? strlen(delim) : 0)
@@ -263,6 +263,140 @@ OSFL_Value osfl_to_lower(int arg_count, OSFL_Value* args) {
     return result;
 }
 
+/* -----------------------------
+ * REGEX FUNCTIONS
+ *   Patterns are compiled on first use and cached by their text, so a
+ *   regex literal inside a loop is compiled once.
+ * ----------------------------- */
+static const Regex* regex_arg(const OSFL_Value* v) {
+    char error[128];
+    const Regex* re = regex_cached(v->as.str_val, error, sizeof(error));
+    if (!re) {
+        fprintf(stderr, "Invalid regex /%s/: %s\n", v->as.str_val, error);
+    }
+    return re;
+}
+
+static OSFL_Value make_string_range(const char* s, size_t length) {
+    OSFL_Value v;
+    v.type = VAL_STRING;
+    v.as.str_val = malloc(length + 1);
+    if (v.as.str_val) {
+        memcpy(v.as.str_val, s, length);
+        v.as.str_val[length] = '\0';
+    }
+    return v;
+}
+
+/**
+ * match(text, re): true if the whole text matches
+ */
+OSFL_Value osfl_match(int arg_count, OSFL_Value* args) {
+    if (arg_count < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING) {
+        return VALUE_NULL;
+    }
+    const Regex* re = regex_arg(&args[1]);
+    if (!re) return VALUE_NULL;
+    OSFL_Value result;
+    result.type = VAL_BOOL;
+    result.as.bool_val = regex_match(re, args[0].as.str_val, strlen(args[0].as.str_val));
+    return result;
+}
+
+/**
+ * search(text, re): the leftmost matching substring, or null
+ */
+OSFL_Value osfl_search(int arg_count, OSFL_Value* args) {
+    if (arg_count < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING) {
+        return VALUE_NULL;
+    }
+    const Regex* re = regex_arg(&args[1]);
+    if (!re) return VALUE_NULL;
+    const char* text = args[0].as.str_val;
+    size_t start, end;
+    if (!regex_search(re, text, strlen(text), 0, &start, &end)) {
+        return VALUE_NULL;
+    }
+    return make_string_range(text + start, end - start);
+}
+
+/**
+ * find_all(text, re): list of every non-overlapping match, left to right
+ */
+OSFL_Value osfl_find_all(int arg_count, OSFL_Value* args) {
+    if (arg_count < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING) {
+        return VALUE_NULL;
+    }
+    const Regex* re = regex_arg(&args[1]);
+    if (!re) return VALUE_NULL;
+    const char* text = args[0].as.str_val;
+    size_t length = strlen(text);
+    OSFL_Value result = make_list();
+    size_t from = 0, start, end;
+    while (from <= length && regex_search(re, text, length, from, &start, &end)) {
+        list_push(&result, make_string_range(text + start, end - start));
+        from = end > start ? end : end + 1;  /* step past an empty match */
+    }
+    return result;
+}
+
+/**
+ * replace_re(text, re, replacement): replace every match with the replacement text
+ */
+OSFL_Value osfl_replace_re(int arg_count, OSFL_Value* args) {
+    if (arg_count < 3 || args[0].type != VAL_STRING ||
+        args[1].type != VAL_STRING || args[2].type != VAL_STRING) {
+        return VALUE_NULL;
+    }
+    const Regex* re = regex_arg(&args[1]);
+    if (!re) return VALUE_NULL;
+    const char* text = args[0].as.str_val;
+    const char* repl = args[2].as.str_val;
+    size_t length = strlen(text);
+    size_t repl_len = strlen(repl);
+
+    size_t res_cap = length + 1;
+    size_t res_len = 0;
+    char* buffer = malloc(res_cap);
+    if (!buffer) return VALUE_NULL;
+
+    size_t from = 0, copied = 0, start, end;
+    while (from <= length && regex_search(re, text, length, from, &start, &end)) {
+        size_t need = res_len + (start - copied) + repl_len + 1;
+        if (need > res_cap) {
+            while (need > res_cap) res_cap *= 2;
+            char* grown = realloc(buffer, res_cap);
+            if (!grown) {
+                free(buffer);
+                return VALUE_NULL;
+            }
+            buffer = grown;
+        }
+        memcpy(buffer + res_len, text + copied, start - copied);
+        res_len += start - copied;
+        memcpy(buffer + res_len, repl, repl_len);
+        res_len += repl_len;
+        copied = end;
+        from = end > start ? end : end + 1;
+    }
+    size_t tail = length - copied;
+    if (res_len + tail + 1 > res_cap) {
+        char* grown = realloc(buffer, res_len + tail + 1);
+        if (!grown) {
+            free(buffer);
+            return VALUE_NULL;
+        }
+        buffer = grown;
+    }
+    memcpy(buffer + res_len, text + copied, tail);
+    buffer[res_len + tail] = '\0';
+
+    OSFL_Value result;
+    result.type = VAL_STRING;
+    result.as.str_val = buffer;
+    return result;
+}
+
 /* -----------------------------
  * LIST/ARRAY FUNCTIONS
  * ----------------------------- */
@@ -276,7 +410,7 @@ OSFL_Value osfl_len(int arg_count, OSFL_Value* args) {
             result.as.int_val = (long long)strlen(args[0].as.str_val);
             break;
         case VAL_LIST:
-            result.as.int_val = (long long)args[0].as.list_val.length;
+            result.as.int_val = (long long)args[0].as.list_val->length;
             break;
         default:
             result.as.int_val = 0;
@@ -297,12 +431,12 @@ OSFL_Value osfl_pop(int arg_count, OSFL_Value* args) {
     if (arg_count < 1 || args[0].type != VAL_LIST) {
         return VALUE_NULL;
     }
-    size_t len = args[0].as.list_val.length;
+    size_t len = args[0].as.list_val->length;
     if (len == 0) {
         return VALUE_NULL;
     }
-    OSFL_Value item = args[0].as.list_val.data[len - 1];
-    args[0].as.list_val.length--;
+    OSFL_Value item = args[0].as.list_val->data[len - 1];
+    args[0].as.list_val->length--;
     return item;
 }
 
@@ -320,17 +454,17 @@ OSFL_Value osfl_insert(int arg_count, OSFL_Value* args) {
     OSFL_Value val = args[2];
 
     if (index < 0) index = 0;
-    if (index > (long long)listv->as.list_val.length) {
-        index = listv->as.list_val.length;
+    if (index > (long long)listv->as.list_val->length) {
+        index = listv->as.list_val->length;
     }
     /* Expand by pushing a dummy. */
     list_push(listv, VALUE_NULL);
 
     /* shift elements right from the end to index */
-    for (long long i = (long long)listv->as.list_val.length - 1; i > index; i--) {
-        listv->as.list_val.data[i] = listv->as.list_val.data[i - 1];
+    for (long long i = (long long)listv->as.list_val->length - 1; i > index; i--) {
+        listv->as.list_val->data[i] = listv->as.list_val->data[i - 1];
     }
-    listv->as.list_val.data[index] = val;
+    listv->as.list_val->data[index] = val;
     return *listv;
 }
 
@@ -343,22 +477,22 @@ OSFL_Value osfl_remove(int arg_count, OSFL_Value* args) {
     }
     OSFL_Value* listv = &args[0];
     OSFL_Value val = args[1];
-    for (size_t i = 0; i < listv->as.list_val.length; i++) {
+    for (size_t i = 0; i < listv->as.list_val->length; i++) {
         bool match = false;
-        if (val.type == VAL_INT && listv->as.list_val.data[i].type == VAL_INT) {
-            match = (val.as.int_val == listv->as.list_val.data[i].as.int_val);
-        } else if (val.type == VAL_STRING && listv->as.list_val.data[i].type == VAL_STRING) {
-            if (strcmp(val.as.str_val, listv->as.list_val.data[i].as.str_val) == 0) {
+        if (val.type == VAL_INT && listv->as.list_val->data[i].type == VAL_INT) {
+            match = (val.as.int_val == listv->as.list_val->data[i].as.int_val);
+        } else if (val.type == VAL_STRING && listv->as.list_val->data[i].type == VAL_STRING) {
+            if (strcmp(val.as.str_val, listv->as.list_val->data[i].as.str_val) == 0) {
                 match = true;
             }
         }
         /* Add more type comparisons if needed. */
         if (match) {
             /* shift everything left by 1 */
-            for (size_t j = i; j < listv->as.list_val.length - 1; j++) {
-                listv->as.list_val.data[j] = listv->as.list_val.data[j + 1];
+            for (size_t j = i; j < listv->as.list_val->length - 1; j++) {
+                listv->as.list_val->data[j] = listv->as.list_val->data[j + 1];
             }
-            listv->as.list_val.length--;
+            listv->as.list_val->length--;
             break;
         }
     }
@@ -639,6 +773,18 @@ OSFL_Value osfl_time(int arg_count, OSFL_Value* args) {
     return r;
 }
 
+/* The job a worker forked by the serve mode was started for (see serve.h). */
+static const char* g_current_job = NULL;
+
+void osfl_set_job(const char* job) {
+    g_current_job = job;
+}
+
+OSFL_Value osfl_job(int arg_count, OSFL_Value* args) {
+    (void)arg_count; (void)args;
+    return g_current_job ? make_string(g_current_job) : VALUE_NULL;
+}
+
 /* -----------------------------
  * MISCELLANEOUS
  * ----------------------------- */
@@ -694,7 +840,7 @@ OSFL_Value osfl_enumerate(int arg_count, OSFL_Value* args) {
     }
     OSFL_Value input_list = args[0];
     OSFL_Value result = make_list();
-    for (size_t i = 0; i < input_list.as.list_val.length; i++) {
+    for (size_t i = 0; i < input_list.as.list_val->length; i++) {
         OSFL_Value pair = make_list();
         /* index */
         OSFL_Value idx;
@@ -702,9 +848,164 @@ OSFL_Value osfl_enumerate(int arg_count, OSFL_Value* args) {
         idx.as.int_val = (long long)i;
         list_push(&pair, idx);
         /* item */
-        list_push(&pair, input_list.as.list_val.data[i]);
+        list_push(&pair, input_list.as.list_val->data[i]);
         /* push pair into result list */
         list_push(&result, pair);
     }
     return result;
-}
\ No newline at end of file
+}
+/**
+ * map_native(name, list): the list of name(item) for each item, where
+ * 'name' is a built-in or plugin native taking one argument that is pure or
+ * has a batch entry point (see NATIVE_MAPPABLE); anything else gives null.
+ * The native is looked up once and applied to the list's elements in place,
+ * through its batch entry point or its fast paths when it has them.
+ */
+OSFL_Value osfl_map_native(int arg_count, OSFL_Value* args) {
+    if (arg_count < 2 || args[0].type != VAL_STRING || args[1].type != VAL_LIST) {
+        return VALUE_NULL;
+    }
+    const NativeDescriptor* native = osfl_find_native(args[0].as.str_val);
+    if (!native || !NATIVE_MAPPABLE(native)) {
+        return VALUE_NULL;
+    }
+    size_t count = args[1].as.list_val->length;
+    OSFL_Value* items = args[1].as.list_val->data;
+    OSFL_Value result = make_list();
+    if (count == 0 || result.type != VAL_LIST) {
+        return result;
+    }
+    OSFL_Value* results = (OSFL_Value*)malloc(count * sizeof(OSFL_Value));
+    if (!results) {
+        free(result.as.list_val);
+        return VALUE_NULL;
+    }
+    if (native->batch) {
+        native->batch(count, items, results);
+    } else {
+        bool fast = NATIVE_HAS_FAST_PATH(native, 1);
+        for (size_t i = 0; i < count; i++) {
+            if (fast && items[i].type == VAL_INT && native->fast_i64) {
+                results[i].type = VAL_INT;
+                results[i].as.int_val = native->fast_i64(&items[i].as.int_val);
+            } else if (fast && (items[i].type == VAL_INT || items[i].type == VAL_FLOAT) && native->fast_f64) {
+                double x = items[i].type == VAL_INT ? (double)items[i].as.int_val : items[i].as.float_val;
+                results[i].type = VAL_FLOAT;
+                results[i].as.float_val = native->fast_f64(&x);
+            } else {
+                results[i] = native->func(1, &items[i]);
+            }
+        }
+    }
+    result.as.list_val->data = results;
+    result.as.list_val->length = count;
+    result.as.list_val->capacity = count;
+    return result;
+}
+
+/* -----------------------------
+ * NATIVE DESCRIPTORS
+ * ----------------------------- */
+static double fast_sqrt(const double* a) { return sqrt(a[0]); }
+static double fast_pow(const double* a)  { return pow(a[0], a[1]); }
+static double fast_sin(const double* a)  { return sin(a[0]); }
+static double fast_cos(const double* a)  { return cos(a[0]); }
+static double fast_tan(const double* a)  { return tan(a[0]); }
+static double fast_log(const double* a)  { return log(a[0]); }
+static double fast_fabs(const double* a) { return fabs(a[0]); }
+static int64_t fast_abs(const int64_t* a) { return a[0] < 0 ? -a[0] : a[0]; }
+
+/* Batch entry points of one-argument natives: the loop runs here, not in the VM. */
+#define BATCH(native) \
+    static void batch_##native(size_t count, Value* args, Value* results) { \
+        for (size_t i = 0; i < count; i++) results[i] = osfl_##native(1, &args[i]); \
+    }
+BATCH(to_upper)
+BATCH(to_lower)
+BATCH(len)
+BATCH(int)
+BATCH(float)
+BATCH(str)
+BATCH(bool)
+BATCH(type)
+#undef BATCH
+
+#define ANY     NATIVE_TYPE_ANY
+#define INT     NATIVE_TYPE_INT
+#define FLOAT   NATIVE_TYPE_FLOAT
+#define NUMBER  NATIVE_TYPE_NUMBER
+#define BOOL    NATIVE_TYPE_BOOL
+#define STRING  NATIVE_TYPE_STRING
+#define LIST    NATIVE_TYPE_LIST
+#define FILE_T  NATIVE_TYPE_FILE
+#define PURE    NATIVE_PURE
+#define NOALLOC NATIVE_NO_ALLOC
+#define EXTERN  NATIVE_EXTERNAL
+#define VARIADIC NATIVE_VARIADIC
+
+const NativeDescriptor osfl_natives[] = {
+    { "print",      osfl_print,      0, VARIADIC, { ANY },                         ANY,    EXTERN,         NULL, NULL, NULL },
+    { "split",      osfl_split,      2, 2,        { STRING, STRING },              LIST,   PURE,           NULL, NULL, NULL },
+    { "join",       osfl_join,       2, 2,        { LIST, STRING },                STRING, PURE,           NULL, NULL, NULL },
+    { "substring",  osfl_substring,  3, 3,        { STRING, INT, INT },            STRING, PURE,           NULL, NULL, NULL },
+    { "replace",    osfl_replace,    3, 3,        { STRING, STRING, STRING },      STRING, PURE,           NULL, NULL, NULL },
+    { "to_upper",   osfl_to_upper,   1, 1,        { STRING },                      STRING, PURE,           NULL, NULL, batch_to_upper },
+    { "to_lower",   osfl_to_lower,   1, 1,        { STRING },                      STRING, PURE,           NULL, NULL, batch_to_lower },
+    { "match",      osfl_match,      2, 2,        { STRING, STRING },              BOOL,   PURE | NOALLOC, NULL, NULL, NULL },
+    { "search",     osfl_search,     2, 2,        { STRING, STRING },              ANY,    PURE,           NULL, NULL, NULL },
+    { "find_all",   osfl_find_all,   2, 2,        { STRING, STRING },              LIST,   PURE,           NULL, NULL, NULL },
+    { "replace_re", osfl_replace_re, 3, 3,        { STRING, STRING, STRING },      STRING, PURE,           NULL, NULL, NULL },
+    { "len",        osfl_len,        1, 1,        { ANY },                         INT,    PURE | NOALLOC, NULL, NULL, batch_len },
+    { "append",     osfl_append,     2, 2,        { LIST, ANY },                   ANY,    0,              NULL, NULL, NULL },
+    { "pop",        osfl_pop,        1, 1,        { LIST },                        ANY,    0,              NULL, NULL, NULL },
+    { "insert",     osfl_insert,     3, 3,        { LIST, INT, ANY },              ANY,    0,              NULL, NULL, NULL },
+    { "remove",     osfl_remove,     2, 2,        { LIST, INT },                   ANY,    0,              NULL, NULL, NULL },
+    { "sqrt",       osfl_sqrt,       1, 1,        { NUMBER },                      FLOAT,  PURE | NOALLOC, NULL, fast_sqrt, NULL },
+    { "pow",        osfl_pow,        2, 2,        { NUMBER, NUMBER },              FLOAT,  PURE | NOALLOC, NULL, fast_pow, NULL },
+    { "sin",        osfl_sin,        1, 1,        { NUMBER },                      FLOAT,  PURE | NOALLOC, NULL, fast_sin, NULL },
+    { "cos",        osfl_cos,        1, 1,        { NUMBER },                      FLOAT,  PURE | NOALLOC, NULL, fast_cos, NULL },
+    { "tan",        osfl_tan,        1, 1,        { NUMBER },                      FLOAT,  PURE | NOALLOC, NULL, fast_tan, NULL },
+    { "log",        osfl_log,        1, 1,        { NUMBER },                      FLOAT,  PURE | NOALLOC, NULL, fast_log, NULL },
+    { "abs",        osfl_abs,        1, 1,        { NUMBER },                      NUMBER, PURE | NOALLOC, fast_abs, fast_fabs, NULL },
+    { "int",        osfl_int,        1, 1,        { ANY },                         INT,    PURE | NOALLOC, NULL, NULL, batch_int },
+    { "float",      osfl_float,      1, 1,        { ANY },                         FLOAT,  PURE | NOALLOC, NULL, NULL, batch_float },
+    { "str",        osfl_str,        1, 1,        { ANY },                         STRING, PURE,           NULL, NULL, batch_str },
+    { "bool",       osfl_bool,       1, 1,        { ANY },                         BOOL,   PURE | NOALLOC, NULL, NULL, batch_bool },
+    { "open",       osfl_open,       2, 2,        { STRING, STRING },              FILE_T, EXTERN,         NULL, NULL, NULL },
+    { "read",       osfl_read,       1, 1,        { FILE_T },                      STRING, EXTERN,         NULL, NULL, NULL },
+    { "write",      osfl_write,      2, 2,        { FILE_T, STRING },              ANY,    EXTERN,         NULL, NULL, NULL },
+    { "close",      osfl_close,      1, 1,        { FILE_T },                      ANY,    EXTERN,         NULL, NULL, NULL },
+    { "exit",       osfl_exit,       0, 1,        { INT },                         ANY,    EXTERN,         NULL, NULL, NULL },
+    { "time",       osfl_time,       0, 0,        { ANY },                         FLOAT,  NOALLOC | EXTERN, NULL, NULL, NULL },
+    { "job",        osfl_job,        0, 0,        { ANY },                         ANY,    EXTERN,         NULL, NULL, NULL },
+    { "type",       osfl_type,       1, 1,        { ANY },                         STRING, PURE,           NULL, NULL, batch_type },
+    { "range",      osfl_range,      1, 3,        { INT, INT, INT },               LIST,   PURE,           NULL, NULL, NULL },
+    { "enumerate",  osfl_enumerate,  1, 1,        { LIST },                        LIST,   PURE,           NULL, NULL, NULL },
+    { "map_native", osfl_map_native, 2, 2,        { STRING, LIST },                LIST,   0,              NULL, NULL, NULL },
+};
+
+#undef ANY
+#undef INT
+#undef FLOAT
+#undef NUMBER
+#undef BOOL
+#undef STRING
+#undef LIST
+#undef FILE_T
+#undef PURE
+#undef NOALLOC
+#undef EXTERN
+#undef VARIADIC
+
+const size_t osfl_native_count = sizeof(osfl_natives) / sizeof(osfl_natives[0]);
+
+const NativeDescriptor* osfl_find_native(const char* name) {
+    const NativeDescriptor* native = plugin_find_native(name);
+    if (native) return native;
+    for (size_t i = 0; name && i < osfl_native_count; i++) {
+        if (strcmp(osfl_natives[i].name, name) == 0) {
+            return &osfl_natives[i];
+        }
+    }
+    return NULL;
+}
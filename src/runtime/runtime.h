@@ -3,6 +3,7 @@
 #define RUNTIME_H
 
 #include "../../include/value.h"
+#include "../../include/native.h"
 
 Value osfl_print(int arg_count, Value* args);
 Value osfl_split(int arg_count, Value* args);
@@ -11,6 +12,10 @@ Value osfl_substring(int arg_count, Value* args);
 Value osfl_replace(int arg_count, Value* args);
 Value osfl_to_upper(int arg_count, Value* args);
 Value osfl_to_lower(int arg_count, Value* args);
+Value osfl_match(int arg_count, Value* args);
+Value osfl_search(int arg_count, Value* args);
+Value osfl_find_all(int arg_count, Value* args);
+Value osfl_replace_re(int arg_count, Value* args);
 Value osfl_len(int arg_count, Value* args);
 Value osfl_append(int arg_count, Value* args);
 Value osfl_pop(int arg_count, Value* args);
@@ -33,8 +38,20 @@ Value osfl_write(int arg_count, Value* args);
 Value osfl_close(int arg_count, Value* args);
 Value osfl_exit(int arg_count, Value* args);
 Value osfl_time(int arg_count, Value* args);
+Value osfl_job(int arg_count, Value* args);
 Value osfl_type(int arg_count, Value* args);
 Value osfl_range(int arg_count, Value* args);
 Value osfl_enumerate(int arg_count, Value* args);
+Value osfl_map_native(int arg_count, Value* args);
+
+/* Every native above with its arity, type hints and flags, in registration order. */
+extern const NativeDescriptor osfl_natives[];
+extern const size_t osfl_native_count;
+
+/* The descriptor of the native 'name', or NULL. A loaded plugin's natives shadow the built-in ones. */
+const NativeDescriptor* osfl_find_native(const char* name);
+
+/* The string job() returns, or NULL for none; set in each worker of the serve mode. */
+void osfl_set_job(const char* job);
 
 #endif /* RUNTIME_H */
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stdio.h>
 #include "../include/semantic.h"
+#include "../runtime/runtime.h"
+#include "../runtime/plugin.h"
 
 /* Utility for easy string duplication */
 static char* sm_strdup(const char* s) {
@@ -17,6 +19,22 @@ static char* sm_strdup(const char* s) {
 void semantic_init(SemanticContext* ctx) {
     ctx->current_scope = scope_create(NULL); /* global scope */
     ctx->error_count = 0;
+    ctx->next_slot = 0;
+    ctx->function_level = 0;
+    ctx->function_count = 0;
+    ctx->handler_depth = 0;
+    ctx->import_count = 0;
+    ctx->import_error_count = 0;
+    ctx->class_count = 0;
+    ctx->classes = NULL;
+    ctx->class_capacity = 0;
+    ctx->variables = NULL;
+    ctx->variable_count = ctx->variable_capacity = 0;
+    ctx->box_flags = NULL;
+    ctx->box_flag_count = ctx->box_flag_capacity = 0;
+    ctx->field_uses = NULL;
+    ctx->field_use_count = ctx->field_use_capacity = 0;
+    memset(ctx->functions, 0, sizeof(ctx->functions));
 }
 
 void semantic_cleanup(SemanticContext* ctx) {
@@ -25,13 +43,31 @@ void semantic_cleanup(SemanticContext* ctx) {
         ctx->current_scope = NULL;
     }
     ctx->error_count = 0;
+    free(ctx->variables);
+    ctx->variables = NULL;
+    ctx->variable_count = ctx->variable_capacity = 0;
+    free(ctx->box_flags);
+    ctx->box_flags = NULL;
+    ctx->box_flag_count = ctx->box_flag_capacity = 0;
+    free(ctx->field_uses);
+    ctx->field_uses = NULL;
+    ctx->field_use_count = ctx->field_use_capacity = 0;
+    free(ctx->classes);
+    ctx->classes = NULL;
+    ctx->class_capacity = 0;
 }
 
 /* Forward declarations for internal usage */
 static void analyze_node(AstNode* node, SemanticContext* ctx);
 static void analyze_statement(AstNode* node, SemanticContext* ctx);
 static void analyze_var_decl(AstNode* node, SemanticContext* ctx);
+static void analyze_switch(AstNode* node, SemanticContext* ctx);
 static void analyze_func_decl(AstNode* node, SemanticContext* ctx);
+static void analyze_import(AstNode* node, SemanticContext* ctx);
+static void analyze_class_decl(AstNode* node, SemanticContext* ctx);
+static int track_variable(SemanticContext* ctx, SymbolId id, bool initialized, bool* box_flag);
+static bool plain_construction(const SemanticContext* ctx, const AstNode* cls, const AstNode* call);
+static int field_count(const SemanticContext* ctx, const AstNode* cls);
 static void enter_scope(SemanticContext* ctx);
 static void exit_scope(SemanticContext* ctx);
 
@@ -40,6 +76,18 @@ void semantic_analyze(AstNode* root, SemanticContext* ctx) {
     /* You might treat root as AST_NODE_PROGRAM or a block. */
     analyze_node(root, ctx);
 
+    /* Only now is it known which captured variables are ever reassigned. */
+    for (size_t i = 0; i < ctx->box_flag_count; i++) {
+        const SemanticVariable* var = &ctx->variables[ctx->box_flags[i].variable];
+        *ctx->box_flags[i].flag = var->captured && var->reassigned;
+    }
+    /* Likewise which objects were scalar-replaced. */
+    for (size_t i = 0; i < ctx->field_use_count; i++) {
+        const SemanticFieldUse* use = &ctx->field_uses[i];
+        int base = *ctx->variables[use->variable].field_slot;
+        *use->slot = base >= 0 ? base + use->offset : -1;
+    }
+
     /* Optionally do a separate pass for control flow. */
     semantic_control_flow_analysis(root, ctx);
 
@@ -53,11 +101,23 @@ static void analyze_node(AstNode* node, SemanticContext* ctx) {
     while (node) {
         switch (node->type) {
             case AST_NODE_VAR_DECL:
+            case AST_NODE_CONST_DECL:
                 analyze_var_decl(node, ctx);
                 break;
+            case AST_NODE_FRAME: {
+                enter_scope(ctx);
+                for (size_t i = 0; i < node->as.frame_decl.body_count; i++) {
+                    analyze_node(node->as.frame_decl.body_statements[i], ctx);
+                }
+                exit_scope(ctx);
+                break;
+            }
             case AST_NODE_FUNC_DECL:
                 analyze_func_decl(node, ctx);
                 break;
+            case AST_NODE_IMPORT:
+                analyze_import(node, ctx);
+                break;
             case AST_NODE_BLOCK: {
                 enter_scope(ctx);
                 for (size_t i = 0; i < node->as.block.statement_count; i++) {
@@ -66,17 +126,20 @@ static void analyze_node(AstNode* node, SemanticContext* ctx) {
                 exit_scope(ctx);
                 break;
             }
+            case AST_NODE_IF:
             case AST_NODE_IF_STMT:
             case AST_NODE_WHILE_STMT:
             case AST_NODE_FOR_STMT:
+            case AST_NODE_SWITCH_STMT:
             case AST_NODE_RETURN_STMT:
             case AST_NODE_EXPR_STMT:
+            case AST_NODE_TRY_CATCH:
+            case AST_NODE_ERROR_HANDLER:
+            case AST_NODE_RETRY_STMT:
                 analyze_statement(node, ctx);
                 break;
             case AST_NODE_CLASS_DECL:
-                /* You can do logic for class members, etc. */
-                scope_add_symbol(ctx->current_scope, node->as.class_decl.class_name, SYMBOL_CLASS, -1);
-                /* parse class members in a new scope or the same, up to you. */
+                analyze_class_decl(node, ctx);
                 break;
 
             /* Expression nodes might appear in a top-level list for script usage. */
@@ -101,6 +164,7 @@ static void analyze_node(AstNode* node, SemanticContext* ctx) {
 /* Example for statements that are not var/func/class decls */
 static void analyze_statement(AstNode* node, SemanticContext* ctx) {
     switch (node->type) {
+        case AST_NODE_IF:
         case AST_NODE_IF_STMT: {
             TypeInfo cond_type = semantic_check_expr(node->as.if_stmt.condition, ctx);
             if (cond_type.kind != SEMANTIC_TYPE_BOOL && cond_type.kind != SEMANTIC_TYPE_UNKNOWN) {
@@ -140,13 +204,35 @@ static void analyze_statement(AstNode* node, SemanticContext* ctx) {
             analyze_node(node->as.for_stmt.body, ctx);
             break;
         }
+        case AST_NODE_SWITCH_STMT:
+            analyze_switch(node, ctx);
+            break;
         case AST_NODE_RETURN_STMT:
             if (node->as.ret_stmt.expr) {
                 (void)semantic_check_expr(node->as.ret_stmt.expr, ctx);
             }
             break;
         case AST_NODE_EXPR_STMT:
-            (void)semantic_check_expr(node, ctx);
+            (void)semantic_check_expr(node->as.unary.expr, ctx);
+            break;
+        case AST_NODE_TRY_CATCH:
+            analyze_node(node->as.error_handler.handler_body, ctx);
+            ctx->handler_depth++;
+            analyze_node(node->as.error_handler.catch_body, ctx);
+            ctx->handler_depth--;
+            break;
+        case AST_NODE_ERROR_HANDLER:
+            ctx->handler_depth++;
+            analyze_node(node->as.error_handler.handler_body, ctx);
+            ctx->handler_depth--;
+            break;
+        case AST_NODE_RETRY_STMT:
+            /* retry re-enters the guarded code, so it only makes sense in a handler. */
+            if (ctx->handler_depth == 0) {
+                fprintf(stderr, "Semantic error: retry outside a catch or on_error handler at %s:%d\n",
+                        node->loc.file, node->loc.line);
+                ctx->error_count++;
+            }
             break;
         default:
             /* fallback or error */
@@ -154,37 +240,500 @@ static void analyze_statement(AstNode* node, SemanticContext* ctx) {
     }
 }
 
+/* Case labels are constants of one kind, so the compiler can build a jump table. */
+static void analyze_switch(AstNode* node, SemanticContext* ctx) {
+    (void)semantic_check_expr(node->as.switch_stmt.subject, ctx);
+    bool has_default = false;
+    int label_kind = 0;  /* 1: integers, 2: strings */
+    for (size_t i = 0; i < node->as.switch_stmt.case_count; i++) {
+        AstSwitchCase* arm = &node->as.switch_stmt.cases[i];
+        if (arm->label_count == 0) {
+            if (has_default) {
+                fprintf(stderr, "Semantic error: switch has more than one default at %s:%d\n",
+                        arm->body->loc.file, arm->body->loc.line);
+                ctx->error_count++;
+            }
+            has_default = true;
+        }
+        for (size_t j = 0; j < arm->label_count; j++) {
+            AstNode* label = arm->labels[j];
+            int64_t value = 0;
+            int kind = ast_integer_value(label, &value) ? 1 :
+                       (label->type == AST_EXPR_LITERAL &&
+                        label->as.literal.literal_type == TOKEN_STRING) ? 2 : 0;
+            if (kind == 0 || (label_kind != 0 && kind != label_kind)) {
+                fprintf(stderr, "Semantic error: case labels must be integer or string literals of one kind at %s:%d\n",
+                        label->loc.file, label->loc.line);
+                ctx->error_count++;
+                continue;
+            }
+            label_kind = kind;
+            /* Duplicates make the dispatch ambiguous. */
+            for (size_t pi = 0; pi <= i; pi++) {
+                AstSwitchCase* prev = &node->as.switch_stmt.cases[pi];
+                size_t limit = (pi == i) ? j : prev->label_count;
+                for (size_t pj = 0; pj < limit; pj++) {
+                    AstNode* other = prev->labels[pj];
+                    int64_t other_value;
+                    bool same = (kind == 1)
+                        ? (ast_integer_value(other, &other_value) && other_value == value)
+                        : (other->type == AST_EXPR_LITERAL &&
+                           other->as.literal.literal_type == TOKEN_STRING &&
+                           strcmp(other->as.literal.str_val, label->as.literal.str_val) == 0);
+                    if (same) {
+                        fprintf(stderr, "Semantic error: duplicate case label at %s:%d\n",
+                                label->loc.file, label->loc.line);
+                        ctx->error_count++;
+                    }
+                }
+            }
+        }
+        analyze_node(arm->body, ctx);
+    }
+}
+
 static void analyze_var_decl(AstNode* node, SemanticContext* ctx) {
     /* node->as.var_decl has var_name, initializer, is_const */
-    if (!scope_add_symbol(ctx->current_scope, node->as.var_decl.var_name,
-                          node->as.var_decl.is_const ? SYMBOL_CONST : SYMBOL_VAR, -1))
+    /* Every declaration gets its own frame slot; slots are not reused when
+       a block ends, so a slot only ever holds one variable. */
+    int slot = ctx->next_slot++;
+    /* The initializer cannot see the name it initializes. */
+    if (node->as.var_decl.initializer) {
+        (void)semantic_check_expr(node->as.var_decl.initializer, ctx);
+    }
+    if (!scope_add_local(ctx->current_scope, node->as.var_decl.var_symbol,
+                         node->as.var_decl.is_const ? SYMBOL_CONST : SYMBOL_VAR, slot,
+                         ctx->function_level))
     {
         fprintf(stderr, "Semantic error: duplicate variable '%s' in scope at %s:%d\n",
                 node->as.var_decl.var_name, node->loc.file, node->loc.line);
         ctx->error_count++;
     }
-    if (node->as.var_decl.initializer) {
-        (void)semantic_check_expr(node->as.var_decl.initializer, ctx);
+    node->as.var_decl.slot = slot;
+    node->as.var_decl.field_slot = -1;
+    int variable = track_variable(ctx, node->as.var_decl.var_symbol, true, &node->as.var_decl.boxed);
+    /* A new object may be scalar-replaced, unless the rest of the function lets it escape. */
+    const AstNode* init = node->as.var_decl.initializer;
+    if (variable >= 0 && init && init->type == AST_EXPR_CALL &&
+        init->as.call.callee->type == AST_EXPR_IDENTIFIER &&
+        init->as.call.callee->as.ident.binding == IDENT_CLASS) {
+        const AstNode* cls = ctx->classes[init->as.call.callee->as.ident.slot];
+        if (plain_construction(ctx, cls, init)) {
+            ctx->variables[variable].record = cls;
+            ctx->variables[variable].field_slot = &node->as.var_decl.field_slot;
+        }
+    }
+}
+
+/* Record that the AST flag 'flag' says whether 'variable' lives in a box. */
+static void add_box_flag(SemanticContext* ctx, bool* flag, int variable) {
+    if (ctx->box_flag_count == ctx->box_flag_capacity) {
+        size_t capacity = ctx->box_flag_capacity ? ctx->box_flag_capacity * 2 : 32;
+        SemanticBoxFlag* flags = (SemanticBoxFlag*)realloc(ctx->box_flags, capacity * sizeof(SemanticBoxFlag));
+        if (!flags) {
+            fprintf(stderr, "Out of memory in semantic analysis\n");
+            exit(1);
+        }
+        ctx->box_flags = flags;
+        ctx->box_flag_capacity = capacity;
     }
+    ctx->box_flags[ctx->box_flag_count].flag = flag;
+    ctx->box_flags[ctx->box_flag_count].variable = variable;
+    ctx->box_flag_count++;
 }
 
+/*
+ * Number the variable 'id' just declared in the current scope, if it belongs
+ * to a function; top-level variables are globals and are never captured.
+ * 'box_flag' is the flag of its declaration.
+ */
+static int track_variable(SemanticContext* ctx, SymbolId id, bool initialized, bool* box_flag) {
+    *box_flag = false;
+    if (ctx->function_level == 0) return -1;
+    Symbol* sym = scope_lookup_id(ctx->current_scope, id);
+    if (!sym) return -1;
+    if (ctx->variable_count == ctx->variable_capacity) {
+        size_t capacity = ctx->variable_capacity ? ctx->variable_capacity * 2 : 32;
+        SemanticVariable* vars = (SemanticVariable*)realloc(ctx->variables, capacity * sizeof(SemanticVariable));
+        if (!vars) {
+            fprintf(stderr, "Out of memory in semantic analysis\n");
+            exit(1);
+        }
+        ctx->variables = vars;
+        ctx->variable_capacity = capacity;
+    }
+    int variable = (int)ctx->variable_count++;
+    ctx->variables[variable].initialized = initialized;
+    ctx->variables[variable].captured = false;
+    ctx->variables[variable].reassigned = false;
+    ctx->variables[variable].record = NULL;
+    ctx->variables[variable].field_slot = NULL;
+    sym->variable = variable;
+    add_box_flag(ctx, box_flag, variable);
+    return variable;
+}
+
+/*
+ * The upvalue of the function whose body is at 'level' that holds 'variable',
+ * declared at 'var_level' in frame slot 'slot'. Closures are flat: every
+ * function between the declaring one and 'level' captures the variable too,
+ * so that it can pass it on. Returns -1 if there is no function to capture it.
+ */
+static int capture_variable(SemanticContext* ctx, int level, int variable, int var_level, int slot) {
+    if (level <= var_level || level > SEMANTIC_MAX_NESTING) return -1;
+    SemanticFunction* fn = &ctx->functions[level];
+    if (!fn->func) return -1;
+    for (size_t i = 0; i < fn->func->capture_count; i++) {
+        if (fn->captured[i] == variable) return (int)i;
+    }
+    int source = slot;
+    if (level - 1 > var_level) {
+        int outer = capture_variable(ctx, level - 1, variable, var_level, slot);
+        if (outer < 0) return -1;
+        source = -(outer + 1);
+    }
+    size_t count = fn->func->capture_count + 1;
+    int* captures = (int*)realloc(fn->func->captures, count * sizeof(int));
+    int* captured = (int*)realloc(fn->captured, count * sizeof(int));
+    if (!captures || !captured) {
+        fprintf(stderr, "Out of memory in semantic analysis\n");
+        exit(1);
+    }
+    captures[count - 1] = source;
+    captured[count - 1] = variable;
+    fn->func->captures = captures;
+    fn->captured = captured;
+    fn->func->capture_count = count;
+    return (int)(count - 1);
+}
+
+/*
+ * Functions at the top level (and methods) get numbers and are called
+ * directly. A function declared inside another one is a closure held in a
+ * slot of the enclosing function, and a function expression is a closure
+ * with no name; neither gets a number.
+ */
 static void analyze_func_decl(AstNode* node, SemanticContext* ctx) {
-    /* Add symbol to scope */
-    if (!scope_add_symbol(ctx->current_scope, node->as.func_decl.func_name, SYMBOL_FUNC, -1)) {
-        fprintf(stderr, "Semantic error: duplicate function '%s' at %s:%d\n",
-                node->as.func_decl.func_name, node->loc.file, node->loc.line);
+    AstFuncDeclData* fn = &node->as.func_decl;
+    bool named = fn->func_symbol != SYMBOL_ID_NONE;
+    int variable = -1;
+    fn->func_index = -1;
+    fn->closure_slot = -1;
+    fn->boxed = false;
+    if (named && ctx->function_level > 0) {
+        /* Visible in its own body, which captures it before it is initialized. */
+        fn->closure_slot = ctx->next_slot++;
+        if (!scope_add_local(ctx->current_scope, fn->func_symbol, SYMBOL_CONST,
+                             fn->closure_slot, ctx->function_level)) {
+            fprintf(stderr, "Semantic error: duplicate function '%s' at %s:%d\n",
+                    fn->func_name, node->loc.file, node->loc.line);
+            ctx->error_count++;
+        } else {
+            variable = track_variable(ctx, fn->func_symbol, false, &fn->boxed);
+        }
+    } else if (named) {
+        /* Add symbol to scope; it is visible in its own body for recursion. */
+        fn->func_index = ctx->function_count++;
+        if (!scope_add_local(ctx->current_scope, fn->func_symbol, SYMBOL_FUNC,
+                             fn->func_index, ctx->function_level)) {
+            fprintf(stderr, "Semantic error: duplicate function '%s' at %s:%d\n",
+                    fn->func_name, node->loc.file, node->loc.line);
+            ctx->error_count++;
+        }
+    }
+    if (ctx->function_level >= SEMANTIC_MAX_NESTING) {
+        fprintf(stderr, "Semantic error: functions nested too deeply at %s:%d\n",
+                node->loc.file, node->loc.line);
         ctx->error_count++;
+        return;
     }
     /* Create child scope for function body */
     enter_scope(ctx);
-    /* Add parameters as symbols */
-    for (size_t i = 0; i < node->as.func_decl.param_count; i++) {
-        scope_add_symbol(ctx->current_scope, node->as.func_decl.param_names[i], SYMBOL_VAR, -1);
+    int saved_slot = ctx->next_slot;
+    int saved_handler_depth = ctx->handler_depth;
+    ctx->next_slot = 0;
+    ctx->handler_depth = 0;
+    ctx->function_level++;
+    SemanticFunction* state = &ctx->functions[ctx->function_level];
+    state->func = fn;
+    state->captured = NULL;
+    free(fn->captures);
+    fn->captures = NULL;
+    fn->capture_count = 0;
+    size_t first_variable = ctx->variable_count;
+    /* Add parameters as symbols; they occupy the first frame slots. */
+    free(fn->param_boxed);
+    fn->param_boxed = (bool*)calloc(fn->param_count > 0 ? fn->param_count : 1, sizeof(bool));
+    if (!fn->param_boxed) {
+        fprintf(stderr, "Out of memory in semantic analysis\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < fn->param_count; i++) {
+        scope_add_local(ctx->current_scope, fn->param_symbols[i], SYMBOL_VAR,
+                        ctx->next_slot++, ctx->function_level);
+        track_variable(ctx, fn->param_symbols[i], true, &fn->param_boxed[i]);
+    }
+    analyze_node(fn->body, ctx);
+    /* The objects that never escaped get frame slots for their fields. */
+    for (size_t v = first_variable; v < ctx->variable_count; v++) {
+        SemanticVariable* var = &ctx->variables[v];
+        if (!var->record) continue;
+        *var->field_slot = ctx->next_slot;
+        ctx->next_slot += field_count(ctx, var->record);
+        var->record = NULL;
+    }
+    fn->frame_size = (size_t)ctx->next_slot;
+    free(state->captured);
+    state->captured = NULL;
+    state->func = NULL;
+    ctx->function_level--;
+    ctx->next_slot = saved_slot;
+    ctx->handler_depth = saved_handler_depth;
+    exit_scope(ctx);
+    if (variable >= 0) {
+        ctx->variables[variable].initialized = true;
+    }
+}
+
+/* A module's initializer runs in the top-level frame, so imports belong there. */
+static void analyze_import(AstNode* node, SemanticContext* ctx) {
+    node->as.import_decl.index = ctx->import_count++;
+    if (ctx->function_level > 0) {
+        fprintf(stderr, "Semantic error: import inside a function at %s:%d\n",
+                node->loc.file, node->loc.line);
+        ctx->error_count++;
+        return;
+    }
+    if (plugin_is_library(node->as.import_decl.path)) {
+        // Loaded now, so that calls further down resolve against its natives.
+        char error[256];
+        node->as.import_decl.plugin = true;
+        if (!plugin_import(node->loc.file, node->as.import_decl.path, error, sizeof(error))) {
+            fprintf(stderr, "Import error: %s at %s:%d\n", error, node->loc.file, node->loc.line);
+            ctx->import_error_count++;
+        }
+        return;
+    }
+    if (!scope_add_local(ctx->current_scope, node->as.import_decl.alias, SYMBOL_MODULE,
+                         node->as.import_decl.index, ctx->function_level)) {
+        fprintf(stderr, "Semantic error: '%s' is already declared; cannot import it at %s:%d\n",
+                intern_text(node->as.import_decl.alias), node->loc.file, node->loc.line);
+        ctx->error_count++;
+    }
+}
+
+/**
+ * Classes get numbers, like functions. Fields are slots of the object rather
+ * than of a frame, and their initializers run in the constructor, so they
+ * are resolved as if inside a method. Methods are functions whose first
+ * parameter is 'this'.
+ */
+static void analyze_class_decl(AstNode* node, SemanticContext* ctx) {
+    AstClassDeclData* cls = &node->as.class_decl;
+    cls->class_index = ctx->class_count++;
+    if ((size_t)ctx->class_count > ctx->class_capacity) {
+        size_t capacity = ctx->class_capacity ? ctx->class_capacity * 2 : 16;
+        const AstNode** classes = (const AstNode**)realloc(ctx->classes, capacity * sizeof(AstNode*));
+        if (!classes) {
+            fprintf(stderr, "Out of memory in semantic analysis\n");
+            exit(1);
+        }
+        ctx->classes = classes;
+        ctx->class_capacity = capacity;
+    }
+    ctx->classes[cls->class_index] = node;
+    cls->parent_index = -1;
+    if (cls->parent_symbol != SYMBOL_ID_NONE) {
+        Symbol* parent = scope_lookup_id(ctx->current_scope, cls->parent_symbol);
+        if (!parent || parent->kind != SYMBOL_CLASS) {
+            fprintf(stderr, "Semantic error: '%s' is not a class declared before '%s' at %s:%d\n",
+                    intern_text(cls->parent_symbol), cls->class_name, node->loc.file, node->loc.line);
+            ctx->error_count++;
+        } else {
+            cls->parent_index = parent->slot;
+        }
+    }
+    if (!scope_add_local(ctx->current_scope, cls->class_symbol, SYMBOL_CLASS, cls->class_index,
+                         ctx->function_level)) {
+        fprintf(stderr, "Semantic error: duplicate class '%s' at %s:%d\n",
+                cls->class_name, node->loc.file, node->loc.line);
+        ctx->error_count++;
+    }
+
+    enter_scope(ctx);
+    for (size_t i = 0; i < cls->member_count; i++) {
+        AstNode* member = cls->members[i];
+        if (member->type == AST_NODE_FUNC_DECL) {
+            analyze_func_decl(member, ctx);
+        } else if (member->type == AST_NODE_VAR_DECL || member->type == AST_NODE_CONST_DECL) {
+            for (size_t j = 0; j < i; j++) {
+                AstNode* other = cls->members[j];
+                if ((other->type == AST_NODE_VAR_DECL || other->type == AST_NODE_CONST_DECL) &&
+                    other->as.var_decl.var_symbol == member->as.var_decl.var_symbol) {
+                    fprintf(stderr, "Semantic error: duplicate field '%s' in class '%s' at %s:%d\n",
+                            member->as.var_decl.var_name, cls->class_name,
+                            member->loc.file, member->loc.line);
+                    ctx->error_count++;
+                }
+            }
+            member->as.var_decl.slot = -1;
+            ctx->function_level++;
+            (void)semantic_check_expr(member->as.var_decl.initializer, ctx);
+            ctx->function_level--;
+        } else {
+            fprintf(stderr, "Semantic error: classes may only contain fields and methods at %s:%d\n",
+                    member->loc.file, member->loc.line);
+            ctx->error_count++;
+        }
     }
-    analyze_node(node->as.func_decl.body, ctx);
     exit_scope(ctx);
 }
 
+/* The number of fields of an object of class 'cls', the inherited ones included. */
+static int field_count(const SemanticContext* ctx, const AstNode* cls) {
+    const AstClassDeclData* data = &cls->as.class_decl;
+    int count = data->parent_index >= 0 ? field_count(ctx, ctx->classes[data->parent_index]) : 0;
+    for (size_t i = 0; i < data->member_count; i++) {
+        if (data->members[i]->type == AST_NODE_VAR_DECL) count++;
+    }
+    return count;
+}
+
+/* Where the field 'field' is in an object of class 'cls' (the inherited fields first), or -1. */
+static int field_position(const SemanticContext* ctx, const AstNode* cls, SymbolId field) {
+    const AstClassDeclData* data = &cls->as.class_decl;
+    int position = 0;
+    if (data->parent_index >= 0) {
+        const AstNode* parent = ctx->classes[data->parent_index];
+        int inherited = field_position(ctx, parent, field);
+        if (inherited >= 0) return inherited;
+        position = field_count(ctx, parent);
+    }
+    for (size_t i = 0; i < data->member_count; i++) {
+        const AstNode* member = data->members[i];
+        if (member->type != AST_NODE_VAR_DECL) continue;
+        if (member->as.var_decl.var_symbol == field) return position;
+        position++;
+    }
+    return -1;
+}
+
+/* Whether 'expr' names parameter 'first' or a later one of the function 'fn' itself. */
+static bool is_parameter(const AstNode* expr, const AstFuncDeclData* fn, int first) {
+    return expr->type == AST_EXPR_IDENTIFIER && expr->as.ident.binding == IDENT_LOCAL &&
+           expr->as.ident.depth == 0 && !expr->as.ident.boxed &&
+           expr->as.ident.slot >= first && (size_t)expr->as.ident.slot < fn->param_count;
+}
+
+/*
+ * Whether the call 'call' of class 'cls' does no more than give each field of
+ * the new object a value, so that its fields can be frame slots of the caller
+ * instead: every field initializer is a literal, and the constructor, if the
+ * class declares one, only stores its parameters into fields. A slot is never
+ * reset to null, so each field must be given a value.
+ */
+static bool plain_construction(const SemanticContext* ctx, const AstNode* cls, const AstNode* call) {
+    int count = field_count(ctx, cls);
+    bool* valued = (bool*)calloc(count > 0 ? (size_t)count : 1, sizeof(bool));
+    if (!valued) {
+        fprintf(stderr, "Out of memory in semantic analysis\n");
+        exit(1);
+    }
+    bool plain = true;
+    for (const AstNode* c = cls; c && plain; ) {
+        const AstClassDeclData* data = &c->as.class_decl;
+        for (size_t i = 0; i < data->member_count && plain; i++) {
+            const AstNode* member = data->members[i];
+            if (member->type == AST_NODE_CONST_DECL) {
+                plain = false;
+            } else if (member->type == AST_NODE_VAR_DECL && member->as.var_decl.initializer) {
+                int64_t value;
+                const AstNode* initial = member->as.var_decl.initializer;
+                plain = initial->type == AST_EXPR_LITERAL || ast_integer_value(initial, &value);
+                valued[field_position(ctx, cls, member->as.var_decl.var_symbol)] = true;
+            }
+        }
+        c = data->parent_index >= 0 ? ctx->classes[data->parent_index] : NULL;
+    }
+
+    /* Constructors are not inherited; the last 'init' declared is the one used. */
+    const AstFuncDeclData* ctor = NULL;
+    const AstClassDeclData* data = &cls->as.class_decl;
+    for (size_t i = 0; i < data->member_count; i++) {
+        const AstNode* member = data->members[i];
+        if (member->type == AST_NODE_FUNC_DECL && strcmp(member->as.func_decl.func_name, "init") == 0) {
+            ctor = &member->as.func_decl;
+        }
+    }
+    if (call->as.call.arg_count != (ctor ? ctor->param_count - 1 : 0)) plain = false;
+    if (ctor && plain && ctor->body) {
+        const AstNode* body = ctor->body;
+        plain = body->type == AST_NODE_BLOCK;
+        for (size_t i = 0; plain && i < body->as.block.statement_count; i++) {
+            const AstNode* stmt = body->as.block.statements[i];
+            const AstNode* store = stmt->type == AST_NODE_EXPR_STMT ? stmt->as.unary.expr : NULL;
+            plain = store && store->type == AST_EXPR_BINARY && store->as.binary.op == TOKEN_ASSIGN &&
+                    store->as.binary.left->type == AST_EXPR_MEMBER &&
+                    is_parameter(store->as.binary.left->as.member_expr.object, ctor, 0) &&
+                    store->as.binary.left->as.member_expr.object->as.ident.slot == 0 &&
+                    is_parameter(store->as.binary.right, ctor, 1);
+            if (!plain) break;
+            int position = field_position(ctx, cls, store->as.binary.left->as.member_expr.member_symbol);
+            if (position < 0) {
+                plain = false;
+            } else {
+                valued[position] = true;
+            }
+        }
+    }
+
+    /* Every field ends up with a value; one a subclass declares again is the inherited one. */
+    for (const AstNode* c = cls; c && plain; ) {
+        const AstClassDeclData* d = &c->as.class_decl;
+        for (size_t i = 0; i < d->member_count && plain; i++) {
+            const AstNode* member = d->members[i];
+            if (member->type != AST_NODE_VAR_DECL) continue;
+            plain = valued[field_position(ctx, cls, member->as.var_decl.var_symbol)];
+        }
+        c = d->parent_index >= 0 ? ctx->classes[d->parent_index] : NULL;
+    }
+    free(valued);
+    return plain;
+}
+
+/*
+ * Record the field access 'member' on the object in 'variable', which has not
+ * escaped so far. A field the class does not have stays a run-time error, so
+ * the object is then constructed after all.
+ */
+static void note_field_use(AstNode* member, int variable, SemanticContext* ctx) {
+    SemanticVariable* var = &ctx->variables[variable];
+    int offset = field_position(ctx, var->record, member->as.member_expr.member_symbol);
+    if (offset < 0) {
+        var->record = NULL;
+        return;
+    }
+    if (ctx->field_use_count == ctx->field_use_capacity) {
+        size_t capacity = ctx->field_use_capacity ? ctx->field_use_capacity * 2 : 32;
+        SemanticFieldUse* uses = (SemanticFieldUse*)realloc(ctx->field_uses, capacity * sizeof(SemanticFieldUse));
+        if (!uses) {
+            fprintf(stderr, "Out of memory in semantic analysis\n");
+            exit(1);
+        }
+        ctx->field_uses = uses;
+        ctx->field_use_capacity = capacity;
+    }
+    ctx->field_uses[ctx->field_use_count].slot = &member->as.member_expr.field_slot;
+    ctx->field_uses[ctx->field_use_count].variable = variable;
+    ctx->field_uses[ctx->field_use_count].offset = offset;
+    ctx->field_use_count++;
+}
+
+/* Any use of the variable 'sym' other than one of its fields lets its object escape. */
+static void note_escape(const Symbol* sym, SemanticContext* ctx) {
+    if (sym && sym->variable >= 0) ctx->variables[sym->variable].record = NULL;
+}
+
 /* Enter a new scope (child) */
 static void enter_scope(SemanticContext* ctx) {
     ctx->current_scope = scope_create(ctx->current_scope);
@@ -202,6 +751,142 @@ static void exit_scope(SemanticContext* ctx) {
    Expression Checking
    --------------*/
 
+static bool is_assignment_op(OSFLTokenType op) {
+    return op == TOKEN_ASSIGN || op == TOKEN_PLUS_ASSIGN || op == TOKEN_MINUS_ASSIGN ||
+           op == TOKEN_STAR_ASSIGN || op == TOKEN_SLASH_ASSIGN || op == TOKEN_MOD_ASSIGN;
+}
+
+/* False if a value of type 'kind' is known not to fit the hint 'hint'. */
+static bool native_type_admits(NativeType hint, SemanticValueType kind) {
+    switch (hint) {
+        case NATIVE_TYPE_INT:    return kind == SEMANTIC_TYPE_INT;
+        case NATIVE_TYPE_FLOAT:  return kind == SEMANTIC_TYPE_FLOAT;
+        case NATIVE_TYPE_NUMBER: return kind == SEMANTIC_TYPE_INT || kind == SEMANTIC_TYPE_FLOAT;
+        case NATIVE_TYPE_BOOL:   return kind == SEMANTIC_TYPE_BOOL;
+        case NATIVE_TYPE_STRING: return kind == SEMANTIC_TYPE_STRING;
+        case NATIVE_TYPE_LIST:
+        case NATIVE_TYPE_FILE:   return kind != SEMANTIC_TYPE_INT && kind != SEMANTIC_TYPE_FLOAT &&
+                                        kind != SEMANTIC_TYPE_BOOL && kind != SEMANTIC_TYPE_STRING;
+        default:                 return true;
+    }
+}
+
+/*
+ * Check a call of the undeclared name in 'expr' against the built-in native
+ * of that name, if there is one: its arity, and the type hints of the
+ * arguments whose type is known here.
+ */
+static void check_native_call(const AstNode* expr, const TypeInfo* arg_types, SemanticContext* ctx) {
+    const AstNode* callee = expr->as.call.callee;
+    const NativeDescriptor* native = osfl_find_native(callee->as.ident.name);
+    if (!native) return;
+    int arg_count = (int)expr->as.call.arg_count;
+    if (!NATIVE_ACCEPTS(native, arg_count)) {
+        char expected[32];
+        if (native->max_args == NATIVE_VARIADIC) {
+            snprintf(expected, sizeof(expected), "at least %d", native->min_args);
+        } else if (native->max_args == native->min_args) {
+            snprintf(expected, sizeof(expected), "%d", native->min_args);
+        } else {
+            snprintf(expected, sizeof(expected), "%d to %d", native->min_args, native->max_args);
+        }
+        fprintf(stderr, "Semantic error: '%s' takes %s argument(s), but %d given at %s:%d\n",
+                native->name, expected, arg_count, expr->loc.file, expr->loc.line);
+        ctx->error_count++;
+        return;
+    }
+    for (int i = 0; i < arg_count && i < NATIVE_MAX_HINTS; i++) {
+        if (arg_types[i].kind == SEMANTIC_TYPE_UNKNOWN) continue;
+        if (!native_type_admits(native->arg_types[i], arg_types[i].kind)) {
+            fprintf(stderr, "Semantic error: argument %d of '%s' has the wrong type at %s:%d\n",
+                    i + 1, native->name, expr->loc.file, expr->loc.line);
+            ctx->error_count++;
+        }
+    }
+    // map_native("name", list) applies the native 'name' to each element.
+    const AstNode* applied = native->func == osfl_map_native ? expr->as.call.args[0] : NULL;
+    if (applied && applied->type == AST_EXPR_LITERAL && applied->as.literal.literal_type == TOKEN_STRING) {
+        const NativeDescriptor* target = osfl_find_native(applied->as.literal.str_val);
+        if (!target || !NATIVE_MAPPABLE(target)) {
+            fprintf(stderr, "Semantic error: map_native needs a pure native taking one argument, not '%s' at %s:%d\n",
+                    applied->as.literal.str_val, expr->loc.file, expr->loc.line);
+            ctx->error_count++;
+        }
+    }
+}
+
+/*
+ * Record what the identifier 'ident' names, as seen from the current scope.
+ * A variable of an enclosing function becomes an upvalue of this one.
+ */
+static void bind_identifier(AstNode* ident, const Symbol* sym, SemanticContext* ctx) {
+    AstIdentifierData* id = &ident->as.ident;
+    id->binding = IDENT_UNRESOLVED;
+    id->depth = 0;
+    id->slot = -1;
+    id->boxed = false;
+    if (!sym || sym->slot < 0) return;
+    id->slot = sym->slot;
+    if (sym->kind == SYMBOL_FUNC) {
+        id->binding = IDENT_FUNCTION;
+    } else if (sym->kind == SYMBOL_MODULE) {
+        id->binding = IDENT_MODULE;
+    } else if (sym->kind == SYMBOL_CLASS) {
+        id->binding = IDENT_CLASS;
+    } else if (sym->level == 0 && ctx->function_level > 0) {
+        id->binding = IDENT_GLOBAL;
+    } else {
+        id->binding = IDENT_LOCAL;
+        id->depth = ctx->function_level - sym->level;
+        if (sym->variable < 0) return;
+        if (id->depth > 0) {
+            int upvalue = capture_variable(ctx, ctx->function_level, sym->variable, sym->level, sym->slot);
+            if (upvalue < 0) return;
+            SemanticVariable* var = &ctx->variables[sym->variable];
+            var->captured = true;
+            if (!var->initialized) var->reassigned = true;
+            id->binding = IDENT_UPVALUE;
+            id->depth = 0;
+            id->slot = upvalue;
+        }
+        add_box_flag(ctx, &id->boxed, sym->variable);
+    }
+}
+
+/* Only declared, non-constant variables and object fields can be assigned. */
+static void check_assignment_target(AstNode* target, SemanticContext* ctx) {
+    if (target && target->type == AST_EXPR_MEMBER) {
+        (void)semantic_check_expr(target, ctx);
+        const AstNode* object = target->as.member_expr.object;
+        if (object->type == AST_EXPR_IDENTIFIER && object->as.ident.binding == IDENT_MODULE) {
+            fprintf(stderr, "Semantic error: cannot assign to module member '%s' at %s:%d\n",
+                    target->as.member_expr.member_name, target->loc.file, target->loc.line);
+            ctx->error_count++;
+        }
+        return;
+    }
+    if (!target || target->type != AST_EXPR_IDENTIFIER) {
+        fprintf(stderr, "Semantic error: invalid assignment target at %s:%d\n",
+                target ? target->loc.file : "?", target ? target->loc.line : 0);
+        ctx->error_count++;
+        return;
+    }
+    Symbol* sym = scope_lookup_id(ctx->current_scope, target->as.ident.symbol);
+    bind_identifier(target, sym, ctx);
+    if (!sym) {
+        fprintf(stderr, "Semantic error: assignment to undefined variable '%s' at %s:%d\n",
+                target->as.ident.name, target->loc.file, target->loc.line);
+        ctx->error_count++;
+    } else if (sym->kind != SYMBOL_VAR) {
+        fprintf(stderr, "Semantic error: cannot assign to '%s' at %s:%d\n",
+                target->as.ident.name, target->loc.file, target->loc.line);
+        ctx->error_count++;
+    } else if (sym->variable >= 0) {
+        ctx->variables[sym->variable].reassigned = true;
+        note_escape(sym, ctx);
+    }
+}
+
 TypeInfo semantic_check_expr(AstNode* expr, SemanticContext* ctx) {
     TypeInfo result;
     result.kind = SEMANTIC_TYPE_UNKNOWN;
@@ -222,6 +907,7 @@ TypeInfo semantic_check_expr(AstNode* expr, SemanticContext* ctx) {
                     break;
                 case TOKEN_STRING:
                 case TOKEN_DOCSTRING:
+                case TOKEN_REGEX:  /* patterns are strings at run time */
                     result.kind = SEMANTIC_TYPE_STRING;
                     break;
                 default:
@@ -231,18 +917,33 @@ TypeInfo semantic_check_expr(AstNode* expr, SemanticContext* ctx) {
             return result;
         }
         case AST_EXPR_IDENTIFIER: {
-            Symbol* sym = scope_lookup(ctx->current_scope, expr->as.ident.name);
+            Symbol* sym = scope_lookup_id(ctx->current_scope, expr->as.ident.symbol);
+            bind_identifier(expr, sym, ctx);
+            note_escape(sym, ctx);
             if (!sym) {
                 fprintf(stderr, "Semantic error: undefined identifier '%s' at %s:%d\n",
                         expr->as.ident.name, expr->loc.file, expr->loc.line);
                 ctx->error_count++;
                 return result;
             }
+            if (sym->kind == SYMBOL_MODULE) {
+                fprintf(stderr, "Semantic error: module '%s' is not a value; use '%s.name' at %s:%d\n",
+                        expr->as.ident.name, expr->as.ident.name, expr->loc.file, expr->loc.line);
+                ctx->error_count++;
+            } else if (sym->kind == SYMBOL_CLASS) {
+                fprintf(stderr, "Semantic error: class '%s' is not a value; call it to construct one at %s:%d\n",
+                        expr->as.ident.name, expr->loc.file, expr->loc.line);
+                ctx->error_count++;
+            }
             /* For demo, we won't store symbol->type, so we just guess. */
             /* Real code: result = sym->typeInfo; */
             return result;
         }
         case AST_EXPR_BINARY: {
+            if (is_assignment_op(expr->as.binary.op)) {
+                check_assignment_target(expr->as.binary.left, ctx);
+                return semantic_check_expr(expr->as.binary.right, ctx);
+            }
             TypeInfo leftType = semantic_check_expr(expr->as.binary.left, ctx);
             TypeInfo rightType = semantic_check_expr(expr->as.binary.right, ctx);
             /* Simple numeric example: if either is float => result float, else int. */
@@ -273,10 +974,29 @@ TypeInfo semantic_check_expr(AstNode* expr, SemanticContext* ctx) {
             return result;
         }
         case AST_EXPR_CALL: {
-            /* check callee type. If function, check argument count, etc. */
-            (void)semantic_check_expr(expr->as.call.callee, ctx);
+            /* check callee type. If function, check argument count, etc.
+               A bare name that is not declared may be a native, which is
+               only known at run time. */
+            AstNode* callee = expr->as.call.callee;
+            if (callee->type == AST_EXPR_IDENTIFIER) {
+                Symbol* sym = scope_lookup_id(ctx->current_scope, callee->as.ident.symbol);
+                bind_identifier(callee, sym, ctx);
+                note_escape(sym, ctx);
+            } else {
+                (void)semantic_check_expr(callee, ctx);
+                /* A method call passes the object on. */
+                const AstNode* object = callee->type == AST_EXPR_MEMBER ? callee->as.member_expr.object : NULL;
+                if (object && object->type == AST_EXPR_IDENTIFIER) {
+                    note_escape(scope_lookup_id(ctx->current_scope, object->as.ident.symbol), ctx);
+                }
+            }
+            TypeInfo arg_types[NATIVE_MAX_HINTS];
             for (size_t i = 0; i < expr->as.call.arg_count; i++) {
-                (void)semantic_check_expr(expr->as.call.args[i], ctx);
+                TypeInfo arg = semantic_check_expr(expr->as.call.args[i], ctx);
+                if (i < NATIVE_MAX_HINTS) arg_types[i] = arg;
+            }
+            if (callee->type == AST_EXPR_IDENTIFIER && callee->as.ident.binding == IDENT_UNRESOLVED) {
+                check_native_call(expr, arg_types, ctx);
             }
             /* For demonstration, assume calls return unknown or some placeholder. */
             return result;
@@ -289,12 +1009,34 @@ TypeInfo semantic_check_expr(AstNode* expr, SemanticContext* ctx) {
             return result;
         }
         case AST_EXPR_MEMBER: {
-            (void)semantic_check_expr(expr->as.member_expr.object, ctx);
+            /* The members of a module are only known once it is linked. */
+            AstNode* object = expr->as.member_expr.object;
+            Symbol* sym = object->type == AST_EXPR_IDENTIFIER
+                        ? scope_lookup_id(ctx->current_scope, object->as.ident.symbol) : NULL;
+            expr->as.member_expr.field_slot = -1;
+            if (sym && sym->kind == SYMBOL_MODULE) {
+                bind_identifier(object, sym, ctx);
+                return result;
+            }
+            /* A field of an object that has not escaped may be a frame slot. */
+            if (sym && sym->variable >= 0 && sym->level == ctx->function_level &&
+                ctx->variables[sym->variable].record) {
+                bind_identifier(object, sym, ctx);
+                note_field_use(expr, sym->variable, ctx);
+                return result;
+            }
+            (void)semantic_check_expr(object, ctx);
             /* We might do a type-based lookup of the member. For now, just unknown. */
             return result;
         }
+        case AST_NODE_FUNC_DECL:
+            /* A function expression. */
+            analyze_func_decl(expr, ctx);
+            return result;
         case AST_EXPR_INTERPOLATION: {
-            (void)semantic_check_expr(expr->as.interpolation.expr, ctx);
+            for (size_t i = 0; i < expr->as.interpolation.part_count; i++) {
+                (void)semantic_check_expr(expr->as.interpolation.parts[i], ctx);
+            }
             /* Usually part of a string-building operation. We can call it string. */
             result.kind = SEMANTIC_TYPE_STRING;
             return result;
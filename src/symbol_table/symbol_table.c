@@ -3,16 +3,6 @@
 #include <string.h>
 #include <stdio.h>
 
-static char* st_strdup(const char* s) {
-    if (!s) return NULL;
-    size_t len = strlen(s);
-    char* copy = (char*)malloc(len + 1);
-    if (!copy) return NULL;
-    memcpy(copy, s, len);
-    copy[len] = '\0';
-    return copy;
-}
-
 Scope* scope_create(Scope* parent) {
     Scope* scope = (Scope*)malloc(sizeof(Scope));
     if (!scope) return NULL;
@@ -25,10 +15,7 @@ Scope* scope_create(Scope* parent) {
 
 void scope_destroy(Scope* scope) {
     if (!scope) return;
-    /* free each symbol */
-    for (size_t i = 0; i < scope->symbol_count; i++) {
-        free(scope->symbols[i].name);
-    }
+    /* symbol names belong to the intern table */
     free(scope->symbols);
     free(scope);
 }
@@ -46,28 +33,54 @@ static void scope_grow_if_needed(Scope* scope) {
     }
 }
 
-bool scope_add_symbol(Scope* scope, const char* name, SymbolKind kind, int reg) {
+static Symbol* scope_add(Scope* scope, SymbolId id, SymbolKind kind) {
+    if (id == SYMBOL_ID_NONE) return NULL;
     /* Check if already exists in this scope only */
     for (size_t i = 0; i < scope->symbol_count; i++) {
-        if (strcmp(scope->symbols[i].name, name) == 0) {
+        if (scope->symbols[i].id == id) {
             /* symbol already declared in this scope => error */
-            return false;
+            return NULL;
         }
     }
     scope_grow_if_needed(scope);
+    if (scope->symbol_count >= scope->symbol_capacity) return NULL;
     Symbol* s = &scope->symbols[scope->symbol_count++];
-    s->name = st_strdup(name);
+    s->id = id;
+    s->name = intern_text(id);
     s->kind = kind;
+    s->reg = -1;
+    s->slot = -1;
+    s->level = 0;
+    s->variable = -1;
+    return s;
+}
+
+bool scope_add_symbol(Scope* scope, const char* name, SymbolKind kind, int reg) {
+    Symbol* s = scope_add(scope, intern_cstr(name), kind);
+    if (!s) return false;
     s->reg = reg;   // Store the register number
     return true;
 }
 
+bool scope_add_local(Scope* scope, SymbolId id, SymbolKind kind, int slot, int level) {
+    Symbol* s = scope_add(scope, id, kind);
+    if (!s) return false;
+    s->slot = slot;
+    s->level = level;
+    return true;
+}
+
 Symbol* scope_lookup(Scope* scope, const char* name) {
+    SymbolId id = intern_find(name);
+    return id != SYMBOL_ID_NONE ? scope_lookup_id(scope, id) : NULL;
+}
+
+Symbol* scope_lookup_id(Scope* scope, SymbolId id) {
     /* search current scope */
     Scope* current = scope;
     while (current) {
         for (size_t i = 0; i < current->symbol_count; i++) {
-            if (strcmp(current->symbols[i].name, name) == 0) {
+            if (current->symbols[i].id == id) {
                 return &current->symbols[i];
             }
         }
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "debugger.h"
+
+/* How deep debugger_print_value follows lists and objects, which may refer to themselves. */
+#define DEBUG_PRINT_DEPTH 3
+
+static const Instruction breakpoint_instruction = { OP_BREAKPOINT, 0, 0, 0, 0 };
+
+static Breakpoint* find_breakpoint(const Debugger* dbg, size_t pc) {
+    for (size_t i = 0; i < dbg->breakpoint_count; i++) {
+        if (dbg->breakpoints[i].pc == pc) return &dbg->breakpoints[i];
+    }
+    return NULL;
+}
+
+Debugger* debugger_attach(VM* vm) {
+    Debugger* dbg = (Debugger*)calloc(1, sizeof(Debugger));
+    if (!dbg) return NULL;
+    dbg->vm = vm;
+    return dbg;
+}
+
+void debugger_detach(Debugger* dbg) {
+    if (!dbg) return;
+    for (size_t i = 0; i < dbg->breakpoint_count; i++) {
+        dbg->vm->bytecode->instructions[dbg->breakpoints[i].pc] = dbg->breakpoints[i].original;
+    }
+    free(dbg->breakpoints);
+    free(dbg);
+}
+
+bool debugger_set_breakpoint(Debugger* dbg, size_t pc) {
+    Bytecode* bc = dbg->vm->bytecode;
+    if (pc >= bc->instruction_count) return false;
+    if (find_breakpoint(dbg, pc)) return true;
+    if (dbg->breakpoint_count == dbg->breakpoint_capacity) {
+        size_t capacity = dbg->breakpoint_capacity ? dbg->breakpoint_capacity * 2 : 8;
+        Breakpoint* breakpoints = (Breakpoint*)realloc(dbg->breakpoints, capacity * sizeof(Breakpoint));
+        if (!breakpoints) return false;
+        dbg->breakpoints = breakpoints;
+        dbg->breakpoint_capacity = capacity;
+    }
+    dbg->breakpoints[dbg->breakpoint_count].pc = pc;
+    dbg->breakpoints[dbg->breakpoint_count].original = bc->instructions[pc];
+    dbg->breakpoint_count++;
+    bc->instructions[pc] = breakpoint_instruction;
+    return true;
+}
+
+bool debugger_clear_breakpoint(Debugger* dbg, size_t pc) {
+    Breakpoint* bp = find_breakpoint(dbg, pc);
+    if (!bp) return false;
+    dbg->vm->bytecode->instructions[pc] = bp->original;
+    *bp = dbg->breakpoints[--dbg->breakpoint_count];
+    return true;
+}
+
+bool debugger_has_breakpoint(const Debugger* dbg, size_t pc) {
+    return find_breakpoint(dbg, pc) != NULL;
+}
+
+Instruction debugger_instruction(const Debugger* dbg, size_t pc) {
+    const Breakpoint* bp = find_breakpoint(dbg, pc);
+    return bp ? bp->original : dbg->vm->bytecode->instructions[pc];
+}
+
+static DebugStop stop_reason(const Debugger* dbg) {
+    const VM* vm = dbg->vm;
+    if (vm->faulted && !vm->running) return DEBUG_STOP_FAULTED;
+    if (vm->suspended) {
+        bool at_breakpoint = vm->pc < vm->bytecode->instruction_count &&
+                             vm->bytecode->instructions[vm->pc].opcode == OP_BREAKPOINT;
+        return at_breakpoint ? DEBUG_STOP_BREAKPOINT : DEBUG_STOP_SUSPENDED;
+    }
+    if (!vm->running || vm->pc >= vm->bytecode->instruction_count) return DEBUG_STOP_FINISHED;
+    return DEBUG_STOP_STEP;
+}
+
+DebugStop debugger_step(Debugger* dbg) {
+    VM* vm = dbg->vm;
+    Instruction* code = vm->bytecode->instructions;
+    const Breakpoint* bp = find_breakpoint(dbg, vm->pc);
+    if (bp) code[bp->pc] = bp->original;
+    vm_step(vm);
+    if (bp) code[bp->pc] = breakpoint_instruction;
+    return stop_reason(dbg);
+}
+
+DebugStop debugger_continue(Debugger* dbg) {
+    // Leave a breakpoint the VM is stopped at by stepping over it.
+    if (find_breakpoint(dbg, dbg->vm->pc)) {
+        DebugStop stop = debugger_step(dbg);
+        if (stop != DEBUG_STOP_STEP) return stop;
+    }
+    vm_run(dbg->vm);
+    return stop_reason(dbg);
+}
+
+size_t debugger_frame_count(const Debugger* dbg) {
+    return dbg->vm->call_stack_top + 1;
+}
+
+Frame* debugger_frame(const Debugger* dbg, size_t depth) {
+    const VM* vm = dbg->vm;
+    if (depth < vm->call_stack_top) return vm->call_stack[vm->call_stack_top - 1 - depth];
+    return depth == vm->call_stack_top ? vm->top_level : NULL;
+}
+
+size_t debugger_frame_pc(const Debugger* dbg, size_t depth) {
+    const VM* vm = dbg->vm;
+    if (depth == 0 || depth > vm->call_stack_top) return vm->pc;
+    return vm->return_addresses[vm->call_stack_top - depth] - 1;
+}
+
+static void print_value(const Debugger* dbg, Value v, FILE* out, int depth) {
+    switch (v.type) {
+        case VAL_NULL:   fprintf(out, "null"); break;
+        case VAL_INT:    fprintf(out, "%" PRId64, v.as.int_val); break;
+        case VAL_FLOAT:  fprintf(out, "%f", v.as.float_val); break;
+        case VAL_BOOL:   fprintf(out, "%s", v.as.bool_val ? "true" : "false"); break;
+        case VAL_STRING: fprintf(out, "\"%s\"", v.as.str_val ? v.as.str_val : ""); break;
+        case VAL_FILE:   fprintf(out, "[file]"); break;
+        case VAL_LIST:
+            if (depth == 0) {
+                fprintf(out, "[list of %zu]", v.as.list_val->length);
+                break;
+            }
+            fprintf(out, "[");
+            for (size_t i = 0; i < v.as.list_val->length; i++) {
+                if (i > 0) fprintf(out, ", ");
+                print_value(dbg, v.as.list_val->data[i], out, depth - 1);
+            }
+            fprintf(out, "]");
+            break;
+        case VAL_OBJ: {
+            const VMObject* obj = (const VMObject*)v.as.obj_ref;
+            const Bytecode* bc = dbg->vm->bytecode;
+            if (obj->closure >= 0) {
+                fprintf(out, "<function at %d>", bc->closures[obj->closure].address);
+                break;
+            }
+            const ClassInfo* cls = obj->class_index >= 0 ? &bc->classes[obj->class_index] : NULL;
+            fprintf(out, "%s", cls ? bc->constant_pool.strings[cls->name] : "object");
+            if (depth == 0) break;
+            fprintf(out, " {");
+            for (size_t i = 0; i < obj->fields.count; i++) {
+                const char* name = cls && i < cls->field_count ? bc->constant_pool.strings[cls->fields[i]]
+                                 : obj->fields.keys ? obj->fields.keys[i] : "?";
+                fprintf(out, "%s %s = ", i > 0 ? "," : "", name);
+                print_value(dbg, obj->fields.values[i], out, depth - 1);
+            }
+            fprintf(out, " }");
+        } break;
+        default:
+            fprintf(out, "?");
+            break;
+    }
+}
+
+void debugger_print_value(const Debugger* dbg, Value v, FILE* out) {
+    print_value(dbg, v, out, DEBUG_PRINT_DEPTH);
+}
+
+void debugger_print_state(const Debugger* dbg, FILE* out) {
+    const VM* vm = dbg->vm;
+    if (vm->pc < vm->bytecode->instruction_count) {
+        Instruction inst = debugger_instruction(dbg, vm->pc);
+        fprintf(out, "PC %zu: Opcode %d, op1=%d, op2=%d, op3=%d, op4=%d%s\n",
+                vm->pc, inst.opcode, inst.operand1, inst.operand2, inst.operand3, inst.operand4,
+                debugger_has_breakpoint(dbg, vm->pc) ? " (breakpoint)" : "");
+    } else {
+        fprintf(out, "PC %zu: end of code\n", vm->pc);
+    }
+    for (int r = 0; r < 16; r++) {
+        if (vm->registers[r].type == VAL_NULL) continue;
+        fprintf(out, "  R%d = ", r);
+        print_value(dbg, vm->registers[r], out, DEBUG_PRINT_DEPTH);
+        fprintf(out, "\n");
+    }
+    size_t frames = debugger_frame_count(dbg);
+    for (size_t depth = 0; depth < frames; depth++) {
+        const Frame* frame = debugger_frame(dbg, depth);
+        fprintf(out, "  #%zu %s at PC %zu\n", depth, depth + 1 == frames ? "top level" : "call",
+                debugger_frame_pc(dbg, depth));
+        for (size_t i = 0; frame && i < frame->local_count; i++) {
+            if (frame->locals[i].type == VAL_NULL) continue;
+            fprintf(out, "    local %zu = ", i);
+            print_value(dbg, frame->locals[i], out, DEBUG_PRINT_DEPTH);
+            fprintf(out, "\n");
+        }
+    }
+}
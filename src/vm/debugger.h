@@ -0,0 +1,89 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+#include "frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A debugger for a running VM. A breakpoint replaces the instruction at its
+ * PC with OP_BREAKPOINT, which stops vm_run in front of it; continuing or
+ * stepping from there puts the instruction back for the one step that runs
+ * it, then patches the breakpoint in again. Code without breakpoints runs
+ * exactly as it does with no debugger attached.
+ *
+ *     Debugger* dbg = debugger_attach(vm);
+ *     debugger_set_breakpoint(dbg, pc);
+ *     while (debugger_continue(dbg) == DEBUG_STOP_BREAKPOINT) {
+ *         debugger_print_state(dbg, stderr);
+ *     }
+ *     debugger_detach(dbg);
+ *
+ * PCs are those of the bytecode the VM runs, after optimization.
+ */
+
+typedef enum DebugStop {
+    DEBUG_STOP_BREAKPOINT,  // about to run an instruction with a breakpoint
+    DEBUG_STOP_STEP,        // one instruction ran; more are left
+    DEBUG_STOP_SUSPENDED,   // the fuel handler yielded (see vm_set_fuel)
+    DEBUG_STOP_FINISHED,    // nothing left to run, or out of fuel
+    DEBUG_STOP_FAULTED      // stopped by a runtime error no handler caught
+} DebugStop;
+
+typedef struct Breakpoint {
+    size_t pc;
+    Instruction original;   // the instruction OP_BREAKPOINT replaced
+} Breakpoint;
+
+typedef struct Debugger {
+    VM* vm;
+    Breakpoint* breakpoints;
+    size_t breakpoint_count;
+    size_t breakpoint_capacity;
+} Debugger;
+
+Debugger* debugger_attach(VM* vm);
+
+/* Remove every breakpoint, leaving the bytecode as it was, and free 'dbg'. */
+void debugger_detach(Debugger* dbg);
+
+/* False if 'pc' is out of range; setting a breakpoint twice is harmless. */
+bool debugger_set_breakpoint(Debugger* dbg, size_t pc);
+bool debugger_clear_breakpoint(Debugger* dbg, size_t pc);
+bool debugger_has_breakpoint(const Debugger* dbg, size_t pc);
+
+/* Run to the next breakpoint or to the end. */
+DebugStop debugger_continue(Debugger* dbg);
+
+/* Run one instruction, even one with a breakpoint. */
+DebugStop debugger_step(Debugger* dbg);
+
+/* The instruction at 'pc' as compiled, whether or not a breakpoint covers it. */
+Instruction debugger_instruction(const Debugger* dbg, size_t pc);
+
+/* Calls in progress plus the top level. */
+size_t debugger_frame_count(const Debugger* dbg);
+
+/* Frame 'depth' (0 is the innermost; the last is the top level), or NULL. */
+Frame* debugger_frame(const Debugger* dbg, size_t depth);
+
+/* Where frame 'depth' is: vm->pc for the innermost, else its pending call. */
+size_t debugger_frame_pc(const Debugger* dbg, size_t depth);
+
+/* A value, objects with their field names and lists with their elements. */
+void debugger_print_value(const Debugger* dbg, Value v, FILE* out);
+
+/* The PC and its instruction, the registers in use and every frame. */
+void debugger_print_state(const Debugger* dbg, FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEBUGGER_H */
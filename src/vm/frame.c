@@ -12,7 +12,10 @@ Frame* frame_create(size_t local_count, Frame* parent) {
     }
     f->local_count = local_count;
     f->parent = parent;
-    f->locals = (Value*)calloc(local_count, sizeof(Value));
+    f->closure = VALUE_NULL;
+    f->saved_count = 0;
+    f->result_register = -1;
+    f->locals = (Value*)calloc(local_count > 0 ? local_count : 1, sizeof(Value));
     if (!f->locals) {
         fprintf(stderr, "Failed to allocate Frame locals.\n");
         free(f);
@@ -28,8 +31,7 @@ Frame* frame_create(size_t local_count, Frame* parent) {
 
 void frame_destroy(Frame* frame) {
     if (!frame) return;
-    /* If we had references to objects or strings in these locals,
-    we'd release them or handle reference counting. */
+    /* The VM releases whatever the locals still reference before this. */
     free(frame->locals);
     free(frame);
 }
\ No newline at end of file
@@ -15,6 +15,10 @@ typedef struct Frame {
     Value* locals;
     size_t local_count;
     struct Frame* parent;  /* link to parent frame if needed */
+    Value closure;         /* the closure the frame runs (its upvalues), or null */
+    Value saved_registers[16];  /* the caller's registers below saved_count, put back on return */
+    int saved_count;
+    int result_register;   /* caller's register for the returned value, or -1 to drop it */
 } Frame;
 
 /* Create/destroy frames */
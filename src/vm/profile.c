@@ -0,0 +1,172 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_MAGIC "OSFLPROF"
+#define PROFILE_VERSION 1u
+
+Profile* profile_create(uint64_t fingerprint, size_t count) {
+    Profile* profile = (Profile*)malloc(sizeof(Profile));
+    if (!profile) {
+        fprintf(stderr, "Failed to allocate Profile.\n");
+        return NULL;
+    }
+    profile->fingerprint = fingerprint;
+    profile->count = count;
+    profile->entries = (ProfileEntry*)calloc(count > 0 ? count : 1, sizeof(ProfileEntry));
+    if (!profile->entries) {
+        fprintf(stderr, "Failed to allocate Profile entries.\n");
+        free(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+void profile_destroy(Profile* profile) {
+    if (!profile) return;
+    free(profile->entries);
+    free(profile);
+}
+
+/* Mark the type held in register 'r' as observed. */
+static void observe_register(ProfileEntry* entry, const Value* registers, int r) {
+    if (r < 0 || r >= 16) return;
+    entry->operand_types |= (uint32_t)1u << registers[r].type;
+}
+
+void profile_record(Profile* profile, size_t source_pc, const Instruction* inst,
+                    const Value* registers, size_t pc, size_t next_pc) {
+    if (!profile || source_pc >= profile->count) return;
+    ProfileEntry* entry = &profile->entries[source_pc];
+    entry->exec_count++;
+
+    switch (inst->opcode) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+            observe_register(entry, registers, inst->operand2);
+            observe_register(entry, registers, inst->operand3);
+            break;
+        case OP_NOT:
+        case OP_BIT_NOT:
+        case OP_MOVE:
+        case OP_MOVE_OWN:
+        case OP_STORE_LOCAL:
+        case OP_STORE_GLOBAL:
+            observe_register(entry, registers, inst->operand2);
+            break;
+        case OP_JUMP:
+        case OP_JUMP_IF_ZERO:
+        case OP_JUMP_IF_NONZERO:
+            if (inst->opcode != OP_JUMP) {
+                observe_register(entry, registers, inst->operand2);
+            }
+            if (next_pc != pc + 1) {
+                entry->taken_count++;
+            }
+            break;
+        case OP_JUMP_IF_EQ:
+        case OP_JUMP_IF_NE:
+        case OP_JUMP_IF_LT:
+        case OP_JUMP_IF_LE:
+        case OP_JUMP_IF_GT:
+        case OP_JUMP_IF_GE:
+            observe_register(entry, registers, inst->operand2);
+            observe_register(entry, registers, inst->operand3);
+            if (next_pc != pc + 1) {
+                entry->taken_count++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+const ProfileEntry* profile_entry(const Profile* profile, size_t source_pc) {
+    if (!profile || source_pc >= profile->count) return NULL;
+    return &profile->entries[source_pc];
+}
+
+/*
+    File layout (host byte order):
+        char[8]  magic "OSFLPROF"
+        uint32   version
+        uint64   fingerprint
+        uint64   entry count
+        entries: uint64 exec_count, uint64 taken_count, uint32 operand_types
+*/
+bool profile_write(const Profile* profile, const char* path) {
+    if (!profile || !path) return false;
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Could not open profile '%s' for writing.\n", path);
+        return false;
+    }
+    uint32_t version = PROFILE_VERSION;
+    uint64_t count = (uint64_t)profile->count;
+    bool ok = fwrite(PROFILE_MAGIC, 1, 8, fp) == 8 &&
+              fwrite(&version, sizeof(version), 1, fp) == 1 &&
+              fwrite(&profile->fingerprint, sizeof(profile->fingerprint), 1, fp) == 1 &&
+              fwrite(&count, sizeof(count), 1, fp) == 1;
+    for (size_t i = 0; ok && i < profile->count; i++) {
+        const ProfileEntry* e = &profile->entries[i];
+        ok = fwrite(&e->exec_count, sizeof(e->exec_count), 1, fp) == 1 &&
+             fwrite(&e->taken_count, sizeof(e->taken_count), 1, fp) == 1 &&
+             fwrite(&e->operand_types, sizeof(e->operand_types), 1, fp) == 1;
+    }
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "Failed to write profile '%s'.\n", path);
+    }
+    return ok;
+}
+
+Profile* profile_read(const char* path) {
+    if (!path) return NULL;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    char magic[8];
+    uint32_t version = 0;
+    uint64_t fingerprint = 0;
+    uint64_t count = 0;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, PROFILE_MAGIC, 8) != 0 ||
+        fread(&version, sizeof(version), 1, fp) != 1 || version != PROFILE_VERSION ||
+        fread(&fingerprint, sizeof(fingerprint), 1, fp) != 1 ||
+        fread(&count, sizeof(count), 1, fp) != 1) {
+        fprintf(stderr, "Profile '%s' is not a valid OSFL profile.\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    Profile* profile = profile_create(fingerprint, (size_t)count);
+    if (!profile) {
+        fclose(fp);
+        return NULL;
+    }
+    for (size_t i = 0; i < profile->count; i++) {
+        ProfileEntry* e = &profile->entries[i];
+        if (fread(&e->exec_count, sizeof(e->exec_count), 1, fp) != 1 ||
+            fread(&e->taken_count, sizeof(e->taken_count), 1, fp) != 1 ||
+            fread(&e->operand_types, sizeof(e->operand_types), 1, fp) != 1) {
+            fprintf(stderr, "Profile '%s' is truncated.\n", path);
+            profile_destroy(profile);
+            fclose(fp);
+            return NULL;
+        }
+    }
+    fclose(fp);
+    return profile;
+}
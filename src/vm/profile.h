@@ -0,0 +1,61 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../include/vm_common.h"
+#include "../../include/value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Execution profile recorded by vm_run and consumed by the optimizer on the
+ * next compile. Entries are indexed by the instruction's PC in the
+ * *unoptimized* bytecode, so a profile stays valid across optimizer changes
+ * to the layout as long as the program itself is unchanged (see fingerprint).
+ */
+typedef struct {
+    uint64_t exec_count;    /* times the instruction was executed (call count for OP_CALL) */
+    uint64_t taken_count;   /* branches: times control did not fall through */
+    uint32_t operand_types; /* bitmask of (1 << ValueType) seen in source registers */
+} ProfileEntry;
+
+typedef struct Profile {
+    uint64_t fingerprint;   /* bytecode_fingerprint() of the unoptimized program */
+    ProfileEntry* entries;
+    size_t count;
+} Profile;
+
+/**
+ * Create an empty profile for a program of 'count' unoptimized instructions.
+ */
+Profile* profile_create(uint64_t fingerprint, size_t count);
+void profile_destroy(Profile* profile);
+
+/**
+ * Record one executed instruction. 'source_pc' is the unoptimized PC,
+ * 'next_pc' the PC the VM continued at.
+ */
+void profile_record(Profile* profile, size_t source_pc, const Instruction* inst,
+                    const Value* registers, size_t pc, size_t next_pc);
+
+/**
+ * Serialize to / load from a binary profile file.
+ * profile_read returns NULL if the file is missing or malformed.
+ */
+bool profile_write(const Profile* profile, const char* path);
+Profile* profile_read(const char* path);
+
+/**
+ * Return the entry for an unoptimized PC, or NULL if out of range.
+ */
+const ProfileEntry* profile_entry(const Profile* profile, size_t source_pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_H */
@@ -0,0 +1,233 @@
+#include "replay.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC "OSFLRPLY"
+#define REPLAY_VERSION 1u
+
+/*
+ * After the magic, version and fingerprint, one entry per call: the
+ * unoptimized PC and the result. Numbers and lengths are LEB128 varints
+ * (ints zigzag-encoded first), so most entries take a few bytes.
+ *   value   type byte, then: int varint | float 8 bytes | bool byte |
+ *           string length and bytes | list length and values |
+ *           file one byte (0 for a failed open) | nothing for the rest
+ */
+
+/* Lists nest no deeper than this in a log; deeper ones are malformed. */
+#define REPLAY_MAX_DEPTH 64
+
+static void put_varint(FILE* fp, uint64_t x) {
+    while (x >= 0x80) {
+        fputc((int)(x & 0x7f) | 0x80, fp);
+        x >>= 7;
+    }
+    fputc((int)x, fp);
+}
+
+static bool get_varint(FILE* fp, uint64_t* out) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(fp);
+        if (c == EOF) return false;
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *out = x;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void put_value(FILE* fp, const Value* v) {
+    ValueType type = v->type == VAL_OBJ ? VAL_NULL : v->type;  /* natives make no objects */
+    fputc((int)type, fp);
+    switch (type) {
+        case VAL_INT: {
+            uint64_t bits = (uint64_t)v->as.int_val;
+            put_varint(fp, (bits << 1) ^ (uint64_t)-(int64_t)(bits >> 63));
+        } break;
+        case VAL_FLOAT:
+            fwrite(&v->as.float_val, sizeof(double), 1, fp);
+            break;
+        case VAL_BOOL:
+            fputc(v->as.bool_val ? 1 : 0, fp);
+            break;
+        case VAL_STRING: {
+            size_t length = v->as.str_val ? strlen(v->as.str_val) : 0;
+            put_varint(fp, length);
+            fwrite(v->as.str_val, 1, length, fp);
+        } break;
+        case VAL_LIST:
+            put_varint(fp, v->as.list_val->length);
+            for (size_t i = 0; i < v->as.list_val->length; i++) {
+                put_value(fp, &v->as.list_val->data[i]);
+            }
+            break;
+        case VAL_FILE:
+            fputc(v->as.file_val.native_file ? 1 : 0, fp);
+            break;
+        default:
+            break;
+    }
+}
+
+static void free_value(Value* v) {
+    if (v->type == VAL_STRING) {
+        free(v->as.str_val);
+    } else if (v->type == VAL_LIST) {
+        for (size_t i = 0; i < v->as.list_val->length; i++) {
+            free_value(&v->as.list_val->data[i]);
+        }
+        free(v->as.list_val->data);
+        free(v->as.list_val);
+    }
+    *v = VALUE_NULL;
+}
+
+/*
+ * Read a value into fresh storage, as the native returned it. A replayed
+ * file has no handle: every native that would use one is replayed too.
+ */
+static bool get_value(FILE* fp, Value* v, int depth) {
+    *v = VALUE_NULL;
+    int type = fgetc(fp);
+    uint64_t x;
+    switch (type) {
+        case VAL_NULL:
+            return true;
+        case VAL_INT:
+            if (!get_varint(fp, &x)) return false;
+            v->type = VAL_INT;
+            v->as.int_val = (int64_t)((x >> 1) ^ (uint64_t)-(int64_t)(x & 1));
+            return true;
+        case VAL_FLOAT:
+            v->type = VAL_FLOAT;
+            return fread(&v->as.float_val, sizeof(double), 1, fp) == 1;
+        case VAL_BOOL: {
+            int c = fgetc(fp);
+            v->type = VAL_BOOL;
+            v->as.bool_val = c == 1;
+            return c != EOF;
+        }
+        case VAL_STRING: {
+            if (!get_varint(fp, &x) || x > SIZE_MAX - 1) return false;
+            char* s = (char*)malloc((size_t)x + 1);
+            if (!s) return false;
+            if (fread(s, 1, (size_t)x, fp) != (size_t)x) {
+                free(s);
+                return false;
+            }
+            s[x] = '\0';
+            v->type = VAL_STRING;
+            v->as.str_val = s;
+            return true;
+        }
+        case VAL_LIST: {
+            if (depth >= REPLAY_MAX_DEPTH || !get_varint(fp, &x) || x > SIZE_MAX / sizeof(Value)) return false;
+            ValueList* list = (ValueList*)calloc(1, sizeof(ValueList));
+            if (!list) return false;
+            list->data = x > 0 ? (Value*)calloc((size_t)x, sizeof(Value)) : NULL;
+            list->capacity = (size_t)x;
+            if (x > 0 && !list->data) {
+                free(list);
+                return false;
+            }
+            v->type = VAL_LIST;
+            v->as.list_val = list;
+            for (size_t i = 0; i < (size_t)x; i++) {
+                v->as.list_val->length = i + 1;
+                if (!get_value(fp, &v->as.list_val->data[i], depth + 1)) {
+                    free_value(v);
+                    return false;
+                }
+            }
+            return true;
+        }
+        case VAL_FILE:
+            v->type = VAL_FILE;
+            v->as.file_val.native_file = NULL;
+            return fgetc(fp) != EOF;
+        default:
+            return false;
+    }
+}
+
+static Replay* replay_create(ReplayMode mode, FILE* fp) {
+    Replay* replay = (Replay*)calloc(1, sizeof(Replay));
+    if (!replay) {
+        fclose(fp);
+        return NULL;
+    }
+    replay->mode = mode;
+    replay->fp = fp;
+    return replay;
+}
+
+Replay* replay_record(const char* path, uint64_t fingerprint) {
+    FILE* fp = path ? fopen(path, "wb") : NULL;
+    if (!fp) {
+        fprintf(stderr, "Could not open replay log '%s' for writing.\n", path ? path : "");
+        return NULL;
+    }
+    uint32_t version = REPLAY_VERSION;
+    fwrite(REPLAY_MAGIC, 1, 8, fp);
+    fwrite(&version, sizeof(version), 1, fp);
+    fwrite(&fingerprint, sizeof(fingerprint), 1, fp);
+    return replay_create(REPLAY_RECORD, fp);
+}
+
+Replay* replay_open(const char* path, uint64_t fingerprint) {
+    FILE* fp = path ? fopen(path, "rb") : NULL;
+    if (!fp) {
+        fprintf(stderr, "Could not open replay log '%s'.\n", path ? path : "");
+        return NULL;
+    }
+    char magic[8];
+    uint32_t version = 0;
+    uint64_t recorded = 0;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, REPLAY_MAGIC, 8) != 0 ||
+        fread(&version, sizeof(version), 1, fp) != 1 || version != REPLAY_VERSION ||
+        fread(&recorded, sizeof(recorded), 1, fp) != 1) {
+        fprintf(stderr, "'%s' is not a valid OSFL replay log.\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    if (recorded != fingerprint) {
+        fprintf(stderr, "Replay log '%s' was recorded for a different program.\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    return replay_create(REPLAY_PLAY, fp);
+}
+
+void replay_close(Replay* replay) {
+    if (!replay) return;
+    if (fclose(replay->fp) != 0 && replay->mode == REPLAY_RECORD) {
+        fprintf(stderr, "Failed to write replay log.\n");
+    }
+    free(replay);
+}
+
+bool replay_native(Replay* replay, size_t source_pc, const NativeDescriptor* native,
+                   int arg_count, Value* args, Value* result) {
+    if (replay->mode == REPLAY_RECORD) {
+        *result = native->func(arg_count, args);
+        put_varint(replay->fp, source_pc);
+        put_value(replay->fp, result);
+        replay->calls++;
+        return true;
+    }
+
+    *result = VALUE_NULL;
+    uint64_t pc;
+    if (!get_varint(replay->fp, &pc)) {
+        replay->ended = true;
+        return false;
+    }
+    if (pc != source_pc || !get_value(replay->fp, result, 0)) {
+        return false;
+    }
+    replay->calls++;
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../include/value.h"
+#include "../../include/native.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Record and replay of the natives that depend on the world outside the VM
+ * (NATIVE_EXTERNAL: the clock, files, output). Recording logs the result of
+ * each call of one; replaying returns the logged results instead of
+ * calling them, so the run takes the path of the recorded one without
+ * touching any file or printing anything, as often as needed. Every other
+ * native runs as usual: given the same arguments it gives the same result.
+ *
+ * Calls are identified by their unoptimized PC (see bytecode_origin), so
+ * the log replays under any optimization of the same program.
+ */
+
+typedef enum {
+    REPLAY_RECORD,
+    REPLAY_PLAY
+} ReplayMode;
+
+typedef struct Replay {
+    ReplayMode mode;
+    FILE* fp;
+    uint64_t calls;     /* calls recorded or replayed so far */
+    bool ended;         /* replaying: the log ran out, where the recorded run stopped */
+} Replay;
+
+/**
+ * Start a log at 'path' for the program with this bytecode_fingerprint(),
+ * or open one to replay. NULL if the file cannot be opened, or is not a
+ * log of that program.
+ */
+Replay* replay_record(const char* path, uint64_t fingerprint);
+Replay* replay_open(const char* path, uint64_t fingerprint);
+
+/* Finish writing the log (or stop reading it) and free 'replay'. */
+void replay_close(Replay* replay);
+
+/**
+ * Call the external native 'native' at unoptimized PC 'source_pc' and log
+ * its result, or take the result from the log. Returns false, with a null
+ * result, if the log ran out or was recorded for a different call.
+ */
+bool replay_native(Replay* replay, size_t source_pc, const NativeDescriptor* native,
+                   int arg_count, Value* args, Value* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H */
@@ -0,0 +1,667 @@
+#include "snapshot.h"
+#include "frame.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC "OSFLSNAP"
+#define SNAPSHOT_VERSION 2u
+
+/*
+ * Layout of an image, after the magic and version:
+ *   bytecode     instructions, origins, constant pool and the side tables
+ *   payloads     count, then per payload its kind, reference count and size
+ *                (and the bytes of a string)
+ *   contents     the elements of each list and the keys and values of each
+ *                object, in payload order
+ *   state        pc, the 16 registers and the top-level locals
+ * Values refer to payloads by number, so shared and cyclic structures come
+ * back as they were. Every payload is allocated before any value is read.
+ */
+
+enum {
+    PAYLOAD_STRING,
+    PAYLOAD_LIST,
+    PAYLOAD_OBJECT
+};
+
+/* Tags of encoded values beyond the ValueTypes. */
+#define TAG_CONSTANT_STRING 0x80   /* a constant pool string, by index */
+
+/* A string, list or object of the VM being written. */
+typedef struct {
+    const void* ptr;
+    int kind;
+    size_t walked;     /* elements whose payloads have been numbered */
+} SnapshotPayload;
+
+/* Numbers payloads by pointer; constant pool strings are -(index + 1). */
+typedef struct {
+    const void** keys;
+    int* ids;
+    size_t used;
+    size_t capacity;
+    SnapshotPayload* payloads;
+    size_t payload_count;
+    size_t payload_capacity;
+    bool ok;
+} SnapshotWriter;
+
+static size_t pointer_hash(const void* ptr, size_t capacity) {
+    uintptr_t x = (uintptr_t)ptr;
+    x ^= x >> 17;
+    x *= (uintptr_t)0xed5ad4bbu;
+    x ^= x >> 11;
+    return (size_t)x & (capacity - 1);
+}
+
+static int* writer_find(SnapshotWriter* w, const void* ptr) {
+    size_t i = pointer_hash(ptr, w->capacity);
+    while (w->keys[i] && w->keys[i] != ptr) i = (i + 1) & (w->capacity - 1);
+    if (!w->keys[i]) {
+        w->keys[i] = ptr;
+        w->ids[i] = 0;  /* not numbered yet */
+        w->used++;
+    }
+    return &w->ids[i];
+}
+
+static bool writer_grow(SnapshotWriter* w) {
+    size_t old_capacity = w->capacity;
+    const void** old_keys = w->keys;
+    int* old_ids = w->ids;
+    w->capacity = old_capacity ? old_capacity * 2 : 256;
+    w->keys = (const void**)calloc(w->capacity, sizeof(void*));
+    w->ids = (int*)calloc(w->capacity, sizeof(int));
+    if (!w->keys || !w->ids) {
+        free(w->keys);
+        free(w->ids);
+        w->keys = old_keys;
+        w->ids = old_ids;
+        w->capacity = old_capacity;
+        return false;
+    }
+    w->used = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_keys[i]) *writer_find(w, old_keys[i]) = old_ids[i];
+    }
+    free(old_keys);
+    free(old_ids);
+    return true;
+}
+
+/* The id slot of 'ptr', added (as 0) if it is new. NULL when out of memory. */
+static int* writer_slot(SnapshotWriter* w, const void* ptr) {
+    if ((w->used + 1) * 2 > w->capacity && !writer_grow(w)) {
+        w->ok = false;
+        return NULL;
+    }
+    return writer_find(w, ptr);
+}
+
+/* The number of the payload of 'v', adding it on first sight; 0 for none. */
+static int writer_number(SnapshotWriter* w, const Value* v) {
+    const void* ptr = NULL;
+    int kind = PAYLOAD_STRING;
+    switch (v->type) {
+        case VAL_STRING: ptr = v->as.str_val; break;
+        case VAL_LIST:   ptr = v->as.list_val; kind = PAYLOAD_LIST; break;
+        case VAL_OBJ:    ptr = v->as.obj_ref; kind = PAYLOAD_OBJECT; break;
+        default: return 0;
+    }
+    if (!ptr) return 0;
+    int* id = writer_slot(w, ptr);
+    if (!id) return 0;
+    if (*id == 0) {
+        if (w->payload_count == w->payload_capacity) {
+            size_t capacity = w->payload_capacity ? w->payload_capacity * 2 : 64;
+            SnapshotPayload* payloads = (SnapshotPayload*)realloc(w->payloads, capacity * sizeof(SnapshotPayload));
+            if (!payloads) {
+                w->ok = false;
+                return 0;
+            }
+            w->payloads = payloads;
+            w->payload_capacity = capacity;
+        }
+        SnapshotPayload* p = &w->payloads[w->payload_count];
+        p->ptr = ptr;
+        p->kind = kind;
+        p->walked = 0;
+        *id = (int)++w->payload_count;
+    }
+    return *id;
+}
+
+static void writer_collect(SnapshotWriter* w, const Value* values, size_t count) {
+    for (size_t i = 0; w->ok && i < count; i++) writer_number(w, &values[i]);
+}
+
+/*
+ * Number everything reachable from what has been numbered so far, until
+ * no payload has elements left unwalked.
+ */
+static void writer_collect_all(SnapshotWriter* w) {
+    bool grew = true;
+    while (w->ok && grew) {
+        grew = false;
+        for (size_t n = 0; w->ok && n < w->payload_count; n++) {
+            SnapshotPayload p = w->payloads[n];  /* a copy: numbering may move the array */
+            const Value* values = NULL;
+            size_t total = 0;
+            if (p.kind == PAYLOAD_LIST) {
+                values = ((const ValueList*)p.ptr)->data;
+                total = ((const ValueList*)p.ptr)->length;
+            } else if (p.kind == PAYLOAD_OBJECT) {
+                values = ((const VMObject*)p.ptr)->fields.values;
+                total = ((const VMObject*)p.ptr)->fields.count;
+            }
+            if (p.walked >= total) continue;
+            writer_collect(w, values + p.walked, total - p.walked);
+            w->payloads[n].walked = total;
+            grew = true;
+        }
+    }
+}
+
+static void put(SnapshotWriter* w, FILE* fp, const void* data, size_t size) {
+    if (w->ok && size > 0 && fwrite(data, size, 1, fp) != 1) w->ok = false;
+}
+
+static void put_u64(SnapshotWriter* w, FILE* fp, uint64_t x) { put(w, fp, &x, sizeof(x)); }
+static void put_i32(SnapshotWriter* w, FILE* fp, int32_t x) { put(w, fp, &x, sizeof(x)); }
+
+static void put_string(SnapshotWriter* w, FILE* fp, const char* s) {
+    uint64_t length = (uint64_t)strlen(s);
+    put_u64(w, fp, length);
+    put(w, fp, s, (size_t)length);
+}
+
+static void put_value(SnapshotWriter* w, FILE* fp, const Value* v) {
+    uint8_t tag = (uint8_t)v->type;
+    int id = 0;
+    if (v->type == VAL_STRING || v->type == VAL_LIST || v->type == VAL_OBJ) {
+        id = writer_number(w, v);
+        if (id < 0) tag = TAG_CONSTANT_STRING;
+    }
+    put(w, fp, &tag, 1);
+    switch (v->type) {
+        case VAL_INT:   put(w, fp, &v->as.int_val, sizeof(v->as.int_val)); break;
+        case VAL_FLOAT: put(w, fp, &v->as.float_val, sizeof(v->as.float_val)); break;
+        case VAL_BOOL: {
+            uint8_t b = v->as.bool_val ? 1 : 0;
+            put(w, fp, &b, 1);
+        } break;
+        case VAL_STRING:
+        case VAL_LIST:
+        case VAL_OBJ:
+            put_i32(w, fp, id < 0 ? -id - 1 : id);
+            break;
+        case VAL_FILE:
+            fprintf(stderr, "Snapshot: a file handle cannot be saved.\n");
+            w->ok = false;
+            break;
+        default:
+            break;
+    }
+}
+
+static void put_bytecode(SnapshotWriter* w, FILE* fp, const Bytecode* bc) {
+    put_u64(w, fp, (uint64_t)bc->instruction_count);
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        const Instruction* inst = &bc->instructions[i];
+        put_i32(w, fp, (int32_t)inst->opcode);
+        put_i32(w, fp, inst->operand1);
+        put_i32(w, fp, inst->operand2);
+        put_i32(w, fp, inst->operand3);
+        put_i32(w, fp, inst->operand4);
+        put_i32(w, fp, (int32_t)bytecode_origin(bc, i));
+    }
+    put_u64(w, fp, (uint64_t)bc->constant_pool.count);
+    for (size_t i = 0; i < bc->constant_pool.count; i++) {
+        put_string(w, fp, bc->constant_pool.strings[i]);
+    }
+    put_u64(w, fp, (uint64_t)bc->top_level_slots);
+    put_i32(w, fp, bc->main_address);
+    put_u64(w, fp, (uint64_t)bc->switch_table_count);
+    for (size_t t = 0; t < bc->switch_table_count; t++) {
+        const SwitchTable* table = &bc->switch_tables[t];
+        put(w, fp, &table->low, sizeof(table->low));
+        put_u64(w, fp, (uint64_t)table->count);
+        for (size_t i = 0; i < table->count; i++) {
+            put(w, fp, &table->entries[i].key, sizeof(table->entries[i].key));
+            put_i32(w, fp, table->entries[i].target);
+            put_i32(w, fp, table->entries[i].str_index);
+        }
+    }
+    put_u64(w, fp, (uint64_t)bc->handler_count);
+    for (size_t h = 0; h < bc->handler_count; h++) {
+        put_i32(w, fp, bc->handlers[h].start);
+        put_i32(w, fp, bc->handlers[h].end);
+        put_i32(w, fp, bc->handlers[h].handler);
+    }
+    put_u64(w, fp, (uint64_t)bc->class_count);
+    for (size_t c = 0; c < bc->class_count; c++) {
+        const ClassInfo* cls = &bc->classes[c];
+        put_i32(w, fp, cls->name);
+        put_u64(w, fp, (uint64_t)cls->field_count);
+        for (size_t f = 0; f < cls->field_count; f++) put_i32(w, fp, cls->fields[f]);
+        put_u64(w, fp, (uint64_t)cls->method_count);
+        for (size_t m = 0; m < cls->method_count; m++) {
+            put_i32(w, fp, cls->methods[m].name);
+            put_i32(w, fp, cls->methods[m].address);
+            put_i32(w, fp, cls->methods[m].frame_size);
+        }
+    }
+    put_u64(w, fp, (uint64_t)bc->closure_count);
+    for (size_t c = 0; c < bc->closure_count; c++) {
+        const ClosureInfo* info = &bc->closures[c];
+        put_i32(w, fp, info->address);
+        put_i32(w, fp, info->frame_size);
+        put_u64(w, fp, (uint64_t)info->capture_count);
+        for (size_t k = 0; k < info->capture_count; k++) put_i32(w, fp, info->captures[k]);
+    }
+}
+
+bool vm_snapshot(const VM* vm, const char* path) {
+    if (!vm || !path) return false;
+    if (!vm_paused_at_main(vm)) {
+        fprintf(stderr, "Snapshot: the VM is not paused before main().\n");
+        return false;
+    }
+    const Bytecode* bc = vm->bytecode;
+    SnapshotWriter w = { NULL, NULL, 0, 0, NULL, 0, 0, true };
+    for (size_t i = 0; w.ok && i < bc->constant_pool.count; i++) {
+        int* id = writer_slot(&w, bc->constant_pool.strings[i]);
+        if (id) *id = -(int)i - 1;
+    }
+    writer_collect(&w, vm->registers, 16);
+    writer_collect(&w, vm->top_level->locals, vm->top_level->local_count);
+    writer_collect_all(&w);
+
+    FILE* fp = w.ok ? fopen(path, "wb") : NULL;
+    if (!fp) {
+        if (w.ok) fprintf(stderr, "Could not open snapshot '%s' for writing.\n", path);
+        free(w.keys);
+        free(w.ids);
+        free(w.payloads);
+        return false;
+    }
+    uint32_t version = SNAPSHOT_VERSION;
+    put(&w, fp, SNAPSHOT_MAGIC, 8);
+    put(&w, fp, &version, sizeof(version));
+    put_bytecode(&w, fp, bc);
+
+    put_u64(&w, fp, (uint64_t)w.payload_count);
+    for (size_t n = 0; n < w.payload_count; n++) {
+        const SnapshotPayload* p = &w.payloads[n];
+        uint8_t kind = (uint8_t)p->kind;
+        put(&w, fp, &kind, 1);
+        if (p->kind == PAYLOAD_OBJECT) {
+            const VMObject* obj = (const VMObject*)p->ptr;
+            put_i32(&w, fp, obj->refcount);
+            put_i32(&w, fp, obj->class_index);
+            put_i32(&w, fp, obj->closure);
+            put_u64(&w, fp, (uint64_t)obj->fields.count);
+            uint8_t keyed = obj->fields.keys ? 1 : 0;
+            put(&w, fp, &keyed, 1);
+            continue;
+        }
+        Value v = { .type = p->kind == PAYLOAD_LIST ? VAL_LIST : VAL_STRING };
+        if (p->kind == PAYLOAD_LIST) {
+            v.as.list_val = (ValueList*)p->ptr;
+        } else {
+            v.as.str_val = (char*)p->ptr;
+        }
+        int refcount = vm_value_refcount(vm, v);
+        put_i32(&w, fp, refcount > 0 ? refcount : VM_HEAP_PINNED);
+        if (p->kind == PAYLOAD_LIST) {
+            put_u64(&w, fp, (uint64_t)v.as.list_val->length);
+            put_u64(&w, fp, (uint64_t)v.as.list_val->capacity);
+        } else {
+            put_string(&w, fp, (const char*)p->ptr);
+        }
+    }
+    for (size_t n = 0; w.ok && n < w.payload_count; n++) {
+        const SnapshotPayload* p = &w.payloads[n];
+        if (p->kind == PAYLOAD_LIST) {
+            const ValueList* list = (const ValueList*)p->ptr;
+            for (size_t i = 0; i < list->length; i++) put_value(&w, fp, &list->data[i]);
+        } else if (p->kind == PAYLOAD_OBJECT) {
+            const VMObject* obj = (const VMObject*)p->ptr;
+            for (size_t i = 0; i < obj->fields.count; i++) {
+                if (obj->fields.keys) put_string(&w, fp, obj->fields.keys[i]);
+                put_value(&w, fp, &obj->fields.values[i]);
+            }
+        }
+    }
+
+    put_u64(&w, fp, (uint64_t)vm->pc);
+    for (int r = 0; r < 16; r++) put_value(&w, fp, &vm->registers[r]);
+    put_u64(&w, fp, (uint64_t)vm->top_level->local_count);
+    for (size_t i = 0; i < vm->top_level->local_count; i++) {
+        put_value(&w, fp, &vm->top_level->locals[i]);
+    }
+
+    bool ok = w.ok;
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Failed to write snapshot '%s'.\n", path);
+        remove(path);
+    }
+    free(w.keys);
+    free(w.ids);
+    free(w.payloads);
+    return ok;
+}
+
+/* ------------------------------------------------------------------
+    Restore
+------------------------------------------------------------------ */
+
+typedef struct {
+    const unsigned char* data;   /* the whole image */
+    size_t size;
+    size_t offset;
+    bool ok;
+    void** payloads;             /* by number - 1 */
+    uint8_t* kinds;
+    size_t* lengths;             /* elements of each list or object */
+    size_t payload_count;
+    const ConstantPool* pool;
+} SnapshotReader;
+
+static void get(SnapshotReader* r, void* out, size_t size) {
+    if (!r->ok || size > r->size - r->offset) {
+        r->ok = false;
+        memset(out, 0, size);
+        return;
+    }
+    memcpy(out, r->data + r->offset, size);
+    r->offset += size;
+}
+
+static uint64_t get_u64(SnapshotReader* r) { uint64_t x; get(r, &x, sizeof(x)); return x; }
+static int32_t get_i32(SnapshotReader* r) { int32_t x; get(r, &x, sizeof(x)); return x; }
+
+/* A count of items of at least 'item_size' bytes each that the rest of the image can hold. */
+static size_t get_count(SnapshotReader* r, size_t item_size) {
+    uint64_t count = get_u64(r);
+    if (r->ok && count > (r->size - r->offset) / (item_size ? item_size : 1)) r->ok = false;
+    return r->ok ? (size_t)count : 0;
+}
+
+static char* get_string(SnapshotReader* r) {
+    size_t length = get_count(r, 1);
+    char* s = r->ok ? (char*)malloc(length + 1) : NULL;
+    if (!s) {
+        r->ok = false;
+        return NULL;
+    }
+    get(r, s, length);
+    s[length] = '\0';
+    return s;
+}
+
+static Value get_value(SnapshotReader* r) {
+    Value v = VALUE_NULL;
+    uint8_t tag = 0;
+    get(r, &tag, 1);
+    if (tag == TAG_CONSTANT_STRING) {
+        int32_t index = get_i32(r);
+        if (!r->ok || index < 0 || (size_t)index >= r->pool->count) {
+            r->ok = false;
+            return VALUE_NULL;
+        }
+        v.type = VAL_STRING;
+        v.as.str_val = r->pool->strings[index];
+        return v;
+    }
+    v.type = (ValueType)tag;
+    switch (tag) {
+        case VAL_NULL: break;
+        case VAL_INT:   get(r, &v.as.int_val, sizeof(v.as.int_val)); break;
+        case VAL_FLOAT: get(r, &v.as.float_val, sizeof(v.as.float_val)); break;
+        case VAL_BOOL: {
+            uint8_t b = 0;
+            get(r, &b, 1);
+            v.as.bool_val = b != 0;
+        } break;
+        case VAL_STRING:
+        case VAL_LIST:
+        case VAL_OBJ: {
+            int32_t id = get_i32(r);
+            uint8_t kind = tag == VAL_STRING ? PAYLOAD_STRING : tag == VAL_LIST ? PAYLOAD_LIST : PAYLOAD_OBJECT;
+            void* payload = NULL;
+            if (id > 0 && (size_t)id <= r->payload_count && r->kinds[id - 1] == kind) {
+                payload = r->payloads[id - 1];
+            } else if (id != 0) {
+                r->ok = false;
+            }
+            if (tag == VAL_STRING) v.as.str_val = (char*)payload;
+            if (tag == VAL_LIST) v.as.list_val = (ValueList*)payload;
+            if (tag == VAL_OBJ) v.as.obj_ref = payload;
+        } break;
+        default:
+            r->ok = false;
+            break;
+    }
+    return r->ok ? v : VALUE_NULL;
+}
+
+static Bytecode* get_bytecode(SnapshotReader* r) {
+    Bytecode* bc = bytecode_create();
+    if (!bc) {
+        r->ok = false;
+        return NULL;
+    }
+    size_t count = get_count(r, 6 * sizeof(int32_t));
+    bc->origins = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    if (!bc->origins) r->ok = false;
+    for (size_t i = 0; r->ok && i < count; i++) {
+        int32_t op[5];
+        for (int k = 0; k < 5; k++) op[k] = get_i32(r);
+        bc->origins[i] = get_i32(r);
+        bytecode_add_instruction_ex(bc, (VMOpcode)op[0], op[1], op[2], op[3], op[4]);
+    }
+    size_t strings = get_count(r, sizeof(uint64_t));
+    for (size_t i = 0; r->ok && i < strings; i++) {
+        char* s = get_string(r);
+        if (s) bytecode_add_constant_str(bc, s);
+        free(s);
+    }
+    bc->top_level_slots = (size_t)get_u64(r);
+    bc->main_address = get_i32(r);
+
+    size_t tables = get_count(r, sizeof(int64_t) + sizeof(uint64_t));
+    for (size_t t = 0; r->ok && t < tables; t++) {
+        int64_t low = 0;
+        get(r, &low, sizeof(low));
+        size_t entry_count = get_count(r, sizeof(int64_t) + 2 * sizeof(int32_t));
+        SwitchEntry* entries = (SwitchEntry*)malloc((entry_count > 0 ? entry_count : 1) * sizeof(SwitchEntry));
+        if (!entries) r->ok = false;
+        for (size_t i = 0; r->ok && i < entry_count; i++) {
+            get(r, &entries[i].key, sizeof(entries[i].key));
+            entries[i].target = get_i32(r);
+            entries[i].str_index = get_i32(r);
+        }
+        if (r->ok) bytecode_add_switch_table(bc, low, entries, entry_count);
+        free(entries);
+    }
+    size_t handlers = get_count(r, 3 * sizeof(int32_t));
+    for (size_t h = 0; r->ok && h < handlers; h++) {
+        int start = get_i32(r);
+        int end = get_i32(r);
+        int handler = get_i32(r);
+        bytecode_add_handler(bc, start, end, handler);
+    }
+    size_t classes = get_count(r, sizeof(int32_t) + 2 * sizeof(uint64_t));
+    for (size_t c = 0; r->ok && c < classes; c++) {
+        int name = get_i32(r);
+        size_t field_count = get_count(r, sizeof(int32_t));
+        int* fields = (int*)malloc((field_count > 0 ? field_count : 1) * sizeof(int));
+        if (!fields) r->ok = false;
+        for (size_t f = 0; r->ok && f < field_count; f++) fields[f] = get_i32(r);
+        size_t method_count = get_count(r, 3 * sizeof(int32_t));
+        ClassMethod* methods = (ClassMethod*)malloc((method_count > 0 ? method_count : 1) * sizeof(ClassMethod));
+        if (!methods) r->ok = false;
+        for (size_t m = 0; r->ok && m < method_count; m++) {
+            methods[m].name = get_i32(r);
+            methods[m].address = get_i32(r);
+            methods[m].frame_size = get_i32(r);
+        }
+        if (r->ok) bytecode_add_class(bc, name, fields, field_count, methods, method_count);
+        free(fields);
+        free(methods);
+    }
+    size_t closures = get_count(r, 2 * sizeof(int32_t) + sizeof(uint64_t));
+    for (size_t c = 0; r->ok && c < closures; c++) {
+        int address = get_i32(r);
+        int frame_size = get_i32(r);
+        size_t capture_count = get_count(r, sizeof(int32_t));
+        int* captures = (int*)malloc((capture_count > 0 ? capture_count : 1) * sizeof(int));
+        if (!captures) r->ok = false;
+        for (size_t k = 0; r->ok && k < capture_count; k++) captures[k] = get_i32(r);
+        if (r->ok) bytecode_add_closure(bc, address, frame_size, captures, capture_count);
+        free(captures);
+    }
+    if (r->ok && (bc->instruction_count != count || bc->constant_pool.count != strings)) r->ok = false;
+    return bc;
+}
+
+/*
+ * Allocate every payload and hand it to the VM with its reference count.
+ * Lists and objects are filled in afterwards, once all of them exist.
+ */
+static void get_payloads(SnapshotReader* r, VM* vm) {
+    r->payload_count = get_count(r, 1 + sizeof(int32_t));
+    r->payloads = (void**)calloc(r->payload_count > 0 ? r->payload_count : 1, sizeof(void*));
+    r->kinds = (uint8_t*)calloc(r->payload_count > 0 ? r->payload_count : 1, 1);
+    r->lengths = (size_t*)calloc(r->payload_count > 0 ? r->payload_count : 1, sizeof(size_t));
+    if (!r->payloads || !r->kinds || !r->lengths) r->ok = false;
+    for (size_t n = 0; r->ok && n < r->payload_count; n++) {
+        get(r, &r->kinds[n], 1);
+        int refcount = get_i32(r);
+        if (r->kinds[n] == PAYLOAD_OBJECT) {
+            VMObject* obj = vm_create_object(vm);
+            obj->refcount = refcount;
+            obj->class_index = get_i32(r);
+            obj->closure = get_i32(r);
+            size_t count = get_count(r, 1);
+            uint8_t keyed = 0;
+            get(r, &keyed, 1);
+            obj->fields.values = (Value*)calloc(count > 0 ? count : 1, sizeof(Value));
+            obj->fields.keys = keyed ? (char**)calloc(count > 0 ? count : 1, sizeof(char*)) : NULL;
+            obj->fields.capacity = count;
+            r->lengths[n] = count;
+            if (!obj->fields.values || (keyed && !obj->fields.keys)) r->ok = false;
+            r->payloads[n] = obj;
+        } else if (r->kinds[n] == PAYLOAD_LIST) {
+            size_t length = get_count(r, 1);
+            uint64_t capacity = get_u64(r);
+            if (capacity < length || capacity > (uint64_t)SIZE_MAX / sizeof(Value)) r->ok = false;
+            r->lengths[n] = length;
+            ValueList* list = r->ok ? (ValueList*)calloc(1, sizeof(ValueList)) : NULL;
+            Value* items = list ? (Value*)calloc(capacity > 0 ? (size_t)capacity : 1, sizeof(Value)) : NULL;
+            if (!items) {
+                free(list);
+                r->ok = false;
+            } else {
+                list->data = items;
+                list->capacity = (size_t)capacity;
+                r->payloads[n] = list;
+            }
+        } else if (r->kinds[n] == PAYLOAD_STRING) {
+            r->payloads[n] = get_string(r);
+        } else {
+            r->ok = false;
+        }
+        if (r->ok && r->kinds[n] != PAYLOAD_OBJECT) {
+            Value v = { .type = r->kinds[n] == PAYLOAD_LIST ? VAL_LIST : VAL_STRING };
+            if (r->kinds[n] == PAYLOAD_LIST) {
+                v.as.list_val = (ValueList*)r->payloads[n];
+            } else {
+                v.as.str_val = (char*)r->payloads[n];
+            }
+            vm_track_payload(vm, v, refcount);
+        }
+    }
+}
+
+static void get_contents(SnapshotReader* r) {
+    for (size_t n = 0; r->ok && n < r->payload_count; n++) {
+        if (r->kinds[n] == PAYLOAD_LIST) {
+            ValueList* list = (ValueList*)r->payloads[n];
+            for (size_t i = 0; r->ok && i < r->lengths[n]; i++) {
+                list->data[i] = get_value(r);
+                list->length = i + 1;
+            }
+        } else if (r->kinds[n] == PAYLOAD_OBJECT) {
+            VMObject* obj = (VMObject*)r->payloads[n];
+            for (size_t i = 0; r->ok && i < r->lengths[n]; i++) {
+                if (obj->fields.keys) obj->fields.keys[i] = get_string(r);
+                obj->fields.values[i] = get_value(r);
+                obj->fields.count = i + 1;
+            }
+        }
+    }
+}
+
+VM* vm_restore(const char* path) {
+    if (!path) return NULL;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char* data = size > 0 ? (unsigned char*)malloc((size_t)size) : NULL;
+    bool read = data && fread(data, 1, (size_t)size, fp) == (size_t)size;
+    fclose(fp);
+    if (!read) {
+        free(data);
+        return NULL;
+    }
+
+    SnapshotReader r = { data, (size_t)size, 0, true, NULL, NULL, NULL, 0, NULL };
+    char magic[8];
+    uint32_t version = 0;
+    get(&r, magic, 8);
+    get(&r, &version, sizeof(version));
+    if (!r.ok || memcmp(magic, SNAPSHOT_MAGIC, 8) != 0 || version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Snapshot '%s' is not a valid OSFL snapshot.\n", path);
+        free(data);
+        return NULL;
+    }
+    Bytecode* bc = get_bytecode(&r);
+    VM* vm = r.ok ? vm_create(bc) : NULL;
+    if (!vm) {
+        fprintf(stderr, "Snapshot '%s' is truncated.\n", path);
+        bytecode_destroy(bc);
+        free(data);
+        return NULL;
+    }
+    r.pool = &bc->constant_pool;
+
+    get_payloads(&r, vm);
+    get_contents(&r);
+
+    vm->pc = (size_t)get_u64(&r);
+    for (int i = 0; i < 16; i++) vm->registers[i] = get_value(&r);
+    size_t local_count = get_count(&r, 1);
+    if (r.ok && local_count != vm->top_level->local_count) r.ok = false;
+    for (size_t i = 0; r.ok && i < local_count; i++) {
+        vm->top_level->locals[i] = get_value(&r);
+    }
+    free(r.payloads);
+    free(r.kinds);
+    free(r.lengths);
+    free(data);
+    if (!r.ok || !vm_paused_at_main(vm)) {
+        fprintf(stderr, "Snapshot '%s' is truncated or inconsistent.\n", path);
+        for (int i = 0; i < 16; i++) vm->registers[i] = VALUE_NULL;
+        for (size_t i = 0; i < vm->top_level->local_count; i++) vm->top_level->locals[i] = VALUE_NULL;
+        vm_destroy(vm);
+        bytecode_destroy(bc);
+        return NULL;
+    }
+    return vm;
+}
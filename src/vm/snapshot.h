@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A snapshot is an image of a program whose top-level code has run: the
+ * bytecode, the globals and registers, and every string, list and object
+ * they reach, with their reference counts. Restoring it gives a VM that
+ * continues with the call of main(), so scripts that build tables at the
+ * top level do that work once rather than on every start.
+ *
+ *     vm->pause_before_main = true;
+ *     vm_run(vm);                       // runs the top-level code only
+ *     vm_snapshot(vm, "app.snap");
+ *     ...
+ *     VM* vm = vm_restore("app.snap");  // next start: no compile, no initialization
+ *     (register natives)
+ *     vm_run(vm);
+ *
+ * Natives are not part of the image; register them on the restored VM. An
+ * image is only read back by the same build of OSFL on the same kind of
+ * machine.
+ */
+
+/**
+ * Write the state of 'vm', paused before main() (see vm_paused_at_main), to
+ * 'path'. Fails, writing nothing usable, if a global holds a file.
+ */
+bool vm_snapshot(const VM* vm, const char* path);
+
+/**
+ * Create a VM from the image at 'path', or NULL if it is missing or
+ * malformed. The VM owns nothing of its bytecode: free vm->bytecode with
+ * bytecode_destroy() after vm_destroy().
+ */
+VM* vm_restore(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNAPSHOT_H */
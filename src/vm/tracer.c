@@ -0,0 +1,163 @@
+#include "tracer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+typedef struct TraceRing {
+    TraceEvent* events;
+    size_t capacity;
+    uint64_t written;         /* events ever recorded; the newest is at (written - 1) % capacity */
+    unsigned thread;
+    struct TraceRing* next;
+} TraceRing;
+
+bool g_tracer_enabled = false;
+TracerConfig g_tracer_config = { TRACER_DEFAULT_CAPACITY, TRACER_DEFAULT_SAMPLE_EVERY, TRACER_DEFAULT_NATIVE_US };
+
+/* Every thread's ring, pushed without a lock by the thread that made it. */
+static _Atomic(TraceRing*) g_rings = NULL;
+static atomic_uint g_next_thread = 1;
+/* Bumped by tracer_stop, so threads make a new ring rather than use a freed one. */
+static atomic_uint g_generation = 1;
+static uint64_t g_start = 0;
+
+static _Thread_local TraceRing* t_ring = NULL;
+static _Thread_local unsigned t_generation = 0;
+static _Thread_local unsigned t_calls = 0;
+
+TracerConfig tracer_default_config(void) {
+    TracerConfig config = { TRACER_DEFAULT_CAPACITY, TRACER_DEFAULT_SAMPLE_EVERY, TRACER_DEFAULT_NATIVE_US };
+    return config;
+}
+
+uint64_t tracer_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void tracer_start(TracerConfig config) {
+    tracer_stop();
+    if (config.capacity == 0) config.capacity = TRACER_DEFAULT_CAPACITY;
+    if (config.sample_every == 0) config.sample_every = 1;
+    g_tracer_config = config;
+    g_start = tracer_now();
+    g_tracer_enabled = true;
+}
+
+void tracer_stop(void) {
+    g_tracer_enabled = false;
+    atomic_fetch_add(&g_generation, 1);
+    TraceRing* ring = atomic_exchange(&g_rings, NULL);
+    while (ring) {
+        TraceRing* next = ring->next;
+        free(ring->events);
+        free(ring);
+        ring = next;
+    }
+}
+
+/* This thread's ring, made on its first event. */
+static TraceRing* thread_ring(void) {
+    unsigned generation = atomic_load(&g_generation);
+    if (t_ring && t_generation == generation) return t_ring;
+    t_ring = NULL;
+    TraceRing* ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+    if (!ring) return NULL;
+    ring->events = (TraceEvent*)malloc(g_tracer_config.capacity * sizeof(TraceEvent));
+    if (!ring->events) {
+        free(ring);
+        return NULL;
+    }
+    ring->capacity = g_tracer_config.capacity;
+    ring->thread = atomic_fetch_add(&g_next_thread, 1);
+    TraceRing* head = atomic_load(&g_rings);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak(&g_rings, &head, ring));
+    t_ring = ring;
+    t_generation = generation;
+    return ring;
+}
+
+static void record(const char* category, const char* name, char phase, uint64_t timestamp, uint64_t duration) {
+    if (!g_tracer_enabled) return;
+    TraceRing* ring = thread_ring();
+    if (!ring) return;
+    TraceEvent* e = &ring->events[ring->written % ring->capacity];
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->category = category;
+    e->phase = phase;
+    e->timestamp = timestamp;
+    e->duration = duration;
+    ring->written++;
+}
+
+bool tracer_sample(void) {
+    return ++t_calls % g_tracer_config.sample_every == 0;
+}
+
+void tracer_span(const char* category, const char* name, uint64_t start) {
+    uint64_t now = tracer_now();
+    record(category, name, 'X', start, now > start ? now - start : 0);
+}
+
+void tracer_begin(const char* category, const char* name) {
+    record(category, name, 'B', tracer_now(), 0);
+}
+
+void tracer_end(const char* category, const char* name) {
+    record(category, name, 'E', tracer_now(), 0);
+}
+
+void tracer_instant(const char* category, const char* name) {
+    record(category, name, 'i', tracer_now(), 0);
+}
+
+static void write_string(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+bool tracer_write(const char* path) {
+    FILE* fp = path ? fopen(path, "w") : NULL;
+    if (!fp) {
+        fprintf(stderr, "Could not open trace '%s' for writing.\n", path ? path : "");
+        return false;
+    }
+    fprintf(fp, "{\"traceEvents\":[");
+    bool first = true;
+    for (TraceRing* ring = atomic_load(&g_rings); ring; ring = ring->next) {
+        uint64_t count = ring->written < ring->capacity ? ring->written : ring->capacity;
+        for (uint64_t i = ring->written - count; i < ring->written; i++) {
+            const TraceEvent* e = &ring->events[i % ring->capacity];
+            uint64_t timestamp = e->timestamp > g_start ? e->timestamp - g_start : 0;
+            fprintf(fp, "%s\n{\"name\":", first ? "" : ",");
+            write_string(fp, e->name);
+            fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u",
+                    e->category, e->phase, (unsigned long long)timestamp, ring->thread);
+            if (e->phase == 'X') fprintf(fp, ",\"dur\":%llu", (unsigned long long)e->duration);
+            if (e->phase == 'i') fprintf(fp, ",\"s\":\"t\"");
+            fputc('}', fp);
+            first = false;
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    bool ok = fclose(fp) == 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write trace '%s'.\n", path);
+    }
+    return ok;
+}
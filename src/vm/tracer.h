@@ -0,0 +1,80 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Timeline tracing in the Chrome trace-event format (open the file in
+ * Perfetto or chrome://tracing). While tracing is on, the pipeline phases,
+ * a sample of the calls, native calls slower than a threshold, heap
+ * collection and coroutine switches are recorded as events.
+ *
+ * Each thread records into a ring buffer of its own, so recording takes no
+ * lock; when a ring is full the oldest events are overwritten. Rings are
+ * only read by tracer_write(), which must not race with threads still
+ * recording.
+ */
+
+#define TRACER_DEFAULT_CAPACITY     65536  /* events per thread */
+#define TRACER_DEFAULT_SAMPLE_EVERY 64     /* trace one call in this many */
+#define TRACER_DEFAULT_NATIVE_US    100    /* natives taking less are not traced */
+
+#define TRACER_NAME_LENGTH 32
+
+typedef struct TraceEvent {
+    char name[TRACER_NAME_LENGTH];
+    const char* category;  /* a string literal */
+    char phase;            /* 'X' complete, 'B'/'E' begin/end, 'i' instant */
+    uint64_t timestamp;    /* microseconds */
+    uint64_t duration;     /* 'X' only */
+} TraceEvent;
+
+typedef struct TracerConfig {
+    size_t capacity;
+    unsigned sample_every;
+    uint64_t native_threshold;  /* microseconds */
+} TracerConfig;
+
+/* Read on every traced operation; use tracer_enabled(). */
+extern bool g_tracer_enabled;
+extern TracerConfig g_tracer_config;
+
+static inline bool tracer_enabled(void) { return g_tracer_enabled; }
+
+TracerConfig tracer_default_config(void);
+
+/* Start recording, dropping what earlier runs recorded. */
+void tracer_start(TracerConfig config);
+
+/* Stop recording and free every ring. */
+void tracer_stop(void);
+
+/* Microseconds on the tracer's clock. */
+uint64_t tracer_now(void);
+
+/* True for one call in sample_every: whether to trace this one. */
+bool tracer_sample(void);
+
+/* A span from 'start' (tracer_now()) until now. */
+void tracer_span(const char* category, const char* name, uint64_t start);
+
+/* The begin or end of a span whose end is not known in advance. */
+void tracer_begin(const char* category, const char* name);
+void tracer_end(const char* category, const char* name);
+
+void tracer_instant(const char* category, const char* name);
+
+/* Write every thread's events as trace-event JSON. */
+bool tracer_write(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACER_H */
@@ -3,19 +3,52 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
 #include <inttypes.h>
 #include "frame.h"
 #include "../include/vm_common.h"
 #include "../compiler/bytecode.h"
+#include "tracer.h"
 
 /* forward declarations */
 static void vm_init_registers(VM* vm);
 static void vm_execute_instruction(VM* vm, Instruction inst);
-static void vm_push_frame(VM* vm, Frame* frame, size_t return_address);
+static void vm_push_frame(VM* vm, Frame* frame, size_t return_address, size_t target,
+                          const Instruction* call);
+static void vm_jump(VM* vm, size_t target);
+static void vm_charge_fuel(VM* vm);
 static void vm_pop_frame(VM* vm);
+static void vm_raise(VM* vm, const char* fmt, ...);
+static void vm_unwind(VM* vm, size_t pc);
+static Value* vm_local_slot(VM* vm, int slot, const char* opname);
+static Value* vm_frame_slot(VM* vm, Frame* frame, int slot, const char* opname);
+static void vm_store_slot(VM* vm, Value* slot, int src, bool move);
+static void vm_release_frame(VM* vm, Frame* frame);
 static void vm_grow_object_array(VM* vm);
+static bool vm_truthy(const Value* v, bool* out);
+static bool vm_compare(const Value* a, const Value* b, VMOpcode cmp, bool* out);
+static const void* value_payload(Value v);
+static const char* vm_format_value(const Value* v, char* scratch, size_t* length);
+static int vm_switch_target(const SwitchTable* table, const Value* v, bool dense,
+                            const ConstantPool* pool);
 static VMValue vmvalue_from_int(int64_t n);
 static void destroy_object(VMObject* obj);
+static void vm_set_register(VM* vm, int r, Value v);
+static void object_store(VM* vm, VMObject* obj, const char* key, Value val);
+static int class_field_slot(const VM* vm, int class_index, const char* key);
+static VMObject* vm_class_object(VM* vm, int r, const char* opname);
+static int vm_cached_lookup(VM* vm, const VMObject* obj, int name, bool method);
+static VMObject* vm_create_cells(VM* vm, size_t count);
+static VMObject* vm_running_closure(VM* vm);
+static Value* vm_upvalue(VM* vm, int index, const char* opname);
+static Value* vm_box_contents(VM* vm, Value box, const char* opname);
+static void vm_reconcile_native_args(VM* vm, const Value* saved, const ValueList* before, int arg_count);
+static bool vm_call_fast_native(VM* vm, const NativeDescriptor* native, int dest,
+                                int base_reg, int arg_count);
+static VMHeapEntry* heap_find(const VM* vm, const void* ptr);
+static void heap_insert(VM* vm, const void* ptr, int refcount, bool list);
+static void heap_remove(VM* vm, const void* ptr);
 
 VM* vm_create(Bytecode* bytecode) {
     VM* vm = (VM*)malloc(sizeof(VM));
@@ -27,6 +60,8 @@ VM* vm_create(Bytecode* bytecode) {
     vm->bytecode = bytecode;
     vm->pc = 0;
     vm->running = 1;
+    vm->faulted = false;
+    vm->error_message[0] = '\0';
     vm->call_stack_top = 0;
 
     vm_init_registers(vm);
@@ -34,6 +69,7 @@ VM* vm_create(Bytecode* bytecode) {
     for (size_t i = 0; i < 1024; i++) {
         vm->call_stack[i] = NULL;
         vm->return_addresses[i] = 0;
+        vm->traced_calls[i] = false;
     }
 
     vm->objects = NULL;
@@ -45,12 +81,40 @@ VM* vm_create(Bytecode* bytecode) {
     }
     vm->current_coro = 0;
 
-    vm->native_count = 0;
-    for (size_t i = 0; i < 64; i++) {
-        vm->native_registry[i].name = NULL;
-        vm->native_registry[i].func = NULL;
+    vm->profile = NULL;
+    vm->replay = NULL;
+
+    vm->heap = NULL;
+    vm->heap_count = 0;
+    vm->heap_capacity = 0;
+    if (bytecode) {
+        for (size_t i = 0; i < bytecode->constant_pool.count; i++) {
+            if (!heap_find(vm, bytecode->constant_pool.strings[i])) {
+                heap_insert(vm, bytecode->constant_pool.strings[i], VM_HEAP_PINNED, false);
+            }
+        }
+    }
+
+    vm->top_level = frame_create(bytecode ? bytecode->top_level_slots : 0, NULL);
+
+    size_t instruction_count = bytecode ? bytecode->instruction_count : 0;
+    vm->inline_caches = (VMInlineCache*)malloc((instruction_count > 0 ? instruction_count : 1) * sizeof(VMInlineCache));
+    for (size_t i = 0; vm->inline_caches && i < instruction_count; i++) {
+        vm->inline_caches[i].class_index = -1;
+        vm->inline_caches[i].index = 0;
     }
 
+    vm->natives = NULL;
+    vm->native_count = 0;
+    vm->native_capacity = 0;
+    vm->pause_before_main = false;
+    vm->fuel = INT64_MAX;
+    vm->fuel_quantum = 0;
+    vm->fuel_handler = NULL;
+    vm->fuel_context = NULL;
+    vm->suspended = false;
+    vm->out_of_fuel = false;
+
 #ifdef ENABLE_JIT
     vm->jit_context = NULL;
 #endif
@@ -64,11 +128,28 @@ void vm_destroy(VM* vm) {
     while (vm->call_stack_top > 0) {
         vm_pop_frame(vm);
     }
+    vm_release_frame(vm, vm->top_level);
+    frame_destroy(vm->top_level);
 
+    // Tear down without walking references: everything the VM still owns goes.
+    uint64_t start = tracer_enabled() ? tracer_now() : 0;
     for (size_t i = 0; i < vm->object_count; i++) {
         destroy_object(vm->objects[i]);
     }
     free(vm->objects);
+    for (size_t i = 0; i < vm->heap_capacity; i++) {
+        if (vm->heap[i].ptr && vm->heap[i].refcount != VM_HEAP_PINNED) {
+            if (vm->heap[i].list) free(((ValueList*)vm->heap[i].ptr)->data);
+            free((void*)vm->heap[i].ptr);
+        }
+    }
+    free(vm->heap);
+    if (start) tracer_span("gc", "teardown", start);
+    free(vm->inline_caches);
+    for (size_t i = 0; i < vm->native_count; i++) {
+        free((char*)vm->natives[i].name);
+    }
+    free(vm->natives);
 
 #ifdef ENABLE_JIT
     if (vm->jit_context) {
@@ -82,7 +163,6 @@ void vm_destroy(VM* vm) {
 static void vm_init_registers(VM* vm) {
     for (int i = 0; i < 16; i++) {
         vm->registers[i].type = VAL_NULL;
-        vm->registers[i].refcount = 0;
         vm->registers[i].as.int_val = 0;
     }
 }
@@ -92,10 +172,162 @@ void vm_run(VM* vm) {
     vm_jit_compile(vm);
 #endif
 
+    if (vm->suspended) {
+        vm->suspended = false;
+        vm->running = 1;
+    }
     while (vm->running && vm->pc < vm->bytecode->instruction_count) {
-        Instruction inst = vm->bytecode->instructions[vm->pc];
-        vm_execute_instruction(vm, inst);
+        size_t pc = vm->pc;
+        Instruction inst = vm->bytecode->instructions[pc];
+        if (inst.opcode == OP_CALL && vm->pause_before_main && vm_paused_at_main(vm)) {
+            vm->pause_before_main = false;
+            return;
+        }
+        if (vm->profile) {
+            // Record against the unoptimized PC, after execution so the
+            // branch direction is known. Operand types are sampled first.
+            Value before[16];
+            memcpy(before, vm->registers, sizeof(before));
+            vm_execute_instruction(vm, inst);
+            profile_record(vm->profile, bytecode_origin(vm->bytecode, pc), &inst,
+                           before, pc, vm->pc);
+        } else {
+            vm_execute_instruction(vm, inst);
+        }
+        if (vm->faulted) {
+            vm_unwind(vm, pc);
+        }
+    }
+}
+
+/**
+ * Run the instruction at vm->pc, as vm_run would, and stop. Execution
+ * counts are not recorded. Returns whether there is more to run.
+ */
+bool vm_step(VM* vm) {
+    if (vm->suspended) {
+        vm->suspended = false;
+        vm->running = 1;
+    }
+    if (!vm->running || vm->pc >= vm->bytecode->instruction_count) return false;
+    size_t pc = vm->pc;
+    vm_execute_instruction(vm, vm->bytecode->instructions[pc]);
+    if (vm->faulted) {
+        vm_unwind(vm, pc);
+    }
+    return vm->running && vm->pc < vm->bytecode->instruction_count;
+}
+
+bool vm_paused_at_main(const VM* vm) {
+    if (!vm->running || vm->call_stack_top != 0 || vm->pc >= vm->bytecode->instruction_count) return false;
+    const Instruction* inst = &vm->bytecode->instructions[vm->pc];
+    return inst->opcode == OP_CALL && vm->bytecode->main_address >= 0 &&
+           inst->operand1 == vm->bytecode->main_address;
+}
+
+/**
+ * Limit how long the VM runs. Fuel is charged only where a long run must
+ * pass, at backward jumps and calls, one unit each; when 'quantum' units
+ * are used up 'handler' decides what happens (no handler aborts). A
+ * quantum of 0 lifts the limit.
+ */
+void vm_set_fuel(VM* vm, int64_t quantum, VMFuelHandler handler, void* context) {
+    vm->fuel_quantum = quantum > 0 ? quantum : 0;
+    vm->fuel = quantum > 0 ? quantum : INT64_MAX;
+    vm->fuel_handler = handler;
+    vm->fuel_context = context;
+}
+
+/* Ask the host what to do now that the fuel is gone. */
+static void vm_refuel(VM* vm) {
+    VMFuelAction action = vm->fuel_handler ? vm->fuel_handler(vm, vm->fuel_context) : VM_FUEL_ABORT;
+    if (vm->fuel_quantum == 0) {
+        // The handler lifted the limit.
+        vm->fuel = INT64_MAX;
+        return;
+    }
+    switch (action) {
+        case VM_FUEL_EXTEND:
+            vm->fuel = vm->fuel_quantum;
+            break;
+        case VM_FUEL_YIELD:
+            vm->fuel = vm->fuel_quantum;
+            vm->suspended = true;
+            vm->running = 0;
+            break;
+        case VM_FUEL_ABORT:
+        default:
+            // Not a runtime error: no handler of the script may catch it.
+            vm->fuel = 0;
+            vm->out_of_fuel = true;
+            vm->running = 0;
+            break;
+    }
+}
+
+static void vm_charge_fuel(VM* vm) {
+    if (--vm->fuel <= 0) {
+        vm_refuel(vm);
+    }
+}
+
+/* Continue at 'target'; a jump backwards may start another loop iteration. */
+static void vm_jump(VM* vm, size_t target) {
+    if (target <= vm->pc) {
+        vm_charge_fuel(vm);
     }
+    vm->pc = target;
+}
+
+/**
+ * Stop on a runtime error. The message is kept rather than printed, since
+ * vm_unwind() may still find a handler for it.
+ */
+static void vm_raise(VM* vm, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(vm->error_message, sizeof(vm->error_message), fmt, args);
+    va_end(args);
+    vm->running = 0;
+    vm->faulted = true;
+}
+
+/* The innermost handler entry covering 'pc', or NULL. */
+static const HandlerEntry* find_handler(const Bytecode* bc, size_t pc) {
+    for (size_t i = 0; i < bc->handler_count; i++) {
+        const HandlerEntry* h = &bc->handlers[i];
+        if ((size_t)h->start <= pc && pc < (size_t)h->end) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Transfer control for an error raised by the instruction at 'pc'. The
+ * handler table is searched for that PC, then for each pending call site in
+ * turn; frames above the one that handles the error are discarded. Guarded
+ * code pays nothing until an error is actually raised. With no handler the
+ * error is reported and the VM stays stopped.
+ */
+static void vm_unwind(VM* vm, size_t pc) {
+    size_t depth = vm->call_stack_top;
+    const HandlerEntry* handler = find_handler(vm->bytecode, pc);
+    while (!handler && depth > 0) {
+        // Look at the OP_CALL that entered this frame.
+        pc = vm->return_addresses[--depth] - 1;
+        handler = find_handler(vm->bytecode, pc);
+    }
+    if (!handler) {
+        fprintf(stderr, "%s", vm->error_message);
+        return;
+    }
+    while (vm->call_stack_top > depth) {
+        vm_pop_frame(vm);
+    }
+    vm->pc = (size_t)handler->handler;
+    vm->faulted = false;
+    vm->running = 1;
 }
 
 static void vm_execute_instruction(VM* vm, Instruction inst) {
@@ -108,40 +340,51 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             int r = inst.operand1;
             int val = inst.operand2;
             if (r < 0 || r >= 16) {
-                    fprintf(stderr, "Invalid register index %d\n", r);
-                    vm->running = 0;
+                    vm_raise(vm, "Invalid register index %d\n", r);
                     return;
             }
+            vm_release(vm, vm->registers[r]);
             vm->registers[r].type = VAL_INT;
             vm->registers[r].as.int_val = val;
-            vm->registers[r].refcount = 0;
             vm->pc++;
         } break;
         case OP_LOAD_CONST_FLOAT: {
             int r = inst.operand1;
             if (r < 0 || r >= 16) {
-                fprintf(stderr, "Invalid register index %d for float constant\n", r);
-                vm->running = 0;
+                vm_raise(vm, "Invalid register index %d for float constant\n", r);
                 return;
             }
+            uint64_t bits = (uint64_t)(uint32_t)inst.operand2 | ((uint64_t)(uint32_t)inst.operand3 << 32);
+            vm_release(vm, vm->registers[r]);
             vm->registers[r].type = VAL_FLOAT;
-            vm->registers[r].as.float_val = 0.0; // Placeholder for float constants
-            vm->registers[r].refcount = 0;
+            memcpy(&vm->registers[r].as.float_val, &bits, sizeof(double));
             vm->pc++;
         } break;
         case OP_LOAD_CONST_STR: {
             int r = inst.operand1;
             if (r < 0 || r >= 16) {
-                    fprintf(stderr, "Invalid register index %d for string constant\n", r);
-                    vm->running = 0;
+                    vm_raise(vm, "Invalid register index %d for string constant\n", r);
                     return;
             }
+            int cp_index = inst.operand2;
+            if (cp_index < 0 || cp_index >= (int)vm->bytecode->constant_pool.count) {
+                vm_raise(vm, "OP_LOAD_CONST_STR: constant pool index %d out of range\n", cp_index);
+                return;
+            }
+            vm_release(vm, vm->registers[r]);
             vm->registers[r].type = VAL_STRING;
-            // Here we assume the compiler loaded a raw pointer;
-            // with our new constant pool, you might want to change this
-            // so that OP_LOAD_CONST_STR gets its string from the constant pool.
-            vm->registers[r].as.str_val = (char*)(intptr_t)inst.operand2;
-            vm->registers[r].refcount = 0;
+            vm->registers[r].as.str_val = vm->bytecode->constant_pool.strings[cp_index];
+            vm->pc++;
+        } break;
+        case OP_LOAD_BOOL: {
+            int r = inst.operand1;
+            if (r < 0 || r >= 16) {
+                vm_raise(vm, "Invalid register index %d for bool constant\n", r);
+                return;
+            }
+            vm_release(vm, vm->registers[r]);
+            vm->registers[r].type = VAL_BOOL;
+            vm->registers[r].as.bool_val = inst.operand2 != 0;
             vm->pc++;
         } break;
         case OP_ADD: {
@@ -149,34 +392,34 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             int rs1 = inst.operand2;
             int rs2 = inst.operand3;
             if (rd < 0 || rd >= 16 || rs1 < 0 || rs1 >= 16 || rs2 < 0 || rs2 >= 16) {
-                fprintf(stderr, "OP_ADD invalid register index.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_ADD invalid register index.\n");
                 return;
             }
             if (vm->registers[rs1].type == VAL_INT && vm->registers[rs2].type == VAL_INT) {
+                vm_release(vm, vm->registers[rd]);
                 vm->registers[rd].type = VAL_INT;
                 vm->registers[rd].as.int_val = vm->registers[rs1].as.int_val + vm->registers[rs2].as.int_val;
-                vm->registers[rd].refcount = 0;
             } else {
-                fprintf(stderr, "OP_ADD type mismatch.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_ADD type mismatch.\n");
             }
             vm->pc++;
         } break;
         case OP_SUB:
         case OP_MUL:
-        case OP_DIV: {
+        case OP_DIV:
+        case OP_MOD:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR: {
             int rd = inst.operand1;
             int rs1 = inst.operand2;
             int rs2 = inst.operand3;
             if (rd < 0 || rd >= 16 || rs1 < 0 || rs1 >= 16 || rs2 < 0 || rs2 >= 16) {
-                fprintf(stderr, "OP_%d invalid register index\n", inst.opcode);
-                vm->running = 0;
+                vm_raise(vm, "OP_%d invalid register index\n", inst.opcode);
                 return;
             }
             if (vm->registers[rs1].type != VAL_INT || vm->registers[rs2].type != VAL_INT) {
-                fprintf(stderr, "OP_%d type mismatch (must be int)\n", inst.opcode);
-                vm->running = 0;
+                vm_raise(vm, "OP_%d type mismatch (must be int)\n", inst.opcode);
                 return;
             }
             long long a = vm->registers[rs1].as.int_val;
@@ -186,102 +429,261 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
                 r = a - b;
             } else if (inst.opcode == OP_MUL) {
                 r = a * b;
+            } else if (inst.opcode == OP_BIT_AND) {
+                r = a & b;
+            } else if (inst.opcode == OP_BIT_OR) {
+                r = a | b;
+            } else if (inst.opcode == OP_BIT_XOR) {
+                r = a ^ b;
             } else {
                 if (b == 0) {
-                    fprintf(stderr, "Division by zero!\n");
-                    vm->running = 0;
+                    vm_raise(vm, "Division by zero!\n");
                     return;
                 }
-                r = a / b;
+                r = (inst.opcode == OP_MOD) ? a % b : a / b;
             }
+            vm_release(vm, vm->registers[rd]);
             vm->registers[rd].type = VAL_INT;
             vm->registers[rd].as.int_val = r;
-            vm->registers[rd].refcount = 0;
             vm->pc++;
         } break;
-        case OP_EQ: {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE: {
             int dest = inst.operand1;
             int rs1 = inst.operand2;
             int rs2 = inst.operand3;
             if (dest < 0 || dest >= 16 || rs1 < 0 || rs1 >= 16 || rs2 < 0 || rs2 >= 16) {
-                fprintf(stderr, "OP_EQ invalid register index.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_%d invalid register index.\n", inst.opcode);
                 return;
             }
-            // Compare integer values (for simplicity; you may extend this to floats etc.)
-            if (vm->registers[rs1].type == VAL_INT && vm->registers[rs2].type == VAL_INT) {
-                vm->registers[dest].type = VAL_INT;
-                vm->registers[dest].as.int_val = (vm->registers[rs1].as.int_val == vm->registers[rs2].as.int_val) ? 1 : 0;
-                vm->registers[dest].refcount = 0;
-            } else {
-                fprintf(stderr, "OP_EQ type mismatch: expected ints.\n");
-                vm->running = 0;
+            bool result;
+            if (!vm_compare(&vm->registers[rs1], &vm->registers[rs2], inst.opcode, &result)) {
+                vm_raise(vm, "OP_%d type mismatch: cannot compare these values.\n", inst.opcode);
                 return;
             }
+            vm_release(vm, vm->registers[dest]);
+            vm->registers[dest].type = VAL_BOOL;
+            vm->registers[dest].as.bool_val = result;
             vm->pc++;
         } break;
-        case OP_NEQ: {
+        case OP_CONCAT_N: {
             int dest = inst.operand1;
-            int rs1 = inst.operand2;
-            int rs2 = inst.operand3;
-            if (dest < 0 || dest >= 16 || rs1 < 0 || rs1 >= 16 || rs2 < 0 || rs2 >= 16) {
-                fprintf(stderr, "OP_NEQ invalid register index.\n");
-                vm->running = 0;
+            int base = inst.operand2;
+            int count = inst.operand3;
+            if (dest < 0 || dest >= 16 || base < 0 || count < 0 || base + count > 16) {
+                vm_raise(vm, "OP_CONCAT_N invalid register range.\n");
                 return;
             }
-            if (vm->registers[rs1].type == VAL_INT && vm->registers[rs2].type == VAL_INT) {
-                vm->registers[dest].type = VAL_INT;
-                vm->registers[dest].as.int_val = (vm->registers[rs1].as.int_val != vm->registers[rs2].as.int_val) ? 1 : 0;
-                vm->registers[dest].refcount = 0;
-            } else {
-                fprintf(stderr, "OP_NEQ type mismatch: expected ints.\n");
-                vm->running = 0;
+            // Convert every part first, so the result is allocated and copied once.
+            char scratch[16][VM_FORMAT_SCRATCH];
+            const char* text[16];
+            size_t length[16];
+            size_t total = 0;
+            for (int i = 0; i < count; i++) {
+                text[i] = vm_format_value(&vm->registers[base + i], scratch[i], &length[i]);
+                total += length[i];
+            }
+            char* joined = (char*)malloc(total + 1);
+            if (!joined) {
+                vm_raise(vm, "OP_CONCAT_N: out of memory.\n");
+                return;
+            }
+            char* out = joined;
+            for (int i = 0; i < count; i++) {
+                memcpy(out, text[i], length[i]);
+                out += length[i];
+            }
+            *out = '\0';
+            Value result;
+            result.type = VAL_STRING;
+            result.as.str_val = joined;
+            vm_set_register(vm, dest, vm_adopt(vm, result));
+            vm->pc++;
+        } break;
+        case OP_NOT: {
+            int dest = inst.operand1;
+            int src = inst.operand2;
+            bool truth;
+            if (dest < 0 || dest >= 16 || src < 0 || src >= 16) {
+                vm_raise(vm, "OP_NOT invalid register index.\n");
+                return;
+            }
+            if (!vm_truthy(&vm->registers[src], &truth)) {
+                vm_raise(vm, "OP_NOT requires a bool, int or float register\n");
                 return;
             }
+            vm_release(vm, vm->registers[dest]);
+            vm->registers[dest].type = VAL_BOOL;
+            vm->registers[dest].as.bool_val = !truth;
+            vm->pc++;
+        } break;
+        case OP_BIT_NOT: {
+            int dest = inst.operand1;
+            int src = inst.operand2;
+            if (dest < 0 || dest >= 16 || src < 0 || src >= 16) {
+                vm_raise(vm, "OP_BIT_NOT invalid register index.\n");
+                return;
+            }
+            if (vm->registers[src].type != VAL_INT) {
+                vm_raise(vm, "OP_BIT_NOT type mismatch (must be int)\n");
+                return;
+            }
+            int64_t v = ~vm->registers[src].as.int_val;
+            vm_release(vm, vm->registers[dest]);
+            vm->registers[dest].type = VAL_INT;
+            vm->registers[dest].as.int_val = v;
             vm->pc++;
         } break;
         case OP_MOVE: {
             int dest = inst.operand1;
             int src = inst.operand2;
             if (dest < 0 || dest >= 16 || src < 0 || src >= 16) {
-                fprintf(stderr, "OP_MOVE: invalid register index (dest=%d, src=%d).\n", dest, src);
-                vm->running = 0;
+                vm_raise(vm, "OP_MOVE: invalid register index (dest=%d, src=%d).\n", dest, src);
+                return;
+            }
+            vm_retain(vm, vm->registers[src]);
+            vm_set_register(vm, dest, vm->registers[src]);
+            vm->pc++;
+        } break;
+        case OP_MOVE_OWN: {
+            int dest = inst.operand1;
+            int src = inst.operand2;
+            if (dest < 0 || dest >= 16 || src < 0 || src >= 16) {
+                vm_raise(vm, "OP_MOVE_OWN: invalid register index (dest=%d, src=%d).\n", dest, src);
+                return;
+            }
+            if (dest != src) {
+                // The reference is handed over: no retain for dest, no release for src.
+                Value moved = vm->registers[src];
+                vm->registers[src] = VALUE_NULL;
+                vm_set_register(vm, dest, moved);
+            }
+            vm->pc++;
+        } break;
+        case OP_LOAD_LOCAL:
+        case OP_LOAD_GLOBAL: {
+            int dest = inst.operand1;
+            const char* opname = inst.opcode == OP_LOAD_LOCAL ? "OP_LOAD_LOCAL" : "OP_LOAD_GLOBAL";
+            if (dest < 0 || dest >= 16) {
+                vm_raise(vm, "%s: invalid register index %d.\n", opname, dest);
                 return;
             }
-            vm->registers[dest] = vm->registers[src];
+            Value* slot = inst.opcode == OP_LOAD_LOCAL
+                ? vm_local_slot(vm, inst.operand2, opname)
+                : vm_frame_slot(vm, vm->top_level, inst.operand2, opname);
+            if (!slot) return;
+            vm_retain(vm, *slot);
+            vm_set_register(vm, dest, *slot);
+            vm->pc++;
+        } break;
+        case OP_STORE_LOCAL:
+        case OP_STORE_GLOBAL: {
+            int src = inst.operand2;
+            const char* opname = inst.opcode == OP_STORE_LOCAL ? "OP_STORE_LOCAL" : "OP_STORE_GLOBAL";
+            if (src < 0 || src >= 16) {
+                vm_raise(vm, "%s: invalid register index %d.\n", opname, src);
+                return;
+            }
+            Value* slot = inst.opcode == OP_STORE_LOCAL
+                ? vm_local_slot(vm, inst.operand1, opname)
+                : vm_frame_slot(vm, vm->top_level, inst.operand1, opname);
+            if (!slot) return;
+            vm_store_slot(vm, slot, src, inst.operand3 != 0);
+            vm->pc++;
+        } break;
+        case OP_MOVE_LOCAL: {
+            Value* dest = vm_local_slot(vm, inst.operand1, "OP_MOVE_LOCAL");
+            Value* src = dest ? vm_local_slot(vm, inst.operand2, "OP_MOVE_LOCAL") : NULL;
+            if (!src) return;
+            vm_retain(vm, *src);
+            Value old = *dest;
+            *dest = *src;
+            vm_release(vm, old);
+            vm->pc++;
+        } break;
+        case OP_STORE_LOCAL_CONST: {
+            Value* slot = vm_local_slot(vm, inst.operand1, "OP_STORE_LOCAL_CONST");
+            if (!slot) return;
+            vm_release(vm, *slot);
+            slot->type = VAL_INT;
+            slot->as.int_val = inst.operand2;
             vm->pc++;
         } break;
         case OP_JUMP:
-            vm->pc = (size_t)inst.operand1;
+            vm_jump(vm, (size_t)inst.operand1);
             break;
-        case OP_JUMP_IF_ZERO: {
+        case OP_JUMP_IF_ZERO:
+        case OP_JUMP_IF_NONZERO: {
             int r = inst.operand2;
+            bool truth;
             if (r < 0 || r >= 16) {
-                fprintf(stderr, "OP_JUMP_IF_ZERO invalid register index\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_%d invalid register index\n", inst.opcode);
                 return;
             }
-            if (vm->registers[r].type != VAL_INT) {
-                fprintf(stderr, "OP_JUMP_IF_ZERO requires an int register\n");
-                vm->running = 0;
+            if (!vm_truthy(&vm->registers[r], &truth)) {
+                vm_raise(vm, "OP_%d requires a bool, int or float register\n", inst.opcode);
                 return;
             }
-            if (vm->registers[r].as.int_val == 0) {
-                vm->pc = (size_t)inst.operand1;
+            if (truth == (inst.opcode == OP_JUMP_IF_NONZERO)) {
+                vm_jump(vm, (size_t)inst.operand1);
             } else {
                 vm->pc++;
             }
         } break;
+        case OP_JUMP_IF_EQ:
+        case OP_JUMP_IF_NE:
+        case OP_JUMP_IF_LT:
+        case OP_JUMP_IF_LE:
+        case OP_JUMP_IF_GT:
+        case OP_JUMP_IF_GE: {
+            int rs1 = inst.operand2;
+            int rs2 = inst.operand3;
+            bool taken;
+            if (rs1 < 0 || rs1 >= 16 || rs2 < 0 || rs2 >= 16) {
+                vm_raise(vm, "OP_%d invalid register index\n", inst.opcode);
+                return;
+            }
+            VMOpcode cmp = (VMOpcode)(OP_EQ + (inst.opcode - OP_JUMP_IF_EQ));
+            if (!vm_compare(&vm->registers[rs1], &vm->registers[rs2], cmp, &taken)) {
+                vm_raise(vm, "OP_%d type mismatch: cannot compare these values.\n", inst.opcode);
+                return;
+            }
+            // operand4 set: jump when the comparison does not hold.
+            if (inst.operand4) taken = !taken;
+            vm_jump(vm, taken ? (size_t)inst.operand1 : vm->pc + 1);
+        } break;
+        case OP_TABLESWITCH:
+        case OP_LOOKUPSWITCH: {
+            int r = inst.operand2;
+            int t = inst.operand3;
+            if (r < 0 || r >= 16 || t < 0 || (size_t)t >= vm->bytecode->switch_table_count) {
+                vm_raise(vm, "OP_%d invalid register or switch table index\n", inst.opcode);
+                return;
+            }
+            int target = vm_switch_target(&vm->bytecode->switch_tables[t], &vm->registers[r],
+                                          inst.opcode == OP_TABLESWITCH, &vm->bytecode->constant_pool);
+            vm_jump(vm, (size_t)(target >= 0 ? target : inst.operand1));
+        } break;
         case OP_CALL: {
             size_t func_addr = (size_t)inst.operand1;
             if (func_addr >= vm->bytecode->instruction_count) {
-                fprintf(stderr, "OP_CALL: function addr out of range %zu\n", func_addr);
-                vm->running = 0;
+                vm_raise(vm, "OP_CALL: function addr out of range %zu\n", func_addr);
+                return;
+            }
+            if (inst.operand2 < 0) {
+                vm_raise(vm, "OP_CALL: invalid frame size %d\n", inst.operand2);
                 return;
             }
-            Frame* f = frame_create(8, vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : NULL);
-            vm_push_frame(vm, f, vm->pc + 1);
-            vm->pc = func_addr;
+            Frame* f = frame_create((size_t)inst.operand2, vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level);
+            if (!f) {
+                vm_raise(vm, "OP_CALL: failed to allocate a frame\n");
+                return;
+            }
+            vm_push_frame(vm, f, vm->pc + 1, func_addr, &inst);
         } break;
         case OP_CALL_NATIVE: {
             int dest = inst.operand1;
@@ -289,68 +691,141 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             fprintf(stderr, "[DEBUG] OP_CALL_NATIVE: About to look up constant pool index %d (pool count: %zu).\n",
                     cp_index, vm->bytecode->constant_pool.count);
             if (cp_index < 0 || cp_index >= (int)vm->bytecode->constant_pool.count) {
-                fprintf(stderr, "OP_CALL_NATIVE: constant pool index %d out of range\n", cp_index);
-                vm->running = 0;
+                vm_raise(vm, "OP_CALL_NATIVE: constant pool index %d out of range\n", cp_index);
                 return;
             }
             const char* native_name = vm->bytecode->constant_pool.strings[cp_index];
             fprintf(stderr, "[DEBUG] OP_CALL_NATIVE: Retrieved native function name '%s' from constant pool index %d.\n",
                     native_name, cp_index);
-            int arg_count = inst.operand3;
+            int arg_count = inst.operand3 & NATIVE_ARGC_MASK;
+            unsigned move_mask = (unsigned)inst.operand3 >> NATIVE_MOVE_SHIFT;
             int base_reg = inst.operand4;
             if (!native_name) {
-                fprintf(stderr, "ERROR: NULL native function name\n");
-                vm->running = 0;
+                vm_raise(vm, "ERROR: NULL native function name\n");
                 return;
             }
-            VMValue* args = (VMValue*)malloc(arg_count * sizeof(VMValue));
+            // The name is looked up once per call site; registered natives keep their index.
+            VMInlineCache* cache = &vm->inline_caches[vm->pc];
+            const NativeDescriptor* native = NULL;
+            if (cache->class_index == 0) {
+                native = &vm->natives[cache->index];
+            } else if ((native = vm_find_native(vm, native_name)) != NULL) {
+                cache->class_index = 0;
+                cache->index = (int)(native - vm->natives);
+            }
+            bool replayed = native && vm->replay && (native->flags & NATIVE_EXTERNAL);
+            // Numbers go to a fast path unboxed, without an argument array.
+            if (native && !replayed && NATIVE_HAS_FAST_PATH(native, arg_count) &&
+                vm_call_fast_native(vm, native, dest, base_reg, arg_count)) {
+                vm->pc++;
+                break;
+            }
+            VMValue* args = (VMValue*)malloc(arg_count * (2 * sizeof(VMValue) + sizeof(ValueList)));
             if (!args) {
-                fprintf(stderr, "Failed to allocate memory for native call arguments.\n");
-                vm->running = 0;
+                vm_raise(vm, "Failed to allocate memory for native call arguments.\n");
                 return;
             }
+            VMValue* saved = args + arg_count;
+            ValueList* before = (ValueList*)(saved + arg_count);
             for (int i = 0; i < arg_count; i++) {
                 if (base_reg + i >= 16) {
-                    fprintf(stderr, "ERROR: Register index out of bounds in native call\n");
+                    vm_raise(vm, "ERROR: Register index out of bounds in native call\n");
                     free(args);
-                    vm->running = 0;
                     return;
                 }
                 args[i] = vm->registers[base_reg + i];
+                saved[i] = args[i];
+                if (args[i].type == VAL_LIST) before[i] = *args[i].as.list_val;
             }
-            VMValue result = vm_call_native(vm, native_name, arg_count, args);
-            free(args);
-            if (dest >= 0 && dest < 16) {
-                vm->registers[dest] = result;
-            } else {
-                fprintf(stderr, "ERROR: Invalid destination register in native call\n");
-                vm->running = 0;
+            if (dest < 0 || dest >= 16) {
+                vm_raise(vm, "ERROR: Invalid destination register in native call\n");
+                free(args);
                 return;
             }
+
+            // Arguments at their last use are handed over; the rest are borrowed.
+            for (int i = 0; i < arg_count; i++) {
+                if (move_mask & (1u << i)) {
+                    vm->registers[base_reg + i] = VALUE_NULL;
+                }
+            }
+            VMValue result = VALUE_NULL;
+            bool replay_ok = true;
+            if (replayed) {
+                replay_ok = replay_native(vm->replay, bytecode_origin(vm->bytecode, vm->pc),
+                                          native, arg_count, args, &result);
+            } else if (native && tracer_enabled()) {
+                uint64_t start = tracer_now();
+                result = native->func(arg_count, args);
+                if (tracer_now() - start >= g_tracer_config.native_threshold) {
+                    tracer_span("native", native->name, start);
+                }
+            } else if (native) {
+                result = native->func(arg_count, args);
+            }
+            vm_reconcile_native_args(vm, saved, before, arg_count);
+            if (!native || !(native->flags & NATIVE_NO_ALLOC)) {
+                result = vm_adopt(vm, result);
+            }
+            // The native does not release what it was given; drop those references now.
+            for (int i = 0; i < arg_count; i++) {
+                if (move_mask & (1u << i)) {
+                    vm_release(vm, saved[i]);
+                }
+            }
+            free(args);
+            vm_set_register(vm, dest, result);
             vm->pc++;
+            if (!replay_ok) {
+                if (vm->replay->ended) {
+                    // The recorded run stopped here.
+                    vm->running = 0;
+                } else {
+                    vm_raise(vm, "Replay diverged from the log at native '%s'\n", native->name);
+                }
+            }
         } break;
-        case OP_RET:
+        case OP_RET: {
+            int rs = inst.operand1;
+            if (rs < -1 || rs >= 16) {
+                vm_raise(vm, "OP_RET invalid register index\n");
+                return;
+            }
             if (vm->call_stack_top == 0) {
                 // No caller frame exists (e.g. main returned).
                 vm->running = 0;
+                break;
+            }
+            Value result = rs >= 0 ? vm->registers[rs] : VALUE_NULL;
+            vm_retain(vm, result);
+            int dest = vm->call_stack[vm->call_stack_top - 1]->result_register;
+            vm_pop_frame(vm);
+            if (dest >= 0) {
+                vm_release(vm, vm->registers[dest]);
+                vm->registers[dest] = result;
             } else {
-                vm_pop_frame(vm);
+                vm_release(vm, result);
             }
-            break;
+        } break;
         case OP_HALT:
             vm->running = 0;
             break;
+        case OP_BREAKPOINT:
+            // Stop in front of the patched instruction; the debugger puts it
+            // back to step over it, so the loop itself never checks.
+            vm->suspended = true;
+            vm->running = 0;
+            break;
         case OP_NEWOBJ: {
             int rd = inst.operand1;
             if (rd < 0 || rd >= 16) {
-                fprintf(stderr, "OP_NEWOBJ invalid register index\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_NEWOBJ invalid register index\n");
                 return;
             }
             VMObject* obj = vm_create_object(vm);
+            vm_release(vm, vm->registers[rd]);
             vm->registers[rd].type = VAL_OBJ;
             vm->registers[rd].as.obj_ref = obj;
-            vm->registers[rd].refcount = 1;
             vm->pc++;
         } break;
         case OP_SETPROP: {
@@ -358,24 +833,27 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             int rk = inst.operand2;
             int rv = inst.operand3;
             if (ro < 0 || ro >= 16 || rk < 0 || rk >= 16 || rv < 0 || rv >= 16) {
-                fprintf(stderr, "OP_SETPROP invalid register index\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_SETPROP invalid register index\n");
                 return;
             }
             if (vm->registers[ro].type != VAL_OBJ) {
-                fprintf(stderr, "OP_SETPROP: not an object.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_SETPROP: not an object.\n");
                 return;
             }
             if (vm->registers[rk].type != VAL_INT) {
-                fprintf(stderr, "OP_SETPROP: key is not an int\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_SETPROP: key is not an int\n");
                 return;
             }
             char buffer[32];
             snprintf(buffer, sizeof(buffer), "%" PRId64, vm->registers[rk].as.int_val);
             VMValue val_to_set = vm->registers[rv];
-            vm_set_property(vm, (VMObject*)vm->registers[ro].as.obj_ref, buffer, val_to_set);
+            if (inst.operand4) {
+                // Last use of rv: the object takes over the register's reference.
+                vm->registers[rv] = VALUE_NULL;
+                object_store(vm, (VMObject*)vm->registers[ro].as.obj_ref, buffer, val_to_set);
+            } else {
+                vm_set_property(vm, (VMObject*)vm->registers[ro].as.obj_ref, buffer, val_to_set);
+            }
             vm->pc++;
         } break;
         case OP_GETPROP: {
@@ -383,35 +861,250 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             int ro = inst.operand2;
             int rk = inst.operand3;
             if (rd < 0 || rd >= 16 || ro < 0 || ro >= 16 || rk < 0 || rk >= 16) {
-                fprintf(stderr, "OP_GETPROP invalid register index\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_GETPROP invalid register index\n");
                 return;
             }
             if (vm->registers[ro].type != VAL_OBJ) {
-                fprintf(stderr, "OP_GETPROP: not an object.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_GETPROP: not an object.\n");
                 return;
             }
             if (vm->registers[rk].type != VAL_INT) {
-                fprintf(stderr, "OP_GETPROP: key not int.\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_GETPROP: key not int.\n");
                 return;
             }
             char buffer[32];
             snprintf(buffer, sizeof(buffer), "%" PRId64, vm->registers[rk].as.int_val);
             VMObject* obj = (VMObject*)vm->registers[ro].as.obj_ref;
             VMValue val = vm_get_property(vm, obj, buffer);
-            vm->registers[rd] = val;
-            if (val.type == VAL_OBJ) {
-                val.refcount++;
+            vm_retain(vm, val);
+            vm_set_register(vm, rd, val);
+            vm->pc++;
+        } break;
+        case OP_NEWCLASS: {
+            int rd = inst.operand1;
+            int ci = inst.operand2;
+            if (rd < 0 || rd >= 16) {
+                vm_raise(vm, "OP_NEWCLASS invalid register index\n");
+                return;
             }
+            if (ci < 0 || (size_t)ci >= vm->bytecode->class_count) {
+                vm_raise(vm, "OP_NEWCLASS: class %d out of range\n", ci);
+                return;
+            }
+            // Every field gets its slot up front; a class object never grows.
+            VMObject* obj = vm_create_cells(vm, vm->bytecode->classes[ci].field_count);
+            obj->class_index = ci;
+            vm_release(vm, vm->registers[rd]);
+            vm->registers[rd].type = VAL_OBJ;
+            vm->registers[rd].as.obj_ref = obj;
+            vm->pc++;
+        } break;
+        case OP_GETFIELD: {
+            int rd = inst.operand1;
+            if (rd < 0 || rd >= 16) {
+                vm_raise(vm, "OP_GETFIELD invalid register index\n");
+                return;
+            }
+            VMObject* obj = vm_class_object(vm, inst.operand2, "OP_GETFIELD");
+            if (!obj) return;
+            VMValue val;
+            if (obj->class_index < 0) {
+                val = vm_get_property(vm, obj, vm->bytecode->constant_pool.strings[inst.operand3]);
+            } else {
+                int slot = vm_cached_lookup(vm, obj, inst.operand3, false);
+                if (slot < 0) {
+                    vm_raise(vm, "OP_GETFIELD: no field '%s'\n", vm->bytecode->constant_pool.strings[inst.operand3]);
+                    return;
+                }
+                val = obj->fields.values[slot];
+            }
+            vm_retain(vm, val);
+            vm_set_register(vm, rd, val);
+            vm->pc++;
+        } break;
+        case OP_SETFIELD: {
+            int rv = inst.operand3;
+            if (rv < 0 || rv >= 16) {
+                vm_raise(vm, "OP_SETFIELD invalid register index\n");
+                return;
+            }
+            VMObject* obj = vm_class_object(vm, inst.operand1, "OP_SETFIELD");
+            if (!obj) return;
+            if (obj->class_index < 0) {
+                vm_set_property(vm, obj, vm->bytecode->constant_pool.strings[inst.operand2], vm->registers[rv]);
+            } else {
+                int slot = vm_cached_lookup(vm, obj, inst.operand2, false);
+                if (slot < 0) {
+                    vm_raise(vm, "OP_SETFIELD: no field '%s'\n", vm->bytecode->constant_pool.strings[inst.operand2]);
+                    return;
+                }
+                Value old = obj->fields.values[slot];
+                vm_retain(vm, vm->registers[rv]);
+                obj->fields.values[slot] = vm->registers[rv];
+                vm_release(vm, old);
+            }
+            vm->pc++;
+        } break;
+        case OP_INVOKE: {
+            VMObject* obj = vm_class_object(vm, inst.operand4, "OP_INVOKE");
+            if (!obj) return;
+            if (obj->class_index < 0) {
+                vm_raise(vm, "OP_INVOKE: method call on an object that is not a class instance\n");
+                return;
+            }
+            int index = vm_cached_lookup(vm, obj, inst.operand1, true);
+            if (index < 0) {
+                vm_raise(vm, "OP_INVOKE: no method '%s'\n", vm->bytecode->constant_pool.strings[inst.operand1]);
+                return;
+            }
+            const ClassMethod* method = &vm->bytecode->classes[obj->class_index].methods[index];
+            if (method->address < 0 || (size_t)method->address >= vm->bytecode->instruction_count) {
+                vm_raise(vm, "OP_INVOKE: method address out of range %d\n", method->address);
+                return;
+            }
+            Frame* f = frame_create((size_t)method->frame_size, vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level);
+            if (!f) {
+                vm_raise(vm, "OP_INVOKE: failed to allocate a frame\n");
+                return;
+            }
+            vm_push_frame(vm, f, vm->pc + 1, (size_t)method->address, &inst);
+        } break;
+        case OP_CLOSURE: {
+            int rd = inst.operand1;
+            int ci = inst.operand2;
+            if (rd < 0 || rd >= 16) {
+                vm_raise(vm, "OP_CLOSURE invalid register index\n");
+                return;
+            }
+            if (ci < 0 || (size_t)ci >= vm->bytecode->closure_count) {
+                vm_raise(vm, "OP_CLOSURE: function %d out of range\n", ci);
+                return;
+            }
+            const ClosureInfo* info = &vm->bytecode->closures[ci];
+            Frame* frame = vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level;
+            VMObject* running = vm_running_closure(vm);
+            VMObject* closure = vm_create_cells(vm, info->capture_count);
+            closure->closure = ci;
+            // Flat capture: copy each variable (or its box) from this frame or this closure.
+            for (size_t i = 0; i < info->capture_count; i++) {
+                int source = info->captures[i];
+                Value v;
+                if (source >= 0) {
+                    Value* slot = vm_frame_slot(vm, frame, source, "OP_CLOSURE");
+                    if (!slot) {
+                        vm_release_object(vm, closure);
+                        return;
+                    }
+                    v = *slot;
+                } else {
+                    size_t upvalue = (size_t)(-(source + 1));
+                    if (!running || upvalue >= running->fields.count) {
+                        vm_raise(vm, "OP_CLOSURE: no upvalue %zu to capture\n", upvalue);
+                        vm_release_object(vm, closure);
+                        return;
+                    }
+                    v = running->fields.values[upvalue];
+                }
+                vm_retain(vm, v);
+                closure->fields.values[i] = v;
+            }
+            vm_release(vm, vm->registers[rd]);
+            vm->registers[rd].type = VAL_OBJ;
+            vm->registers[rd].as.obj_ref = closure;
+            vm->pc++;
+        } break;
+        case OP_CALL_INDIRECT: {
+            int rf = inst.operand1;
+            if (rf < 0 || rf >= 16) {
+                vm_raise(vm, "OP_CALL_INDIRECT invalid register index\n");
+                return;
+            }
+            Value callee = vm->registers[rf];
+            VMObject* closure = callee.type == VAL_OBJ ? (VMObject*)callee.as.obj_ref : NULL;
+            if (!closure || closure->closure < 0) {
+                vm_raise(vm, "OP_CALL_INDIRECT: value is not a function\n");
+                return;
+            }
+            const ClosureInfo* info = &vm->bytecode->closures[closure->closure];
+            Frame* f = frame_create((size_t)info->frame_size, vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level);
+            if (!f) {
+                vm_raise(vm, "OP_CALL_INDIRECT: failed to allocate a frame\n");
+                return;
+            }
+            vm_retain(vm, callee);
+            f->closure = callee;
+            vm_push_frame(vm, f, vm->pc + 1, (size_t)info->address, &inst);
+        } break;
+        case OP_LOAD_UPVALUE: {
+            int rd = inst.operand1;
+            Value* upvalue = vm_upvalue(vm, inst.operand2, "OP_LOAD_UPVALUE");
+            if (!upvalue) return;
+            if (inst.operand3) {
+                upvalue = vm_box_contents(vm, *upvalue, "OP_LOAD_UPVALUE");
+                if (!upvalue) return;
+            }
+            if (rd < 0 || rd >= 16) {
+                vm_raise(vm, "OP_LOAD_UPVALUE invalid register index\n");
+                return;
+            }
+            vm_retain(vm, *upvalue);
+            vm_set_register(vm, rd, *upvalue);
+            vm->pc++;
+        } break;
+        case OP_STORE_UPVALUE: {
+            Value* upvalue = vm_upvalue(vm, inst.operand1, "OP_STORE_UPVALUE");
+            Value* cell = upvalue ? vm_box_contents(vm, *upvalue, "OP_STORE_UPVALUE") : NULL;
+            if (!cell) return;
+            if (inst.operand2 < 0 || inst.operand2 >= 16) {
+                vm_raise(vm, "OP_STORE_UPVALUE invalid register index\n");
+                return;
+            }
+            vm_store_slot(vm, cell, inst.operand2, false);
+            vm->pc++;
+        } break;
+        case OP_BOX: {
+            Value* slot = vm_local_slot(vm, inst.operand1, "OP_BOX");
+            if (!slot) return;
+            // The box takes over the slot's reference.
+            VMObject* box = vm_create_cells(vm, 1);
+            if (inst.operand2) {
+                vm_release(vm, *slot);
+                box->fields.values[0] = VALUE_NULL;
+            } else {
+                box->fields.values[0] = *slot;
+            }
+            slot->type = VAL_OBJ;
+            slot->as.obj_ref = box;
+            vm->pc++;
+        } break;
+        case OP_LOAD_BOXED: {
+            int rd = inst.operand1;
+            Value* slot = vm_local_slot(vm, inst.operand2, "OP_LOAD_BOXED");
+            Value* cell = slot ? vm_box_contents(vm, *slot, "OP_LOAD_BOXED") : NULL;
+            if (!cell) return;
+            if (rd < 0 || rd >= 16) {
+                vm_raise(vm, "OP_LOAD_BOXED invalid register index\n");
+                return;
+            }
+            vm_retain(vm, *cell);
+            vm_set_register(vm, rd, *cell);
+            vm->pc++;
+        } break;
+        case OP_STORE_BOXED: {
+            Value* slot = vm_local_slot(vm, inst.operand1, "OP_STORE_BOXED");
+            Value* cell = slot ? vm_box_contents(vm, *slot, "OP_STORE_BOXED") : NULL;
+            if (!cell) return;
+            if (inst.operand2 < 0 || inst.operand2 >= 16) {
+                vm_raise(vm, "OP_STORE_BOXED invalid register index\n");
+                return;
+            }
+            vm_store_slot(vm, cell, inst.operand2, false);
             vm->pc++;
         } break;
         case OP_CORO_INIT: {
             size_t idx = (size_t)inst.operand1;
             if (idx >= MAX_COROUTINES) {
-                fprintf(stderr, "OP_CORO_INIT: index out of range\n");
-                vm->running = 0;
+                vm_raise(vm, "OP_CORO_INIT: index out of range\n");
                 return;
             }
             size_t cindex = vm_create_coroutine(vm);
@@ -430,78 +1123,667 @@ static void vm_execute_instruction(VM* vm, Instruction inst) {
             vm->pc++;
         } break;
         default:
-            fprintf(stderr, "Unknown opcode %d at PC %zu\n", inst.opcode, vm->pc);
-            vm->running = 0;
+            vm_raise(vm, "Unknown opcode %d at PC %zu\n", inst.opcode, vm->pc);
             break;
     }
 }
 
-static void vm_push_frame(VM* vm, Frame* frame, size_t return_address) {
-    if (vm->call_stack_top >= 1024) {
-        fprintf(stderr, "Call stack overflow!\n");
-        vm->running = 0;
+/**
+ * Enter 'frame' for the instruction 'call', running from 'target'. The
+ * caller's registers below the call's first argument are set aside in the
+ * frame; the arguments and those above them shift down to register 0. The
+ * sampled calls are traced as spans named after the address of the callee.
+ */
+static void vm_push_frame(VM* vm, Frame* frame, size_t return_address, size_t target,
+                          const Instruction* call) {
+    int base = call->operand4;
+    int result = call->operand3;
+    if (vm->call_stack_top >= 1024 || base < 0 || base > 16 || result < -1 || result >= 16) {
+        if (vm->call_stack_top >= 1024) {
+            vm_raise(vm, "Call stack overflow!\n");
+        } else {
+            vm_raise(vm, "OP_%d invalid register index\n", call->opcode);
+        }
+        vm_release_frame(vm, frame);
+        frame_destroy(frame);
         return;
     }
+    frame->saved_count = base;
+    frame->result_register = result;
+    memcpy(frame->saved_registers, vm->registers, (size_t)base * sizeof(Value));
+    memmove(vm->registers, vm->registers + base, (size_t)(16 - base) * sizeof(Value));
+    for (int i = 16 - base; i < 16; i++) {
+        vm->registers[i] = VALUE_NULL;
+    }
+    bool traced = tracer_enabled() && tracer_sample();
+    if (traced) {
+        char name[TRACER_NAME_LENGTH];
+        snprintf(name, sizeof(name), "fn@%zu", target);
+        tracer_begin("call", name);
+    }
     vm->call_stack[vm->call_stack_top] = frame;
     vm->return_addresses[vm->call_stack_top] = return_address;
+    vm->traced_calls[vm->call_stack_top] = traced;
     vm->call_stack_top++;
+    vm->pc = target;
+    vm_charge_fuel(vm);
 }
 
 static void vm_pop_frame(VM* vm) {
     if (vm->call_stack_top == 0) {
-        fprintf(stderr, "Call stack underflow!\n");
-        vm->running = 0;
+        vm_raise(vm, "Call stack underflow!\n");
         return;
     }
     vm->call_stack_top--;
+    if (vm->traced_calls[vm->call_stack_top]) {
+        // Begin and end pair up by nesting, so the end needs no name of its own.
+        tracer_end("call", "");
+        vm->traced_calls[vm->call_stack_top] = false;
+    }
     Frame* top = vm->call_stack[vm->call_stack_top];
     size_t ret_addr = vm->return_addresses[vm->call_stack_top];
+    // The caller gets back the registers it kept.
+    for (int i = 0; i < top->saved_count; i++) {
+        vm_release(vm, vm->registers[i]);
+        vm->registers[i] = top->saved_registers[i];
+    }
+    vm_release_frame(vm, top);
     frame_destroy(top);
     vm->call_stack[vm->call_stack_top] = NULL;
     vm->pc = ret_addr;
 }
 
+/**
+ * The slot 'slot' of the running function's frame (or of the top-level
+ * frame outside any call), or NULL after stopping the VM if out of range.
+ */
+static Value* vm_local_slot(VM* vm, int slot, const char* opname) {
+    Frame* frame = vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level;
+    return vm_frame_slot(vm, frame, slot, opname);
+}
+
+static Value* vm_frame_slot(VM* vm, Frame* frame, int slot, const char* opname) {
+    if (!frame || slot < 0 || (size_t)slot >= frame->local_count) {
+        vm_raise(vm, "%s: invalid frame slot %d\n", opname, slot);
+        return NULL;
+    }
+    return &frame->locals[slot];
+}
+
+/**
+ * Store register 'src' into a frame slot, handing over the register's
+ * reference when 'move' is set and sharing it otherwise.
+ */
+static void vm_store_slot(VM* vm, Value* slot, int src, bool move) {
+    Value v = vm->registers[src];
+    if (move) {
+        vm->registers[src] = VALUE_NULL;
+    } else {
+        vm_retain(vm, v);
+    }
+    Value old = *slot;
+    *slot = v;
+    vm_release(vm, old);
+}
+
+/**
+ * Drop the references held by a frame's locals before it is destroyed.
+ */
+static void vm_release_frame(VM* vm, Frame* frame) {
+    if (!frame) return;
+    vm_release(vm, frame->closure);
+    frame->closure = VALUE_NULL;
+    for (size_t i = 0; i < frame->local_count; i++) {
+        vm_release(vm, frame->locals[i]);
+        frame->locals[i] = VALUE_NULL;
+    }
+}
+
+/* ------------------------------------------------------------------
+    Reference counting
+
+    Objects carry their count in VMObject. Strings and list storage come
+    from natives as plain malloc'd pointers, so their counts are kept in
+    vm->heap, keyed by payload pointer. A payload the VM never adopted
+    (constant-pool strings, host data) is not in the table and is never
+    freed; constant-pool strings are pinned explicitly.
+------------------------------------------------------------------ */
+
+/*
+    Truth value of a condition register: false, 0, 0.0 and null are false.
+    Returns false for values that have no truth value.
+*/
+static bool vm_truthy(const Value* v, bool* out) {
+    switch (v->type) {
+        case VAL_BOOL:  *out = v->as.bool_val; return true;
+        case VAL_INT:   *out = v->as.int_val != 0; return true;
+        case VAL_FLOAT: *out = v->as.float_val != 0.0; return true;
+        case VAL_NULL:  *out = false; return true;
+        default:        return false;
+    }
+}
+
+/*
+    Evaluate comparison 'cmp' (OP_EQ .. OP_GE) on two values. Numbers compare
+    by value (ints against floats as doubles), strings by content; equality
+    also covers bools, null and, by identity, lists and objects, and values of
+    different types are simply unequal. Returns false if 'cmp' is an ordering
+    the values do not support.
+*/
+static bool vm_compare(const Value* a, const Value* b, VMOpcode cmp, bool* out) {
+    int order;
+    bool numeric_a = a->type == VAL_INT || a->type == VAL_FLOAT;
+    bool numeric_b = b->type == VAL_INT || b->type == VAL_FLOAT;
+    if (a->type == VAL_INT && b->type == VAL_INT) {
+        order = (a->as.int_val > b->as.int_val) - (a->as.int_val < b->as.int_val);
+    } else if (numeric_a && numeric_b) {
+        double x = a->type == VAL_INT ? (double)a->as.int_val : a->as.float_val;
+        double y = b->type == VAL_INT ? (double)b->as.int_val : b->as.float_val;
+        if (x != x || y != y) {
+            *out = (cmp == OP_NEQ);  /* NaN is unordered */
+            return true;
+        }
+        order = (x > y) - (x < y);
+    } else if (a->type == VAL_STRING && b->type == VAL_STRING) {
+        int c = (a->as.str_val == b->as.str_val) ? 0 : strcmp(a->as.str_val, b->as.str_val);
+        order = (c > 0) - (c < 0);
+    } else if (cmp == OP_EQ || cmp == OP_NEQ) {
+        bool equal;
+        if (a->type != b->type) {
+            equal = false;
+        } else if (a->type == VAL_BOOL) {
+            equal = a->as.bool_val == b->as.bool_val;
+        } else if (a->type == VAL_NULL) {
+            equal = true;
+        } else if (a->type == VAL_FILE) {
+            equal = a->as.file_val.native_file == b->as.file_val.native_file;
+        } else {
+            equal = value_payload(*a) == value_payload(*b);
+        }
+        *out = (cmp == OP_EQ) ? equal : !equal;
+        return true;
+    } else {
+        return false;
+    }
+    switch (cmp) {
+        case OP_EQ:  *out = order == 0; break;
+        case OP_NEQ: *out = order != 0; break;
+        case OP_LT:  *out = order < 0;  break;
+        case OP_LE:  *out = order <= 0; break;
+        case OP_GT:  *out = order > 0;  break;
+        case OP_GE:  *out = order >= 0; break;
+        default:     return false;
+    }
+    return true;
+}
+
+/*
+    Case target for 'v' in a switch table, or -1 for the default. Dense tables
+    are indexed directly; sorted tables are binary-searched by value, or for
+    strings by hash, with equal hashes confirmed against the case's text.
+*/
+static int vm_switch_target(const SwitchTable* table, const Value* v, bool dense,
+                            const ConstantPool* pool) {
+    int64_t key;
+    if (v->type == VAL_INT) {
+        key = v->as.int_val;
+        if (dense) {
+            if (key < table->low || (uint64_t)key - (uint64_t)table->low >= table->count) return -1;
+            return table->entries[key - table->low].target;
+        }
+    } else if (v->type == VAL_STRING && !dense) {
+        key = (int64_t)bytecode_hash_string(v->as.str_val);
+    } else {
+        return -1;
+    }
+
+    size_t lo = 0, hi = table->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (table->entries[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    for (size_t i = lo; i < table->count && table->entries[i].key == key; i++) {
+        const SwitchEntry* e = &table->entries[i];
+        if (e->str_index < 0) {
+            return v->type == VAL_INT ? e->target : -1;
+        }
+        if (v->type != VAL_STRING || (size_t)e->str_index >= pool->count) continue;
+        const char* text = pool->strings[e->str_index];
+        if (text == v->as.str_val || strcmp(text, v->as.str_val) == 0) {
+            return e->target;
+        }
+    }
+    return -1;
+}
+
+/* Writes the digits of 'n' so that they end at 'end'; returns where they start. */
+static char* format_int_backwards(int64_t n, char* end) {
+    uint64_t u = n < 0 ? 0 - (uint64_t)n : (uint64_t)n;
+    char* p = end;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (n < 0) *--p = '-';
+    return p;
+}
+
+/*
+    Text of 'v' for string interpolation, spelled as print() spells it.
+    Numbers are written into 'scratch' (VM_FORMAT_SCRATCH bytes) without
+    going through printf where the digits can be produced directly; other
+    values point at their own text.
+*/
+static const char* vm_format_value(const Value* v, char* scratch, size_t* length) {
+    char* end = scratch + VM_FORMAT_SCRATCH;
+    const char* text;
+    switch (v->type) {
+        case VAL_STRING:
+            text = v->as.str_val ? v->as.str_val : "";
+            break;
+        case VAL_INT: {
+            char* start = format_int_backwards(v->as.int_val, end);
+            *length = (size_t)(end - start);
+            return start;
+        }
+        case VAL_FLOAT: {
+            double d = v->as.float_val;
+            if (d > -1e15 && d < 1e15 && (double)(int64_t)d == d && !signbit(d)) {
+                // Whole numbers: the integer digits plus print()'s six zeros.
+                static const char zeros[] = ".000000";
+                char* start = format_int_backwards((int64_t)d, end - (sizeof(zeros) - 1));
+                memcpy(end - (sizeof(zeros) - 1), zeros, sizeof(zeros) - 1);
+                *length = (size_t)(end - start);
+                return start;
+            }
+            int n = snprintf(scratch, VM_FORMAT_SCRATCH, "%f", d);
+            if (n < 0 || n >= VM_FORMAT_SCRATCH) {
+                n = snprintf(scratch, VM_FORMAT_SCRATCH, "%g", d);  /* too long for %f */
+            }
+            *length = (size_t)n;
+            return scratch;
+        }
+        case VAL_BOOL:
+            text = v->as.bool_val ? "true" : "false";
+            break;
+        case VAL_LIST:
+            text = "[list]";
+            break;
+        case VAL_FILE:
+            text = "[file]";
+            break;
+        case VAL_NULL:
+            text = "null";
+            break;
+        default:
+            text = "[unknown]";
+            break;
+    }
+    *length = strlen(text);
+    return text;
+}
+
+static size_t heap_hash(const void* ptr, size_t capacity) {
+    uintptr_t h = (uintptr_t)ptr >> 4;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    return (size_t)(h ^ (h >> 29)) & (capacity - 1);
+}
+
+static VMHeapEntry* heap_find(const VM* vm, const void* ptr) {
+    if (!ptr || vm->heap_capacity == 0) return NULL;
+    size_t i = heap_hash(ptr, vm->heap_capacity);
+    while (vm->heap[i].ptr) {
+        if (vm->heap[i].ptr == ptr) return &vm->heap[i];
+        i = (i + 1) & (vm->heap_capacity - 1);
+    }
+    return NULL;
+}
+
+static void heap_insert(VM* vm, const void* ptr, int refcount, bool list) {
+    if ((vm->heap_count + 1) * 4 >= vm->heap_capacity * 3) {
+        size_t old_capacity = vm->heap_capacity;
+        VMHeapEntry* old = vm->heap;
+        vm->heap_capacity = old_capacity ? old_capacity * 2 : 64;
+        vm->heap = (VMHeapEntry*)calloc(vm->heap_capacity, sizeof(VMHeapEntry));
+        if (!vm->heap) {
+            fprintf(stderr, "Failed to grow VM heap table\n");
+            exit(1);
+        }
+        vm->heap_count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i].ptr) heap_insert(vm, old[i].ptr, old[i].refcount, old[i].list);
+        }
+        free(old);
+    }
+    size_t i = heap_hash(ptr, vm->heap_capacity);
+    while (vm->heap[i].ptr) i = (i + 1) & (vm->heap_capacity - 1);
+    vm->heap[i].ptr = ptr;
+    vm->heap[i].refcount = refcount;
+    vm->heap[i].list = list;
+    vm->heap_count++;
+}
+
+/* Linear-probing delete: shift later entries of the same run back into the hole. */
+static void heap_remove(VM* vm, const void* ptr) {
+    VMHeapEntry* e = heap_find(vm, ptr);
+    if (!e) return;
+    size_t mask = vm->heap_capacity - 1;
+    size_t hole = (size_t)(e - vm->heap);
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (!vm->heap[i].ptr) break;
+        size_t home = heap_hash(vm->heap[i].ptr, vm->heap_capacity);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            vm->heap[hole] = vm->heap[i];
+            hole = i;
+        }
+    }
+    vm->heap[hole].ptr = NULL;
+    vm->heap[hole].refcount = 0;
+    vm->heap[hole].list = false;
+    vm->heap_count--;
+}
+
+static const void* value_payload(Value v) {
+    switch (v.type) {
+        case VAL_STRING: return v.as.str_val;
+        case VAL_LIST:   return v.as.list_val;
+        case VAL_OBJ:    return v.as.obj_ref;
+        default:         return NULL;
+    }
+}
+
+void vm_retain(VM* vm, Value v) {
+    if (v.type == VAL_OBJ) {
+        vm_retain_object(vm, (VMObject*)v.as.obj_ref);
+        return;
+    }
+    VMHeapEntry* e = heap_find(vm, value_payload(v));
+    if (e && e->refcount != VM_HEAP_PINNED) e->refcount++;
+}
+
+void vm_release(VM* vm, Value v) {
+    if (v.type == VAL_OBJ) {
+        vm_release_object(vm, (VMObject*)v.as.obj_ref);
+        return;
+    }
+    const void* payload = value_payload(v);
+    VMHeapEntry* e = heap_find(vm, payload);
+    if (!e || e->refcount == VM_HEAP_PINNED || --e->refcount > 0) return;
+    heap_remove(vm, payload);
+    if (v.type == VAL_LIST) {
+        for (size_t i = 0; i < v.as.list_val->length; i++) {
+            vm_release(vm, v.as.list_val->data[i]);
+        }
+        free(v.as.list_val->data);
+        free(v.as.list_val);
+    } else {
+        free(v.as.str_val);
+    }
+}
+
+Value vm_adopt(VM* vm, Value v) {
+    const void* payload = value_payload(v);
+    if (!payload) return v;
+    if (v.type == VAL_OBJ || heap_find(vm, payload)) {
+        vm_retain(vm, v);  /* an alias of something the VM already owns */
+        return v;
+    }
+    heap_insert(vm, payload, 1, v.type == VAL_LIST);
+    if (v.type == VAL_LIST) {
+        for (size_t i = 0; i < v.as.list_val->length; i++) {
+            vm_adopt(vm, v.as.list_val->data[i]);
+        }
+    }
+    return v;
+}
+
+void vm_track_payload(VM* vm, Value v, int refcount) {
+    const void* payload = value_payload(v);
+    if (!payload || v.type == VAL_OBJ) return;
+    VMHeapEntry* e = heap_find(vm, payload);
+    if (e) {
+        e->refcount = refcount;
+    } else {
+        heap_insert(vm, payload, refcount, v.type == VAL_LIST);
+    }
+}
+
+int vm_value_refcount(const VM* vm, Value v) {
+    if (v.type == VAL_OBJ) {
+        return v.as.obj_ref ? ((const VMObject*)v.as.obj_ref)->refcount : 0;
+    }
+    const VMHeapEntry* e = heap_find(vm, value_payload(v));
+    return e ? e->refcount : 0;
+}
+
+/**
+ * Store into a register that owns 'v'; the previous contents are released.
+ */
+static void vm_set_register(VM* vm, int r, Value v) {
+    Value old = vm->registers[r];
+    vm->registers[r] = v;
+    vm_release(vm, old);
+}
+
+/*
+ * Call the fast path of 'native' on the numbers in registers base_reg..
+ * and put the result in 'dest'. Returns false, having done nothing, if an
+ * argument is not of a type the fast paths take.
+ */
+static bool vm_call_fast_native(VM* vm, const NativeDescriptor* native, int dest,
+                                int base_reg, int arg_count) {
+    if (dest < 0 || dest >= 16 || base_reg < 0 || base_reg + arg_count > 16) return false;
+    const Value* args = &vm->registers[base_reg];
+    bool all_int = true;
+    for (int i = 0; i < arg_count; i++) {
+        if (args[i].type == VAL_FLOAT) {
+            all_int = false;
+        } else if (args[i].type != VAL_INT) {
+            return false;
+        }
+    }
+    Value result;
+    if (all_int && native->fast_i64) {
+        int64_t ints[NATIVE_MAX_HINTS];
+        for (int i = 0; i < arg_count; i++) ints[i] = args[i].as.int_val;
+        result.type = VAL_INT;
+        result.as.int_val = native->fast_i64(ints);
+    } else if (native->fast_f64) {
+        double floats[NATIVE_MAX_HINTS];
+        for (int i = 0; i < arg_count; i++) {
+            floats[i] = args[i].type == VAL_INT ? (double)args[i].as.int_val : args[i].as.float_val;
+        }
+        result.type = VAL_FLOAT;
+        result.as.float_val = native->fast_f64(floats);
+    } else {
+        return false;
+    }
+    vm_set_register(vm, dest, result);
+    return true;
+}
+
+/**
+ * Natives are not reference-count aware. After one returns, bring the
+ * counts in line with what it did to the lists it was given ('before' holds
+ * their headers as they were): a list that changed may have had any other
+ * argument stored into it, so each of those gets a reference on the list's
+ * behalf. Storage the native reallocated needs nothing, since every alias
+ * reaches it through the same header.
+ */
+static void vm_reconcile_native_args(VM* vm, const Value* saved, const ValueList* before, int arg_count) {
+    for (int i = 0; i < arg_count; i++) {
+        if (saved[i].type != VAL_LIST) continue;
+        const ValueList* list = saved[i].as.list_val;
+        if (list->data == before[i].data && list->length == before[i].length) continue;
+        for (int j = 0; j < arg_count; j++) {
+            if (j != i && value_payload(saved[j])) vm_retain(vm, saved[j]);
+        }
+    }
+}
+
 void vm_retain_object(VM* vm, VMObject* obj) {
+    (void)vm;
     if (!obj) return;
     obj->refcount++;
 }
 
 void vm_release_object(VM* vm, VMObject* obj) {
     if (!obj) return;
-    obj->refcount--;
-    if (obj->refcount <= 0) {
-        for (size_t i = 0; i < vm->object_count; i++) {
-            if (vm->objects[i] == obj) {
-                destroy_object(vm->objects[i]);
-                for (size_t j = i; j < vm->object_count - 1; j++) {
-                    vm->objects[j] = vm->objects[j+1];
-                }
-                vm->object_count--;
-                return;
-            }
-        }
+    if (--obj->refcount > 0) return;
+    for (size_t i = 0; i < obj->fields.count; i++) {
+        vm_release(vm, obj->fields.values[i]);
     }
+    // Swap-remove from the object table using the slot recorded at creation.
+    size_t slot = obj->slot;
+    if (slot < vm->object_count && vm->objects[slot] == obj) {
+        vm->objects[slot] = vm->objects[--vm->object_count];
+        vm->objects[slot]->slot = slot;
+    }
+    destroy_object(obj);
 }
 
 void vm_gc_collect(VM* vm) {
+    // Payloads are freed by reference count as they die; there is no cycle to
+    // run, but a traced collection still shows where it was asked for.
     (void)vm;
+    if (tracer_enabled()) tracer_span("gc", "collect", tracer_now());
 }
 
 VMObject* vm_create_object(VM* vm) {
     VMObject* obj = (VMObject*)malloc(sizeof(VMObject));
     memset(obj, 0, sizeof(VMObject));
     obj->refcount = 1;
+    obj->class_index = -1;
+    obj->closure = -1;
     vm_grow_object_array(vm);
+    obj->slot = vm->object_count;
     vm->objects[vm->object_count++] = obj;
     return obj;
 }
 
-bool vm_set_property(VM* vm, VMObject* obj, const char* key, VMValue val) {
-    (void)vm;
+/**
+ * Slot of the field named 'key' in objects of class 'class_index', or -1.
+ */
+static int class_field_slot(const VM* vm, int class_index, const char* key) {
+    const ClassInfo* cls = &vm->bytecode->classes[class_index];
+    const char** names = (const char**)vm->bytecode->constant_pool.strings;
+    for (size_t i = 0; i < cls->field_count; i++) {
+        if (strcmp(names[cls->fields[i]], key) == 0) return (int)i;
+    }
+    return -1;
+}
+
+/**
+ * A new object without keys holding 'count' null values: the fields of a
+ * class object, the upvalues of a closure, or the one value of a box.
+ */
+static VMObject* vm_create_cells(VM* vm, size_t count) {
+    VMObject* obj = vm_create_object(vm);
+    obj->fields.values = (VMValue*)calloc(count > 0 ? count : 1, sizeof(VMValue));
+    obj->fields.count = count;
+    obj->fields.capacity = count;
+    return obj;
+}
+
+/* The closure the running function was called through, or NULL. */
+static VMObject* vm_running_closure(VM* vm) {
+    Frame* frame = vm->call_stack_top > 0 ? vm->call_stack[vm->call_stack_top - 1] : vm->top_level;
+    return frame->closure.type == VAL_OBJ ? (VMObject*)frame->closure.as.obj_ref : NULL;
+}
+
+/* Upvalue 'index' of the running closure, or NULL after raising an error. */
+static Value* vm_upvalue(VM* vm, int index, const char* opname) {
+    VMObject* closure = vm_running_closure(vm);
+    if (!closure || index < 0 || (size_t)index >= closure->fields.count) {
+        vm_raise(vm, "%s: no upvalue %d\n", opname, index);
+        return NULL;
+    }
+    return &closure->fields.values[index];
+}
+
+/* The value held by the box 'box', or NULL after raising an error. */
+static Value* vm_box_contents(VM* vm, Value box, const char* opname) {
+    const VMObject* obj = box.type == VAL_OBJ ? (const VMObject*)box.as.obj_ref : NULL;
+    if (!obj || obj->fields.keys || obj->class_index >= 0 || obj->closure >= 0 || obj->fields.count != 1) {
+        vm_raise(vm, "%s: not a box\n", opname);
+        return NULL;
+    }
+    return &((VMObject*)box.as.obj_ref)->fields.values[0];
+}
+
+/**
+ * The object in register 'r' (checked), or NULL after raising an error.
+ */
+static VMObject* vm_class_object(VM* vm, int r, const char* opname) {
+    if (r < 0 || r >= 16) {
+        vm_raise(vm, "%s invalid register index\n", opname);
+        return NULL;
+    }
+    if (vm->registers[r].type != VAL_OBJ) {
+        vm_raise(vm, "%s: not an object.\n", opname);
+        return NULL;
+    }
+    return (VMObject*)vm->registers[r].as.obj_ref;
+}
+
+/**
+ * Field slot (or method table index) of constant 'name' in the class of
+ * 'obj', through the inline cache of the current instruction: while the
+ * instruction keeps seeing objects of the same class it skips the search.
+ */
+static int vm_cached_lookup(VM* vm, const VMObject* obj, int name, bool method) {
+    VMInlineCache* cache = &vm->inline_caches[vm->pc];
+    if (cache->class_index == obj->class_index) return cache->index;
+    if (name < 0 || (size_t)name >= vm->bytecode->constant_pool.count) return -1;
+    const ClassInfo* cls = &vm->bytecode->classes[obj->class_index];
+    const char** names = (const char**)vm->bytecode->constant_pool.strings;
+    int index = -1;
+    if (method) {
+        for (size_t i = 0; i < cls->method_count && index < 0; i++) {
+            if (cls->methods[i].name == name || strcmp(names[cls->methods[i].name], names[name]) == 0) index = (int)i;
+        }
+    } else {
+        for (size_t i = 0; i < cls->field_count && index < 0; i++) {
+            if (cls->fields[i] == name || strcmp(names[cls->fields[i]], names[name]) == 0) index = (int)i;
+        }
+    }
+    if (index >= 0) {
+        cache->class_index = obj->class_index;
+        cache->index = index;
+    }
+    return index;
+}
+
+/**
+ * Store 'val' under 'key', taking over the caller's reference to it.
+ * A class object only stores into the fields its class declares.
+ */
+static void object_store(VM* vm, VMObject* obj, const char* key, Value val) {
+    if (obj->class_index >= 0) {
+        int slot = class_field_slot(vm, obj->class_index, key);
+        if (slot < 0) {
+            vm_release(vm, val);
+            return;
+        }
+        Value old = obj->fields.values[slot];
+        obj->fields.values[slot] = val;
+        vm_release(vm, old);
+        return;
+    }
+    if (!obj->fields.keys && obj->fields.count > 0) {
+        vm_release(vm, val);  /* closures and boxes have no properties */
+        return;
+    }
     for (size_t i = 0; i < obj->fields.count; i++) {
         if (strcmp(obj->fields.keys[i], key) == 0) {
+            Value old = obj->fields.values[i];
             obj->fields.values[i] = val;
-            return true;
+            vm_release(vm, old);
+            return;
         }
     }
     if (obj->fields.count >= obj->fields.capacity) {
@@ -513,19 +1795,26 @@ bool vm_set_property(VM* vm, VMObject* obj, const char* key, VMValue val) {
     size_t idx = obj->fields.count++;
     obj->fields.keys[idx] = strdup(key);
     obj->fields.values[idx] = val;
+}
+
+bool vm_set_property(VM* vm, VMObject* obj, const char* key, VMValue val) {
+    vm_retain(vm, val);
+    object_store(vm, obj, key, val);
     return true;
 }
 
 VMValue vm_get_property(VM* vm, VMObject* obj, const char* key) {
-    (void)vm;
-    for (size_t i = 0; i < obj->fields.count; i++) {
+    if (obj->class_index >= 0) {
+        int slot = class_field_slot(vm, obj->class_index, key);
+        if (slot >= 0) return obj->fields.values[slot];
+    }
+    for (size_t i = 0; obj->fields.keys && i < obj->fields.count; i++) {
         if (strcmp(obj->fields.keys[i], key) == 0) {
             return obj->fields.values[i];
         }
     }
     VMValue none;
     none.type = VAL_NULL;
-    none.refcount = 0;
     none.as.int_val = 0;
     return none;
 }
@@ -538,7 +1827,6 @@ size_t vm_create_coroutine(VM* vm) {
             vm->coroutines[i].frame = NULL;
             for (int r = 0; r < 16; r++) {
                 vm->coroutines[i].registers[r].type = VAL_NULL;
-                vm->coroutines[i].registers[r].refcount = 0;
             }
             return i;
         }
@@ -563,6 +1851,11 @@ void vm_coroutine_yield(VM* vm) {
     }
     vm->current_coro = next;
     vm->pc = vm->coroutines[next].pc;
+    if (tracer_enabled() && next != c) {
+        char name[TRACER_NAME_LENGTH];
+        snprintf(name, sizeof(name), "yield %zu->%zu", c, next);
+        tracer_instant("coroutine", name);
+    }
 }
 
 void vm_coroutine_resume(VM* vm, size_t coro_index) {
@@ -574,52 +1867,82 @@ void vm_coroutine_resume(VM* vm, size_t coro_index) {
     vm->coroutines[vm->current_coro].pc = vm->pc;
     vm->current_coro = coro_index;
     vm->pc = vm->coroutines[coro_index].pc;
+    if (tracer_enabled()) {
+        char name[TRACER_NAME_LENGTH];
+        snprintf(name, sizeof(name), "resume %zu", coro_index);
+        tracer_instant("coroutine", name);
+    }
 }
 
 bool vm_register_native(VM* vm, const char* name, VMValue(*func)(int, VMValue*)) {
+    // Nothing is known about it: any number of arguments, of any type.
+    NativeDescriptor native = { name, func, 0, NATIVE_VARIADIC, { NATIVE_TYPE_ANY }, NATIVE_TYPE_ANY, 0, NULL, NULL, NULL };
+    return vm_register_native_desc(vm, &native);
+}
+
+bool vm_register_native_desc(VM* vm, const NativeDescriptor* native) {
     if (!vm) {
         fprintf(stderr, "ERROR: NULL VM passed to vm_register_native\n");
         return false;
     }
     
-    if (!name) {
+    if (!native || !native->name) {
         fprintf(stderr, "ERROR: NULL name passed to vm_register_native\n");
         return false;
     }
     
-    if (!func) {
+    if (!native->func) {
         fprintf(stderr, "ERROR: NULL function pointer passed to vm_register_native\n");
         return false;
     }
 
-    if (vm->native_count >= 64) {
-        fprintf(stderr, "ERROR: Native registry full (max 64 functions)\n");
-        return false;
-    }
-
     for (size_t i = 0; i < vm->native_count; i++) {
-        if (strcmp(vm->native_registry[i].name, name) == 0) {
-            vm->native_registry[i].func = func;
+        if (strcmp(vm->natives[i].name, native->name) == 0) {
+            const char* name = vm->natives[i].name;
+            vm->natives[i] = *native;
+            vm->natives[i].name = name;
             return true;
         }
     }
 
-    vm->native_registry[vm->native_count].name = name;
-    vm->native_registry[vm->native_count].func = func;
+    if (vm->native_count == vm->native_capacity) {
+        size_t capacity = vm->native_capacity ? vm->native_capacity * 2 : 64;
+        NativeDescriptor* natives = (NativeDescriptor*)realloc(vm->natives, capacity * sizeof(NativeDescriptor));
+        if (!natives) {
+            fprintf(stderr, "ERROR: Out of memory registering native '%s'\n", native->name);
+            return false;
+        }
+        vm->natives = natives;
+        vm->native_capacity = capacity;
+    }
+    char* name = strdup(native->name);
+    if (!name) {
+        fprintf(stderr, "ERROR: Out of memory registering native '%s'\n", native->name);
+        return false;
+    }
+    vm->natives[vm->native_count] = *native;
+    vm->natives[vm->native_count].name = name;
     vm->native_count++;
     
     return true;
 }
 
-VMValue vm_call_native(VM* vm, const char* name, int arg_count, VMValue* args) {
+const NativeDescriptor* vm_find_native(const VM* vm, const char* name) {
     for (size_t i = 0; i < vm->native_count; i++) {
-        if (strcmp(vm->native_registry[i].name, name) == 0) {
-            return vm->native_registry[i].func(arg_count, args);
+        if (strcmp(vm->natives[i].name, name) == 0) {
+            return &vm->natives[i];
         }
     }
+    return NULL;
+}
+
+VMValue vm_call_native(VM* vm, const char* name, int arg_count, VMValue* args) {
+    const NativeDescriptor* native = vm_find_native(vm, name);
+    if (native) {
+        return native->func(arg_count, args);
+    }
     VMValue v;
     v.type = VAL_NULL;
-    v.refcount = 0;
     v.as.int_val = 0;
     return v;
 }
@@ -634,7 +1957,6 @@ void vm_jit_compile(VM* vm) {
 static VMValue vmvalue_from_int(int64_t n) {
     VMValue v;
     v.type = VAL_INT;
-    v.refcount = 0;
     v.as.int_val = n;
     return v;
 }
@@ -649,7 +1971,7 @@ static void vm_grow_object_array(VM* vm) {
 
 static void destroy_object(VMObject* obj) {
     if (!obj) return;
-    for (size_t i = 0; i < obj->fields.count; i++) {
+    for (size_t i = 0; obj->fields.keys && i < obj->fields.count; i++) {
         free(obj->fields.keys[i]);
     }
     free(obj->fields.keys);
@@ -662,25 +1984,25 @@ void vm_dump_registers(const VM* vm) {
         const VMValue* v = &vm->registers[i];
         switch (v->type) {
             case VAL_INT:
-                printf("R%d: INT(%" PRId64 "), refcount=%d\n", i, v->as.int_val, v->refcount);
+                printf("R%d: INT(%" PRId64 ")\n", i, v->as.int_val);
                 break;
             case VAL_FLOAT:
-                printf("R%d: FLOAT(%f), refcount=%d\n", i, v->as.float_val, v->refcount);
+                printf("R%d: FLOAT(%f)\n", i, v->as.float_val);
                 break;
             case VAL_BOOL:
-                printf("R%d: BOOL(%s), refcount=%d\n", i, v->as.bool_val ? "true" : "false", v->refcount);
+                printf("R%d: BOOL(%s)\n", i, v->as.bool_val ? "true" : "false");
                 break;
             case VAL_NULL:
-                printf("R%d: NULL, refcount=%d\n", i, v->refcount);
+                printf("R%d: NULL\n", i);
                 break;
             case VAL_OBJ:
-                printf("R%d: OBJ(%p), refcount=%d\n", i, v->as.obj_ref, v->refcount);
+                printf("R%d: OBJ(%p), refcount=%d\n", i, v->as.obj_ref, vm_value_refcount(vm, *v));
                 break;
             case VAL_STRING:
-                printf("R%d: STRING(%s), refcount=%d\n", i, v->as.str_val, v->refcount);
+                printf("R%d: STRING(%s), refcount=%d\n", i, v->as.str_val, vm_value_refcount(vm, *v));
                 break;
             default:
-                printf("R%d: Unknown type, refcount=%d\n", i, v->refcount);
+                printf("R%d: Unknown type, refcount=%d\n", i, vm_value_refcount(vm, *v));
                 break;
         }
     }
@@ -689,7 +2011,6 @@ void vm_dump_registers(const VM* vm) {
 VMValue vm_get_register_value(const VM* vm, int reg_index) {
     VMValue none;
     none.type = VAL_NULL;
-    none.refcount = 0;
     if (!vm || reg_index < 0 || reg_index >= 16) {
         return none;
     }
@@ -5,7 +5,10 @@
 #include <stdbool.h>
 #include "../../include/vm_common.h"
 #include "../../include/value.h"
+#include "../../include/native.h"
 #include "../compiler/bytecode.h"
+#include "profile.h"
+#include "replay.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +23,9 @@ typedef struct Frame Frame;
 */
 typedef struct VMObject {
     int refcount;
+    size_t slot;        // index in vm->objects, for O(1) removal
+    int class_index;    // -1 for a plain object; else one value per field of the class, and no keys
+    int closure;        // -1, or the ClosureInfo of a closure, whose upvalues are the values (no keys)
     struct {
         char** keys;
         Value* values;  // Using Value instead of VMValue
@@ -40,6 +46,47 @@ typedef struct Coro {
 
 #define MAX_COROUTINES 64
 
+/**
+    Reference count of a string or list payload owned by the VM; a list is
+    counted by its header. A negative count marks a pinned payload
+    (constant-pool strings).
+*/
+typedef struct VMHeapEntry {
+    const void* ptr;
+    int refcount;
+    bool list;    // ptr is a ValueList, whose storage is freed with it
+} VMHeapEntry;
+
+#define VM_HEAP_PINNED (-1)
+
+/* Scratch space for one number converted to text by OP_CONCAT_N. */
+#define VM_FORMAT_SCRATCH 64
+
+/**
+    What one OP_GETFIELD, OP_SETFIELD or OP_INVOKE last looked up: the class
+    of the object and the field slot or method table index found in it.
+    An OP_CALL_NATIVE keeps the registry index of its native, with
+    class_index 0 once it has been resolved.
+*/
+typedef struct VMInlineCache {
+    int class_index;      // -1 while empty
+    int index;
+} VMInlineCache;
+
+/**
+    What the host wants done when a VM has used up its fuel (see
+    vm_set_fuel): stop it for good, return from vm_run so it can be resumed
+    by calling vm_run again, or keep going. The latter two grant another
+    quantum.
+*/
+typedef enum VMFuelAction {
+    VM_FUEL_ABORT,
+    VM_FUEL_YIELD,
+    VM_FUEL_EXTEND
+} VMFuelAction;
+
+typedef VMFuelAction (*VMFuelHandler)(VM* vm, void* context);
+
 /**
     The main VM structure.
 */
@@ -48,31 +95,54 @@ typedef struct VM {
     size_t pc;
     Value registers[16];  // Using Value instead of VMValue
     int running;
+    bool faulted;         // stopped by a runtime error that no handler caught
+    char error_message[256];
     Frame* call_stack[1024];
     size_t call_stack_top;
     size_t return_addresses[1024];
+    bool traced_calls[1024];  // calls the tracer sampled, whose return ends a span
     VMObject** objects;
     size_t object_count;
     size_t object_capacity;
     Coro coroutines[MAX_COROUTINES];
     size_t current_coro;
-    struct {
-        const char* name;
-        Value (*func)(int arg_count, Value* args);  // Using Value instead of VMValue
-    } native_registry[64];
+    NativeDescriptor* natives;    // registered natives; each name is an owned copy
     size_t native_count;
+    size_t native_capacity;
     void* jit_context;
+    Profile* profile;     // when set, vm_run records execution counts into it (not owned)
+    Replay* replay;       // when set, calls of external natives are logged to it or replayed from it (not owned)
+    VMHeapEntry* heap;    // open-addressed table of reference-counted payloads
+    size_t heap_count;
+    size_t heap_capacity;
+    Frame* top_level;     // locals of code running outside any function
+    VMInlineCache* inline_caches;  // one per instruction
+    bool pause_before_main;  // vm_run returns when the top-level code is about to call main()
+    int64_t fuel;         // left before the fuel handler is asked; charged at backward jumps and calls
+    int64_t fuel_quantum; // 0: no limit
+    VMFuelHandler fuel_handler;
+    void* fuel_context;
+    bool suspended;       // yielded when out of fuel, or at a breakpoint; vm_run resumes it
+    bool out_of_fuel;     // aborted when out of fuel
 } VM;
 
 /* PUBLIC FUNCTIONS */
 VM* vm_create(Bytecode* bytecode);
 void vm_destroy(VM* vm);
 void vm_run(VM* vm);
+bool vm_step(VM* vm);                     // run one instruction; false once the VM has stopped
 void vm_dump_registers(const VM* vm);
 Value vm_get_register_value(const VM* vm, int reg_index);  // Using Value instead of VMValue
 void vm_retain_object(VM* vm, VMObject* obj);
 void vm_release_object(VM* vm, VMObject* obj);
 void vm_gc_collect(VM* vm);
+void vm_retain(VM* vm, Value v);
+void vm_release(VM* vm, Value v);
+Value vm_adopt(VM* vm, Value v);          // take ownership of a value produced outside the VM
+int vm_value_refcount(const VM* vm, Value v);
+void vm_track_payload(VM* vm, Value v, int refcount);  // own the string or list of 'v' with this count
+bool vm_paused_at_main(const VM* vm);     // stopped by pause_before_main, ready to call main()
+void vm_set_fuel(VM* vm, int64_t quantum, VMFuelHandler handler, void* context);  // NULL handler: abort
 VMObject* vm_create_object(VM* vm);
 bool vm_set_property(VM* vm, VMObject* obj, const char* key, Value val);  // Using Value instead of VMValue
 Value vm_get_property(VM* vm, VMObject* obj, const char* key);  // Using Value instead of VMValue
@@ -80,6 +150,8 @@ size_t vm_create_coroutine(VM* vm);
 void vm_coroutine_yield(VM* vm);
 void vm_coroutine_resume(VM* vm, size_t coro_index);
 bool vm_register_native(VM* vm, const char* name, Value(*func)(int, Value*));  // Using Value instead of VMValue
+bool vm_register_native_desc(VM* vm, const NativeDescriptor* native);  // arity, hints, flags and fast paths
+const NativeDescriptor* vm_find_native(const VM* vm, const char* name);
 Value vm_call_native(VM* vm, const char* name, int arg_count, Value* args);  // Using Value instead of VMValue
 
 #ifdef ENABLE_JIT
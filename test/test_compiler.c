@@ -0,0 +1,1665 @@
+/*
+ * test_compiler.c
+ *
+ * Tests for the bytecode optimizer passes in optimizer.h / optimizer.c,
+ * with and without a recorded execution profile.
+ * Each test builds a small program, optimizes it, and checks both the shape
+ * of the rewritten code and that the VM still computes the same result.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/compiler/bytecode.h"
+#include "../src/compiler/optimizer.h"
+#include "../src/vm/vm.h"
+#include "../src/vm/frame.h"
+#include "../src/vm/snapshot.h"
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/compiler/compiler.h"
+#include "../include/semantic.h"
+#include "../src/runtime/runtime.h"
+#include "../src/runtime/regex.h"
+#include "../src/runtime/plugin.h"
+#include "../src/osfl/serve.h"
+#include "../src/compiler/module.h"
+#include "../include/osfl.h"
+
+/* Helper: run a program and return the integer held in the given register. */
+static int64_t run_and_read(Bytecode* bc, int reg_index) {
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    Value v = vm_get_register_value(vm, reg_index);
+    assert(v.type == VAL_INT && "Expected VAL_INT in register.");
+    vm_destroy(vm);
+    return v.as.int_val;
+}
+
+/* Helper: no branch in the program may target an unconditional jump. */
+static void assert_no_jump_chains(const Bytecode* bc) {
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        const Instruction* inst = &bc->instructions[i];
+        if (inst->opcode == OP_JUMP || (inst->opcode >= OP_JUMP_IF_ZERO &&
+            inst->opcode <= OP_JUMP_IF_GE)) {
+            assert((size_t)inst->operand1 < bc->instruction_count);
+            assert(bc->instructions[inst->operand1].opcode != OP_JUMP && "Jump chain left in place.");
+        }
+    }
+}
+
+/* TEST 1: JUMP -> JUMP -> HALT chains collapse to their final target. */
+static void test_thread_jumps(void) {
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 7, 0);  /* 0 */
+    bytecode_add_instruction(bc, OP_JUMP, 3, 0, 0);        /* 1 -> 3 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 1, 0);  /* 2 (dead) */
+    bytecode_add_instruction(bc, OP_JUMP, 4, 0, 0);        /* 3 -> 4 */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);        /* 4 */
+
+    optimizer_thread_jumps(bc);
+    assert(bc->instructions[1].opcode == OP_HALT && "Jump to HALT should become HALT.");
+    assert(bc->instructions[3].opcode == OP_HALT);
+    assert(run_and_read(bc, 0) == 7);
+
+    bytecode_destroy(bc);
+    printf("[test_thread_jumps] PASSED\n");
+}
+
+/* TEST 2: a bottom-tested loop with a nested if/else keeps its result after layout. */
+static void test_layout_loop(void) {
+    /*
+       R0 = 6 (counter), R1 = 0 (acc), R2 = 1, R3 = parity
+       while (R0 != 0) {
+           if (R3) R1 = R1 + R0; else R1 = R1 + R2;
+           R3 = R2 - R3;
+           R0 = R0 - R2;
+       }
+    */
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 6, 0);       /* 0 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 0, 0);       /* 1 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 1, 0);       /* 2 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 3, 0, 0);       /* 3 */
+    bytecode_add_instruction(bc, OP_JUMP, 11, 0, 0);            /* 4: loop entry */
+    bytecode_add_instruction(bc, OP_JUMP_IF_ZERO, 8, 3, 0);     /* 5: body */
+    bytecode_add_instruction(bc, OP_ADD, 1, 1, 0);              /* 6 */
+    bytecode_add_instruction(bc, OP_JUMP, 13, 0, 0);            /* 7 -> 13 -> 9 */
+    bytecode_add_instruction(bc, OP_ADD, 1, 1, 2);              /* 8 */
+    bytecode_add_instruction(bc, OP_SUB, 3, 2, 3);              /* 9 */
+    bytecode_add_instruction(bc, OP_SUB, 0, 0, 2);              /* 10 */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 5, 0, 0);  /* 11: loop test */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 12 */
+    bytecode_add_instruction(bc, OP_JUMP, 9, 0, 0);             /* 13 */
+
+    int64_t expected = run_and_read(bc, 1);
+    optimizer_optimize(bc, NULL);
+    assert_no_jump_chains(bc);
+    assert(bc->instruction_count <= 13 && "Unreachable trampoline should be dropped.");
+    assert(run_and_read(bc, 1) == expected);
+
+    bytecode_destroy(bc);
+    printf("[test_layout_loop] PASSED\n");
+}
+
+/* TEST 3: "JZ r, L1; JUMP L2; L1:" is rewritten to a single JNZ. */
+static void test_invert_branch_over_jump(void) {
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 1, 0);       /* 0 */
+    bytecode_add_instruction(bc, OP_JUMP_IF_ZERO, 3, 0, 0);     /* 1 */
+    bytecode_add_instruction(bc, OP_JUMP, 5, 0, 0);             /* 2 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 111, 0);     /* 3 */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 4 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 222, 0);     /* 5 */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 6 */
+
+    optimizer_optimize(bc, NULL);
+    size_t jumps = 0;
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        if (bc->instructions[i].opcode == OP_JUMP) jumps++;
+    }
+    assert(jumps == 0 && "Unconditional jump should have been folded into the branch.");
+    assert(run_and_read(bc, 1) == 222);
+
+    bytecode_destroy(bc);
+    printf("[test_invert_branch_over_jump] PASSED\n");
+}
+
+/* Helper: run a program with a fresh profile attached and return the profile. */
+static Profile* record_profile(Bytecode* bc) {
+    Profile* profile = profile_create(bytecode_fingerprint(bc), bc->instruction_count);
+    VM* vm = vm_create(bc);
+    vm->profile = profile;
+    vm_run(vm);
+    vm_destroy(vm);
+    return profile;
+}
+
+/* TEST 4: a branch that the profile shows is almost always taken gets the fallthrough slot. */
+static void test_profile_layout(void) {
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 50, 0);      /* 0 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 0, 0);       /* 1 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 1, 0);       /* 2 */
+    bytecode_add_instruction(bc, OP_JUMP, 9, 0, 0);             /* 3: loop entry */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 7, 2, 0);  /* 4: always taken */
+    bytecode_add_instruction(bc, OP_SUB, 1, 1, 2);              /* 5: cold */
+    bytecode_add_instruction(bc, OP_JUMP, 8, 0, 0);             /* 6 */
+    bytecode_add_instruction(bc, OP_ADD, 1, 1, 2);              /* 7: hot */
+    bytecode_add_instruction(bc, OP_SUB, 0, 0, 2);              /* 8 */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 4, 0, 0);  /* 9: loop test */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 10 */
+
+    Profile* profile = record_profile(bc);
+    assert(profile_entry(profile, 4)->exec_count == 50);
+    assert(profile_entry(profile, 4)->taken_count == 50);
+    assert(profile_entry(profile, 5)->exec_count == 0);
+
+    optimizer_optimize(bc, profile);
+    size_t i = 0;
+    while (i < bc->instruction_count && !(bc->instructions[i].opcode == OP_JUMP_IF_ZERO &&
+                                          bc->instructions[i].operand2 == 2)) {
+        i++;
+    }
+    assert(i + 1 < bc->instruction_count && "Hot branch should have been inverted.");
+    assert(bc->instructions[i + 1].opcode == OP_ADD && "Hot successor should follow the branch.");
+    assert(bytecode_origin(bc, i) == 4);
+    assert(run_and_read(bc, 1) == 50);
+
+    profile_destroy(profile);
+    bytecode_destroy(bc);
+    printf("[test_profile_layout] PASSED\n");
+}
+
+// A guarded range whose cold block is moved away is split so that it still covers it.
+static void test_layout_handlers(void) {
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 50, 0);      /* 0 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 0, 0);       /* 1 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 1, 0);       /* 2 */
+    bytecode_add_instruction(bc, OP_JUMP, 9, 0, 0);             /* 3: loop entry */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 7, 2, 0);  /* 4: guarded, always taken */
+    bytecode_add_instruction(bc, OP_SUB, 1, 1, 2);              /* 5: cold */
+    bytecode_add_instruction(bc, OP_JUMP, 8, 0, 0);             /* 6 */
+    bytecode_add_instruction(bc, OP_ADD, 1, 1, 2);              /* 7: hot */
+    bytecode_add_instruction(bc, OP_SUB, 0, 0, 2);              /* 8 */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 4, 0, 0);  /* 9: loop test */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 3, 0, 0);       /* 10 */
+    bytecode_add_instruction(bc, OP_MOD, 4, 1, 3);              /* 11: division by zero */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 12 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 5, 7, 0);       /* 13: handler */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 14 */
+    bytecode_add_handler(bc, 4, 12, 13);
+
+    Profile* profile = record_profile(bc);
+    optimizer_optimize(bc, profile);
+    assert(bc->origins != NULL && "Block layout should run through a handler range.");
+    assert(bc->handler_count == 2 && "The range should be split around the moved cold block.");
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        size_t origin = bytecode_origin(bc, i);
+        bool covered = false;
+        for (size_t h = 0; h < bc->handler_count; h++) {
+            covered |= (size_t)bc->handlers[h].start <= i && i < (size_t)bc->handlers[h].end;
+        }
+        assert(covered == (origin >= 4 && origin < 12));
+    }
+    assert(bc->instructions[bc->handlers[0].handler].opcode == OP_LOAD_CONST);
+    assert(run_and_read(bc, 5) == 7);
+
+    profile_destroy(profile);
+    bytecode_destroy(bc);
+    printf("[test_layout_handlers] PASSED\n");
+}
+
+/* TEST 5: a hot call to a short straight-line function is inlined. */
+static void test_profile_inline(void) {
+    Bytecode* bc = bytecode_create();
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 100, 0);     /* 0 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 0, 0);       /* 1 */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 1, 0);       /* 2 */
+    bytecode_add_instruction(bc, OP_JUMP, 6, 0, 0);             /* 3 */
+    bytecode_add_instruction(bc, OP_CALL, 8, 0, 0);             /* 4 */
+    bytecode_add_instruction(bc, OP_SUB, 0, 0, 2);              /* 5 */
+    bytecode_add_instruction(bc, OP_JUMP_IF_NONZERO, 4, 0, 0);  /* 6 */
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);             /* 7 */
+    bytecode_add_instruction(bc, OP_ADD, 1, 1, 2);              /* 8: callee */
+    bytecode_add_instruction(bc, OP_RET, 0, 0, 0);              /* 9 */
+
+    Profile* profile = record_profile(bc);
+    optimizer_optimize(bc, profile);
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        assert(bc->instructions[i].opcode != OP_CALL && "Hot call should have been inlined.");
+        assert(bc->instructions[i].opcode != OP_RET && "Inlined callee should be dropped.");
+    }
+    assert(run_and_read(bc, 1) == 100);
+
+    profile_destroy(profile);
+    bytecode_destroy(bc);
+    printf("[test_profile_inline] PASSED\n");
+}
+
+/* TEST 7: copies at a register's last use become moves; live sources keep copying. */
+static Value identity_native(int arg_count, Value* args) {
+    return arg_count > 0 ? args[0] : VALUE_NULL;
+}
+
+static void test_last_use_moves(void) {
+    Bytecode* bc = bytecode_create();
+    int name = bytecode_add_constant_str(bc, "identity");
+    int text = bytecode_add_constant_str(bc, "payload");
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 0, 5, 0);
+    bytecode_add_instruction(bc, OP_MOVE, 1, 0, 0);                  /* r0 read below: copy */
+    bytecode_add_instruction(bc, OP_ADD, 2, 0, 1);
+    bytecode_add_instruction(bc, OP_MOVE, 3, 2, 0);                  /* r2 dead: move */
+    bytecode_add_instruction(bc, OP_LOAD_CONST_STR, 4, text, 0);
+    bytecode_add_instruction_ex(bc, OP_CALL_NATIVE, 5, name, 1, 4);  /* r4 dead: move */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 0, 0);
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 4, 0, 0);
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);
+
+    optimizer_mark_last_uses(bc);
+    assert(bc->instructions[1].opcode == OP_MOVE);
+    assert(bc->instructions[3].opcode == OP_MOVE_OWN);
+    assert((bc->instructions[5].operand3 & NATIVE_ARGC_MASK) == 1);
+    assert((bc->instructions[5].operand3 >> NATIVE_MOVE_SHIFT) == 1);
+
+    VM* vm = vm_create(bc);
+    vm_register_native(vm, "identity", identity_native);
+    vm_run(vm);
+    assert(vm_get_register_value(vm, 3).as.int_val == 10);
+    Value moved = vm_get_register_value(vm, 5);
+    assert(moved.type == VAL_STRING && moved.as.str_val == bc->constant_pool.strings[text]);
+    vm_destroy(vm);
+
+    bytecode_destroy(bc);
+    printf("[test_last_use_moves] PASSED\n");
+}
+
+// A list borrowed by a native that reallocates it stays valid in every register sharing it.
+static void test_borrowed_list_growth(void) {
+    Bytecode* bc = bytecode_create();
+    int range = bytecode_add_constant_str(bc, "range");
+    int append = bytecode_add_constant_str(bc, "append");
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 1, 0, 0);
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 2, 3, 0);
+    bytecode_add_instruction_ex(bc, OP_CALL_NATIVE, 0, range, 2, 1);   /* r0 = range(0, 3) */
+    bytecode_add_instruction(bc, OP_MOVE, 3, 0, 0);                     /* r3 shares it */
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 4, 0, 0);
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 5, 1, 0);
+    bytecode_add_instruction(bc, OP_LOAD_CONST, 6, 20, 0);
+    bytecode_add_instruction(bc, OP_MOVE, 8, 3, 0);                     /* PC=7 */
+    bytecode_add_instruction(bc, OP_MOVE, 9, 4, 0);
+    bytecode_add_instruction_ex(bc, OP_CALL_NATIVE, 10, append, 2, 8);  /* append(r3, r4) */
+    bytecode_add_instruction(bc, OP_ADD, 4, 4, 5);
+    bytecode_add_instruction(bc, OP_JUMP_IF_LT, 7, 4, 6);
+    bytecode_add_instruction(bc, OP_HALT, 0, 0, 0);
+    optimizer_mark_last_uses(bc);
+
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value list = vm_get_register_value(vm, 0);
+    assert(list.type == VAL_LIST && list.as.list_val->length == 23);
+    assert(vm_get_register_value(vm, 3).as.list_val == list.as.list_val);
+    assert(list.as.list_val->data[22].as.int_val == 19);
+    vm_destroy(vm);
+
+    bytecode_destroy(bc);
+    printf("[test_borrowed_list_growth] PASSED\n");
+}
+
+/* Helper: lex, parse, analyze and compile 'source'; the AST is returned in '*root'. */
+static Bytecode* compile_source(const char* source, AstNode** root) {
+    Lexer* lexer = lexer_create(source, strlen(source), lexer_default_config());
+    Token tokens[512];
+    size_t token_count = 0;
+    do {
+        tokens[token_count] = lexer_next_token(lexer);
+    } while (tokens[token_count++].type != TOKEN_EOF && token_count < 512);
+    Parser* parser = parser_create(tokens, token_count);
+    *root = parser_parse(parser);
+    parser_destroy(parser);
+
+    SemanticContext ctx;
+    semantic_init(&ctx);
+    semantic_analyze(*root, &ctx);
+    assert(ctx.error_count == 0 && "Semantic errors in test program.");
+    semantic_cleanup(&ctx);
+    Bytecode* bc = compiler_compile_ast(*root);
+    lexer_destroy(lexer);
+    return bc;
+}
+
+/* Helper: the number of semantic errors in 'source'. */
+static int semantic_errors(const char* source) {
+    Lexer* lexer = lexer_create(source, strlen(source), lexer_default_config());
+    Token tokens[512];
+    size_t token_count = 0;
+    do {
+        tokens[token_count] = lexer_next_token(lexer);
+    } while (tokens[token_count++].type != TOKEN_EOF && token_count < 512);
+    Parser* parser = parser_create(tokens, token_count);
+    AstNode* root = parser_parse(parser);
+    parser_destroy(parser);
+
+    SemanticContext ctx;
+    semantic_init(&ctx);
+    semantic_analyze(root, &ctx);
+    int errors = ctx.error_count;
+    semantic_cleanup(&ctx);
+    ast_destroy(root);
+    lexer_destroy(lexer);
+    return errors;
+}
+
+/* Helper: whether 'source' compiles when the semantic pass is skipped. */
+static bool compiles_unanalyzed(const char* source) {
+    Lexer* lexer = lexer_create(source, strlen(source), lexer_default_config());
+    Token tokens[64];
+    size_t token_count = 0;
+    do {
+        tokens[token_count] = lexer_next_token(lexer);
+    } while (tokens[token_count++].type != TOKEN_EOF && token_count < 64);
+    Parser* parser = parser_create(tokens, token_count);
+    AstNode* root = parser_parse(parser);
+    parser_destroy(parser);
+    Bytecode* bc = compiler_compile_ast(root);
+    bool compiled = bc != NULL;
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    lexer_destroy(lexer);
+    return compiled;
+}
+
+static size_t count_opcode(const Bytecode* bc, VMOpcode op) {
+    size_t n = 0;
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        if (bc->instructions[i].opcode == op) n++;
+    }
+    return n;
+}
+
+// A hot call to a function that only touches globals is inlined in a compiled program.
+static void test_inline_from_source(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var total = 0;\n"
+        "    func bump() {\n"
+        "        total = total + 2;\n"
+        "    }\n"
+        "    func main() {\n"
+        "        var i = 0;\n"
+        "        while (i < 100) {\n"
+        "            bump();\n"
+        "            i = i + 1;\n"
+        "        }\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    // bump() and main() are both called; only the call in the loop is hot.
+    assert(count_opcode(bc, OP_CALL) == 2);
+    Profile* profile = record_profile(bc);
+    optimizer_optimize(bc, profile);
+    assert(count_opcode(bc, OP_CALL) == 1 && "Hot call to bump() should have been inlined.");
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    assert(vm->top_level->locals[0].type == VAL_INT && vm->top_level->locals[0].as.int_val == 200);
+    vm_destroy(vm);
+    profile_destroy(profile);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_inline_from_source] PASSED\n");
+}
+
+/* TEST 8: the semantic pass binds identifiers; the compiler uses the bindings. */
+static AstNode* find_identifier(AstNode* node, const char* name);
+
+static void test_resolved_identifiers(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var total = 5;\n"
+        "    func bump(n) {\n"
+        "        var step = n;\n"
+        "        step += 1;\n"
+        "        total = total + step;\n"
+        "    }\n"
+        "    func main() {\n"
+        "        bump(2);\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+
+    AstNode* step = find_identifier(root, "step");
+    assert(step && step->as.ident.binding == IDENT_LOCAL);
+    assert(step->as.ident.depth == 0 && step->as.ident.slot == 1);
+    AstNode* total = find_identifier(root, "total");
+    assert(total && total->as.ident.binding == IDENT_GLOBAL && total->as.ident.slot == 0);
+    AstNode* bump = find_identifier(root, "bump");
+    assert(bump && bump->as.ident.binding == IDENT_FUNCTION);
+    assert(count_opcode(bc, OP_LOAD_GLOBAL) == 1 && count_opcode(bc, OP_STORE_GLOBAL) == 1);
+    assert(bc->top_level_slots == 1);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(vm->top_level->locals[0].type == VAL_INT && vm->top_level->locals[0].as.int_val == 8);
+    vm_destroy(vm);
+
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Without the semantic pass nothing is resolved, which fails the compilation.
+    assert(!compiles_unanalyzed("frame Other {\n    total + 1;\n}\n"));
+    assert(!compiles_unanalyzed("frame Other {\n    var x = 1;\n}\n"));
+    printf("[test_resolved_identifiers] PASSED\n");
+}
+
+/* TEST 9: relational and logical operators, with short-circuit branches. */
+static void test_conditions(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var odd = 0;\n"
+        "    var sum = 0;\n"
+        "    var done = false;\n"
+        "    func main() {\n"
+        "        var i = 0;\n"
+        "        while (i < 10 && !(sum > 100)) {\n"
+        "            if (i % 2 == 1 || false) {\n"
+        "                odd += 1;\n"
+        "            }\n"
+        "            sum = sum + (i ^ 1);\n"
+        "            i += 1;\n"
+        "        }\n"
+        "        done = i >= 10 && odd == 5;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(count_opcode(bc, OP_JUMP_IF_LT) == 1 && count_opcode(bc, OP_JUMP_IF_GT) == 1 &&
+           "Loop tests should use fused branches.");
+    assert(count_opcode(bc, OP_LT) == 0 && count_opcode(bc, OP_NOT) == 0);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 5);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 45);
+    assert(globals[2].type == VAL_BOOL && globals[2].as.bool_val);
+    vm_destroy(vm);
+
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_conditions] PASSED\n");
+}
+
+// Operand registers are reused, so long sums fit; nesting that cannot fit fails to compile.
+static void test_register_pressure(void) {
+    char source[2048];
+    char sum[512] = "";
+    char nested[512] = "";
+    int length = snprintf(source, sizeof(source), "frame Main {\n    var x = 0;\n    func main() {\n");
+    for (int i = 0; i < 20; i++) {
+        length += snprintf(source + length, sizeof(source) - (size_t)length, "        var v%d = %d;\n", i, i);
+        snprintf(sum + strlen(sum), sizeof(sum) - strlen(sum), "%sv%d", i ? " + " : "", i);
+    }
+    snprintf(source + length, sizeof(source) - (size_t)length, "        x = %s;\n    }\n}\n", sum);
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    for (size_t i = 0; i < bc->instruction_count; i++) {
+        assert(bc->instructions[i].opcode != OP_ADD || bc->instructions[i].operand1 < 16);
+    }
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    assert(vm->top_level->locals[0].type == VAL_INT && vm->top_level->locals[0].as.int_val == 190);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // v0 + (v1 + (v2 + ...)) keeps every left operand live at once.
+    for (int i = 0; i < 20; i++) {
+        snprintf(nested + strlen(nested), sizeof(nested) - strlen(nested), "%sv%d", i ? " + (" : "", i);
+    }
+    for (int i = 1; i < 20; i++) strcat(nested, ")");
+    snprintf(source + length, sizeof(source) - (size_t)length, "        x = %s;\n    }\n}\n", nested);
+    assert(compile_source(source, &root) == NULL);
+    ast_destroy(root);
+    printf("[test_register_pressure] PASSED\n");
+}
+
+/* TEST 10: switches compile to table or lookup dispatch. */
+static void test_switch_dispatch(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var dense = 0;\n"
+        "    var sparse = 0;\n"
+        "    var named = 0;\n"
+        "    func main() {\n"
+        "        var op = 0;\n"
+        "        while (op < 6) {\n"
+        "            switch (op) {\n"
+        "                case 0, 1: dense += 1;\n"
+        "                case 2: dense += 10;\n"
+        "                case 4: dense += 100;\n"
+        "                default: dense += 1000;\n"
+        "            }\n"
+        "            op += 1;\n"
+        "        }\n"
+        "        switch (-7000) {\n"
+        "            case 5: sparse = 1;\n"
+        "            case -7000: sparse = 2;\n"
+        "            case 90000: sparse = 3;\n"
+        "        }\n"
+        "        switch (\"beta\") {\n"
+        "            case \"alpha\": named = 1;\n"
+        "            case \"beta\", \"gamma\": named = 2;\n"
+        "            default: named = 3;\n"
+        "        }\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(count_opcode(bc, OP_TABLESWITCH) == 1 && count_opcode(bc, OP_LOOKUPSWITCH) == 2);
+    assert(bc->switch_tables[0].low == 0 && bc->switch_tables[0].count == 5);
+    assert(bc->switch_tables[0].entries[3].target == -1);
+    // Block layout moves the cases and remaps the tables rather than giving up.
+    optimizer_optimize(bc, NULL);
+    assert(bc->origins != NULL && bc->switch_tables[0].entries[3].target == -1);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 2 + 10 + 100 + 2000);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 2);
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 2);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Labels at the ends of the int64 range are too far apart for a table.
+    bc = compile_source("frame Main {\n"
+                        "    var low = 0;\n"
+                        "    var high = 0;\n"
+                        "    func pick(k) {\n"
+                        "        switch (k) {\n"
+                        "            case -9000000000000000000: return 1;\n"
+                        "            case 0: return 2;\n"
+                        "            case 9000000000000000000: return 3;\n"
+                        "            default: return 4;\n"
+                        "        }\n"
+                        "    }\n"
+                        "    func main() {\n"
+                        "        var big = 1000000000 * 1000000000 * 9;\n"
+                        "        low = pick(0 - big);\n"
+                        "        high = pick(big) * 10 + pick(big - 1);\n"
+                        "        return 0;\n"
+                        "    }\n"
+                        "}\n", &root);
+    assert(bc && count_opcode(bc, OP_TABLESWITCH) == 0 && count_opcode(bc, OP_LOOKUPSWITCH) == 1);
+    optimizer_optimize(bc, NULL);
+    vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 1);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 34);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_switch_dispatch] PASSED\n");
+}
+
+/* TEST 11: try/catch, on_error and retry go through the handler table. */
+static void test_error_handlers(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var caught = 0;\n"
+        "    var attempts = 0;\n"
+        "    var unwound = 0;\n"
+        "    var guarded = 0;\n"
+        "    func fail(d) {\n"
+        "        var q = 1 % d;\n"
+        "        unwound = 100;\n"
+        "    }\n"
+        "    func main() {\n"
+        "        var zero = 0;\n"
+        "        try {\n"
+        "            var x = 1 % zero;\n"
+        "            caught = 100;\n"
+        "        } catch {\n"
+        "            caught += 1;\n"
+        "        }\n"
+        "        try {\n"
+        "            attempts += 1;\n"
+        "            var y = 10 % zero;\n"
+        "        } catch {\n"
+        "            if (attempts < 3) {\n"
+        "                retry;\n"
+        "            }\n"
+        "        }\n"
+        "        try {\n"
+        "            fail(zero);\n"
+        "        } catch {\n"
+        "            unwound += 7;\n"
+        "        }\n"
+        "        {\n"
+        "            on_error {\n"
+        "                guarded += 1;\n"
+        "            }\n"
+        "            guarded += 10;\n"
+        "            var z = 5 % zero;\n"
+        "            guarded = 100;\n"
+        "        }\n"
+        "        guarded += 1000;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc->handler_count == 4);
+    // Block layout moves guarded code and splits the handler ranges to follow it.
+    optimizer_optimize(bc, NULL);
+    assert(bc->origins != NULL && bc->handler_count >= 4);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    assert(vm->call_stack_top == 0);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 1);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 3);
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 7);
+    assert(globals[3].type == VAL_INT && globals[3].as.int_val == 1011);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Without a handler the error still stops the program.
+    bc = compile_source("frame Main {\n    func main() {\n        var z = 0;\n        var q = 1 % z;\n    }\n}\n", &root);
+    vm = vm_create(bc);
+    vm_run(vm);
+    assert(vm->faulted && strstr(vm->error_message, "Division by zero") != NULL);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_error_handlers] PASSED\n");
+}
+
+static void test_string_interpolation(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var msg = \"\";\n"
+        "    var digits = \"\";\n"
+        "    func main() {\n"
+        "        var n = 42;\n"
+        "        var m = 0 - 7;\n"
+        "        msg = \"n=${n} m=${m} ok=${n > 1} ${\"x\"}!\";\n"
+        "        digits = \"${n}${n}${n}${n}${n}${n}${n}${n}${n}${n}\";\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    // Both strings have more parts than one join takes, so each needs two.
+    assert(count_opcode(bc, OP_CONCAT_N) == 4);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_STRING && strcmp(globals[0].as.str_val, "n=42 m=-7 ok=true x!") == 0);
+    assert(globals[1].type == VAL_STRING &&
+           strcmp(globals[1].as.str_val, "42424242424242424242") == 0);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_string_interpolation] PASSED\n");
+}
+
+static void test_regex_natives(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var ok = false;\n"
+        "    var first = \"\";\n"
+        "    var count = 0;\n"
+        "    var fixed = \"\";\n"
+        "    var ratio = 0;\n"
+        "    func main() {\n"
+        "        var line = \"2024-01-05 ERROR disk=91 net=7\";\n"
+        "        ok = match(line, /\\d{4}-\\d\\d-\\d\\d [A-Z]+ .*/);\n"
+        "        first = search(line, /[A-Z]+/);\n"
+        "        count = len(find_all(line, /\\d+/));\n"
+        "        fixed = replace_re(line, /=\\d+/, \"=?\");\n"
+        "        var total = 12;\n"
+        "        var parts = 3;\n"
+        "        ratio = total / parts / 2;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(count_opcode(bc, OP_DIV) == 2);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_register_native(vm, "match", osfl_match);
+    vm_register_native(vm, "search", osfl_search);
+    vm_register_native(vm, "find_all", osfl_find_all);
+    vm_register_native(vm, "replace_re", osfl_replace_re);
+    vm_register_native(vm, "len", osfl_len);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_BOOL && globals[0].as.bool_val);
+    assert(globals[1].type == VAL_STRING && strcmp(globals[1].as.str_val, "ERROR") == 0);
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 5);
+    assert(globals[3].type == VAL_STRING &&
+           strcmp(globals[3].as.str_val, "2024-01-05 ERROR disk=? net=?") == 0);
+    assert(globals[4].type == VAL_INT && globals[4].as.int_val == 2);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // The engine itself: errors, laziness, and no backtracking blowup.
+    char error[64];
+    assert(regex_compile("a(b", error, sizeof(error)) == NULL && strstr(error, ")") != NULL);
+    assert(regex_compile("x{3,1}", error, sizeof(error)) == NULL);
+    size_t start, end;
+    Regex* re = regex_compile("a.*?b", NULL, 0);
+    assert(regex_search(re, "xxaXbYb", 7, 0, &start, &end) && start == 2 && end == 5);
+    regex_free(re);
+    re = regex_compile("^(ab|a)(c|bcd)$", NULL, 0);
+    assert(regex_match(re, "abcd", 4) && regex_match(re, "abc", 3) && !regex_match(re, "abcdd", 5));
+    regex_free(re);
+    static char text[20001];
+    memset(text, 'a', 20000);
+    re = regex_compile("(a*)*b", NULL, 0);
+    assert(!regex_search(re, text, 20000, 0, &start, &end));
+    regex_free(re);
+    assert(regex_cached("\\d+", NULL, 0) == regex_cached("\\d+", NULL, 0));
+    regex_cache_clear();
+    printf("[test_regex_natives] PASSED\n");
+}
+
+static void write_file(const char* path, const char* text) {
+    FILE* fp = fopen(path, "wb");
+    assert(fp);
+    fputs(text, fp);
+    fclose(fp);
+}
+
+/* Imported modules are compiled once, linked lazily and resolved by name. */
+static void test_modules(void) {
+    const char* lib_path = "osfl_test_mathlib.osfl";
+    write_file(lib_path,
+        "var scale = 3;\n"
+        "var total = 0;\n"
+        "func add_scaled(x) {\n"
+        "    total = total + x * scale;\n"
+        "}\n"
+        "func accumulate(x) {\n"
+        "    add_scaled(x);\n"
+        "    add_scaled(1);\n"
+        "}\n");
+    const char* source =
+        "import \"osfl_test_mathlib.osfl\";\n"
+        "import \"osfl_test_missing.osfl\";\n"
+        "frame Main {\n"
+        "    var before = 7;\n"
+        "    func main() {\n"
+        "        osfl_test_mathlib.accumulate(4);\n"
+        "        osfl_test_mathlib.accumulate(5);\n"
+        "    }\n"
+        "}\n";
+
+    // The missing module is never called, so it is never loaded.
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc && "Unused imports must not be loaded.");
+    Module* lib = module_load(lib_path);
+    assert(lib && lib->export_count == 2);
+    const Bytecode* lib_code = lib->code;
+    assert(bc->top_level_slots == 1 + lib_code->top_level_slots);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 7);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 3);   /* initializer ran */
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 33);  /* (4*3 + 3) + (5*3 + 3) */
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // A second importer reuses the compiled module.
+    bc = compile_source(source, &root);
+    assert(bc && module_load(lib_path) == lib && lib->code == lib_code);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Editing the file recompiles it; calls are checked against its functions.
+    write_file(lib_path, "func accumulate_all(x) {\n}\n");
+    bc = compile_source(source, &root);
+    assert(bc == NULL && "Call to a function the module no longer has.");
+    assert(module_load(lib_path)->export_count == 1);
+    ast_destroy(root);
+
+    module_cache_clear();
+    remove(lib_path);
+    printf("[test_modules] PASSED\n");
+}
+
+// Classes: shaped objects, constructors, field initializers and overridden methods.
+static void test_classes(void) {
+    const char* source =
+        "class Counter {\n"
+        "    var count = 10;\n"
+        "    var step;\n"
+        "    func init(step) { this.step = step; }\n"
+        "    func bump() { this.count += this.step; }\n"
+        "}\n"
+        "class Double : Counter {\n"
+        "    var bumps = 0;\n"
+        "    func bump() { this.count += this.step * 2; this.bumps += 1; }\n"
+        "}\n"
+        "frame Main {\n"
+        "    var a = 0;\n"
+        "    var b = 0;\n"
+        "    var c = 0;\n"
+        "    func main() {\n"
+        "        var plain = Counter(3);\n"
+        "        var twice = Double();\n"
+        "        twice.step = 5;\n"
+        "        var objects = 0;\n"
+        "        while (objects < 2) {\n"
+        "            plain.bump();\n"
+        "            twice.bump();\n"
+        "            objects += 1;\n"
+        "        }\n"
+        "        a = plain.count;\n"
+        "        b = twice.count;\n"
+        "        c = twice.bumps;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc && bc->class_count == 2);
+    const ClassInfo* counter = &bc->classes[0];
+    const ClassInfo* twice = &bc->classes[1];
+    assert(counter->field_count == 2 && twice->field_count == 3);
+    assert(twice->fields[0] == counter->fields[0] && twice->fields[1] == counter->fields[1]);
+    // Double gets a constructor of its own and overrides bump in Counter's slot.
+    assert(counter->method_count == 2 && twice->method_count == 2);
+    for (size_t m = 0; m < 2; m++) {
+        assert(strcmp(bc->constant_pool.strings[counter->methods[m].name],
+                      bc->constant_pool.strings[twice->methods[m].name]) == 0);
+        assert(counter->methods[m].address != twice->methods[m].address);
+    }
+    assert(count_opcode(bc, OP_NEWCLASS) == 2);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 16);  /* 10 + 3 + 3 */
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 30);  /* 10 + 10 + 10 */
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 2);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // A method's result can be used in an expression, and nested calls see their own.
+    bc = compile_source("class P {\n"
+                        "    var x = 4;\n"
+                        "    func get() { var a = 1; var b = 2; return this.x + a + b; }\n"
+                        "    func twice() { return this.get() * 2; }\n"
+                        "}\n"
+                        "frame Main {\n"
+                        "    var v = 0;\n"
+                        "    var w = 0;\n"
+                        "    func main() {\n"
+                        "        var q = 100;\n"
+                        "        var p = P();\n"
+                        "        v = q + p.get();\n"
+                        "        w = p.twice() - p.get() + q;\n"
+                        "        return 0;\n"
+                        "    }\n"
+                        "}\n", &root);
+    assert(bc);
+    optimizer_optimize(bc, NULL);
+    vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 107);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 107);  /* 14 - 7 + 100 */
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Fields a class does not declare are a runtime error.
+    bc = compile_source("class P { var x = 1; }\n"
+                        "frame Main { func main() { var p = P(); p.y = 2; } }\n", &root);
+    assert(bc);
+    vm = vm_create(bc);
+    vm_run(vm);
+    assert(vm->faulted);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_classes] PASSED\n");
+}
+
+// Objects that never leave their function are not allocated: their fields become frame slots.
+static void test_scalar_replacement(void) {
+    const char* source =
+        "class Point {\n"
+        "    var x;\n"
+        "    var y;\n"
+        "    var tag = 7;\n"
+        "    func init(x, y) { this.x = x; this.y = y; }\n"
+        "}\n"
+        "class Box : Point {\n"
+        "    var z;\n"
+        "    func init(a, b) { this.x = a; this.y = b; this.z = a; }\n"
+        "}\n"
+        "frame Main {\n"
+        "    var sum = 0;\n"
+        "    var boxed = 0;\n"
+        "    var escaped = 0;\n"
+        "    func show(q) { return q.x + q.y + q.tag; }\n"
+        "    func main() {\n"
+        "        var i = 0;\n"
+        "        while (i < 10) {\n"
+        "            var p = Point(i, i * 2);\n"
+        "            p.x += p.tag;\n"
+        "            sum = sum + p.x + p.y;\n"
+        "            i += 1;\n"
+        "        }\n"
+        "        var b = Box(3, 4);\n"
+        "        b.z *= 10;\n"
+        "        boxed = b.x + b.y + b.z + b.tag;\n"
+        "        var e = Point(5, 6);\n"
+        "        escaped = show(e);\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    // Only 'e', which is passed to show(), is still constructed; the field
+    // accesses left are those of show() and of the constructors.
+    assert(count_opcode(bc, OP_NEWCLASS) == 1);
+    assert(count_opcode(bc, OP_GETFIELD) == 3 && count_opcode(bc, OP_SETFIELD) == 7);
+    optimizer_optimize(bc, NULL);
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 205);  /* sum of 3i + 7 */
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 44);   /* 3 + 4 + 30 + 7 */
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 18);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // A field with no value to start from keeps the object, which starts it at null.
+    bc = compile_source("class R { var x; var y = 1; }\n"
+                        "frame Main { func main() { var r = R(); r.x = 2; return 0; } }\n", &root);
+    assert(bc && count_opcode(bc, OP_NEWCLASS) == 1);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_scalar_replacement] PASSED\n");
+}
+
+// Closures capture variables by value, boxing only those reassigned after capture.
+static void test_closures(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var a = 0;\n"
+        "    var b = 0;\n"
+        "    var c = 0;\n"
+        "    var d = 0;\n"
+        "    var e = 0;\n"
+        "    func apply(f, x) { f(x); }\n"
+        "    func record(x) { e = x; }\n"
+        "    func main() {\n"
+        "        var count = 0;\n"
+        "        func bump(n) { count += n; }\n"
+        "        bump(2);\n"
+        "        bump(3);\n"
+        "        a = count;\n"
+        "        var base = 7;\n"
+        "        var show = func (x) { b = base + x; };\n"
+        "        apply(show, 1);\n"
+        "        func fact(n, acc) {\n"
+        "            if (n <= 1) { c = acc; } else { fact(n - 1, acc * n); }\n"
+        "        }\n"
+        "        fact(5, 1);\n"
+        "        func outer() {\n"
+        "            func inner() { count += 10; }\n"
+        "            inner();\n"
+        "        }\n"
+        "        outer();\n"
+        "        d = count;\n"
+        "        var sink = record;\n"
+        "        sink(4);\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    // bump, the function expression, fact, outer and inner, then record as a value.
+    assert(bc->closure_count == 6);
+    // Only 'count' and the self-recursive 'fact' need a box; 'base' is copied.
+    assert(count_opcode(bc, OP_BOX) == 2);
+    assert(count_opcode(bc, OP_CALL_INDIRECT) == 8);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 5);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 8);
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 120);
+    assert(globals[3].type == VAL_INT && globals[3].as.int_val == 15);
+    assert(globals[4].type == VAL_INT && globals[4].as.int_val == 4);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_closures] PASSED\n");
+}
+
+// Calls hand back what the callee returns, and the caller's temporaries survive them.
+static void test_return_values(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var a = 0;\n"
+        "    var b = 0;\n"
+        "    var c = 0;\n"
+        "    var d = 0;\n"
+        "    func make_adder(k) {\n"
+        "        return func (x) { return x + k; };\n"
+        "    }\n"
+        "    func fact(n) {\n"
+        "        if (n <= 1) { return 1; }\n"
+        "        return n * fact(n - 1);\n"
+        "    }\n"
+        "    func main() {\n"
+        "        var k = 10;\n"
+        "        var add = func (x) { return x + k; };\n"
+        "        a = add(1);\n"
+        "        var add5 = make_adder(5);\n"
+        "        b = 100 + add5(2) * add(3);\n"
+        "        c = fact(5) + fact(3);\n"
+        "        d = make_adder(1)(41);\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 11);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 191);
+    assert(globals[2].type == VAL_INT && globals[2].as.int_val == 126);
+    assert(globals[3].type == VAL_INT && globals[3].as.int_val == 42);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_return_values] PASSED\n");
+}
+
+// Pure natives of constant arguments fold to constants; arity is checked up front.
+static void test_native_descriptors(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var a = 0;\n"
+        "    var b = 0;\n"
+        "    var c = 0;\n"
+        "    var d = 0;\n"
+        "    var e = 0;\n"
+        "    func main() {\n"
+        "        a = sqrt(16);\n"
+        "        b = abs(-7);\n"
+        "        c = pow(2, 10);\n"
+        "        e = sqrt(abs(-2.25));\n"
+        "        var x = 9;\n"
+        "        d = sqrt(x);\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    // Only sqrt(x) is left to run, on the unboxed fast path.
+    assert(count_opcode(bc, OP_CALL_NATIVE) == 1);
+    optimizer_optimize(bc, NULL);
+
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_FLOAT && globals[0].as.float_val == 4.0);
+    assert(globals[1].type == VAL_INT && globals[1].as.int_val == 7);
+    assert(globals[2].type == VAL_FLOAT && globals[2].as.float_val == 1024.0);
+    assert(globals[3].type == VAL_FLOAT && globals[3].as.float_val == 3.0);
+    assert(globals[4].type == VAL_FLOAT && globals[4].as.float_val == 1.5);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    // Logical arguments, whose result register comes before their operands', reach the native.
+    bc = compile_source("frame Main {\n"
+                        "    var a = 0;\n"
+                        "    var b = 0;\n"
+                        "    var c = 0;\n"
+                        "    func main() {\n"
+                        "        var x = false;\n"
+                        "        var y = true;\n"
+                        "        var n = 3;\n"
+                        "        a = str(x || y);\n"
+                        "        b = str(n > 1 && n < 5);\n"
+                        "        c = str(!(n > 1) || n == 3);\n"
+                        "    }\n"
+                        "}\n", &root);
+    assert(bc);
+    optimizer_optimize(bc, NULL);
+    vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_STRING && strcmp(globals[0].as.str_val, "true") == 0);
+    assert(globals[1].type == VAL_STRING && strcmp(globals[1].as.str_val, "true") == 0);
+    assert(globals[2].type == VAL_STRING && strcmp(globals[2].as.str_val, "true") == 0);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    assert(semantic_errors("frame Main { func main() { print(sqrt(1, 2)); } }\n") == 1);
+    assert(semantic_errors("frame Main { func main() { var r = range(); } }\n") == 1);
+    assert(semantic_errors("frame Main { func main() { var s = sqrt(\"four\"); } }\n") == 1);
+    assert(semantic_errors("frame Main { func main() { var s = substring(\"four\", 1, 2); } }\n") == 0);
+    printf("[test_native_descriptors] PASSED\n");
+}
+
+// A list grown by a native is seen grown through every variable holding it.
+static void test_list_aliases(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var counted = 0;\n"
+        "    var words = 0;\n"
+        "    var alias = 0;\n"
+        "    func main() {\n"
+        "        var xs = range(0, 3);\n"
+        "        var ys = xs;\n"
+        "        var i = 0;\n"
+        "        while (i < 40) {\n"
+        "            append(xs, i);\n"
+        "            i = i + 1;\n"
+        "        }\n"
+        "        counted = len(ys);\n"
+        "        var parts = split(\"a b c d e f g h\", \" \");\n"
+        "        append(parts, \"i\");\n"
+        "        append(parts, \"j\");\n"
+        "        words = parts;\n"
+        "        alias = xs;\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_INT && globals[0].as.int_val == 43);
+    assert(globals[1].type == VAL_LIST && globals[1].as.list_val->length == 10);
+    assert(strcmp(globals[1].as.list_val->data[9].as.str_val, "j") == 0);
+    assert(globals[2].type == VAL_LIST && globals[2].as.list_val->length == 43);
+    assert(globals[2].as.list_val->data[42].as.int_val == 39);
+    /* Counted exactly: once for the global and once per register still holding the list. */
+    for (int g = 1; g <= 2; g++) {
+        int holders = 1;
+        for (int r = 0; r < 16; r++) {
+            if (vm->registers[r].type == VAL_LIST && vm->registers[r].as.list_val == globals[g].as.list_val) holders++;
+        }
+        assert(vm_value_refcount(vm, globals[g]) == holders);
+    }
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+    printf("[test_list_aliases] PASSED\n");
+}
+
+// map_native applies a one-argument native to a whole list: by batch, fast path or plain call.
+static void test_map_native(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var lengths = 0;\n"
+        "    var roots = 0;\n"
+        "    var sizes = 0;\n"
+        "    var upper = 0;\n"
+        "    func main() {\n"
+        "        var words = split(\"a bb ccc\", \" \");\n"
+        "        var numbers = range(1, 5);\n"
+        "        lengths = map_native(\"len\", words);\n"
+        "        roots = map_native(\"sqrt\", numbers);\n"
+        "        sizes = map_native(\"abs\", numbers);\n"
+        "        upper = map_native(\"to_upper\", words);\n"
+        "    }\n"
+        "}\n";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    Value* globals = vm->top_level->locals;
+    for (int g = 0; g < 4; g++) {
+        assert(globals[g].type == VAL_LIST);
+    }
+    assert(globals[0].as.list_val->length == 3);
+    for (int i = 0; i < 3; i++) {
+        assert(globals[0].as.list_val->data[i].type == VAL_INT && globals[0].as.list_val->data[i].as.int_val == i + 1);
+    }
+    assert(globals[1].as.list_val->length == 4);
+    assert(globals[1].as.list_val->data[3].type == VAL_FLOAT && globals[1].as.list_val->data[3].as.float_val == 2.0);
+    assert(globals[2].as.list_val->data[2].type == VAL_INT && globals[2].as.list_val->data[2].as.int_val == 3);
+    assert(strcmp(globals[3].as.list_val->data[2].as.str_val, "CCC") == 0);
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    Value words[2] = { { .type = VAL_STRING, .as.str_val = "x" }, { .type = VAL_INT, .as.int_val = -4 } };
+    ValueList list = { words, 2, 2 };
+    Value args[2] = { { .type = VAL_STRING, .as.str_val = "pow" }, { .type = VAL_LIST, .as.list_val = &list } };
+    assert(osfl_map_native(2, args).type == VAL_NULL);
+    args[0].as.str_val = "pop";  /* changes the list it is given */
+    assert(osfl_map_native(2, args).type == VAL_NULL && list.length == 2);
+
+    assert(semantic_errors("frame Main { func main() { var l = map_native(\"len\", range(2)); } }\n") == 0);
+    assert(semantic_errors("frame Main { func main() { var l = map_native(\"pow\", range(2)); } }\n") == 1);
+    assert(semantic_errors("frame Main { func main() { var l = map_native(\"nothing\", range(2)); } }\n") == 1);
+    assert(semantic_errors("frame Main { func main() { var l = map_native(\"pop\", range(2)); } }\n") == 1);
+    printf("[test_map_native] PASSED\n");
+}
+
+// Importing a shared library loads it as a plugin; one that cannot be loaded is an import error.
+static void test_plugin_imports(void) {
+    char error[256] = "";
+    assert(plugin_is_library("ext/hash.so") && plugin_is_library("hash.dll") && plugin_is_library("hash.dylib"));
+    assert(!plugin_is_library("lib/util.osfl") && !plugin_is_library(".so"));
+    assert(!plugin_load("/nonexistent/osfl_plugin.so", error, sizeof(error)));
+    assert(strstr(error, "/nonexistent/osfl_plugin.so") != NULL);
+    assert(plugin_native_count() == 0 && plugin_find_native("sqrt") == NULL);
+    assert(osfl_find_native("sqrt") != NULL);
+
+    // The import binds no module name, and the failed load is not a semantic error.
+    assert(semantic_errors("import \"missing_plugin.so\";\nframe Main { func main() { return 0; } }\n") == 0);
+    plugin_unload_all();
+    printf("[test_plugin_imports] PASSED\n");
+}
+
+// A script importing a missing plugin fails through the CLI path with a file error, not a crash.
+static void test_missing_plugin_run(void) {
+    const char* path = "/tmp/osfl_test_missing_plugin.osfl";
+    FILE* fp = fopen(path, "w");
+    assert(fp);
+    fputs("import \"missing_plugin.so\";\n"
+          "frame Main {\n"
+          "    func main() {\n"
+          "        return 0;\n"
+          "    }\n"
+          "}\n", fp);
+    fclose(fp);
+    OSFLConfig config = osfl_default_config();
+    config.input_file = path;
+    assert(osfl_init(&config) == OSFL_SUCCESS);
+    assert(osfl_run_file(path) == OSFL_ERROR_FILE_IO);
+    assert(osfl_get_last_error()->code == OSFL_ERROR_FILE_IO);
+    osfl_cleanup();
+    remove(path);
+    printf("[test_missing_plugin_run] PASSED\n");
+}
+
+// A run stopped by an error nothing caught fails with that error; a caught one succeeds.
+static void test_faulted_run(void) {
+    const char* faulting =
+        "frame Main {\n"
+        "    func main() {\n"
+        "        var zero = 0;\n"
+        "        var x = 1 / zero;\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    const char* caught =
+        "frame Main {\n"
+        "    func main() {\n"
+        "        var zero = 0;\n"
+        "        try { var x = 1 / zero; } catch { zero = 1; }\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    OSFLConfig config = osfl_default_config();
+    assert(osfl_init(&config) == OSFL_SUCCESS);
+    assert(osfl_run_string(faulting, strlen(faulting)) == OSFL_ERROR_RUNTIME);
+    assert(osfl_get_last_error()->code == OSFL_ERROR_RUNTIME);
+    assert(strcmp(osfl_get_last_error()->message, "Division by zero!") == 0);
+    assert(osfl_run_string(caught, strlen(caught)) == OSFL_SUCCESS);
+    osfl_cleanup();
+    printf("[test_faulted_run] PASSED\n");
+}
+
+// A snapshot taken before main() restores globals, aliasing and objects; main() then runs as usual.
+static void test_snapshot(void) {
+    const char* source =
+        "class Counter {\n"
+        "    var count = 10;\n"
+        "    func bump(n) { this.count += n; }\n"
+        "}\n"
+        "frame Main {\n"
+        "    var words = split(\"a bb ccc\", \" \");\n"
+        "    var alias = words;\n"
+        "    var counter = Counter();\n"
+        "    var ratio = 2.5;\n"
+        "    var total = 0;\n"
+        "    func main() {\n"
+        "        counter.bump(len(alias));\n"
+        "        total = counter.count + len(words);\n"
+        "    }\n"
+        "}\n";
+    const char* path = "/tmp/osfl_test_snapshot.snap";
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc && bc->main_address >= 0);
+    optimizer_optimize(bc, NULL);
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm->pause_before_main = true;
+    vm_run(vm);
+    assert(!vm->faulted && vm_paused_at_main(vm));
+    assert(vm->top_level->locals[4].as.int_val == 0);
+    assert(vm_snapshot(vm, path));
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+
+    vm = vm_restore(path);
+    assert(vm && vm_paused_at_main(vm));
+    bc = vm->bytecode;
+    Value* globals = vm->top_level->locals;
+    assert(globals[0].type == VAL_LIST && globals[0].as.list_val->length == 3);
+    assert(globals[1].as.list_val == globals[0].as.list_val);
+    assert(strcmp(globals[0].as.list_val->data[2].as.str_val, "ccc") == 0);
+    assert(globals[3].type == VAL_FLOAT && globals[3].as.float_val == 2.5);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    vm_run(vm);
+    assert(!vm->faulted);
+    assert(globals[4].type == VAL_INT && globals[4].as.int_val == 16);  /* 10 + 3 + 3 */
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    remove(path);
+
+    assert(vm_restore("/nonexistent/osfl.snap") == NULL);
+    printf("[test_snapshot] PASSED\n");
+}
+
+// Each job forks a worker from the initialized VM; the worker runs main() with job() returning the job.
+static void test_serve_jobs(void) {
+#ifndef _WIN32
+    const char* source =
+        "frame Main {\n"
+        "    var greeting = split(\"served by a worker\", \" \");\n"
+        "    func main() {\n"
+        "        var path = job();\n"
+        "        var text = join(greeting, \"-\");\n"
+        "        var out = open(path, \"w\");\n"
+        "        write(out, text);\n"
+        "        close(out);\n"
+        "    }\n"
+        "}\n";
+    const char* outputs[2] = { "/tmp/osfl_test_serve_1.txt", "/tmp/osfl_test_serve_2.txt" };
+    AstNode* root = NULL;
+    Bytecode* bc = compile_source(source, &root);
+    assert(bc);
+    VM* vm = vm_create(bc);
+    for (size_t i = 0; i < osfl_native_count; i++) {
+        vm_register_native_desc(vm, &osfl_natives[i]);
+    }
+    char error[128] = "";
+    FILE* jobs = tmpfile();
+    assert(jobs);
+    fprintf(jobs, "%s\n\n%s\n", outputs[0], outputs[1]);
+    rewind(jobs);
+    // Not paused before main(): there is nothing to fork from.
+    assert(!serve_jobs(vm, jobs, error, sizeof(error)) && error[0] != '\0');
+    vm->pause_before_main = true;
+    vm_run(vm);
+    assert(serve_jobs(vm, jobs, error, sizeof(error)));
+    fclose(jobs);
+    // The server itself stays paused before main().
+    assert(vm_paused_at_main(vm));
+    for (int i = 0; i < 2; i++) {
+        char text[64] = "";
+        FILE* out = fopen(outputs[i], "r");
+        assert(out);
+        assert(fgets(text, sizeof(text), out));
+        fclose(out);
+        assert(strcmp(text, "served-by-a-worker") == 0);
+        remove(outputs[i]);
+    }
+    vm_destroy(vm);
+    bytecode_destroy(bc);
+    ast_destroy(root);
+#endif
+    printf("[test_serve_jobs] PASSED\n");
+}
+
+// Replaying a log of external native calls reproduces the recorded run without touching files.
+static void test_native_replay(void) {
+    const char* source =
+        "frame Main {\n"
+        "    var text = 0;\n"
+        "    var stamp = 0;\n"
+        "    var words = 0;\n"
+        "    func main() {\n"
+        "        var out = open(\"/tmp/osfl_test_replay.txt\", \"w\");\n"
+        "        write(out, \"recorded run\");\n"
+        "        close(out);\n"
+        "        var input = open(\"/tmp/osfl_test_replay.txt\", \"r\");\n"
+        "        text = read(input);\n"
+        "        close(input);\n"
+        "        stamp = time();\n"
+        "        words = split(text, \" \");\n"
+        "    }\n"
+        "}\n";
+    const char* log = "/tmp/osfl_test_replay.log";
+    double stamp = 0.0;
+    for (int pass = 0; pass < 2; pass++) {
+        AstNode* root = NULL;
+        Bytecode* bc = compile_source(source, &root);
+        assert(bc);
+        uint64_t fingerprint = bytecode_fingerprint(bc);
+        optimizer_optimize(bc, NULL);
+        VM* vm = vm_create(bc);
+        for (size_t i = 0; i < osfl_native_count; i++) {
+            vm_register_native_desc(vm, &osfl_natives[i]);
+        }
+        Replay* replay = pass == 0 ? replay_record(log, fingerprint) : replay_open(log, fingerprint);
+        assert(replay);
+        vm->replay = replay;
+        vm_run(vm);
+        assert(!vm->faulted);
+        // open, write, close, open, read, close and time; split is not external.
+        assert(replay->calls == 7);
+        replay_close(replay);
+        Value* globals = vm->top_level->locals;
+        assert(globals[0].type == VAL_STRING && strcmp(globals[0].as.str_val, "recorded run") == 0);
+        assert(globals[1].type == VAL_FLOAT);
+        if (pass == 0) {
+            stamp = globals[1].as.float_val;
+            assert(remove("/tmp/osfl_test_replay.txt") == 0);
+        } else {
+            assert(globals[1].as.float_val == stamp);
+            FILE* fp = fopen("/tmp/osfl_test_replay.txt", "r");
+            assert(!fp && "Replay must not write files.");
+        }
+        assert(globals[2].type == VAL_LIST && globals[2].as.list_val->length == 2);
+        vm_destroy(vm);
+        bytecode_destroy(bc);
+        ast_destroy(root);
+    }
+    assert(replay_open(log, 0) == NULL);
+    remove(log);
+
+    /* map_native would bypass the log, so it takes no external native, batch or not. */
+    NativeDescriptor tick = *osfl_find_native("to_upper");
+    tick.flags |= NATIVE_EXTERNAL;
+    assert(tick.batch && !NATIVE_MAPPABLE(&tick));
+    assert(!NATIVE_MAPPABLE(osfl_find_native("print")) && !NATIVE_MAPPABLE(osfl_find_native("close")));
+    assert(semantic_errors("frame Main { func main() { var l = map_native(\"print\", range(2)); } }\n") == 1);
+    printf("[test_native_replay] PASSED\n");
+}
+
+// Call expressions carry the callee's location, so call errors name a real line.
+static void test_call_location(void) {
+    const char* source =
+        "frame Main {\n"
+        "    func main() {\n"
+        "        var a = sqrt(1, 2);\n"
+        "        return 0;\n"
+        "    }\n"
+        "}\n";
+    Lexer* lexer = lexer_create(source, strlen(source), lexer_default_config());
+    Token tokens[64];
+    size_t token_count = 0;
+    do {
+        tokens[token_count] = lexer_next_token(lexer);
+    } while (tokens[token_count++].type != TOKEN_EOF && token_count < 64);
+    Parser* parser = parser_create(tokens, token_count);
+    AstNode* root = parser_parse(parser);
+    parser_destroy(parser);
+
+    AstNode* frame = root->as.block.statements[0];
+    AstNode* func = frame->as.frame_decl.body_statements[0];
+    AstNode* decl = func->as.func_decl.body->as.block.statements[0];
+    AstNode* call = decl->as.var_decl.initializer;
+    assert(call->type == AST_EXPR_CALL);
+    assert(call->loc.file != NULL && call->loc.line == 3);
+    ast_destroy(root);
+    lexer_destroy(lexer);
+    assert(semantic_errors(source) == 1);
+    printf("[test_call_location] PASSED\n");
+}
+
+/* Depth-first search for the first identifier expression named 'name'. */
+static AstNode* find_identifier(AstNode* node, const char* name) {
+    if (!node) return NULL;
+    AstNode* found = NULL;
+    switch (node->type) {
+        case AST_EXPR_IDENTIFIER:
+            return strcmp(node->as.ident.name, name) == 0 ? node : NULL;
+        case AST_NODE_FRAME:
+            for (size_t i = 0; !found && i < node->as.frame_decl.body_count; i++) {
+                found = find_identifier(node->as.frame_decl.body_statements[i], name);
+            }
+            break;
+        case AST_NODE_BLOCK:
+            for (size_t i = 0; !found && i < node->as.block.statement_count; i++) {
+                found = find_identifier(node->as.block.statements[i], name);
+            }
+            break;
+        case AST_NODE_FUNC_DECL:
+            found = find_identifier(node->as.func_decl.body, name);
+            break;
+        case AST_NODE_VAR_DECL:
+            found = find_identifier(node->as.var_decl.initializer, name);
+            break;
+        case AST_NODE_EXPR_STMT:
+            found = find_identifier(node->as.unary.expr, name);
+            break;
+        case AST_EXPR_BINARY:
+            found = find_identifier(node->as.binary.left, name);
+            if (!found) found = find_identifier(node->as.binary.right, name);
+            break;
+        case AST_EXPR_CALL:
+            found = find_identifier(node->as.call.callee, name);
+            for (size_t i = 0; !found && i < node->as.call.arg_count; i++) {
+                found = find_identifier(node->as.call.args[i], name);
+            }
+            break;
+        default:
+            break;
+    }
+    return found ? found : find_identifier(node->next_sibling, name);
+}
+
+/* Main test runner */
+int main(void) {
+    printf("=== Compiler Test Suite ===\n");
+
+    test_thread_jumps();
+    test_layout_loop();
+    test_invert_branch_over_jump();
+    test_profile_layout();
+    test_layout_handlers();
+    test_profile_inline();
+    test_inline_from_source();
+    test_last_use_moves();
+    test_borrowed_list_growth();
+    test_resolved_identifiers();
+    test_conditions();
+    test_register_pressure();
+    test_switch_dispatch();
+    test_error_handlers();
+    test_string_interpolation();
+    test_regex_natives();
+    test_modules();
+    test_classes();
+    test_scalar_replacement();
+    test_closures();
+    test_return_values();
+    test_native_descriptors();
+    test_plugin_imports();
+    test_list_aliases();
+    test_map_native();
+    test_snapshot();
+    test_serve_jobs();
+    test_native_replay();
+    test_call_location();
+    test_missing_plugin_run();
+    test_faulted_run();
+
+    printf("All compiler tests passed successfully!\n");
+    return 0;
+}
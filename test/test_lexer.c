@@ -25,7 +25,7 @@
  *     └── test_lexer.c
  * 
  * Compile with:
- * gcc -std=c99 -Wall -Wextra -I../include -I../src/lexer -o test_lexer test_lexer.c ../src/lexer/lexer.c
+ * gcc -std=c99 -Wall -Wextra -I../include -I../src/lexer -o test_lexer test_lexer.c ../src/lexer/lexer.c ../src/lexer/intern.c
  */
 
 #include <stdio.h>
@@ -390,6 +390,28 @@ static void test_identifiers() {
     cleanup_test(lexer);
 }
 
+/**
+ * @brief Tests that equal identifiers share one interned symbol id.
+ */
+static void test_identifier_symbols() {
+    printf("Running test_identifier_symbols...\n");
+    Lexer* lexer = create_test_lexer("count total count var");
+
+    Token first = lexer_next_token(lexer);
+    Token other = lexer_next_token(lexer);
+    Token again = lexer_next_token(lexer);
+    Token keyword = lexer_next_token(lexer);
+
+    TEST_ASSERT(first.symbol != SYMBOL_ID_NONE);
+    TEST_ASSERT(first.symbol == again.symbol);
+    TEST_ASSERT(first.symbol != other.symbol);
+    TEST_ASSERT(keyword.symbol == SYMBOL_ID_NONE);
+    TEST_ASSERT(strcmp(intern_text(first.symbol), "count") == 0);
+    TEST_ASSERT(intern_find("total") == other.symbol);
+
+    cleanup_test(lexer);
+}
+
 /* ------------------------------
    2b) Literal Handling
    ------------------------------ */
@@ -545,6 +567,64 @@ static void test_string_literals() {
     cleanup_test(lexer);
 }
 
+/**
+ * @brief Tests that "${...}" splits a string into segments and expression tokens.
+ */
+static void test_string_interpolation() {
+    printf("Running test_string_interpolation...\n");
+    Lexer* lexer = create_test_lexer("\"a${ {x} }b${y}\" z");
+
+    OSFLTokenType expected_types[] = {
+        TOKEN_STRING, TOKEN_INTERPOLATION_START, TOKEN_LBRACE, TOKEN_IDENTIFIER,
+        TOKEN_RBRACE, TOKEN_INTERPOLATION_END, TOKEN_STRING, TOKEN_INTERPOLATION_START,
+        TOKEN_IDENTIFIER, TOKEN_INTERPOLATION_END, TOKEN_STRING, TOKEN_IDENTIFIER, TOKEN_EOF
+    };
+    size_t num_tokens = sizeof(expected_types) / sizeof(OSFLTokenType);
+
+    for (size_t i = 0; i < num_tokens; i++) {
+        Token token = lexer_next_token(lexer);
+        TEST_ASSERT(token.type == expected_types[i]);
+        if (i == 6) {
+            TEST_ASSERT(strcmp(token.value.string_value.data, "b") == 0);
+        } else if (i == 10) {
+            TEST_ASSERT(token.value.string_value.length == 0);
+        }
+        if (token.type == TOKEN_STRING) {
+            lexer_token_cleanup(&token);
+        }
+    }
+
+    cleanup_test(lexer);
+}
+
+/**
+ * @brief Tests that '/' is a regex literal only where an operand is expected.
+ */
+static void test_regex_or_division() {
+    printf("Running test_regex_or_division...\n");
+    Lexer* lexer = create_test_lexer("a / b = /x+\\//; f(/y/) / 2");
+
+    OSFLTokenType expected_types[] = {
+        TOKEN_IDENTIFIER, TOKEN_SLASH, TOKEN_IDENTIFIER, TOKEN_ASSIGN, TOKEN_REGEX,
+        TOKEN_SEMICOLON, TOKEN_IDENTIFIER, TOKEN_LPAREN, TOKEN_REGEX, TOKEN_RPAREN,
+        TOKEN_SLASH, TOKEN_INTEGER, TOKEN_EOF
+    };
+    size_t num_tokens = sizeof(expected_types) / sizeof(OSFLTokenType);
+
+    for (size_t i = 0; i < num_tokens; i++) {
+        Token token = lexer_next_token(lexer);
+        TEST_ASSERT(token.type == expected_types[i]);
+        if (i == 4) {
+            TEST_ASSERT(strcmp(token.text, "x+\\/") == 0);
+        }
+        if (token.type == TOKEN_REGEX) {
+            lexer_token_cleanup(&token);
+        }
+    }
+
+    cleanup_test(lexer);
+}
+
 /**
  * @brief Tests recognition of boolean literals.
  */
@@ -924,11 +1004,14 @@ int main() {
     test_multi_char_operators();
     test_keywords();
     test_identifiers();
+    test_identifier_symbols();
 
     /* 2b) Literal Handling */
     test_integer_literals();
     test_float_literals();
     test_string_literals();
+    test_string_interpolation();
+    test_regex_or_division();
     test_boolean_literals();
 
     /* 2c) Error Handling */
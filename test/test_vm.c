@@ -7,7 +7,11 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 #include "../src/vm/vm.h"
+#include "../src/vm/frame.h"
+#include "../src/vm/debugger.h"
+#include "../src/vm/tracer.h"
 
 /* In the upgraded vm.h/vm.c, be sure you have:
  *   Value vm_get_register_value(const VM* vm, int reg_index);
@@ -145,6 +149,338 @@ static void test_function_call(void) {
     printf("[test_function_call] PASSED\n");
 }
 
+/* TEST 4: reference counts follow registers and object fields. */
+static Value make_string_native(int arg_count, Value* args) {
+    (void)arg_count;
+    (void)args;
+    Value v = { .type = VAL_STRING };
+    v.as.str_val = strdup("fresh");
+    return v;
+}
+
+static void test_refcounting(void) {
+    char* names[] = { "make" };
+    Instruction code[] = {
+        { OP_NEWOBJ,      0, 0, 0, 0 },
+        { OP_MOVE,        1, 0, 0, 0 },  /* object shared by R0 and R1 */
+        { OP_LOAD_CONST,  0, 0, 0, 0 },  /* drops one reference */
+        { OP_CALL_NATIVE, 2, 0, 0, 0 },  /* R2 = fresh heap string */
+        { OP_LOAD_CONST,  3, 5, 0, 0 },
+        { OP_SETPROP,     1, 3, 2, 0 },  /* object holds the string too */
+        { OP_LOAD_CONST,  2, 0, 0, 0 },
+        { OP_GETPROP,     4, 1, 3, 0 },
+        { OP_LOAD_CONST,  1, 0, 0, 0 },  /* last object reference: freed with its fields */
+        { OP_HALT,        0, 0, 0, 0 }
+    };
+    Bytecode bc = { code, sizeof(code)/sizeof(Instruction) };
+    bc.constant_pool.strings = names;
+    bc.constant_pool.count = 1;
+
+    VM* vm = vm_create(&bc);
+    vm_register_native(vm, "make", make_string_native);
+    vm_run(vm);
+
+    assert(vm->object_count == 0 && "Object should be freed when its last reference goes.");
+    Value s = vm_get_register_value(vm, 4);
+    assert(s.type == VAL_STRING && strcmp(s.as.str_val, "fresh") == 0);
+    assert(vm_value_refcount(vm, s) == 1 && "Only R4 should still reference the string.");
+
+    vm_destroy(vm);
+    printf("[test_refcounting] PASSED\n");
+}
+
+static void test_frame_locals(void) {
+    /* Top-level slot 20 counts down from 3 while slot 19 accumulates it,
+       then a call stores a heap string in its own frame and returns. */
+    char* names[] = { "make" };
+    Instruction code[] = {
+        { OP_STORE_LOCAL_CONST, 20, 3, 0, 0 },
+        { OP_STORE_LOCAL_CONST, 19, 0, 0, 0 },
+        { OP_LOAD_LOCAL,        0, 19, 0, 0 },  /* loop: */
+        { OP_LOAD_LOCAL,        1, 20, 0, 0 },
+        { OP_ADD,               0, 0, 1, 0 },
+        { OP_STORE_LOCAL,       19, 0, 1, 0 },  /* moved: R0 is left null */
+        { OP_LOAD_CONST,        2, 1, 0, 0 },
+        { OP_SUB,               1, 1, 2, 0 },
+        { OP_STORE_LOCAL,       20, 1, 0, 0 },  /* copied: R1 keeps the count */
+        { OP_JUMP_IF_NONZERO,   2, 1, 0, 0 },
+        { OP_MOVE_LOCAL,        0, 19, 0, 0 },
+        { OP_LOAD_LOCAL,        3, 0, 0, 0 },
+        { OP_CALL,              14, 1, 0, 0 },
+        { OP_HALT,              0, 0, 0, 0 },
+        { OP_CALL_NATIVE,       4, 0, 0, 0 },   /* function: one frame slot */
+        { OP_STORE_LOCAL,       0, 4, 0, 0 },
+        { OP_RET,               0, 0, 0, 0 }
+    };
+    Bytecode bc = { code, sizeof(code)/sizeof(Instruction) };
+    bc.constant_pool.strings = names;
+    bc.constant_pool.count = 1;
+    bc.top_level_slots = 21;
+
+    VM* vm = vm_create(&bc);
+    vm_register_native(vm, "make", make_string_native);
+    vm_run(vm);
+
+    assert(vm->top_level->locals[19].as.int_val == 6);
+    assert(vm_get_register_value(vm, 0).type == VAL_NULL);
+    assert_register_int_value(vm, 1, 0);
+    assert_register_int_value(vm, 3, 6);
+    assert(vm->call_stack_top == 0);
+    Value s = vm_get_register_value(vm, 4);
+    assert(vm_value_refcount(vm, s) == 1 && "The popped frame should release its slot.");
+
+    vm_destroy(vm);
+    printf("[test_frame_locals] PASSED\n");
+}
+
+static int slow_twice_calls = 0;
+
+static Value slow_twice(int arg_count, Value* args) {
+    slow_twice_calls++;
+    Value v = VALUE_NULL;
+    if (arg_count == 1 && args[0].type == VAL_STRING) {
+        v.type = VAL_INT;
+        v.as.int_val = (int64_t)strlen(args[0].as.str_val) * 2;
+    }
+    return v;
+}
+
+static int64_t fast_twice_int(const int64_t* args) { return args[0] * 2; }
+static double fast_twice_float(const double* args) { return args[0] * 2.0; }
+
+static void test_native_fast_path(void) {
+    /* Numbers take the unboxed fast paths; anything else calls the native. */
+    char* names[] = { "twice", "abc" };
+    Instruction code[] = {
+        { OP_LOAD_CONST,       0, 21, 0, 0 },
+        { OP_CALL_NATIVE,      1, 0, 1, 0 },   /* R1 = twice(R0), int path */
+        { OP_LOAD_CONST_FLOAT, 2, 0, 0x3ff80000, 0 },  /* 1.5 */
+        { OP_CALL_NATIVE,      3, 0, 1, 2 },   /* R3 = twice(R2), float path */
+        { OP_LOAD_CONST_STR,   4, 1, 0, 0 },
+        { OP_CALL_NATIVE,      5, 0, 1, 4 },   /* R5 = twice("abc"), boxed call */
+        { OP_HALT,             0, 0, 0, 0 }
+    };
+    Bytecode bc = { code, sizeof(code)/sizeof(Instruction) };
+    bc.constant_pool.strings = names;
+    bc.constant_pool.count = 2;
+
+    VM* vm = vm_create(&bc);
+    /* The registry grows past its first allocation and copies the names. */
+    for (int i = 0; i < 80; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "filler%d", i);
+        assert(vm_register_native(vm, name, slow_twice));
+    }
+    NativeDescriptor twice = { "twice", slow_twice, 1, 1, { NATIVE_TYPE_ANY }, NATIVE_TYPE_ANY,
+                               NATIVE_PURE | NATIVE_NO_ALLOC, fast_twice_int, fast_twice_float, NULL };
+    assert(vm_register_native_desc(vm, &twice));
+    assert(vm->native_count == 81 && vm_find_native(vm, "filler79") != NULL);
+    vm_run(vm);
+
+    assert(!vm->faulted);
+    assert_register_int_value(vm, 1, 42);
+    Value f = vm_get_register_value(vm, 3);
+    assert(f.type == VAL_FLOAT && f.as.float_val == 3.0);
+    assert_register_int_value(vm, 5, 6);
+    assert(slow_twice_calls == 1 && "Only the string argument should need the boxed call.");
+
+    vm_destroy(vm);
+    printf("[test_native_fast_path] PASSED\n");
+}
+
+/* Fuel is charged at backward jumps and calls; the host aborts, yields or extends. */
+static VMFuelAction fuel_handler(VM* vm, void* context) {
+    (void)vm;
+    int* calls = (int*)context;
+    calls[0]++;
+    return (VMFuelAction)calls[1];
+}
+
+static void test_fuel(void) {
+    /* Count R0 to 1000: 999 backward jumps. */
+    Instruction counting[] = {
+        { OP_LOAD_CONST, 0, 0,    0 },  /* R0 = 0 */
+        { OP_LOAD_CONST, 1, 1,    0 },  /* R1 = 1 */
+        { OP_LOAD_CONST, 2, 1000, 0 },  /* R2 = 1000 */
+        { OP_ADD,        0, 0,    1 },  /* PC=3: R0 += 1 */
+        { OP_JUMP_IF_LT, 3, 0,    2 },  /* back to 3 while R0 < R2 */
+        { OP_HALT,       0, 0,    0 },
+    };
+    Bytecode bc = { counting, sizeof(counting)/sizeof(Instruction) };
+
+    /* No handler: a runaway loop is stopped for good. */
+    Instruction forever[] = {
+        { OP_LOAD_CONST, 0, 0, 0 },
+        { OP_LOAD_CONST, 1, 1, 0 },
+        { OP_ADD,        0, 0, 1 },  /* PC=2 */
+        { OP_JUMP,       2, 0, 0 },
+    };
+    Bytecode runaway = { forever, sizeof(forever)/sizeof(Instruction) };
+    VM* vm = vm_create(&runaway);
+    vm_set_fuel(vm, 100, NULL, NULL);
+    vm_run(vm);
+    assert(vm->out_of_fuel && !vm->faulted && !vm->running);
+    assert_register_int_value(vm, 0, 100);
+    vm_destroy(vm);
+
+    /* Yield: every vm_run is one time slice, resumed where it stopped. */
+    int calls[2] = { 0, VM_FUEL_YIELD };
+    vm = vm_create(&bc);
+    vm_set_fuel(vm, 100, fuel_handler, calls);
+    int slices = 1;
+    vm_run(vm);
+    while (vm->suspended) {
+        Value r0 = vm_get_register_value(vm, 0);
+        assert(r0.as.int_val == 100 * slices);
+        slices++;
+        vm_run(vm);
+    }
+    assert(!vm->out_of_fuel && calls[0] == 9 && slices == 10);
+    assert_register_int_value(vm, 0, 1000);
+    vm_destroy(vm);
+
+    /* Extend: the handler is asked at each quantum and the run goes on. */
+    calls[0] = 0;
+    calls[1] = VM_FUEL_EXTEND;
+    vm = vm_create(&bc);
+    vm_set_fuel(vm, 100, fuel_handler, calls);
+    vm_run(vm);
+    assert(!vm->suspended && !vm->out_of_fuel && calls[0] == 9);
+    assert_register_int_value(vm, 0, 1000);
+    vm_destroy(vm);
+
+    /* Straight-line code and forward jumps cost nothing. */
+    vm = vm_create(&bc);
+    vm_set_fuel(vm, 1000, NULL, NULL);
+    vm_run(vm);
+    assert(!vm->out_of_fuel && vm->fuel == 1);
+    vm_destroy(vm);
+
+    printf("[test_fuel] PASSED\n");
+}
+
+/* Breakpoints patch OP_BREAKPOINT into the code; stepping runs the original instruction. */
+static void test_debugger(void) {
+    Instruction code[] = {
+        { OP_LOAD_CONST, 0, 0,  0 },  /* R0 = 0 */
+        { OP_LOAD_CONST, 1, 1,  0 },  /* R1 = 1 */
+        { OP_LOAD_CONST, 2, 3,  0 },  /* R2 = 3 */
+        { OP_CALL,       7, 1,  0 },  /* PC=3: call the function at 7 */
+        { OP_JUMP_IF_LT, 3, 0,  2 },  /* again while R0 < R2 */
+        { OP_HALT,       0, 0,  0 },
+        { OP_NOP,        0, 0,  0 },
+        { OP_ADD,        0, 0,  1 },  /* PC=7: R0 += 1 */
+        { OP_RET,        0, 0,  0 },
+    };
+    Bytecode bc = { code, sizeof(code)/sizeof(Instruction) };
+    VM* vm = vm_create(&bc);
+    Debugger* dbg = debugger_attach(vm);
+    assert(dbg);
+    assert(debugger_set_breakpoint(dbg, 7) && !debugger_set_breakpoint(dbg, 9));
+    assert(code[7].opcode == OP_BREAKPOINT && debugger_instruction(dbg, 7).opcode == OP_ADD);
+
+    for (int hit = 0; hit < 2; hit++) {
+        assert(debugger_continue(dbg) == DEBUG_STOP_BREAKPOINT);
+        assert(vm->pc == 7);
+        assert_register_int_value(vm, 0, hit);
+        assert(debugger_frame_count(dbg) == 2);
+        assert(debugger_frame(dbg, 1) == vm->top_level && debugger_frame(dbg, 2) == NULL);
+        assert(debugger_frame_pc(dbg, 0) == 7 && debugger_frame_pc(dbg, 1) == 3);
+    }
+
+    /* Stepping runs the ADD the breakpoint covers and leaves the breakpoint in. */
+    assert(debugger_step(dbg) == DEBUG_STOP_STEP);
+    assert(vm->pc == 8 && code[7].opcode == OP_BREAKPOINT);
+    assert_register_int_value(vm, 0, 2);
+
+    FILE* out = tmpfile();
+    assert(out);
+    debugger_set_breakpoint(dbg, 4);
+    assert(debugger_continue(dbg) == DEBUG_STOP_BREAKPOINT && vm->pc == 4);
+    debugger_print_state(dbg, out);
+    rewind(out);
+    char text[512];
+    size_t length = fread(text, 1, sizeof(text) - 1, out);
+    text[length] = '\0';
+    fclose(out);
+    assert(strstr(text, "PC 4: Opcode") && strstr(text, "(breakpoint)") && strstr(text, "R0 = 2"));
+
+    assert(debugger_clear_breakpoint(dbg, 7) && code[7].opcode == OP_ADD);
+    assert(debugger_continue(dbg) == DEBUG_STOP_BREAKPOINT && vm->pc == 4);
+    debugger_detach(dbg);
+    assert(code[4].opcode == OP_JUMP_IF_LT);
+    vm_run(vm);
+    assert(!vm->faulted);
+    assert_register_int_value(vm, 0, 3);
+    vm_destroy(vm);
+
+    printf("[test_debugger] PASSED\n");
+}
+
+static int count_occurrences(const char* text, const char* needle) {
+    int count = 0;
+    for (const char* at = strstr(text, needle); at; at = strstr(at + 1, needle)) count++;
+    return count;
+}
+
+/* Traced runs record sampled calls and heap collections as trace-event JSON. */
+static void test_tracer(void) {
+    Instruction code[] = {
+        { OP_LOAD_CONST, 0, 0,  0 },  /* R0 = 0 */
+        { OP_LOAD_CONST, 1, 1,  0 },  /* R1 = 1 */
+        { OP_LOAD_CONST, 2, 3,  0 },  /* R2 = 3 */
+        { OP_CALL,       6, 1,  0 },  /* PC=3: call the function at 6 */
+        { OP_JUMP_IF_LT, 3, 0,  2 },  /* again while R0 < R2 */
+        { OP_HALT,       0, 0,  0 },
+        { OP_ADD,        0, 0,  1 },  /* PC=6: R0 += 1 */
+        { OP_RET,        0, 0,  0 },
+    };
+    Bytecode bc = { code, sizeof(code)/sizeof(Instruction) };
+
+    /* Off by default: nothing is recorded. */
+    assert(!tracer_enabled());
+    VM* vm = vm_create(&bc);
+    vm_run(vm);
+    vm_destroy(vm);
+
+    TracerConfig config = tracer_default_config();
+    config.capacity = 8;
+    config.sample_every = 1;
+    tracer_start(config);
+    uint64_t start = tracer_now();
+    vm = vm_create(&bc);
+    vm_run(vm);
+    assert_register_int_value(vm, 0, 3);
+    vm_gc_collect(vm);
+    vm_destroy(vm);
+    tracer_span("pipeline", "run \"quoted\"", start);
+
+    const char* path = "test_vm_trace.json";
+    assert(tracer_write(path));
+    tracer_stop();
+    assert(!tracer_enabled());
+
+    FILE* fp = fopen(path, "r");
+    assert(fp);
+    char text[4096];
+    size_t length = fread(text, 1, sizeof(text) - 1, fp);
+    text[length] = '\0';
+    fclose(fp);
+    remove(path);
+
+    /* 3 calls and their returns, a collection, the teardown and the run: the
+       ring of 8 keeps the last 8 of those 9 events. */
+    assert(strncmp(text, "{\"traceEvents\":[", 15) == 0 && strstr(text, "\"displayTimeUnit\""));
+    assert(count_occurrences(text, "\"name\":") == 8);
+    assert(count_occurrences(text, "\"ph\":\"B\"") == 2 && count_occurrences(text, "\"ph\":\"E\"") == 3);
+    assert(strstr(text, "\"name\":\"fn@6\",\"cat\":\"call\""));
+    assert(strstr(text, "\"name\":\"collect\",\"cat\":\"gc\",\"ph\":\"X\""));
+    assert(strstr(text, "\"name\":\"teardown\""));
+    assert(strstr(text, "\"name\":\"run \\\"quoted\\\"\""));
+
+    printf("[test_tracer] PASSED\n");
+}
+
 /* Main test runner */
 int main(void) {
     printf("=== VM Test Suite (Advanced) ===\n");
@@ -152,6 +488,12 @@ int main(void) {
     test_arithmetic();
     test_jumps();
     test_function_call();
+    test_refcounting();
+    test_frame_locals();
+    test_native_fast_path();
+    test_fuel();
+    test_debugger();
+    test_tracer();
 
     printf("All VM tests passed successfully!\n");
     return 0;